@@ -226,6 +226,13 @@ ldap_pvt_thread_pool_submit LDAP_P((
 	ldap_pvt_thread_start_t *start,
 	void *arg ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_class LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void *arg,
+	int cls ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_retract LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
@@ -237,6 +244,16 @@ ldap_pvt_thread_pool_maxthreads LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	int max_threads ));
 
+/* Task classes the pool schedules between, see pool_class() */
+#define LDAP_PVT_THREAD_POOL_CLASSES	8
+
+LDAP_F( int )
+ldap_pvt_thread_pool_class LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int cls,
+	int weight,
+	int max_active ));
+
 #ifndef LDAP_PVT_THREAD_H_DONE
 typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN = -1,
@@ -251,7 +268,10 @@ typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_ACTIVE_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_PENDING_MAX,
 	LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD_MAX,
-	LDAP_PVT_THREAD_POOL_PARAM_STATE
+	LDAP_PVT_THREAD_POOL_PARAM_STATE,
+	LDAP_PVT_THREAD_POOL_PARAM_STEALS,	/* unsigned long */
+	LDAP_PVT_THREAD_POOL_PARAM_TASKS,	/* unsigned long, tasks started */
+	LDAP_PVT_THREAD_POOL_PARAM_WAIT		/* unsigned long, usec waited */
 } ldap_pvt_thread_pool_param_t;
 #endif /* !LDAP_PVT_THREAD_H_DONE */
 
@@ -260,6 +280,18 @@ ldap_pvt_thread_pool_query LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	ldap_pvt_thread_pool_param_t param, void *value ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_query_q LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int qnum,
+	ldap_pvt_thread_pool_param_t param, void *value ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_query_class LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int cls,
+	ldap_pvt_thread_pool_param_t param, void *value ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_pausing LDAP_P((
 	ldap_pvt_thread_pool_t *pool ));
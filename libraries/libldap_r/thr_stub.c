@@ -166,6 +166,15 @@ ldap_pvt_thread_pool_submit (
 	return(0);
 }
 
+int
+ldap_pvt_thread_pool_submit_class (
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start_routine, void *arg, int cls )
+{
+	(start_routine)(NULL, arg);
+	return(0);
+}
+
 int
 ldap_pvt_thread_pool_retract (
 	ldap_pvt_thread_pool_t *pool,
@@ -180,6 +189,13 @@ ldap_pvt_thread_pool_maxthreads ( ldap_pvt_thread_pool_t *tpool, int max_threads
 	return(0);
 }
 
+int
+ldap_pvt_thread_pool_class ( ldap_pvt_thread_pool_t *tpool, int cls,
+	int weight, int max_active )
+{
+	return(0);
+}
+
 int
 ldap_pvt_thread_pool_query( ldap_pvt_thread_pool_t *tpool,
 	ldap_pvt_thread_pool_param_t param, void *value )
@@ -188,6 +204,20 @@ ldap_pvt_thread_pool_query( ldap_pvt_thread_pool_t *tpool,
 	return(-1);
 }
 
+int
+ldap_pvt_thread_pool_query_q( ldap_pvt_thread_pool_t *tpool,
+	int qnum, ldap_pvt_thread_pool_param_t param, void *value )
+{
+	return(-1);
+}
+
+int
+ldap_pvt_thread_pool_query_class( ldap_pvt_thread_pool_t *tpool,
+	int cls, ldap_pvt_thread_pool_param_t param, void *value )
+{
+	return(-1);
+}
+
 int
 ldap_pvt_thread_pool_backload (
 	ldap_pvt_thread_pool_t *pool )
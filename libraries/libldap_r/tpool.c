@@ -90,10 +90,22 @@ typedef struct ldap_int_thread_task_s {
 	} ltt_next;
 	ldap_pvt_thread_start_t *ltt_start_routine;
 	void *ltt_arg;
+	struct timeval ltt_queued;
 } ldap_int_thread_task_t;
 
 typedef LDAP_STAILQ_HEAD(tcq, ldap_int_thread_task_s) ldap_int_tpool_plist_t;
 
+/* Scheduling state of one task class in one queue */
+typedef struct ldap_int_tpool_class_s {
+	int ltc_weight;		/* share of the threads when classes compete */
+	int ltc_max;		/* max active tasks, 0 for no limit */
+	int ltc_credit;		/* position in the weighted round robin */
+	int ltc_active;		/* tasks running */
+	int ltc_pending;	/* tasks waiting */
+	unsigned long ltc_tasks;	/* tasks started */
+	unsigned long ltc_wait;		/* microseconds tasks spent waiting */
+} ldap_int_tpool_class_t;
+
 struct ldap_int_thread_poolq_s {
 	void *ltp_free;
 
@@ -109,15 +121,17 @@ struct ldap_int_thread_poolq_s {
 	 */
 	ldap_pvt_thread_cond_t ltp_cond;
 
-	/* ltp_pause == 0 ? &ltp_pending_list : &empty_pending_list,
+	/* ltp_pause == 0 ? ltp_pending_list : empty_pending_list,
 	 * maintaned to reduce work for pool_wrapper()
 	 */
 	ldap_int_tpool_plist_t *ltp_work_list;
 
-	/* pending tasks, and unused task objects */
-	ldap_int_tpool_plist_t ltp_pending_list;
+	/* pending tasks of each class, and unused task objects */
+	ldap_int_tpool_plist_t ltp_pending_list[LDAP_PVT_THREAD_POOL_CLASSES];
 	LDAP_SLIST_HEAD(tcl, ldap_int_thread_task_s) ltp_free_list;
 
+	ldap_int_tpool_class_t ltp_class[LDAP_PVT_THREAD_POOL_CLASSES];
+
 	/* Max number of threads in this queue */
 	int ltp_max_count;
 
@@ -128,6 +142,8 @@ struct ldap_int_thread_poolq_s {
 	int ltp_active_count;		/* Active, not paused/idle tasks */
 	int ltp_open_count;			/* Number of threads */
 	int ltp_starting;			/* Currently starting threads */
+
+	unsigned long ltp_steals;	/* Tasks taken from other queues */
 };
 
 struct ldap_int_thread_pool_s {
@@ -172,10 +188,19 @@ struct ldap_int_thread_pool_s {
 
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* Classes in use, 1 + highest class given to pool_class() */
+	int ltp_nclasses;
+
+	/* Configured weight and max active tasks of each class,
+	 * max is split among the queues like ltp_max_count
+	 */
+	int ltp_class_weight[LDAP_PVT_THREAD_POOL_CLASSES];
+	int ltp_class_max[LDAP_PVT_THREAD_POOL_CLASSES];
 };
 
-static ldap_int_tpool_plist_t empty_pending_list =
-	LDAP_STAILQ_HEAD_INITIALIZER(empty_pending_list);
+/* Only ever looked at, so zeroed heads are enough */
+static ldap_int_tpool_plist_t empty_pending_list[LDAP_PVT_THREAD_POOL_CLASSES];
 
 static int ldap_int_has_thread_pool = 0;
 static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
@@ -185,6 +210,7 @@ static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
 static ldap_pvt_thread_mutex_t ldap_pvt_thread_pool_mutex;
 
 static void *ldap_int_thread_pool_wrapper( void *pool );
+static void ldap_int_pool_class_split( struct ldap_int_thread_pool_s *pool );
 
 static ldap_pvt_thread_key_t	ldap_tpool_key;
 
@@ -223,7 +249,7 @@ ldap_pvt_thread_pool_init_q (
 {
 	ldap_pvt_thread_pool_t pool;
 	struct ldap_int_thread_poolq_s *pq;
-	int i, rc, rem_thr, rem_pend;
+	int i, c, rc, rem_thr, rem_pend;
 
 	/* multiple pools are currently not supported (ITS#4943) */
 	assert(!ldap_int_has_thread_pool);
@@ -292,8 +318,9 @@ fail:
 		rc = ldap_pvt_thread_cond_init(&pq->ltp_cond);
 		if (rc != 0)
 			return(rc);
-		LDAP_STAILQ_INIT(&pq->ltp_pending_list);
-		pq->ltp_work_list = &pq->ltp_pending_list;
+		for (c=0; c<LDAP_PVT_THREAD_POOL_CLASSES; c++)
+			LDAP_STAILQ_INIT(&pq->ltp_pending_list[c]);
+		pq->ltp_work_list = pq->ltp_pending_list;
 		LDAP_SLIST_INIT(&pq->ltp_free_list);
 
 		pq->ltp_max_count = max_threads / numqs;
@@ -313,6 +340,11 @@ fail:
 	pool->ltp_max_count = max_threads;
 	pool->ltp_max_pending = max_pending;
 
+	pool->ltp_nclasses = 1;
+	for (c=0; c<LDAP_PVT_THREAD_POOL_CLASSES; c++)
+		pool->ltp_class_weight[c] = 1;
+	ldap_int_pool_class_split( pool );
+
 	ldap_pvt_thread_mutex_lock(&ldap_pvt_thread_pool_mutex);
 	LDAP_STAILQ_INSERT_TAIL(&ldap_int_thread_pool_list, pool, ltp_next);
 	ldap_pvt_thread_mutex_unlock(&ldap_pvt_thread_pool_mutex);
@@ -351,17 +383,158 @@ ldap_int_poolq_hash(
 	return i;
 }
 
+/* More tasks are waiting in pq than it has threads to pick them up.
+ * Threads woken but not yet running still count as free, so a burst
+ * of submits is seen before the threads get to it.
+ */
+#define POOLQ_BACKLOGGED(pq) \
+	((pq)->ltp_pending_count > (pq)->ltp_open_count - (pq)->ltp_active_count)
+
+/* pq has threads waiting for work */
+#define POOLQ_IDLE(pq) \
+	((pq)->ltp_open_count - (pq)->ltp_starting > (pq)->ltp_active_count)
+
+static int
+ldap_int_poolq_empty(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_tpool_plist_t *work_list )
+{
+	int c;
+
+	for (c=0; c<pq->ltp_pool->ltp_nclasses; c++)
+		if (!LDAP_STAILQ_EMPTY(&work_list[c]))
+			return 0;
+	return 1;
+}
+
+/* Called with pq->ltp_mutex held. Choose the class of pq's next task
+ * from the non-empty lists of work_list whose class is below its max
+ * in pq, by smooth weighted round robin: every candidate gains its
+ * weight in credit, the richest one runs and pays back the total.
+ * Returns -1 if nothing may run.
+ */
+static int
+ldap_int_poolq_pick(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_tpool_plist_t *work_list )
+{
+	ldap_int_tpool_class_t *cl;
+	int c, best = -1, total = 0;
+
+	for (c=0; c<pq->ltp_pool->ltp_nclasses; c++) {
+		if (LDAP_STAILQ_EMPTY(&work_list[c]))
+			continue;
+		cl = &pq->ltp_class[c];
+		if (cl->ltc_max && cl->ltc_active >= cl->ltc_max)
+			continue;
+		cl->ltc_credit += cl->ltc_weight;
+		total += cl->ltc_weight;
+		if (best < 0 || cl->ltc_credit > pq->ltp_class[best].ltc_credit)
+			best = c;
+	}
+	if (best >= 0)
+		pq->ltp_class[best].ltc_credit -= total;
+	return best;
+}
+
+static void ldap_int_poolq_wake( struct ldap_int_thread_pool_s *pool, int i );
+
+/* Called with pq->ltp_mutex held when pq has nothing to run. Move
+ * the oldest task of a class pq may run from a backlogged sibling
+ * queue to the head of pq's pending list, and return its class.
+ * Siblings are only tried, never waited for, so two queues stealing
+ * from each other cannot deadlock, and a busy sibling is just skipped.
+ */
+static int
+ldap_int_poolq_steal( struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
+	struct ldap_int_thread_poolq_s *vq;
+	ldap_int_thread_task_t *task = NULL;
+	int i, j, c = -1, more = 0;
+
+	/* not while pausing, that hides all pending tasks */
+	if (pool->ltp_numqs < 2 || pq->ltp_work_list != pq->ltp_pending_list)
+		return -1;
+
+	for (i=0; i<pool->ltp_numqs; i++)
+		if (pool->ltp_wqs[i] == pq) break;
+
+	for (j=1; j<pool->ltp_numqs && task == NULL; j++) {
+		vq = pool->ltp_wqs[(i+j) % pool->ltp_numqs];
+		if (ldap_pvt_thread_mutex_trylock(&vq->ltp_mutex))
+			continue;
+		if (vq->ltp_work_list == vq->ltp_pending_list && POOLQ_BACKLOGGED(vq)) {
+			c = ldap_int_poolq_pick(pq, vq->ltp_pending_list);
+			if (c >= 0) {
+				task = LDAP_STAILQ_FIRST(&vq->ltp_pending_list[c]);
+				LDAP_STAILQ_REMOVE_HEAD(&vq->ltp_pending_list[c], ltt_next.q);
+				vq->ltp_pending_count--;
+				vq->ltp_class[c].ltc_pending--;
+				more = POOLQ_BACKLOGGED(vq);
+			}
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+	}
+
+	if (task) {
+		LDAP_STAILQ_INSERT_HEAD(&pq->ltp_pending_list[c], task, ltt_next.q);
+		pq->ltp_pending_count++;
+		pq->ltp_class[c].ltc_pending++;
+		pq->ltp_steals++;
+	}
+	if (more)
+		ldap_int_poolq_wake( pool, i );
+	return c;
+}
+
+/* Wake an idle thread of a queue after i so it can steal work. Called
+ * when a submit leaves queue i backlogged, and by a thief from queue i
+ * that left its victim backlogged. Threads signalled but not yet
+ * running still look idle, so the thieves pass the wakeup along and a
+ * burst spreads over all queues.
+ */
+static void
+ldap_int_poolq_wake( struct ldap_int_thread_pool_s *pool, int i )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	int j, woke = 0;
+
+	for (j=1; j<pool->ltp_numqs && !woke; j++) {
+		vq = pool->ltp_wqs[(i+j) % pool->ltp_numqs];
+		if (ldap_pvt_thread_mutex_trylock(&vq->ltp_mutex))
+			continue;
+		if (POOLQ_IDLE(vq) && ldap_int_poolq_empty(vq, vq->ltp_pending_list)) {
+			ldap_pvt_thread_cond_signal(&vq->ltp_cond);
+			woke = 1;
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+	}
+}
+
 /* Submit a task to be performed by the thread pool */
 int
 ldap_pvt_thread_pool_submit (
 	ldap_pvt_thread_pool_t *tpool,
 	ldap_pvt_thread_start_t *start_routine, void *arg )
+{
+	return ldap_pvt_thread_pool_submit_class( tpool, start_routine, arg, 0 );
+}
+
+/* Submit a task of class cls. Classes never given to pool_class()
+ * are run as class 0.
+ */
+int
+ldap_pvt_thread_pool_submit_class (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	int cls )
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
-	int i, j;
+	int i, j, wake = 0;
 
 	if (tpool == NULL)
 		return(-1);
@@ -371,6 +544,9 @@ ldap_pvt_thread_pool_submit (
 	if (pool == NULL)
 		return(-1);
 
+	if (cls < 0 || cls >= pool->ltp_nclasses)
+		cls = 0;
+
 	if ( pool->ltp_numqs > 1 )
 		i = ldap_int_poolq_hash( pool, arg );
 	else
@@ -401,9 +577,11 @@ ldap_pvt_thread_pool_submit (
 
 	task->ltt_start_routine = start_routine;
 	task->ltt_arg = arg;
+	gettimeofday(&task->ltt_queued, NULL);
 
 	pq->ltp_pending_count++;
-	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
+	pq->ltp_class[cls].ltc_pending++;
+	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list[cls], task, ltt_next.q);
 
 	if (pool->ltp_pause)
 		goto done;
@@ -432,7 +610,7 @@ ldap_pvt_thread_pool_submit (
 				/* let pool_destroy know there are no more threads */
 				ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
-				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list, ltt_next.q)
+				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list[cls], ltt_next.q)
 					if (ptr == task) break;
 				if (ptr == task) {
 					/* no open threads, task not handled, so
@@ -440,7 +618,8 @@ ldap_pvt_thread_pool_submit (
 					 * report the error.
 					 */
 					pq->ltp_pending_count--;
-					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list, task,
+					pq->ltp_class[cls].ltc_pending--;
+					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list[cls], task,
 						ldap_int_thread_task_s, ltt_next.q);
 					LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task,
 						ltt_next.l);
@@ -453,9 +632,12 @@ ldap_pvt_thread_pool_submit (
 		}
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+	wake = pool->ltp_numqs > 1 && POOLQ_BACKLOGGED(pq);
 
  done:
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	if (wake)
+		ldap_int_poolq_wake( pool, i );
 	return(0);
 
  failed:
@@ -480,8 +662,8 @@ ldap_pvt_thread_pool_retract (
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
-	ldap_int_thread_task_t *task;
-	int i;
+	ldap_int_thread_task_t *task = NULL;
+	int i, c;
 
 	if (tpool == NULL)
 		return(-1);
@@ -495,16 +677,18 @@ ldap_pvt_thread_pool_retract (
 	pq = pool->ltp_wqs[i];
 
 	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
-	LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list, ltt_next.q)
-		if (task->ltt_start_routine == start_routine &&
-			task->ltt_arg == arg) {
-			/* Could LDAP_STAILQ_REMOVE the task, but that
-			 * walks ltp_pending_list again to find it.
-			 */
-			task->ltt_start_routine = no_task;
-			task->ltt_arg = NULL;
-			break;
-		}
+	for (c=0; c<pool->ltp_nclasses && task == NULL; c++) {
+		LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list[c], ltt_next.q)
+			if (task->ltt_start_routine == start_routine &&
+				task->ltt_arg == arg) {
+				/* Could LDAP_STAILQ_REMOVE the task, but that
+				 * walks ltp_pending_list again to find it.
+				 */
+				task->ltt_start_routine = no_task;
+				task->ltt_arg = NULL;
+				break;
+			}
+	}
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 	return task != NULL;
 }
@@ -518,7 +702,7 @@ ldap_pvt_thread_pool_queues(
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
-	int i, rc, rem_thr, rem_pend;
+	int i, c, rc, rem_thr, rem_pend;
 
 	if (numqs < 1 || tpool == NULL)
 		return(-1);
@@ -554,8 +738,9 @@ ldap_pvt_thread_pool_queues(
 			rc = ldap_pvt_thread_cond_init(&pq->ltp_cond);
 			if (rc != 0)
 				return(rc);
-			LDAP_STAILQ_INIT(&pq->ltp_pending_list);
-			pq->ltp_work_list = &pq->ltp_pending_list;
+			for (c=0; c<LDAP_PVT_THREAD_POOL_CLASSES; c++)
+				LDAP_STAILQ_INIT(&pq->ltp_pending_list[c]);
+			pq->ltp_work_list = pq->ltp_pending_list;
 			LDAP_SLIST_INIT(&pq->ltp_free_list);
 		}
 	}
@@ -575,9 +760,72 @@ ldap_pvt_thread_pool_queues(
 		}
 	}
 	pool->ltp_numqs = numqs;
+	ldap_int_pool_class_split( pool );
 	return 0;
 }
 
+/* Hand each queue its share of the class settings */
+static void
+ldap_int_pool_class_split( struct ldap_int_thread_pool_s *pool )
+{
+	struct ldap_int_thread_poolq_s *pq;
+	int i, c, max;
+
+	for (i=0; i<pool->ltp_numqs; i++) {
+		pq = pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		for (c=0; c<LDAP_PVT_THREAD_POOL_CLASSES; c++) {
+			pq->ltp_class[c].ltc_weight = pool->ltp_class_weight[c];
+			max = pool->ltp_class_max[c];
+			if (max) {
+				max = max / pool->ltp_numqs + (i < max % pool->ltp_numqs);
+				/* 0 would mean no limit */
+				if (!max)
+					max = 1;
+			}
+			pq->ltp_class[c].ltc_max = max;
+		}
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+}
+
+/* Set the weight and max active tasks of task class cls. When tasks
+ * of several classes are pending, each class gets threads in
+ * proportion to its weight. max_active <= 0 means no limit.
+ */
+int
+ldap_pvt_thread_pool_class(
+	ldap_pvt_thread_pool_t *tpool,
+	int cls,
+	int weight,
+	int max_active )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (tpool == NULL || cls < 0 || cls >= LDAP_PVT_THREAD_POOL_CLASSES)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	if (weight < 1)
+		weight = 1;
+	if (max_active < 0)
+		max_active = 0;
+
+	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+	pool->ltp_class_weight[cls] = weight;
+	pool->ltp_class_max[cls] = max_active;
+	/* set before the split, so each queue sees it under its mutex */
+	if (cls >= pool->ltp_nclasses)
+		pool->ltp_nclasses = cls + 1;
+	ldap_int_pool_class_split( pool );
+	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	return(0);
+}
+
 /* Set max #threads.  value <= 0 means max supported #threads (LDAP_MAXTHR) */
 int
 ldap_pvt_thread_pool_maxthreads(
@@ -618,6 +866,28 @@ ldap_pvt_thread_pool_maxthreads(
 	return(0);
 }
 
+/* Thread counts of one queue, with pq->ltp_mutex held */
+static int
+ldap_int_poolq_count(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_pvt_thread_pool_param_t param )
+{
+	switch(param) {
+	case LDAP_PVT_THREAD_POOL_PARAM_OPEN:
+		return pq->ltp_open_count;
+	case LDAP_PVT_THREAD_POOL_PARAM_STARTING:
+		return pq->ltp_starting;
+	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
+		return pq->ltp_active_count;
+	case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
+		return pq->ltp_pending_count;
+	case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
+		return pq->ltp_pending_count + pq->ltp_active_count;
+	default:
+		return 0;
+	}
+}
+
 /* Inspect the pool */
 int
 ldap_pvt_thread_pool_query(
@@ -668,23 +938,7 @@ ldap_pvt_thread_pool_query(
 			for (i=0; i<pool->ltp_numqs; i++) {
 				struct ldap_int_thread_poolq_s *pq = pool->ltp_wqs[i];
 				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
-				switch(param) {
-					case LDAP_PVT_THREAD_POOL_PARAM_OPEN:
-						count += pq->ltp_open_count;
-						break;
-					case LDAP_PVT_THREAD_POOL_PARAM_STARTING:
-						count += pq->ltp_starting;
-						break;
-					case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
-						count += pq->ltp_active_count;
-						break;
-					case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
-						count += pq->ltp_pending_count;
-						break;
-					case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
-						count += pq->ltp_pending_count + pq->ltp_active_count;
-						break;
-				}
+				count += ldap_int_poolq_count(pq, param);
 				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 			}
 			if (count < 0)
@@ -717,6 +971,40 @@ ldap_pvt_thread_pool_query(
 		}
 		break;
 
+	case LDAP_PVT_THREAD_POOL_PARAM_STEALS:
+		{
+			unsigned long steals = 0;
+			int i;
+			for (i=0; i<pool->ltp_numqs; i++) {
+				struct ldap_int_thread_poolq_s *pq = pool->ltp_wqs[i];
+				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+				steals += pq->ltp_steals;
+				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+			}
+			*((unsigned long *)value) = steals;
+		}
+		return 0;
+
+	case LDAP_PVT_THREAD_POOL_PARAM_TASKS:
+	case LDAP_PVT_THREAD_POOL_PARAM_WAIT:
+		{
+			unsigned long sum = 0;
+			int i, c;
+			for (i=0; i<pool->ltp_numqs; i++) {
+				struct ldap_int_thread_poolq_s *pq = pool->ltp_wqs[i];
+				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+				for (c=0; c<LDAP_PVT_THREAD_POOL_CLASSES; c++) {
+					if (param == LDAP_PVT_THREAD_POOL_PARAM_TASKS)
+						sum += pq->ltp_class[c].ltc_tasks;
+					else
+						sum += pq->ltp_class[c].ltc_wait;
+				}
+				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+			}
+			*((unsigned long *)value) = sum;
+		}
+		return 0;
+
 	case LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN:
 		break;
 	}
@@ -728,6 +1016,122 @@ ldap_pvt_thread_pool_query(
 	return ( count == -1 ? -1 : 0 );
 }
 
+/* Inspect task class cls of the pool, summed over the queues */
+int
+ldap_pvt_thread_pool_query_class(
+	ldap_pvt_thread_pool_t *tpool,
+	int cls,
+	ldap_pvt_thread_pool_param_t param,
+	void *value )
+{
+	struct ldap_int_thread_pool_s	*pool;
+	struct ldap_int_thread_poolq_s	*pq;
+	ldap_int_tpool_class_t		*cl;
+	unsigned long			sum = 0;
+	int				i, count = 0;
+
+	if ( tpool == NULL || value == NULL ) {
+		return -1;
+	}
+
+	pool = *tpool;
+
+	if ( pool == NULL || cls < 0 || cls >= LDAP_PVT_THREAD_POOL_CLASSES ) {
+		return -1;
+	}
+
+	switch ( param ) {
+	case LDAP_PVT_THREAD_POOL_PARAM_MAX:
+		*((int *)value) = pool->ltp_class_max[cls];
+		return 0;
+
+	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
+	case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
+	case LDAP_PVT_THREAD_POOL_PARAM_TASKS:
+	case LDAP_PVT_THREAD_POOL_PARAM_WAIT:
+		break;
+
+	default:
+		return -1;
+	}
+
+	for (i=0; i<pool->ltp_numqs; i++) {
+		pq = pool->ltp_wqs[i];
+		cl = &pq->ltp_class[cls];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		switch ( param ) {
+		case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
+			count += cl->ltc_active;
+			break;
+		case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
+			count += cl->ltc_pending;
+			break;
+		case LDAP_PVT_THREAD_POOL_PARAM_TASKS:
+			sum += cl->ltc_tasks;
+			break;
+		default:
+			sum += cl->ltc_wait;
+			break;
+		}
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	}
+
+	if ( param == LDAP_PVT_THREAD_POOL_PARAM_TASKS ||
+		param == LDAP_PVT_THREAD_POOL_PARAM_WAIT )
+		*((unsigned long *)value) = sum;
+	else
+		*((int *)value) = count;
+	return 0;
+}
+
+/* Inspect work queue qnum of the pool. Returns -1 when there is
+ * no such queue, so callers can walk the queues from 0.
+ */
+int
+ldap_pvt_thread_pool_query_q(
+	ldap_pvt_thread_pool_t *tpool,
+	int qnum,
+	ldap_pvt_thread_pool_param_t param,
+	void *value )
+{
+	struct ldap_int_thread_pool_s	*pool;
+	struct ldap_int_thread_poolq_s	*pq;
+
+	if ( tpool == NULL || value == NULL ) {
+		return -1;
+	}
+
+	pool = *tpool;
+
+	if ( pool == NULL || qnum < 0 || qnum >= pool->ltp_numqs ) {
+		return -1;
+	}
+
+	pq = pool->ltp_wqs[qnum];
+	switch ( param ) {
+	case LDAP_PVT_THREAD_POOL_PARAM_OPEN:
+	case LDAP_PVT_THREAD_POOL_PARAM_STARTING:
+	case LDAP_PVT_THREAD_POOL_PARAM_ACTIVE:
+	case LDAP_PVT_THREAD_POOL_PARAM_PENDING:
+	case LDAP_PVT_THREAD_POOL_PARAM_BACKLOAD:
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		*((int *)value) = ldap_int_poolq_count(pq, param);
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+		break;
+
+	case LDAP_PVT_THREAD_POOL_PARAM_STEALS:
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		*((unsigned long *)value) = pq->ltp_steals;
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+		break;
+
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * true if pool is pausing; does not lock any mutex to check.
  * 0 if not pause, 1 if pause, -1 if error or no pool.
@@ -805,9 +1209,13 @@ ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 		if (pq->ltp_max_pending > 0)
 			pq->ltp_max_pending = -pq->ltp_max_pending;
 		if (!run_pending) {
-			while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list)) != NULL) {
-				LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list, ltt_next.q);
-				LDAP_FREE(task);
+			int c;
+			for (c=0; c<LDAP_PVT_THREAD_POOL_CLASSES; c++) {
+				while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list[c])) != NULL) {
+					LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list[c], ltt_next.q);
+					LDAP_FREE(task);
+				}
+				pq->ltp_class[c].ltc_pending = 0;
 			}
 			pq->ltp_pending_count = 0;
 		}
@@ -852,9 +1260,11 @@ ldap_int_thread_pool_wrapper (
 	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
 	ldap_int_thread_task_t *task;
 	ldap_int_tpool_plist_t *work_list;
+	ldap_int_tpool_class_t *cl;
 	ldap_int_thread_userctx_t ctx, *kctx;
+	struct timeval now;
 	unsigned i, keyslot, hash;
-	int pool_lock = 0, freeme = 0;
+	int cls, pool_lock = 0, freeme = 0;
 
 	assert(pool != NULL);
 
@@ -893,8 +1303,10 @@ ldap_int_thread_pool_wrapper (
 
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
-		task = LDAP_STAILQ_FIRST(work_list);
-		if (task == NULL) {	/* paused or no pending tasks */
+		cls = ldap_int_poolq_pick(pq, work_list);
+		if (cls < 0)
+			cls = ldap_int_poolq_steal(pq);
+		if (cls < 0) {	/* paused or nothing may run */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
 					ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
@@ -938,8 +1350,10 @@ ldap_int_thread_pool_wrapper (
 					ldap_pvt_thread_cond_wait(&pq->ltp_cond, &pq->ltp_mutex);
 
 				work_list = pq->ltp_work_list;
-				task = LDAP_STAILQ_FIRST(work_list);
-			} while (task == NULL);
+				cls = ldap_int_poolq_pick(pq, work_list);
+				if (cls < 0 && !pool_lock)
+					cls = ldap_int_poolq_steal(pq);
+			} while (cls < 0);
 
 			if (pool_lock) {
 				ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
@@ -949,13 +1363,22 @@ ldap_int_thread_pool_wrapper (
 			pq->ltp_active_count++;
 		}
 
-		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
+		task = LDAP_STAILQ_FIRST(&work_list[cls]);
+		LDAP_STAILQ_REMOVE_HEAD(&work_list[cls], ltt_next.q);
 		pq->ltp_pending_count--;
+		cl = &pq->ltp_class[cls];
+		cl->ltc_pending--;
+		cl->ltc_active++;
+		cl->ltc_tasks++;
+		gettimeofday(&now, NULL);
+		cl->ltc_wait += (now.tv_sec - task->ltt_queued.tv_sec) * 1000000
+			+ now.tv_usec - task->ltt_queued.tv_usec;
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
 
 		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+		pq->ltp_class[cls].ltc_active--;
 		LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task, ltt_next.l);
 	}
  done:
@@ -1089,7 +1512,7 @@ handle_pause( ldap_pvt_thread_pool_t *tpool, int pause_type )
 				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
 
 			/* Hide pending tasks from ldap_pvt_thread_pool_wrapper() */
-			pq->ltp_work_list = &empty_pending_list;
+			pq->ltp_work_list = empty_pending_list;
 
 			if (pq->ltp_active_count > 0)
 				pool->ltp_active_queues++;
@@ -1174,7 +1597,7 @@ ldap_pvt_thread_pool_resume (
 	pool->ltp_pause = 0;
 	for (i=0; i<pool->ltp_numqs; i++) {
 		pq = pool->ltp_wqs[i];
-		pq->ltp_work_list = &pq->ltp_pending_list;
+		pq->ltp_work_list = pq->ltp_pending_list;
 		ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
 	}
 	ldap_pvt_thread_cond_broadcast(&pool->ltp_cond);
@@ -297,6 +297,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** count page accesses per database, see #mdb_env_pagestat() */
+#define MDB_PAGESTATS	0x2000000
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -315,6 +317,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_INTEGERDUP	0x20
 	/** with #MDB_DUPSORT, use reverse string dups */
 #define MDB_REVERSEDUP	0x40
+	/** compress values too big to fit in a page */
+#define MDB_COMPRESS	0x80
 	/** create DB if not already existing */
 #define MDB_CREATE		0x40000
 /** @} */
@@ -352,6 +356,19 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_CP_COMPACT	0x01
 /*	@} */
 
+/**	@defgroup mdb_readahead	Readahead Policies
+ *	@{
+ */
+	/** for a cursor, that of its database; for a database, that
+	 *	of the environment, see #MDB_NORDAHEAD */
+#define MDB_RDAHEAD_DEFAULT	0
+	/** expect random access, don't ask for pages ahead */
+#define MDB_RDAHEAD_RANDOM	1
+	/** when a cursor moves on to the next leaf page, ask the OS to
+	 *	read the following leaf pages and their overflow pages */
+#define MDB_RDAHEAD_SEQUENTIAL	2
+/*	@} */
+
 /** @brief Cursor Get operations.
  *
  *	This is the set of all operations for retrieving data
@@ -465,6 +482,25 @@ typedef struct MDB_envinfo {
 	unsigned int me_numreaders;		/**< max reader slots used in the environment */
 } MDB_envinfo;
 
+	/** Number of tree levels counted separately in #MDB_pagestat */
+#define MDB_PAGESTAT_LEVELS	8
+
+/** @brief Page access counters of a database, see #MDB_PAGESTATS */
+typedef struct MDB_pagestat {
+	size_t	ps_level[MDB_PAGESTAT_LEVELS];	/**< Pages reached at each level
+											of the tree, 0 being the root. The last
+											one also counts all deeper levels. */
+	size_t	ps_overflow;		/**< Overflow pages of the data items read */
+	size_t	ps_seek;			/**< Searches starting from the root page */
+	size_t	ps_step;			/**< Moves of a cursor to the next or
+											previous page of the same level */
+	size_t	ps_dirty;			/**< Pages copied or allocated by writes */
+	size_t	ps_spill;			/**< Dirty pages written out before commit
+											to make room, by an operation on
+											this database */
+	size_t	ps_txns;			/**< Committed write txns that changed it */
+} MDB_pagestat;
+
 	/** @brief Return the LMDB library version information.
 	 *
 	 * @param[out] major if non-NULL, the library major version number is copied here
@@ -604,6 +640,12 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_PAGESTATS
+	 *		Count the pages each database's cursors read, step through and
+	 *		dirty, for #mdb_env_pagestat(). The counters are kept by this
+	 *		environment handle only, not shared with other processes, and
+	 *		are not locked: concurrent readers may lose a few counts.
+	 *		This flag may be changed at any time using #mdb_env_set_flags().
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -710,6 +752,24 @@ int  mdb_env_stat(MDB_env *env, MDB_stat *stat);
 	 */
 int  mdb_env_info(MDB_env *env, MDB_envinfo *stat);
 
+	/** @brief Return the page access counters of a database.
+	 *
+	 * The counters only grow while the environment has the #MDB_PAGESTATS
+	 * flag, and sum up the operations of all transactions since the
+	 * database handle was opened. Sorted duplicates are counted with their
+	 * main database, at the levels of their own subtree.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[out] stat The address of an #MDB_pagestat structure
+	 * 	where the counters will be copied
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_env_pagestat(MDB_env *env, MDB_dbi dbi, MDB_pagestat *stat);
+
 	/** @brief Flush the data buffers to disk.
 	 *
 	 * Data is always written to disk when #mdb_txn_commit() is called,
@@ -829,6 +889,26 @@ int  mdb_env_get_fd(MDB_env *env, mdb_filehandle_t *fd);
 	 */
 int  mdb_env_set_mapsize(MDB_env *env, size_t size);
 
+	/** @brief Set the page size for a new environment.
+	 *
+	 * By default a new environment uses the OS page size. Larger pages
+	 * hold more keys, so trees are shallower, and let values up to about
+	 * half a page be stored without overflow pages. Smaller ones waste
+	 * less space when values are small and writes are scattered.
+	 * The page size of an existing environment is recorded in it and
+	 * cannot be changed; this setting is then ignored.
+	 * This function may only be called after #mdb_env_create() and before #mdb_env_open().
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] size The page size in bytes, a power of 2 from 2048
+	 * up to 32768 (65536 in MDB_DEVEL builds).
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or the environment is already open.
+	 * </ul>
+	 */
+int  mdb_env_set_pagesize(MDB_env *env, unsigned int size);
+
 	/** @brief Set the maximum number of threads/reader slots for the environment.
 	 *
 	 * This defines the number of slots in the lock table that is used to track readers in the
@@ -1037,6 +1117,32 @@ void mdb_txn_reset(MDB_txn *txn);
 	 */
 int  mdb_txn_renew(MDB_txn *txn);
 
+	/** @brief Move pages from the end of the file into free space.
+	 *
+	 * This lets a database file shrink again after many records have been
+	 * deleted, without copying it with #mdb_env_copy2() and #MDB_CP_COMPACT.
+	 * Free pages at the end of the file are given back at once, and up to
+	 * \b max pages of the databases open in the transaction are copied into
+	 * free pages lower in the file. The pages they leave behind are freed
+	 * like any other and can only be given back by a later transaction, once
+	 * no reader uses them any more. Each call continues the sweep where the
+	 * previous one in this environment stopped, so calling it in a series of
+	 * small transactions compacts the file gradually while it stays in use.
+	 * The file is truncated when the transaction commits, except with
+	 * #MDB_WRITEMAP and on Windows, where only the map's used size shrinks.
+	 * @param[in] txn A top-level write transaction handle returned by
+	 * #mdb_txn_begin()
+	 * @param[in] max The maximum number of pages to move
+	 * @param[out] moved The number of pages moved or given back
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EACCES - the transaction is read-only.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_txn_compact(MDB_txn *txn, unsigned int max, unsigned int *moved);
+
 /** Compat with version <= 0.9.4, avoid clash with libmdb from MDB Tools project */
 #define mdb_open(txn,name,flags,dbi)	mdb_dbi_open(txn,name,flags,dbi)
 /** Compat with version <= 0.9.4, avoid clash with libmdb from MDB Tools project */
@@ -1096,6 +1202,18 @@ int  mdb_txn_renew(MDB_txn *txn);
 	 *	<li>#MDB_REVERSEDUP
 	 *		This option specifies that duplicate data items should be compared as
 	 *		strings in reverse order.
+	 *	<li>#MDB_COMPRESS
+	 *		Values that would go on overflow pages are stored compressed
+	 *		with a built-in LZ77 codec, if that saves space. Reading such a
+	 *		value decompresses it into a buffer owned by the transaction,
+	 *		which stays valid until the transaction ends or is reset, so
+	 *		long-lived transactions reading many of them use more memory.
+	 *		Values written with #MDB_RESERVE are not compressed. The flag is
+	 *		ignored with #MDB_DUPSORT. It is recorded in the database, and
+	 *		may be added to an existing database in a write transaction.
+	 *		The next commit then marks the environment with a new datafile
+	 *		version, so that versions of LMDB without compression refuse
+	 *		to open it with #MDB_VERSION_MISMATCH.
 	 *	<li>#MDB_CREATE
 	 *		Create the named database if it doesn't exist. This option is not
 	 *		allowed in a read-only transaction or a read-only environment.
@@ -1125,6 +1243,32 @@ int  mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *d
 	 */
 int  mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *stat);
 
+	/** @brief Find keys that split a database into parts of about equal size.
+	 *
+	 * The keys are taken from the branch pages near the root of the
+	 * database's B-tree, so this only reads a few pages. Each part
+	 * then holds about the same number of pages. This is meant for
+	 * dividing a scan of a large database among several threads, with
+	 * one read-only transaction each on the same snapshot.
+	 * The returned keys are in ascending order. Each one is the lowest
+	 * key of the part that starts with it. The first part starts with
+	 * the first key of the database. A small database yields fewer
+	 * keys than asked for, possibly none.
+	 * See #mdb_get() for restrictions on using the returned keys.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[out] keys An array of at least \b count items for the keys.
+	 * @param[in,out] count The number of keys wanted, which is one less
+	 * than the number of parts. On return, the number of keys found.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  mdb_dbi_split(MDB_txn *txn, MDB_dbi dbi, MDB_val *keys, unsigned int *count);
+
 	/** @brief Retrieve the DB flags for a database handle.
 	 *
 	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
@@ -1243,6 +1387,29 @@ int  mdb_set_relfunc(MDB_txn *txn, MDB_dbi dbi, MDB_rel_func *rel);
 	 */
 int  mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx);
 
+	/** @brief Set the readahead policy of a database.
+	 *
+	 * The kernel only reads ahead in file order, while the pages of
+	 * a B-tree are spread over the file. With #MDB_RDAHEAD_SEQUENTIAL,
+	 * a cursor that moves on from a leaf page to the next one, by
+	 * #MDB_NEXT or by looking up a key there, asks the OS with
+	 * madvise(MADV_WILLNEED) to read the following leaf pages and the
+	 * overflow pages of their items. This suits databases that are
+	 * mostly scanned in key order, in an environment opened with
+	 * #MDB_NORDAHEAD for the ones that are not. Only forward moves are
+	 * detected. The policy applies to the cursors opened afterwards,
+	 * and lasts until the database handle is closed.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] policy One of the @ref mdb_readahead
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_set_readahead(MDB_txn *txn, MDB_dbi dbi, unsigned int policy);
+
 	/** @brief Get items from a database.
 	 *
 	 * This function retrieves key/data pairs from the database. The address
@@ -1429,6 +1596,55 @@ MDB_dbi mdb_cursor_dbi(MDB_cursor *cursor);
 int  mdb_cursor_get(MDB_cursor *cursor, MDB_val *key, MDB_val *data,
 			    MDB_cursor_op op);
 
+	/** @brief Retrieve the data of many keys through a cursor.
+	 *
+	 * This looks up each of the given keys as #MDB_SET would, but in
+	 * one pass. The keys must be sorted in ascending order of the
+	 * database's key comparison. The cursor's page stack is kept from
+	 * one key to the next, so a key only searches the part of the tree
+	 * below the lowest branch page that also covers the previous key,
+	 * instead of starting at the root. If the cursor is already
+	 * positioned and the first key does not sort before its current
+	 * page, that key starts from there as well. Pages the following
+	 * keys will need, and the overflow pages of the values found, are
+	 * announced to the OS ahead of time with madvise(MADV_WILLNEED)
+	 * if the environment was opened with #MDB_NORDAHEAD, where
+	 * otherwise nothing would read them in before they are touched.
+	 * For databases with #MDB_DUPSORT the first data item of each key
+	 * is returned. Afterwards the cursor is positioned as after
+	 * #MDB_SET on the last key.
+	 * See #mdb_get() for restrictions on using the output values.
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
+	 * @param[in] keys An array of \b count keys to look up
+	 * @param[out] data An array of \b count items for the data. The
+	 * item of a key that is not in the database gets a NULL
+	 * \b mv_data and a zero \b mv_size.
+	 * @param[in] count The number of keys
+	 * @return A non-zero error value on failure and 0 on success. Keys
+	 * that are missing are not an error. Some possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>MDB_BAD_VALSIZE - a key has zero length.
+	 * </ul>
+	 */
+int  mdb_cursor_get_batch(MDB_cursor *cursor, MDB_val *keys, MDB_val *data,
+			    unsigned int count);
+
+	/** @brief Set the readahead policy of a cursor.
+	 *
+	 * This overrides the policy of the cursor's database, see
+	 * #mdb_set_readahead(), until it is set again. #MDB_RDAHEAD_DEFAULT
+	 * goes back to that of the database.
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
+	 * @param[in] policy One of the @ref mdb_readahead
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_cursor_set_readahead(MDB_cursor *cursor, unsigned int policy);
+
 	/** @brief Store by cursor.
 	 *
 	 * This function stores key/data pairs into the database.
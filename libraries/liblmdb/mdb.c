@@ -269,6 +269,26 @@ typedef SSIZE_T	ssize_t;
 #define MDB_ROBUST_SUPPORTED	1
 #endif
 
+/** Atomics for the reader table. Without them, reader slots are only
+ * claimed with the reader mutex held, and writers always scan the
+ * reader table for the oldest reader.
+ */
+#ifdef _WIN32
+#define MDB_CAS_PID(p, o, n) \
+	(InterlockedCompareExchange((LONG volatile *)(p), (n), (o)) == (o))
+#define MDB_MEMBAR()	MemoryBarrier()
+#elif (__GNUC__ * 100 + __GNUC_MINOR__ >= 401) || defined(__clang__)
+#define MDB_CAS_PID(p, o, n)	__sync_bool_compare_and_swap((p), (o), (n))
+#define MDB_MEMBAR()	__sync_synchronize()
+#endif
+#ifdef MDB_CAS_PID
+#define MDB_RDR_ATOMIC	1
+#else
+#define MDB_RDR_ATOMIC	0
+#define MDB_CAS_PID(p, o, n)	(*(p) == (o) ? (*(p) = (n), 1) : 0)
+#define MDB_MEMBAR()
+#endif
+
 #ifdef _WIN32
 #define MDB_USE_HASH	1
 #define MDB_PIDLOCK	0
@@ -498,6 +518,13 @@ static txnid_t mdb_debug_start;
 	 */
 #define MAX_PAGESIZE	 (PAGEBASE ? 0x10000 : 0x8000)
 
+	/**	@brief The minimum size of a database page.
+	 *
+	 *	A page must hold #MDB_MINKEYS nodes with keys of
+	 *	#MDB_MAXKEYSIZE bytes.
+	 */
+#define MIN_PAGESIZE	 0x800
+
 	/** The minimum number of keys required in a database page.
 	 *	Setting this to a larger value will place a smaller bound on the
 	 *	maximum size of a data item. Data items larger than this size will
@@ -520,8 +547,13 @@ static txnid_t mdb_debug_start;
 
 	/**	The version number for a database's datafile format. */
 #define MDB_DATA_VERSION	 ((MDB_DEVEL) ? 999 : 1)
+	/**	The datafile format version once any database uses #MDB_COMPRESS.
+	 *	Libraries that don't know #F_COMPRESSED nodes would return their
+	 *	compressed bytes as values, so they must refuse such a file.
+	 */
+#define MDB_DATA_VERSION_ZIP	 (MDB_DATA_VERSION + 1)
 	/**	The version number for a database's lockfile format. */
-#define MDB_LOCK_VERSION	 1
+#define MDB_LOCK_VERSION	 2
 
 	/**	@brief The max size of a key we can write, or 0 for computed max.
 	 *
@@ -728,6 +760,16 @@ typedef struct MDB_txbody {
 		 *	when readers release their slots.
 		 */
 	volatile unsigned	mtb_numreaders;
+		/** The oldest txnid that readers used when a writer last scanned
+		 *	the reader table. Readers that begin later use newer ones, so
+		 *	until one of the readers seen then goes away this is still
+		 *	the oldest, and no writer needs to scan again.
+		 */
+	volatile txnid_t		mtb_oldest;
+		/** Set when a reader that may have used #mtb_oldest goes away,
+		 *	or when that value is not to be trusted.
+		 */
+	volatile unsigned	mtb_rdrefresh;
 } MDB_txbody;
 
 	/** The actual reader table definition. */
@@ -740,6 +782,8 @@ typedef struct MDB_txninfo {
 #define mti_rmname	mt1.mtb.mtb_rmname
 #define mti_txnid	mt1.mtb.mtb_txnid
 #define mti_numreaders	mt1.mtb.mtb_numreaders
+#define mti_oldest	mt1.mtb.mtb_oldest
+#define mti_rdrefresh	mt1.mtb.mtb_rdrefresh
 		char pad[(sizeof(MDB_txbody)+CACHELINE-1) & ~(CACHELINE-1)];
 	} mt1;
 	union {
@@ -868,9 +912,10 @@ typedef struct MDB_node {
 #define F_BIGDATA	 0x01			/**< data put on overflow page */
 #define F_SUBDATA	 0x02			/**< data is a sub-database */
 #define F_DUPDATA	 0x04			/**< data has duplicates */
+#define F_COMPRESSED	 0x08			/**< data is compressed, see #MDB_COMPRESS */
 
 /** valid flags for #mdb_node_add() */
-#define	NODE_ADD_FLAGS	(F_DUPDATA|F_SUBDATA|MDB_RESERVE|MDB_APPEND)
+#define	NODE_ADD_FLAGS	(F_DUPDATA|F_SUBDATA|F_COMPRESSED|MDB_RESERVE|MDB_APPEND)
 
 /** @} */
 	unsigned short	mn_flags;		/**< @ref mdb_node */
@@ -973,7 +1018,7 @@ typedef struct MDB_db {
 #define MDB_VALID	0x8000		/**< DB handle is valid, for me_dbflags */
 #define PERSISTENT_FLAGS	(0xffff & ~(MDB_VALID))
 #define VALID_FLAGS	(MDB_REVERSEKEY|MDB_DUPSORT|MDB_INTEGERKEY|MDB_DUPFIXED|\
-	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_CREATE)
+	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_COMPRESS|MDB_CREATE)
 
 	/** Handle for the DB used to track free pages. */
 #define	FREE_DBI	0
@@ -993,7 +1038,8 @@ typedef struct MDB_meta {
 		/** Stamp identifying this as an LMDB file. It must be set
 		 *	to #MDB_MAGIC. */
 	uint32_t	mm_magic;
-		/** Version number of this file. Must be set to #MDB_DATA_VERSION. */
+		/** Version number of this file. Must be set to #MDB_DATA_VERSION,
+		 *	or to #MDB_DATA_VERSION_ZIP once a DB uses #MDB_COMPRESS. */
 	uint32_t	mm_version;
 	void		*mm_address;		/**< address for fixed mapping */
 	size_t		mm_mapsize;			/**< size of mmap region */
@@ -1029,6 +1075,7 @@ typedef struct MDB_dbx {
 	MDB_cmp_func	*md_dcmp;	/**< function for comparing data items */
 	MDB_rel_func	*md_rel;	/**< user relocate function */
 	void		*md_relctx;		/**< user-provided context for md_rel */
+	unsigned int	md_rdahead;	/**< @ref mdb_readahead policy */
 } MDB_dbx;
 
 	/** A database transaction.
@@ -1115,6 +1162,10 @@ struct MDB_txn {
 	 *	dirty_list into mt_parent after freeing hidden mt_parent pages.
 	 */
 	unsigned int	mt_dirty_room;
+	/** Values decompressed in this txn, see #mdb_val_unzip(). Each
+	 *	buffer starts with a pointer to the next one.
+	 */
+	void		*mt_zbufs;
 };
 
 /** Enough space for 2^32 nodes with minimum of 2 keys per node. I.e., plenty.
@@ -1164,6 +1215,15 @@ struct MDB_cursor {
 #define C_UNTRACK	0x40		/**< Un-track cursor when closing */
 /** @} */
 	unsigned int	mc_flags;	/**< @ref mdb_cursor */
+	unsigned int	mc_rdahead;	/**< @ref mdb_readahead policy, if set */
+	/** For #MDB_RDAHEAD_SEQUENTIAL, see #mdb_cursor_readahead():
+	 *	the branch page above the last leaf page reached,
+	 */
+	pgno_t		mc_rdparent;
+	indx_t		mc_rdidx;	/**< the index of that leaf in it */
+	indx_t		mc_rdend;	/**< the index of the last leaf asked for */
+	indx_t		mc_rdov;	/**< and of the next to ask for overflow pages of */
+	unsigned int	mc_rdrun;	/**< whether that leaf followed the one before */
 	MDB_page	*mc_pg[CURSOR_STACK];	/**< stack of pushed pages */
 	indx_t		mc_ki[CURSOR_STACK];	/**< stack of page indices */
 };
@@ -1185,6 +1245,11 @@ typedef struct MDB_xcursor {
 } MDB_xcursor;
 
 	/** State of FreeDB old pages, stored in the MDB_env */
+	/** Number of lists of #MDB_env.me_pgruns. List n holds the runs of
+	 *	exactly n pages, the last list all longer runs too, sorted by length.
+	 */
+#define MDB_PGRUN_LISTS	256
+
 typedef struct MDB_pgstate {
 	pgno_t		*mf_pghead;	/**< Reclaimed freeDB pages, or NULL before use */
 	txnid_t		mf_pglast;	/**< ID of last used record, or 0 if !mf_pghead */
@@ -1203,6 +1268,10 @@ struct MDB_env {
 #define	MDB_ENV_TXKEY	0x10000000U
 	/** fdatasync is unreliable */
 #define	MDB_FSYNCONLY	0x08000000U
+	/** me_pgruns knows all runs of pages in me_pghead */
+#define	MDB_ENV_PGRUNS	0x04000000U
+	/** a database uses #MDB_COMPRESS, write #MDB_DATA_VERSION_ZIP */
+#define	MDB_ENV_ZIP	0x02000000U
 	uint32_t 	me_flags;		/**< @ref mdb_env */
 	unsigned int	me_psize;	/**< DB page size, inited from me_os_psize */
 	unsigned int	me_os_psize;	/**< OS page size, from #GET_PAGESIZE */
@@ -1217,6 +1286,10 @@ struct MDB_env {
 	MDB_txninfo	*me_txns;		/**< the memory map of the lock file or NULL */
 	MDB_meta	*me_metas[NUM_METAS];	/**< pointers to the two meta pages */
 	void		*me_pbuf;		/**< scratch area for DUPSORT put() */
+	void		*me_zbuf;		/**< scratch area for #MDB_COMPRESS put() */
+	size_t		me_zsize;		/**< size of #me_zbuf */
+	MDB_dbi		me_cpdbi;		/**< DB where #mdb_txn_compact() resumes */
+	MDB_val		me_cpkey;		/**< and the key, if not at its start */
 	MDB_txn		*me_txn;		/**< current write transaction */
 	MDB_txn		*me_txn0;		/**< prealloc'd write transaction */
 	size_t		me_mapsize;		/**< size of the data memory map */
@@ -1225,11 +1298,14 @@ struct MDB_env {
 	MDB_dbx		*me_dbxs;		/**< array of static DB info */
 	uint16_t	*me_dbflags;	/**< array of flags from MDB_db.md_flags */
 	unsigned int	*me_dbiseqs;	/**< array of dbi sequence numbers */
+	MDB_pagestat	*me_pgstats;	/**< array of counters for #MDB_PAGESTATS */
 	pthread_key_t	me_txkey;	/**< thread-key for readers */
 	txnid_t		me_pgoldest;	/**< ID of oldest reader last time we looked */
 	MDB_pgstate	me_pgstate;		/**< state of old pages from freeDB */
 #	define		me_pglast	me_pgstate.mf_pglast
 #	define		me_pghead	me_pgstate.mf_pghead
+	/** Runs of contiguous pages in #me_pghead, see #mdb_pgrun_find() */
+	MDB_IDL		me_pgruns[MDB_PGRUN_LISTS];
 	MDB_page	*me_dpages;		/**< list of malloc'd blocks for re-use */
 	/** IDL of pages that became unused in a write txn */
 	MDB_IDL		me_free_pgs;
@@ -1242,7 +1318,9 @@ struct MDB_env {
 #if !(MDB_MAXKEYSIZE)
 	unsigned int	me_maxkey;	/**< max size of a key */
 #endif
-	int		me_live_reader;		/**< have liveness lock in reader table */
+	/** 1 if we have the liveness lock in the reader table, 2 once
+	 *	a slot was also claimed with the reader mutex held */
+	int		me_live_reader;
 #ifdef _WIN32
 	int		me_pidquery;		/**< Used in OpenProcess */
 #endif
@@ -1281,6 +1359,15 @@ typedef struct MDB_ntxn {
 #define TXN_DBI_CHANGED(txn, dbi) \
 	((txn)->mt_dbiseqs[dbi] != (txn)->mt_env->me_dbiseqs[dbi])
 
+	/** The page counters of the cursor's DB, or NULL if not counting */
+#define MC_PAGESTAT(mc) \
+	(((mc)->mc_txn->mt_env->me_flags & MDB_PAGESTATS) ? \
+	 &(mc)->mc_txn->mt_env->me_pgstats[(mc)->mc_dbi] : NULL)
+
+	/** Count a page reached at tree level \b lvl */
+#define PAGESTAT_LEVEL(ps, lvl) \
+	((ps)->ps_level[(lvl) < MDB_PAGESTAT_LEVELS ? (lvl) : MDB_PAGESTAT_LEVELS-1]++)
+
 static int  mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp);
 static int  mdb_page_new(MDB_cursor *mc, uint32_t flags, int num, MDB_page **mp);
 static int  mdb_page_touch(MDB_cursor *mc);
@@ -1327,7 +1414,9 @@ static int  mdb_node_add(MDB_cursor *mc, indx_t indx,
 static void mdb_node_del(MDB_cursor *mc, int ksize);
 static void mdb_node_shrink(MDB_page *mp, indx_t indx);
 static int	mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft);
-static int  mdb_node_read(MDB_txn *txn, MDB_node *leaf, MDB_val *data);
+static int  mdb_node_read(MDB_cursor *mc, MDB_node *leaf, MDB_val *data);
+static int	mdb_val_zip(MDB_env *env, MDB_val *data, MDB_val *zdata);
+static void	mdb_zbufs_free(MDB_txn *txn);
 static size_t	mdb_leaf_size(MDB_env *env, MDB_val *key, MDB_val *data);
 static size_t	mdb_branch_size(MDB_env *env, MDB_val *key);
 
@@ -1340,6 +1429,7 @@ static int	mdb_cursor_push(MDB_cursor *mc, MDB_page *mp);
 static int	mdb_cursor_del0(MDB_cursor *mc);
 static int	mdb_del0(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data, unsigned flags);
 static int	mdb_cursor_sibling(MDB_cursor *mc, int move_right);
+static void	mdb_cursor_readahead(MDB_cursor *mc);
 static int	mdb_cursor_next(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op);
 static int	mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op);
 static int	mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op,
@@ -1936,7 +2026,8 @@ mdb_page_spill(MDB_cursor *m0, MDB_val *key, MDB_val *data)
 	MDB_txn *txn = m0->mc_txn;
 	MDB_page *dp;
 	MDB_ID2L dl = txn->mt_u.dirty_list;
-	unsigned int i, j, need;
+	MDB_pagestat *ps;
+	unsigned int i, j, need, spilled;
 	int rc;
 
 	if (m0->mc_flags & C_SUB)
@@ -1985,6 +2076,7 @@ mdb_page_spill(MDB_cursor *m0, MDB_val *key, MDB_val *data)
 	 */
 	if (need < MDB_IDL_UM_MAX / 8)
 		need = MDB_IDL_UM_MAX / 8;
+	spilled = txn->mt_spill_pgs[0];
 
 	/* Save the page IDs of all the pages we're flushing */
 	/* flush from the tail forward, this saves a lot of shifting later on. */
@@ -2015,6 +2107,8 @@ mdb_page_spill(MDB_cursor *m0, MDB_val *key, MDB_val *data)
 		need--;
 	}
 	mdb_midl_sort(txn->mt_spill_pgs);
+	if ((ps = MC_PAGESTAT(m0)) != NULL)
+		ps->ps_spill += txn->mt_spill_pgs[0] - spilled;
 
 	/* Flush the spilled part of dirty list */
 	if ((rc = mdb_page_flush(txn, i)) != MDB_SUCCESS)
@@ -2028,21 +2122,40 @@ done:
 	return rc;
 }
 
-/** Find oldest txnid still referenced. Expects txn->mt_txnid > 0. */
+/** Find oldest txnid still referenced. Expects txn->mt_txnid > 0.
+ * The reader table is only scanned when a reader that may have been
+ * the oldest went away since the last scan. Readers going away check
+ * #MDB_txninfo.%mti_oldest after clearing their txnid, so the scan
+ * first sets it to a value they will all see as their own.
+ */
 static txnid_t
 mdb_find_oldest(MDB_txn *txn)
 {
-	int i;
+	MDB_txninfo *ti = txn->mt_env->me_txns;
+	int i, held = 0;
 	txnid_t mr, oldest = txn->mt_txnid - 1;
-	if (txn->mt_env->me_txns) {
-		MDB_reader *r = txn->mt_env->me_txns->mti_readers;
-		for (i = txn->mt_env->me_txns->mti_numreaders; --i >= 0; ) {
+	if (ti) {
+		MDB_reader *r = ti->mti_readers;
+		if (MDB_RDR_ATOMIC && !ti->mti_rdrefresh)
+			return ti->mti_oldest;
+		ti->mti_rdrefresh = 0;
+		ti->mti_oldest = oldest;
+		MDB_MEMBAR();
+		for (i = ti->mti_numreaders; --i >= 0; ) {
 			if (r[i].mr_pid) {
 				mr = r[i].mr_txnid;
-				if (oldest > mr)
+				if (oldest >= mr) {
 					oldest = mr;
+					held = 1;
+				}
 			}
 		}
+		ti->mti_oldest = oldest;
+		/* Without a reader holding it back, it moves on with
+		 * each commit
+		 */
+		if (!held)
+			ti->mti_rdrefresh = 1;
 	}
 	return oldest;
 }
@@ -2066,6 +2179,218 @@ mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
 	txn->mt_dirty_room--;
 }
 
+/** List of #MDB_env.me_pgruns holding runs of n pages. */
+#define mdb_pgrun_list(n)	((n) < MDB_PGRUN_LISTS-1 ? (unsigned)(n) : MDB_PGRUN_LISTS-1)
+
+/** Find the shortest run of at least num pages in the list of long runs.
+ * @param[in] runs the last list of #MDB_env.me_pgruns.
+ * @param[in] num the number of pages.
+ * @return the position of the run's first page, or 0 if none is that long.
+ */
+static unsigned
+mdb_pgrun_search(MDB_IDL runs, pgno_t num)
+{
+	unsigned lo = 1, hi = runs[0] / 2 + 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (runs[2*mid-1] < num)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo <= runs[0] / 2 ? 2*lo : 0;
+}
+
+/** Remember a run of free pages in me_pghead, for #mdb_pgrun_find().
+ * @param[in] env the environment.
+ * @param[in] pgno the first page of the run.
+ * @param[in] len the number of pages, at least 2.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pgrun_add(MDB_env *env, pgno_t pgno, pgno_t len)
+{
+	unsigned c = mdb_pgrun_list(len), i;
+	MDB_IDL *runs = &env->me_pgruns[c];
+	int rc;
+
+	if (!*runs) {
+		if (!(*runs = mdb_midl_alloc(64)))
+			return ENOMEM;
+	} else if ((rc = mdb_midl_need(runs, 2)) != 0) {
+		return rc;
+	}
+	if (c == MDB_PGRUN_LISTS-1) {
+		/* Keep long runs sorted, after those of the same length */
+		i = mdb_pgrun_search(*runs, len + 1);
+		if (i) {
+			memmove(*runs + i + 1, *runs + i - 1,
+				((*runs)[0] - i + 2) * sizeof(pgno_t));
+			(*runs)[i-1] = len;
+			(*runs)[i] = pgno;
+			(*runs)[0] += 2;
+			return MDB_SUCCESS;
+		}
+	}
+	mdb_midl_xappend(*runs, len);
+	mdb_midl_xappend(*runs, pgno);
+	return MDB_SUCCESS;
+}
+
+/** Forget a run of free pages.
+ * @param[in] runs the list of #MDB_env.me_pgruns holding it.
+ * @param[in] c the number of that list.
+ * @param[in] i the position of the run's first page.
+ */
+static void
+mdb_pgrun_del(MDB_IDL runs, unsigned c, unsigned i)
+{
+	if (c == MDB_PGRUN_LISTS-1) {
+		memmove(runs + i - 1, runs + i + 1, (runs[0] - i) * sizeof(pgno_t));
+	} else {
+		runs[i-1] = runs[runs[0]-1];
+		runs[i] = runs[runs[0]];
+	}
+	runs[0] -= 2;
+}
+
+/** Remember the run of free pages that includes a page of me_pghead.
+ * @param[in] env the environment.
+ * @param[in,out] ip the position of the page in me_pghead. Set to
+ *	the position of the highest page of the run.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pgrun_index(MDB_env *env, unsigned *ip)
+{
+	pgno_t *mop = env->me_pghead;
+	unsigned i = *ip, j = i, len = mop[0];
+
+	while (i > 1 && mop[i-1] == mop[i]+1)
+		i--;
+	while (j < len && mop[j+1] == mop[j]-1)
+		j++;
+	*ip = i;
+	return i < j ? mdb_pgrun_add(env, mop[j], j - i + 1) : MDB_SUCCESS;
+}
+
+/** Merge an IDL of free pages into me_pghead, and remember the runs
+ * of pages it creates or lengthens. me_pghead must have room for it.
+ * @param[in] env the environment.
+ * @param[in] idl the pages, sorted like me_pghead.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pghead_merge(MDB_env *env, MDB_IDL idl)
+{
+	pgno_t *mop = env->me_pghead;
+	unsigned i, k;
+	int rc;
+
+	mdb_midl_xmerge(mop, idl);
+	/* From the lowest new page up, skipping those in a run already seen */
+	for (k = idl[0]; k; k--) {
+		i = mdb_midl_search(mop, idl[k]);
+		if ((rc = mdb_pgrun_index(env, &i)) != 0)
+			return rc;
+		while (k > 1 && idl[k-1] <= mop[i])
+			k--;
+	}
+	return MDB_SUCCESS;
+}
+
+/** Forget the known runs and find all runs of me_pghead again. */
+static int
+mdb_pgrun_rebuild(MDB_env *env)
+{
+	pgno_t *mop = env->me_pghead;
+	unsigned i;
+	int rc;
+
+	for (i = 0; i < MDB_PGRUN_LISTS; i++)
+		if (env->me_pgruns[i])
+			env->me_pgruns[i][0] = 0;
+	for (i = mop[0]; i > 1; i--) {
+		if (mop[i-1] == mop[i]+1 && (rc = mdb_pgrun_index(env, &i)) != 0)
+			return rc;
+	}
+	env->me_flags |= MDB_ENV_PGRUNS;
+	return MDB_SUCCESS;
+}
+
+/** Find num contiguous pages in me_pghead.
+ *
+ * Runs of pages are indexed by their length in #MDB_env.me_pgruns when
+ * they are merged into me_pghead, so this need not scan it, and the
+ * first run found is long enough. Pages can leave me_pghead without
+ * the index knowing, so each run is checked against me_pghead when it
+ * is picked. Pages are taken from the bottom of a run, as are single
+ * pages from the bottom of me_pghead, so a run that lost pages is kept
+ * if the rest of it is intact. Otherwise, or if me_pghead was restored
+ * by aborting a nested txn, the index is rebuilt before giving up.
+ * @param[in] env the environment.
+ * @param[in] num the number of pages, at least 2.
+ * @param[out] idx the position in me_pghead of the lowest page found,
+ *	or 0 if there was no such run.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_pgrun_find(MDB_env *env, int num, unsigned *idx)
+{
+	pgno_t *mop = env->me_pghead, *runs, pgno, top, len;
+	unsigned c, i, j;
+	int rc;
+
+	*idx = 0;
+again:
+	/* Prefer short runs, to keep the long ones for big requests */
+	for (c = mdb_pgrun_list(num); c < MDB_PGRUN_LISTS; c++) {
+		while ((runs = env->me_pgruns[c]) && runs[0]) {
+			if (c < MDB_PGRUN_LISTS-1)
+				i = runs[0];
+			else if (!(i = mdb_pgrun_search(runs, num)))
+				break;
+			len = runs[i-1];
+			pgno = runs[i];
+			mdb_pgrun_del(runs, c, i);
+			top = pgno + len - 1;
+			j = mdb_midl_search(mop, pgno);
+			if (j > mop[0] || mop[j] != pgno) {
+				/* Pages were taken from the bottom, find the rest */
+				if (j < 2 || mop[j-1] > top)
+					continue;
+				pgno = mop[--j];
+				len = top - pgno + 1;
+			}
+			if (j < len || mop[j-len+1] != top) {
+				/* Pages are missing higher up, what is left of
+				 * the run is not known any more
+				 */
+				env->me_flags &= ~MDB_ENV_PGRUNS;
+				continue;
+			}
+			if (len < (pgno_t)num) {
+				if (len > 1 && (rc = mdb_pgrun_add(env, pgno, len)) != 0)
+					return rc;
+				continue;
+			}
+			/* Take the bottom num pages, keep the rest of the run */
+			if (len - num > 1 &&
+				(rc = mdb_pgrun_add(env, pgno + num, len - num)) != 0)
+				return rc;
+			*idx = j;
+			return MDB_SUCCESS;
+		}
+	}
+	if (!(env->me_flags & MDB_ENV_PGRUNS)) {
+		if ((rc = mdb_pgrun_rebuild(env)) != 0)
+			return rc;
+		goto again;
+	}
+	return MDB_SUCCESS;
+}
+
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
  * me_pghead and mt_next_pgno.
  *
@@ -2104,7 +2429,8 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 	txnid_t oldest = 0, last;
 	MDB_cursor_op op;
 	MDB_cursor m2;
-	int found_old = 0;
+	MDB_IDL batch = NULL;
+	int found_old = 0, fresh = 1, more = 1;
 
 	/* If there are any loose pages, just use them */
 	if (num == 1 && txn->mt_loose_pgs) {
@@ -2134,14 +2460,22 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		 * pages at the tail, just truncating the list.
 		 */
 		if (mop_len > n2) {
-			i = mop_len;
-			do {
+			if (!n2) {
+				i = mop_len;
 				pgno = mop[i];
-				if (mop[i-n2] == pgno+n2)
+				goto search_done;
+			}
+			if (fresh) {
+				fresh = 0;
+				if ((rc = mdb_pgrun_find(env, num, &i)) != 0)
+					goto fail;
+				if (i) {
+					pgno = mop[i];
 					goto search_done;
-			} while (--i > n2);
+				}
+			}
 			if (--retry < 0)
-				break;
+				more = 0;
 		}
 
 		if (op == MDB_FIRST) {	/* 1st iteration */
@@ -2158,7 +2492,9 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 				retry = -1;
 		}
 		if (Paranoid && retry < 0 && mop_len)
-			break;
+			more = 0;
+		if (!more)
+			goto merge;
 
 		last++;
 		/* Do not fetch more if the record will be too recent */
@@ -2168,14 +2504,17 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 				env->me_pgoldest = oldest;
 				found_old = 1;
 			}
-			if (oldest <= last)
-				break;
+			if (oldest <= last) {
+				more = 0;
+				goto merge;
+			}
 		}
 		rc = mdb_cursor_get(&m2, &key, NULL, op);
 		if (rc) {
-			if (rc == MDB_NOTFOUND)
-				break;
-			goto fail;
+			if (rc != MDB_NOTFOUND)
+				goto fail;
+			more = 0;
+			goto merge;
 		}
 		last = *(txnid_t*)key.mv_data;
 		if (oldest <= last) {
@@ -2184,26 +2523,29 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 				env->me_pgoldest = oldest;
 				found_old = 1;
 			}
-			if (oldest <= last)
-				break;
+			if (oldest <= last) {
+				more = 0;
+				goto merge;
+			}
 		}
 		np = m2.mc_pg[m2.mc_top];
 		leaf = NODEPTR(np, m2.mc_ki[m2.mc_top]);
-		if ((rc = mdb_node_read(txn, leaf, &data)) != MDB_SUCCESS)
+		if ((rc = mdb_node_read(&m2, leaf, &data)) != MDB_SUCCESS) {
+			mdb_midl_free(batch);
 			return rc;
+		}
 
 		idl = (MDB_ID *) data.mv_data;
 		i = idl[0];
-		if (!mop) {
-			if (!(env->me_pghead = mop = mdb_midl_alloc(i))) {
+		if (!batch) {
+			if (!(batch = mdb_midl_alloc(i))) {
 				rc = ENOMEM;
 				goto fail;
 			}
-		} else {
-			if ((rc = mdb_midl_need(&env->me_pghead, i)) != 0)
-				goto fail;
-			mop = env->me_pghead;
+		} else if ((rc = mdb_midl_need(&batch, i)) != 0) {
+			goto fail;
 		}
+		mdb_midl_append_list(&batch, idl);
 		env->me_pglast = last;
 #if (MDB_DEBUG) > 1
 		DPRINTF(("IDL read txn %"Z"u root %"Z"u num %u",
@@ -2211,9 +2553,31 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		for (j = i; j; j--)
 			DPRINTF(("IDL %"Z"u", idl[j]));
 #endif
+		/* Merge records in batches about as big as me_pghead,
+		 * so that merging them all costs O(n log n).
+		 */
+		if (batch[0] < mop_len)
+			continue;
+merge:
+		if (!batch || !batch[0])
+			break;
+		mdb_midl_sort(batch);
+		if (!mop) {
+			if (!(env->me_pghead = mop = mdb_midl_alloc(batch[0]))) {
+				rc = ENOMEM;
+				goto fail;
+			}
+		} else {
+			if ((rc = mdb_midl_need(&env->me_pghead, batch[0])) != 0)
+				goto fail;
+			mop = env->me_pghead;
+		}
 		/* Merge in descending sorted order */
-		mdb_midl_xmerge(mop, idl);
+		if ((rc = mdb_pghead_merge(env, batch)) != 0)
+			goto fail;
+		batch[0] = 0;
 		mop_len = mop[0];
+		fresh = 1;
 	}
 
 	/* Use new pages from the map when nothing suitable in the freeDB */
@@ -2226,6 +2590,8 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 	}
 
 search_done:
+	mdb_midl_free(batch);
+	batch = NULL;
 	if (env->me_flags & MDB_WRITEMAP) {
 		np = (MDB_page *)(env->me_map + env->me_psize * pgno);
 	} else {
@@ -2249,6 +2615,7 @@ search_done:
 	return MDB_SUCCESS;
 
 fail:
+	mdb_midl_free(batch);
 	txn->mt_flags |= MDB_TXN_ERROR;
 	return rc;
 }
@@ -2349,6 +2716,7 @@ mdb_page_touch(MDB_cursor *mc)
 	MDB_page *mp = mc->mc_pg[mc->mc_top], *np;
 	MDB_txn *txn = mc->mc_txn;
 	MDB_cursor *m2, *m3;
+	MDB_pagestat *ps;
 	pgno_t	pgno;
 	int rc;
 
@@ -2410,6 +2778,8 @@ mdb_page_touch(MDB_cursor *mc)
 	mdb_page_copy(np, mp, txn->mt_env->me_psize);
 	np->mp_pgno = pgno;
 	np->mp_flags |= P_DIRTY;
+	if ((ps = MC_PAGESTAT(mc)) != NULL)
+		ps->ps_dirty++;
 
 done:
 	/* Adjust cursors pointing to mp */
@@ -2609,6 +2979,94 @@ mdb_reader_pid(MDB_env *env, enum Pidlock_op op, MDB_PID_T pid)
 #endif
 }
 
+/** Claim a free slot in the reader table for this thread.
+ * Slots are taken by swapping in our pid atomically, so that
+ * slots this process has seen in use can be claimed without the
+ * reader mutex. The mutex is still taken for the first slot of the
+ * process, so that #mdb_reader_check() cannot take a slot claimed
+ * under a reused pid for a dead process's one, and to use a slot
+ * past the end of the table.
+ * @param[in] env the environment handle
+ * @param[out] rp Address where the slot will be stored
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_reader_claim(MDB_env *env, MDB_reader **rp)
+{
+	MDB_txninfo *ti = env->me_txns;
+	MDB_PID_T pid = env->me_pid;
+	mdb_mutexref_t rmutex = env->me_rmutex;
+	MDB_reader *r;
+	txnid_t old;
+	unsigned int i, nr;
+	int rc;
+
+	if (MDB_RDR_ATOMIC && env->me_live_reader > 1) {
+		nr = env->me_close_readers;
+		for (i=0; i<nr; i++) {
+			r = &ti->mti_readers[i];
+			if (r->mr_pid == 0 && MDB_CAS_PID(&r->mr_pid, 0, pid))
+				goto claimed;
+		}
+	}
+
+	if (!env->me_live_reader) {
+		rc = mdb_reader_pid(env, Pidset, pid);
+		if (rc)
+			return rc;
+		env->me_live_reader = 1;
+	}
+
+	if (LOCK_MUTEX(rc, env, rmutex))
+		return rc;
+	nr = ti->mti_numreaders;
+	for (i=0; i<nr; i++) {
+		r = &ti->mti_readers[i];
+		if (r->mr_pid == 0 && MDB_CAS_PID(&r->mr_pid, 0, pid))
+			break;
+	}
+	if (i == nr) {
+		if (i == env->me_maxreaders) {
+			UNLOCK_MUTEX(rmutex);
+			return MDB_READERS_FULL;
+		}
+		r = &ti->mti_readers[i];
+		/* Claim the new reader slot, carefully since other code
+		 * uses the reader table un-mutexed: First reset the
+		 * slot, next publish it in mti_numreaders.  After
+		 * that, it is safe for mdb_env_close() to touch it.
+		 * When it will be closed, we can finally claim it.
+		 */
+		r->mr_pid = 0;
+		r->mr_txnid = (txnid_t)-1;
+		r->mr_tid = pthread_self();
+		ti->mti_numreaders = ++nr;
+		env->me_close_readers = nr;
+		r->mr_pid = pid;
+		UNLOCK_MUTEX(rmutex);
+		env->me_live_reader = 2;
+		*rp = r;
+		return MDB_SUCCESS;
+	}
+	if (env->me_close_readers < (int)nr)
+		env->me_close_readers = nr;
+	UNLOCK_MUTEX(rmutex);
+	env->me_live_reader = 2;
+
+claimed:
+	/* A slot freed by a thread that exited or a process that died
+	 * may still hold the txnid of its last read txn.
+	 */
+	old = r->mr_txnid;
+	r->mr_tid = pthread_self();
+	r->mr_txnid = (txnid_t)-1;
+	MDB_MEMBAR();
+	if (old <= ti->mti_oldest)
+		ti->mti_rdrefresh = 1;
+	*rp = r;
+	return MDB_SUCCESS;
+}
+
 /** Common code for #mdb_txn_begin() and #mdb_txn_renew().
  * @param[in] txn the transaction handle to initialize
  * @return 0 on success, non-zero on failure.
@@ -2619,7 +3077,7 @@ mdb_txn_renew0(MDB_txn *txn)
 	MDB_env *env = txn->mt_env;
 	MDB_txninfo *ti = env->me_txns;
 	MDB_meta *meta;
-	unsigned int i, nr, flags = txn->mt_flags;
+	unsigned int i, flags = txn->mt_flags;
 	uint16_t x;
 	int rc, new_notls = 0;
 
@@ -2635,42 +3093,8 @@ mdb_txn_renew0(MDB_txn *txn)
 				if (r->mr_pid != env->me_pid || r->mr_txnid != (txnid_t)-1)
 					return MDB_BAD_RSLOT;
 			} else {
-				MDB_PID_T pid = env->me_pid;
-				MDB_THR_T tid = pthread_self();
-				mdb_mutexref_t rmutex = env->me_rmutex;
-
-				if (!env->me_live_reader) {
-					rc = mdb_reader_pid(env, Pidset, pid);
-					if (rc)
-						return rc;
-					env->me_live_reader = 1;
-				}
-
-				if (LOCK_MUTEX(rc, env, rmutex))
+				if ((rc = mdb_reader_claim(env, &r)) != 0)
 					return rc;
-				nr = ti->mti_numreaders;
-				for (i=0; i<nr; i++)
-					if (ti->mti_readers[i].mr_pid == 0)
-						break;
-				if (i == env->me_maxreaders) {
-					UNLOCK_MUTEX(rmutex);
-					return MDB_READERS_FULL;
-				}
-				r = &ti->mti_readers[i];
-				/* Claim the reader slot, carefully since other code
-				 * uses the reader table un-mutexed: First reset the
-				 * slot, next publish it in mti_numreaders.  After
-				 * that, it is safe for mdb_env_close() to touch it.
-				 * When it will be closed, we can finally claim it.
-				 */
-				r->mr_pid = 0;
-				r->mr_txnid = (txnid_t)-1;
-				r->mr_tid = tid;
-				if (i == nr)
-					ti->mti_numreaders = ++nr;
-				env->me_close_readers = nr;
-				r->mr_pid = pid;
-				UNLOCK_MUTEX(rmutex);
 
 				new_notls = (env->me_flags & MDB_NOTLS);
 				if (!new_notls && (rc=pthread_setspecific(env->me_txkey, r))) {
@@ -2922,6 +3346,9 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 	/* Export or close DBI handles opened in this txn */
 	mdb_dbis_update(txn, mode & MDB_END_UPDATE);
 
+	if (txn->mt_zbufs)
+		mdb_zbufs_free(txn);
+
 	DPRINTF(("%s txn %"Z"u%c %p on mdbenv %p, root page %"Z"u",
 		names[mode & MDB_END_OPMASK],
 		txn->mt_txnid, (txn->mt_flags & MDB_TXN_RDONLY) ? 'r' : 'w',
@@ -2929,7 +3356,12 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 
 	if (F_ISSET(txn->mt_flags, MDB_TXN_RDONLY)) {
 		if (txn->mt_u.reader) {
+			MDB_txninfo *ti = env->me_txns;
 			txn->mt_u.reader->mr_txnid = (txnid_t)-1;
+			/* Let writers know if this may have been the oldest */
+			MDB_MEMBAR();
+			if (txn->mt_txnid <= ti->mti_oldest)
+				ti->mti_rdrefresh = 1;
 			if (!(env->me_flags & MDB_NOTLS)) {
 				txn->mt_u.reader = NULL; /* txn does not own reader */
 			} else if (mode & MDB_END_SLOT) {
@@ -2942,6 +3374,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 
 	} else if (!F_ISSET(txn->mt_flags, MDB_TXN_FINISHED)) {
 		pgno_t *pghead = env->me_pghead;
+		int i;
 
 		if (!(mode & MDB_END_UPDATE)) /* !(already closed cursors) */
 			mdb_cursors_close(txn, 0);
@@ -2958,6 +3391,10 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			/* me_pgstate: */
 			env->me_pghead = NULL;
 			env->me_pglast = 0;
+			for (i = 0; i < MDB_PGRUN_LISTS; i++)
+				if (env->me_pgruns[i])
+					env->me_pgruns[i][0] = 0;
+			env->me_flags |= MDB_ENV_PGRUNS;
 
 			env->me_txn = NULL;
 			mode = 0;	/* txn == env->me_txn0, do not free() it */
@@ -2969,6 +3406,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			txn->mt_parent->mt_child = NULL;
 			txn->mt_parent->mt_flags &= ~MDB_TXN_HAS_CHILD;
 			env->me_pgstate = ((MDB_ntxn *)txn)->mnt_pgstate;
+			env->me_flags &= ~MDB_ENV_PGRUNS;
 			mdb_midl_free(txn->mt_free_pgs);
 			mdb_midl_free(txn->mt_spill_pgs);
 			free(txn->mt_u.dirty_list);
@@ -3162,7 +3600,8 @@ mdb_freelist_save(MDB_txn *txn)
 			loose[ ++count ] = mp->mp_pgno;
 		loose[0] = count;
 		mdb_midl_sort(loose);
-		mdb_midl_xmerge(mop, loose);
+		if ((rc = mdb_pghead_merge(env, loose)) != 0)
+			return rc;
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
 		mop_len = mop[0];
@@ -3356,6 +3795,7 @@ mdb_txn_commit(MDB_txn *txn)
 	int		rc;
 	unsigned int i, end_mode;
 	MDB_env	*env;
+	pgno_t	last_pg;
 
 	if (txn == NULL)
 		return EINVAL;
@@ -3508,6 +3948,15 @@ mdb_txn_commit(MDB_txn *txn)
 		*lp = txn->mt_loose_pgs;
 		parent->mt_loose_count += txn->mt_loose_count;
 
+		/* Values read by the child stay valid until the parent ends */
+		if (txn->mt_zbufs) {
+			void **zp;
+			for (zp = txn->mt_zbufs; *zp; zp = *zp)
+				;
+			*zp = parent->mt_zbufs;
+			parent->mt_zbufs = txn->mt_zbufs;
+		}
+
 		parent->mt_child = NULL;
 		mdb_midl_free(((MDB_ntxn *)txn)->mnt_pgstate.mf_pghead);
 		free(txn);
@@ -3529,6 +3978,13 @@ mdb_txn_commit(MDB_txn *txn)
 	DPRINTF(("committing txn %"Z"u %p on mdbenv %p, root page %"Z"u",
 	    txn->mt_txnid, (void*)txn, (void*)env, txn->mt_dbs[MAIN_DBI].md_root));
 
+	if (env->me_flags & MDB_PAGESTATS) {
+		MDB_dbi i;
+		for (i = 0; i < txn->mt_numdbs; i++)
+			if (txn->mt_dbflags[i] & DB_DIRTY)
+				env->me_pgstats[i].ps_txns++;
+	}
+
 	/* Update DB root pointers */
 	if (txn->mt_numdbs > CORE_DBS) {
 		MDB_cursor mc;
@@ -3564,12 +4020,25 @@ mdb_txn_commit(MDB_txn *txn)
 	mdb_audit(txn);
 #endif
 
+	last_pg = mdb_env_pick_meta(env)->mm_last_pg;
 	if ((rc = mdb_page_flush(txn, 0)) ||
 		(rc = mdb_env_sync(env, 0)) ||
 		(rc = mdb_env_write_meta(txn)))
 		goto fail;
 	end_mode = MDB_END_COMMITTED|MDB_END_UPDATE;
 
+#ifndef _WIN32
+	/* Give back the end of the file that mdb_txn_compact() freed.
+	 * Nobody needs those pages, but if truncating fails they are
+	 * just left there.
+	 */
+	if (txn->mt_next_pgno <= last_pg && !(env->me_flags & MDB_WRITEMAP)) {
+		if (ftruncate(env->me_fd, (off_t)txn->mt_next_pgno * env->me_psize) < 0) {
+			DPRINTF(("ftruncate: %s", strerror(ErrCode())));
+		}
+	}
+#endif
+
 done:
 	mdb_txn_end(txn, end_mode);
 	return MDB_SUCCESS;
@@ -3631,7 +4100,9 @@ mdb_env_read_header(MDB_env *env, MDB_meta *meta)
 			return MDB_INVALID;
 		}
 
-		if (m->mm_version != MDB_DATA_VERSION) {
+		if (m->mm_version == MDB_DATA_VERSION_ZIP) {
+			env->me_flags |= MDB_ENV_ZIP;
+		} else if (m->mm_version != MDB_DATA_VERSION) {
 			DPRINTF(("database is version %u, expected version %u",
 				m->mm_version, MDB_DATA_VERSION));
 			return MDB_VERSION_MISMATCH;
@@ -3648,7 +4119,8 @@ static void ESECT
 mdb_env_init_meta0(MDB_env *env, MDB_meta *meta)
 {
 	meta->mm_magic = MDB_MAGIC;
-	meta->mm_version = MDB_DATA_VERSION;
+	meta->mm_version = (env->me_flags & MDB_ENV_ZIP) ?
+		MDB_DATA_VERSION_ZIP : MDB_DATA_VERSION;
 	meta->mm_mapsize = env->me_mapsize;
 	meta->mm_psize = env->me_psize;
 	meta->mm_last_pg = NUM_METAS-1;
@@ -3746,6 +4218,8 @@ mdb_env_write_meta(MDB_txn *txn)
 		mapsize = env->me_mapsize;
 
 	if (flags & MDB_WRITEMAP) {
+		if (flags & MDB_ENV_ZIP)
+			mp->mm_version = MDB_DATA_VERSION_ZIP;
 		mp->mm_mapsize = mapsize;
 		mp->mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
 		mp->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
@@ -3782,6 +4256,12 @@ mdb_env_write_meta(MDB_txn *txn)
 	meta.mm_txnid = txn->mt_txnid;
 
 	off = offsetof(MDB_meta, mm_mapsize);
+	if ((flags & MDB_ENV_ZIP) && mp->mm_version != MDB_DATA_VERSION_ZIP) {
+		/* First commit since a DB was compressed, mark the file */
+		meta.mm_version = MDB_DATA_VERSION_ZIP;
+		meta.mm_address = mp->mm_address;
+		off = offsetof(MDB_meta, mm_version);
+	}
 	ptr = (char *)&meta + off;
 	len = sizeof(MDB_meta) - off;
 	off += (char *)mp - env->me_map;
@@ -4002,6 +4482,16 @@ mdb_env_set_maxdbs(MDB_env *env, MDB_dbi dbs)
 	return MDB_SUCCESS;
 }
 
+int ESECT
+mdb_env_set_pagesize(MDB_env *env, unsigned int size)
+{
+	if (env->me_map || size < MIN_PAGESIZE || size > MAX_PAGESIZE ||
+		(size & (size - 1)))
+		return EINVAL;
+	env->me_psize = size;
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_set_maxreaders(MDB_env *env, unsigned int readers)
 {
@@ -4117,7 +4607,8 @@ mdb_env_open2(MDB_env *env)
 			return i;
 		DPUTS("new mdbenv");
 		newenv = 1;
-		env->me_psize = env->me_os_psize;
+		if (!env->me_psize)	/* not set by mdb_env_set_pagesize() */
+			env->me_psize = env->me_os_psize;
 		if (env->me_psize > MAX_PAGESIZE)
 			env->me_psize = MAX_PAGESIZE;
 		memset(&meta, 0, sizeof(meta));
@@ -4634,6 +5125,7 @@ mdb_env_setup_locks(MDB_env *env, char *lpath, int mode, int *excl)
 		env->me_txns->mti_format = MDB_LOCK_FORMAT;
 		env->me_txns->mti_txnid = 0;
 		env->me_txns->mti_numreaders = 0;
+		env->me_txns->mti_rdrefresh = 1;
 
 	} else {
 		if (env->me_txns->mti_magic != MDB_MAGIC) {
@@ -4681,7 +5173,8 @@ fail:
 	 *	at runtime. Changing other flags requires closing the
 	 *	environment and re-opening it with the new flags.
 	 */
-#define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
+#define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT| \
+	MDB_PAGESTATS)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY| \
 	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
 
@@ -4738,7 +5231,9 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 	env->me_dbxs = calloc(env->me_maxdbs, sizeof(MDB_dbx));
 	env->me_dbflags = calloc(env->me_maxdbs, sizeof(uint16_t));
 	env->me_dbiseqs = calloc(env->me_maxdbs, sizeof(unsigned int));
-	if (!(env->me_dbxs && env->me_path && env->me_dbflags && env->me_dbiseqs)) {
+	env->me_pgstats = calloc(env->me_maxdbs, sizeof(MDB_pagestat));
+	if (!(env->me_dbxs && env->me_path && env->me_dbflags && env->me_dbiseqs &&
+		env->me_pgstats)) {
 		rc = ENOMEM;
 		goto leave;
 	}
@@ -4862,12 +5357,17 @@ mdb_env_close0(MDB_env *env, int excl)
 	}
 
 	free(env->me_pbuf);
+	free(env->me_zbuf);
+	free(env->me_cpkey.mv_data);
+	free(env->me_pgstats);
 	free(env->me_dbiseqs);
 	free(env->me_dbflags);
 	free(env->me_path);
 	free(env->me_dirty_list);
 	free(env->me_txn0);
 	mdb_midl_free(env->me_free_pgs);
+	for (i = 0; i < MDB_PGRUN_LISTS; i++)
+		mdb_midl_free(env->me_pgruns[i]);
 
 	if (env->me_flags & MDB_ENV_TXKEY) {
 		pthread_key_delete(env->me_txkey);
@@ -4899,8 +5399,10 @@ mdb_env_close0(MDB_env *env, int excl)
 		 * our readers), and clear each reader atomically.
 		 */
 		for (i = env->me_close_readers; --i >= 0; )
-			if (env->me_txns->mti_readers[i].mr_pid == pid)
+			if (env->me_txns->mti_readers[i].mr_pid == pid) {
 				env->me_txns->mti_readers[i].mr_pid = 0;
+				env->me_txns->mti_rdrefresh = 1;
+			}
 #ifdef _WIN32
 		if (env->me_rmutex) {
 			CloseHandle(env->me_rmutex);
@@ -5271,6 +5773,7 @@ static int
 mdb_page_search_root(MDB_cursor *mc, MDB_val *key, int flags)
 {
 	MDB_page	*mp = mc->mc_pg[mc->mc_top];
+	MDB_pagestat	*ps = MC_PAGESTAT(mc);
 	int rc;
 	DKBUF;
 
@@ -5310,6 +5813,8 @@ mdb_page_search_root(MDB_cursor *mc, MDB_val *key, int flags)
 		mc->mc_ki[mc->mc_top] = i;
 		if ((rc = mdb_cursor_push(mc, mp)))
 			return rc;
+		if (ps)
+			PAGESTAT_LEVEL(ps, mc->mc_top);
 
 		if (flags & MDB_PS_MODIFY) {
 			if ((rc = mdb_page_touch(mc)) != 0)
@@ -5329,6 +5834,8 @@ mdb_page_search_root(MDB_cursor *mc, MDB_val *key, int flags)
 	    key ? DKEY(key) : "null"));
 	mc->mc_flags |= C_INITIALIZED;
 	mc->mc_flags &= ~C_EOF;
+	if (!(flags & MDB_PS_MODIFY))
+		mdb_cursor_readahead(mc);
 
 	return MDB_SUCCESS;
 }
@@ -5344,6 +5851,7 @@ mdb_page_search_lowest(MDB_cursor *mc)
 {
 	MDB_page	*mp = mc->mc_pg[mc->mc_top];
 	MDB_node	*node = NODEPTR(mp, 0);
+	MDB_pagestat	*ps;
 	int rc;
 
 	if ((rc = mdb_page_get(mc->mc_txn, NODEPGNO(node), &mp, NULL)) != 0)
@@ -5352,6 +5860,8 @@ mdb_page_search_lowest(MDB_cursor *mc)
 	mc->mc_ki[mc->mc_top] = 0;
 	if ((rc = mdb_cursor_push(mc, mp)))
 		return rc;
+	if ((ps = MC_PAGESTAT(mc)) != NULL)
+		PAGESTAT_LEVEL(ps, mc->mc_top);
 	return mdb_page_search_root(mc, NULL, MDB_PS_FIRST);
 }
 
@@ -5369,6 +5879,7 @@ mdb_page_search_lowest(MDB_cursor *mc)
 static int
 mdb_page_search(MDB_cursor *mc, MDB_val *key, int flags)
 {
+	MDB_pagestat	*ps;
 	int		 rc;
 	pgno_t		 root;
 
@@ -5398,7 +5909,7 @@ mdb_page_search(MDB_cursor *mc, MDB_val *key, int flags)
 						return MDB_NOTFOUND;
 					if ((leaf->mn_flags & (F_DUPDATA|F_SUBDATA)) != F_SUBDATA)
 						return MDB_INCOMPATIBLE; /* not a named DB */
-					rc = mdb_node_read(mc->mc_txn, leaf, &data);
+					rc = mdb_node_read(&mc2, leaf, &data);
 					if (rc)
 						return rc;
 					memcpy(&flags, ((char *) data.mv_data + offsetof(MDB_db, md_flags)),
@@ -5427,6 +5938,10 @@ mdb_page_search(MDB_cursor *mc, MDB_val *key, int flags)
 
 	mc->mc_snum = 1;
 	mc->mc_top = 0;
+	if ((ps = MC_PAGESTAT(mc)) != NULL) {
+		ps->ps_seek++;
+		ps->ps_level[0]++;
+	}
 
 	DPRINTF(("db %d root page %"Z"u has flags 0x%X",
 		DDBI(mc), root, mc->mc_pg[0]->mp_flags));
@@ -5509,6 +6024,9 @@ release:
 		while (j>i)
 			mop[j--] = pg++;
 		mop[0] += ovpages;
+		i += ovpages;
+		if ((rc = mdb_pgrun_index(env, &i)) != 0)
+			return rc;
 	} else {
 		rc = mdb_midl_append_range(&txn->mt_free_pgs, pg, ovpages);
 		if (rc)
@@ -5524,44 +6042,257 @@ release:
  * @param[out] data Updated to point to the node's data.
  * @return 0 on success, non-zero on failure.
  */
-static int
-mdb_node_read(MDB_txn *txn, MDB_node *leaf, MDB_val *data)
+/** @defgroup compression Value Compression
+ *	@ingroup internal
+ *	Values of #MDB_COMPRESS databases that would need overflow pages
+ *	are stored as their size, an unsigned int, followed by LZ77 data
+ *	in the LZF format: a control byte below 32 starts a run of that
+ *	many plus one literal bytes. Otherwise its top 3 bits are the
+ *	length of a match minus 2 (7 meaning a length byte follows) and
+ *	its low 5 bits, with the next byte, the match offset minus 1.
+ *	@{
+ */
+#define MDB_ZHLOG	12			/**< log2 of the compressor's hash table size */
+#define MDB_ZHSIZE	(1 << MDB_ZHLOG)
+#define MDB_ZMAXLIT	32			/**< longest literal run */
+#define MDB_ZMAXOFF	8192		/**< farthest match */
+#define MDB_ZMAXREF	(2 + 7 + 255)	/**< longest match */
+/** @} */
+
+/** Compress a buffer.
+ * @param[in] htab Scratch space for #MDB_ZHSIZE pointers.
+ * @return the compressed size, or 0 if it doesn't fit in outlen bytes.
+ */
+static size_t
+mdb_lz_compress(const unsigned char **htab, const unsigned char *in, size_t inlen,
+	unsigned char *out, size_t outlen)
 {
-	MDB_page	*omp;		/* overflow page */
-	pgno_t		 pgno;
-	int rc;
+	const unsigned char *ip = in, *in_end = in + inlen, *ref;
+	unsigned char *op = out, *out_end = out + outlen, *lp;
+	unsigned int h, lit = 0;
+	size_t off, len, max;
 
-	if (!F_ISSET(leaf->mn_flags, F_BIGDATA)) {
-		data->mv_size = NODEDSZ(leaf);
-		data->mv_data = NODEDATA(leaf);
-		return MDB_SUCCESS;
+	memset(htab, 0, MDB_ZHSIZE * sizeof(*htab));
+	if (op >= out_end)
+		return 0;
+	lp = op++;		/* length byte of the current literal run */
+	while (ip < in_end) {
+		if (ip + 2 < in_end) {
+			h = ((unsigned int)(ip[0] << 16 | ip[1] << 8 | ip[2]) * 2654435761U)
+				>> (32 - MDB_ZHLOG);
+			ref = htab[h];
+			htab[h] = ip;
+			if (ref && (off = ip - ref - 1) < MDB_ZMAXOFF &&
+				ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+				max = in_end - ip;
+				if (max > MDB_ZMAXREF)
+					max = MDB_ZMAXREF;
+				for (len = 3; len < max && ref[len] == ip[len]; len++)
+					;
+				/* close the literal run, or take back its length byte */
+				if (lit) {
+					*lp = lit - 1;
+					lit = 0;
+				} else {
+					op--;
+				}
+				if (op + 4 > out_end)
+					return 0;
+				ip += len;
+				len -= 2;
+				if (len < 7) {
+					*op++ = len << 5 | off >> 8;
+				} else {
+					*op++ = 7 << 5 | off >> 8;
+					*op++ = len - 7;
+				}
+				*op++ = off;
+				lp = op++;
+				continue;
+			}
+		}
+		if (op >= out_end)
+			return 0;
+		*op++ = *ip++;
+		if (++lit == MDB_ZMAXLIT) {
+			*lp = lit - 1;
+			lit = 0;
+			if (op >= out_end)
+				return 0;
+			lp = op++;
+		}
 	}
+	if (lit)
+		*lp = lit - 1;
+	else
+		op--;
+	return op - out;
+}
 
-	/* Read overflow data.
-	 */
-	data->mv_size = NODEDSZ(leaf);
-	memcpy(&pgno, NODEDATA(leaf), sizeof(pgno));
-	if ((rc = mdb_page_get(txn, pgno, &omp, NULL)) != 0) {
-		DPRINTF(("read overflow page %"Z"u failed", pgno));
-		return rc;
+/** Decompress a buffer into exactly outlen bytes. */
+static int
+mdb_lz_decompress(const unsigned char *in, size_t inlen,
+	unsigned char *out, size_t outlen)
+{
+	const unsigned char *ip = in, *in_end = in + inlen, *ref;
+	unsigned char *op = out, *out_end = out + outlen;
+	unsigned int ctrl;
+	size_t off, len;
+
+	while (ip < in_end) {
+		ctrl = *ip++;
+		if (ctrl < MDB_ZMAXLIT) {
+			len = ctrl + 1;
+			if (len > (size_t)(in_end - ip) || len > (size_t)(out_end - op))
+				return MDB_CORRUPTED;
+			memcpy(op, ip, len);
+			ip += len;
+			op += len;
+		} else {
+			len = ctrl >> 5;
+			if (len == 7) {
+				if (ip >= in_end)
+					return MDB_CORRUPTED;
+				len += *ip++;
+			}
+			if (ip >= in_end)
+				return MDB_CORRUPTED;
+			off = ((ctrl & 0x1f) << 8 | *ip++) + 1;
+			len += 2;
+			if (off > (size_t)(op - out) || len > (size_t)(out_end - op))
+				return MDB_CORRUPTED;
+			/* byte by byte, the match may overlap its copy */
+			for (ref = op - off; len; len--)
+				*op++ = *ref++;
+		}
 	}
-	data->mv_data = METADATA(omp);
+	return op == out_end ? MDB_SUCCESS : MDB_CORRUPTED;
+}
 
-	return MDB_SUCCESS;
+/** Compress a value being put into an #MDB_COMPRESS database.
+ * The result is built in the environment's scratch area, which is
+ * only used by the current write transaction.
+ * @param[in] env The environment.
+ * @param[in] data The value.
+ * @param[out] zdata The compressed value.
+ * @return 1 if the value was compressed, 0 if it should be stored as is.
+ */
+static int
+mdb_val_zip(MDB_env *env, MDB_val *data, MDB_val *zdata)
+{
+	unsigned int size = data->mv_size;
+	size_t max, need, len;
+	unsigned char *out;
+
+	/* Only worth it if it saves at least an eighth */
+	max = data->mv_size - (data->mv_size >> 3);
+	need = MDB_ZHSIZE * sizeof(void *) + max;
+	if (env->me_zsize < need) {
+		void *p = realloc(env->me_zbuf, need);
+		if (!p)
+			return 0;
+		env->me_zbuf = p;
+		env->me_zsize = need;
+	}
+	out = (unsigned char *)env->me_zbuf + MDB_ZHSIZE * sizeof(void *);
+	len = mdb_lz_compress(env->me_zbuf, data->mv_data, data->mv_size,
+		out + sizeof(size), max - sizeof(size));
+	if (!len)
+		return 0;
+	memcpy(out, &size, sizeof(size));
+	zdata->mv_size = sizeof(size) + len;
+	zdata->mv_data = out;
+	return 1;
 }
 
-int
-mdb_get(MDB_txn *txn, MDB_dbi dbi,
-    MDB_val *key, MDB_val *data)
+/** Decompress a value read from an #MDB_COMPRESS database into a
+ * buffer that lives as long as the transaction.
+ * @param[in] txn The transaction.
+ * @param[in,out] data The stored value, updated to the original one.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_val_unzip(MDB_txn *txn, MDB_val *data)
 {
-	MDB_cursor	mc;
-	MDB_xcursor	mx;
-	int exact = 0;
-	DKBUF;
+	unsigned int size;
+	void **buf;
+	int rc;
 
-	DPRINTF(("===> get db %u key [%s]", dbi, DKEY(key)));
+	if (data->mv_size < sizeof(size))
+		return MDB_CORRUPTED;
+	memcpy(&size, data->mv_data, sizeof(size));
+	if ((buf = malloc(sizeof(void *) + size)) == NULL)
+		return ENOMEM;
+	rc = mdb_lz_decompress((unsigned char *)data->mv_data + sizeof(size),
+		data->mv_size - sizeof(size), (unsigned char *)(buf + 1), size);
+	if (rc) {
+		free(buf);
+		return rc;
+	}
+	*buf = txn->mt_zbufs;
+	txn->mt_zbufs = buf;
+	data->mv_size = size;
+	data->mv_data = buf + 1;
+	return MDB_SUCCESS;
+}
 
-	if (!key || !data || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+/** Free the values decompressed in a transaction */
+static void
+mdb_zbufs_free(MDB_txn *txn)
+{
+	void **buf, **next;
+
+	for (buf = txn->mt_zbufs; buf; buf = next) {
+		next = *buf;
+		free(buf);
+	}
+	txn->mt_zbufs = NULL;
+}
+
+static int
+mdb_node_read(MDB_cursor *mc, MDB_node *leaf, MDB_val *data)
+{
+	MDB_txn		*txn = mc->mc_txn;
+	MDB_page	*omp;		/* overflow page */
+	MDB_pagestat	*ps;
+	pgno_t		 pgno;
+	int rc;
+
+	if (!F_ISSET(leaf->mn_flags, F_BIGDATA)) {
+		data->mv_size = NODEDSZ(leaf);
+		data->mv_data = NODEDATA(leaf);
+	} else {
+		/* Read overflow data.
+		 */
+		data->mv_size = NODEDSZ(leaf);
+		memcpy(&pgno, NODEDATA(leaf), sizeof(pgno));
+		if ((rc = mdb_page_get(txn, pgno, &omp, NULL)) != 0) {
+			DPRINTF(("read overflow page %"Z"u failed", pgno));
+			return rc;
+		}
+		if ((ps = MC_PAGESTAT(mc)) != NULL)
+			ps->ps_overflow += omp->mp_pages;
+		data->mv_data = METADATA(omp);
+	}
+
+	if (leaf->mn_flags & F_COMPRESSED)
+		return mdb_val_unzip(txn, data);
+
+	return MDB_SUCCESS;
+}
+
+int
+mdb_get(MDB_txn *txn, MDB_dbi dbi,
+    MDB_val *key, MDB_val *data)
+{
+	MDB_cursor	mc;
+	MDB_xcursor	mx;
+	int exact = 0;
+	DKBUF;
+
+	DPRINTF(("===> get db %u key [%s]", dbi, DKEY(key)));
+
+	if (!key || !data || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
 		return EINVAL;
 
 	if (txn->mt_flags & MDB_TXN_BLOCKED)
@@ -5585,6 +6316,7 @@ mdb_cursor_sibling(MDB_cursor *mc, int move_right)
 	int		 rc;
 	MDB_node	*indx;
 	MDB_page	*mp;
+	MDB_pagestat	*ps;
 
 	if (mc->mc_snum < 2) {
 		return MDB_NOTFOUND;		/* root has no siblings */
@@ -5624,6 +6356,12 @@ mdb_cursor_sibling(MDB_cursor *mc, int move_right)
 	mdb_cursor_push(mc, mp);
 	if (!move_right)
 		mc->mc_ki[mc->mc_top] = NUMKEYS(mp)-1;
+	else if (IS_LEAF(mp))
+		mdb_cursor_readahead(mc);
+	if ((ps = MC_PAGESTAT(mc)) != NULL) {
+		ps->ps_step++;
+		PAGESTAT_LEVEL(ps, mc->mc_top);
+	}
 
 	return MDB_SUCCESS;
 }
@@ -5695,7 +6433,7 @@ skip:
 		mdb_xcursor_init1(mc, leaf);
 	}
 	if (data) {
-		if ((rc = mdb_node_read(mc->mc_txn, leaf, data)) != MDB_SUCCESS)
+		if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
 			return rc;
 
 		if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
@@ -5773,7 +6511,7 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 		mdb_xcursor_init1(mc, leaf);
 	}
 	if (data) {
-		if ((rc = mdb_node_read(mc->mc_txn, leaf, data)) != MDB_SUCCESS)
+		if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
 			return rc;
 
 		if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
@@ -5955,7 +6693,7 @@ set1:
 		} else if (op == MDB_GET_BOTH || op == MDB_GET_BOTH_RANGE) {
 			MDB_val olddata;
 			MDB_cmp_func *dcmp;
-			if ((rc = mdb_node_read(mc->mc_txn, leaf, &olddata)) != MDB_SUCCESS)
+			if ((rc = mdb_node_read(mc, leaf, &olddata)) != MDB_SUCCESS)
 				return rc;
 			dcmp = mc->mc_dbx->md_dcmp;
 #if UINT_MAX < SIZE_MAX
@@ -5973,7 +6711,7 @@ set1:
 		} else {
 			if (mc->mc_xcursor)
 				mc->mc_xcursor->mx_cursor.mc_flags &= ~(C_INITIALIZED|C_EOF);
-			if ((rc = mdb_node_read(mc->mc_txn, leaf, data)) != MDB_SUCCESS)
+			if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
 				return rc;
 		}
 	}
@@ -6022,7 +6760,7 @@ mdb_cursor_first(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 			if (rc)
 				return rc;
 		} else {
-			if ((rc = mdb_node_read(mc->mc_txn, leaf, data)) != MDB_SUCCESS)
+			if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
 				return rc;
 		}
 	}
@@ -6067,7 +6805,7 @@ mdb_cursor_last(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 			if (rc)
 				return rc;
 		} else {
-			if ((rc = mdb_node_read(mc->mc_txn, leaf, data)) != MDB_SUCCESS)
+			if ((rc = mdb_node_read(mc, leaf, data)) != MDB_SUCCESS)
 				return rc;
 		}
 	}
@@ -6113,7 +6851,7 @@ mdb_cursor_get(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 					if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
 						rc = mdb_cursor_get(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_GET_CURRENT);
 					} else {
-						rc = mdb_node_read(mc->mc_txn, leaf, data);
+						rc = mdb_node_read(mc, leaf, data);
 					}
 				}
 			}
@@ -6219,7 +6957,7 @@ fetchm:
 			MDB_node *leaf = NODEPTR(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top]);
 			if (!F_ISSET(leaf->mn_flags, F_DUPDATA)) {
 				MDB_GET_KEY(leaf, key);
-				rc = mdb_node_read(mc->mc_txn, leaf, data);
+				rc = mdb_node_read(mc, leaf, data);
 				break;
 			}
 		}
@@ -6247,6 +6985,266 @@ fetchm:
 	return rc;
 }
 
+/** Tell the OS that some pages of the map will be read soon.
+ * @param[in] env The environment.
+ * @param[in] pgno The first page.
+ * @param[in] num The number of pages.
+ */
+static void
+mdb_page_willneed(MDB_env *env, pgno_t pgno, pgno_t num)
+{
+#if defined(MADV_WILLNEED) || defined(POSIX_MADV_WILLNEED)
+	size_t off = (size_t)pgno * env->me_psize;
+	size_t len = (size_t)num * env->me_psize;
+	size_t adj = off & (env->me_os_psize - 1);
+
+	if (off + len > env->me_mapsize)
+		return;
+	off -= adj;
+	len += adj;
+#ifdef MADV_WILLNEED
+	madvise(env->me_map + off, len, MADV_WILLNEED);
+#else
+	posix_madvise(env->me_map + off, len, POSIX_MADV_WILLNEED);
+#endif
+#endif
+}
+
+/** How many leaf pages ahead #MDB_RDAHEAD_SEQUENTIAL asks for */
+#define MDB_RDAHEAD_PAGES	16
+/** How many leaf pages ahead it asks for the overflow pages of */
+#define MDB_RDAHEAD_OVPAGES	4
+
+/** Ask for the pages a cursor reading in order will need next.
+ * Called when the cursor has reached a leaf page. It reads in order
+ * if this leaf follows the last one it reached under the same branch
+ * page, or is the first one under the next branch page. Then the next
+ * #MDB_RDAHEAD_PAGES leaves under the branch page are asked for, once
+ * half of the ones asked for before have been reached. The overflow
+ * pages of the leaves up to #MDB_RDAHEAD_OVPAGES ahead are asked for
+ * too; those leaves were asked for a while ago, so looking at their
+ * nodes should seldom wait for the disk.
+ * @param[in] mc The cursor, on a leaf page.
+ */
+static void
+mdb_cursor_readahead(MDB_cursor *mc)
+{
+	MDB_env *env = mc->mc_txn->mt_env;
+	MDB_page *mp, *lp;
+	MDB_node *node;
+	pgno_t pgno, first = 0, num = 0;
+	unsigned int i, j, end, nkeys;
+	indx_t idx;
+
+	if ((mc->mc_rdahead ? mc->mc_rdahead : mc->mc_dbx->md_rdahead)
+		!= MDB_RDAHEAD_SEQUENTIAL || !mc->mc_top)
+		return;
+
+	mp = mc->mc_pg[mc->mc_top-1];
+	idx = mc->mc_ki[mc->mc_top-1];
+	if (mp->mp_pgno == mc->mc_rdparent) {
+		if (idx == mc->mc_rdidx)	/* same leaf again */
+			return;
+		mc->mc_rdrun = idx == mc->mc_rdidx + 1;
+	} else {
+		mc->mc_rdparent = mp->mp_pgno;
+		mc->mc_rdrun = mc->mc_rdrun && !idx;
+		mc->mc_rdend = mc->mc_rdov = idx;
+	}
+	mc->mc_rdidx = idx;
+	if (!mc->mc_rdrun) {
+		mc->mc_rdend = mc->mc_rdov = idx;
+		return;
+	}
+
+	/* Pages in a row are asked for with one call */
+#define RDAHEAD_ADD(pg, n)	do { \
+	if (num && (pg) == first + num) { \
+		num += (n); \
+	} else { \
+		if (num) \
+			mdb_page_willneed(env, first, num); \
+		first = (pg); \
+		num = (n); \
+	} } while (0)
+
+	nkeys = NUMKEYS(mp);
+	if (idx + MDB_RDAHEAD_PAGES/2 >= mc->mc_rdend) {
+		end = idx + MDB_RDAHEAD_PAGES;
+		if (end >= nkeys)
+			end = nkeys - 1;
+		for (i = mc->mc_rdend + 1; i <= end; i++)
+			RDAHEAD_ADD(NODEPGNO(NODEPTR(mp, i)), 1);
+		mc->mc_rdend = end;
+	}
+
+	end = idx + MDB_RDAHEAD_OVPAGES;
+	if (end >= nkeys)
+		end = nkeys - 1;
+	for (j = mc->mc_rdov; j <= end; j++) {
+		if (j == idx)
+			lp = mc->mc_pg[mc->mc_top];
+		else if (mdb_page_get(mc->mc_txn, NODEPGNO(NODEPTR(mp, j)), &lp, NULL))
+			break;
+		if (!IS_LEAF(lp) || IS_LEAF2(lp))
+			continue;
+		for (i = 0; i < NUMKEYS(lp); i++) {
+			node = NODEPTR(lp, i);
+			if (!F_ISSET(node->mn_flags, F_BIGDATA))
+				continue;
+			memcpy(&pgno, NODEDATA(node), sizeof(pgno));
+			RDAHEAD_ADD(pgno, OVPAGES(NODEDSZ(node), env->me_psize));
+		}
+	}
+	mc->mc_rdov = j;
+	if (num)
+		mdb_page_willneed(env, first, num);
+#undef RDAHEAD_ADD
+}
+
+/** How many of the following keys to look ahead at for prefetching */
+#define MDB_BATCH_AHEAD	8
+
+/** Prefetch the children of the branch page above the leaf that
+ * the next keys of a batch will descend into.
+ * Only done with #MDB_NORDAHEAD. Otherwise the kernel's readahead
+ * already brings in the neighbourhood of each fault, and the hints
+ * would mostly be system calls for pages that are already resident.
+ * @param[in] mc The cursor, on a leaf page.
+ * @param[in] keys The following keys, in ascending order.
+ * @param[in] count The number of keys.
+ */
+static void
+mdb_cursor_prefetch(MDB_cursor *mc, MDB_val *keys, unsigned int count)
+{
+	MDB_page *mp;
+	MDB_node *node;
+	MDB_val nodekey;
+	unsigned int i, idx, nkeys, last;
+
+	if (!mc->mc_top || !(mc->mc_txn->mt_env->me_flags & MDB_NORDAHEAD))
+		return;
+	mp = mc->mc_pg[mc->mc_top-1];
+	nkeys = NUMKEYS(mp);
+	idx = last = mc->mc_ki[mc->mc_top-1];
+	if (count > MDB_BATCH_AHEAD)
+		count = MDB_BATCH_AHEAD;
+	for (i = 0; i < count; i++) {
+		while (idx+1 < nkeys) {
+			node = NODEPTR(mp, idx+1);
+			MDB_GET_KEY2(node, nodekey);
+			if (mc->mc_dbx->md_cmp(&keys[i], &nodekey) < 0)
+				break;
+			idx++;
+		}
+		if (idx != last) {
+			mdb_page_willneed(mc->mc_txn->mt_env,
+				NODEPGNO(NODEPTR(mp, idx)), 1);
+			last = idx;
+		}
+	}
+}
+
+int
+mdb_cursor_get_batch(MDB_cursor *mc, MDB_val *keys, MDB_val *data,
+	unsigned int count)
+{
+	MDB_page *mp;
+	MDB_node *node;
+	MDB_val nodekey;
+	unsigned int i, l;
+	int rc, exact, reuse;
+
+	if (mc == NULL || keys == NULL || data == NULL)
+		return EINVAL;
+
+	if (mc->mc_txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	if (mc->mc_flags & C_SUB)
+		return MDB_INCOMPATIBLE;
+
+	for (i = 0; i < count; i++) {
+		data[i].mv_size = 0;
+		data[i].mv_data = NULL;
+		if (keys[i].mv_size == 0)
+			return MDB_BAD_VALSIZE;
+		if (mc->mc_xcursor)
+			mc->mc_xcursor->mx_cursor.mc_flags &= ~(C_INITIALIZED|C_EOF);
+
+		reuse = 0;
+		if (mc->mc_flags & C_INITIALIZED) {
+			mp = mc->mc_pg[mc->mc_top];
+			if (i) {
+				reuse = 1;
+			} else if (NUMKEYS(mp)) {
+				/* Start from where the cursor is if the key is
+				 * not before its page.
+				 */
+				node = NODEPTR(mp, 0);
+				MDB_GET_KEY2(node, nodekey);
+				reuse = mc->mc_dbx->md_cmp(&keys[0], &nodekey) >= 0;
+			}
+		}
+		if (!reuse) {
+			rc = mdb_page_search(mc, &keys[i], 0);
+			if (rc == MDB_NOTFOUND)
+				return MDB_SUCCESS;	/* empty DB */
+			if (rc)
+				return rc;
+			if (i+1 < count)
+				mdb_cursor_prefetch(mc, &keys[i+1], count-i-1);
+		} else {
+			/* An earlier key got us here, and this one is not
+			 * smaller. Find the highest branch whose next separator
+			 * this key reaches, and only search again below it.
+			 */
+			for (l = 0; l < mc->mc_top; l++) {
+				mp = mc->mc_pg[l];
+				if (mc->mc_ki[l]+1u >= NUMKEYS(mp))
+					continue;
+				node = NODEPTR(mp, mc->mc_ki[l]+1);
+				MDB_GET_KEY2(node, nodekey);
+				if (mc->mc_dbx->md_cmp(&keys[i], &nodekey) >= 0)
+					break;
+			}
+			if (l < mc->mc_top) {
+				mc->mc_snum = l+1;
+				mc->mc_top = l;
+				if ((rc = mdb_page_search_root(mc, &keys[i], 0)) != 0)
+					return rc;
+				if (i+1 < count)
+					mdb_cursor_prefetch(mc, &keys[i+1], count-i-1);
+			}
+		}
+
+		mc->mc_flags |= C_INITIALIZED;
+		mc->mc_flags &= ~C_EOF;
+		exact = 0;
+		node = mdb_node_search(mc, &keys[i], &exact);
+		if (!node || !exact)
+			continue;
+
+		if (F_ISSET(node->mn_flags, F_DUPDATA)) {
+			mdb_xcursor_init1(mc, node);
+			rc = mdb_cursor_first(&mc->mc_xcursor->mx_cursor, &data[i], NULL);
+		} else {
+			if (F_ISSET(node->mn_flags, F_BIGDATA) &&
+				(mc->mc_txn->mt_env->me_flags & MDB_NORDAHEAD)) {
+				pgno_t pgno;
+				memcpy(&pgno, NODEDATA(node), sizeof(pgno));
+				mdb_page_willneed(mc->mc_txn->mt_env, pgno,
+					OVPAGES(NODEDSZ(node), mc->mc_txn->mt_env->me_psize));
+			}
+			rc = mdb_node_read(mc, node, &data[i]);
+		}
+		if (rc)
+			return rc;
+	}
+
+	return MDB_SUCCESS;
+}
+
 /** Touch all the pages in the cursor stack. Set mc_top.
  *	Makes sure all the pages are writable, before attempting a write operation.
  * @param[in] mc The cursor to operate on.
@@ -6288,9 +7286,9 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	MDB_node	*leaf = NULL;
 	MDB_page	*fp, *mp, *sub_root = NULL;
 	uint16_t	fp_flags;
-	MDB_val		xdata, *rdata, dkey, olddata;
+	MDB_val		xdata, *rdata, dkey, olddata, zdata;
 	MDB_db dummy;
-	int do_sub = 0, insert_key, insert_data;
+	int do_sub = 0, insert_key, insert_data, zip;
 	unsigned int mcount = 0, dcount = 0, nospill;
 	size_t nsize;
 	int rc, rc2;
@@ -6333,6 +7331,8 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 		DDBI(mc), DKEY(key), key ? key->mv_size : 0, data->mv_size));
 
 	dkey.mv_size = 0;
+	zip = (mc->mc_db->md_flags & (MDB_COMPRESS|MDB_DUPSORT)) == MDB_COMPRESS &&
+		!(flags & (MDB_RESERVE|MDB_MULTIPLE));
 
 	if (flags == MDB_CURRENT) {
 		if (!(mc->mc_flags & C_INITIALIZED))
@@ -6349,7 +7349,8 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 		MDB_val d2;
 		if (flags & MDB_APPEND) {
 			MDB_val k2;
-			rc = mdb_cursor_last(mc, &k2, &d2);
+			/* Only the key is compared, don't read the data */
+			rc = mdb_cursor_last(mc, &k2, NULL);
 			if (rc == 0) {
 				rc = mc->mc_dbx->md_cmp(key, &k2);
 				if (rc > 0) {
@@ -6361,7 +7362,9 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				}
 			}
 		} else {
-			rc = mdb_cursor_set(mc, key, &d2, MDB_SET, &exact);
+			/* Don't decompress an old value only to overwrite it */
+			rc = mdb_cursor_set(mc, key,
+				zip && !(flags & MDB_NOOVERWRITE) ? NULL : &d2, MDB_SET, &exact);
 		}
 		if ((flags & MDB_NOOVERWRITE) && rc == 0) {
 			DPRINTF(("duplicate key [%s]", DKEY(key)));
@@ -6375,6 +7378,13 @@ mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	if (mc->mc_flags & C_DEL)
 		mc->mc_flags ^= C_DEL;
 
+	/* Values that would need overflow pages are compressed if that helps */
+	if (zip && LEAFSIZE(key, data) > env->me_nodemax &&
+		mdb_val_zip(env, data, &zdata)) {
+		data = &zdata;
+		flags |= F_COMPRESSED;
+	}
+
 	/* Cursor is positioned, check for room in the dirty list */
 	if (!nospill) {
 		if (flags & MDB_MULTIPLE) {
@@ -6648,6 +7658,8 @@ current:
 					omp = np;
 				}
 				SETDSZ(leaf, data->mv_size);
+				leaf->mn_flags = (leaf->mn_flags & ~F_COMPRESSED) |
+					(flags & F_COMPRESSED);
 				if (F_ISSET(flags, MDB_RESERVE))
 					data->mv_data = METADATA(omp);
 				else
@@ -6662,6 +7674,8 @@ current:
 			 * also reuse this node if the new data is smaller,
 			 * but instead we opt to shrink the node in that case.
 			 */
+			leaf->mn_flags = (leaf->mn_flags & ~F_COMPRESSED) |
+				(flags & F_COMPRESSED);
 			if (F_ISSET(flags, MDB_RESERVE))
 				data->mv_data = olddata.mv_data;
 			else if (!(mc->mc_flags & C_SUB))
@@ -6929,6 +7943,7 @@ static int
 mdb_page_new(MDB_cursor *mc, uint32_t flags, int num, MDB_page **mp)
 {
 	MDB_page	*np;
+	MDB_pagestat	*ps;
 	int rc;
 
 	if ((rc = mdb_page_alloc(mc, num, &np)))
@@ -6947,6 +7962,8 @@ mdb_page_new(MDB_cursor *mc, uint32_t flags, int num, MDB_page **mp)
 		mc->mc_db->md_overflow_pages += num;
 		np->mp_pages = num;
 	}
+	if ((ps = MC_PAGESTAT(mc)) != NULL)
+		ps->ps_dirty += num;
 	*mp = np;
 
 	return 0;
@@ -7264,6 +8281,7 @@ mdb_xcursor_init0(MDB_cursor *mc)
 	mx->mx_cursor.mc_snum = 0;
 	mx->mx_cursor.mc_top = 0;
 	mx->mx_cursor.mc_flags = C_SUB;
+	mx->mx_cursor.mc_rdahead = MDB_RDAHEAD_RANDOM;
 	mx->mx_dbx.md_name.mv_size = 0;
 	mx->mx_dbx.md_name.mv_data = NULL;
 	mx->mx_dbx.md_cmp = mc->mc_dbx->md_dcmp;
@@ -7367,6 +8385,9 @@ mdb_cursor_init(MDB_cursor *mc, MDB_txn *txn, MDB_dbi dbi, MDB_xcursor *mx)
 	mc->mc_pg[0] = 0;
 	mc->mc_ki[0] = 0;
 	mc->mc_flags = 0;
+	mc->mc_rdahead = MDB_RDAHEAD_DEFAULT;
+	mc->mc_rdparent = P_INVALID;
+	mc->mc_rdrun = 0;
 	if (txn->mt_dbs[dbi].md_flags & MDB_DUPSORT) {
 		mdb_tassert(txn, mx != NULL);
 		mc->mc_xcursor = mx;
@@ -7416,6 +8437,8 @@ mdb_cursor_open(MDB_txn *txn, MDB_dbi dbi, MDB_cursor **ret)
 int
 mdb_cursor_renew(MDB_txn *txn, MDB_cursor *mc)
 {
+	unsigned int policy;
+
 	if (!mc || !TXN_DBI_EXIST(txn, mc->mc_dbi, DB_VALID))
 		return EINVAL;
 
@@ -7425,7 +8448,21 @@ mdb_cursor_renew(MDB_txn *txn, MDB_cursor *mc)
 	if (txn->mt_flags & MDB_TXN_BLOCKED)
 		return MDB_BAD_TXN;
 
+	policy = mc->mc_rdahead;
 	mdb_cursor_init(mc, txn, mc->mc_dbi, mc->mc_xcursor);
+	mc->mc_rdahead = policy;
+	return MDB_SUCCESS;
+}
+
+int
+mdb_cursor_set_readahead(MDB_cursor *mc, unsigned int policy)
+{
+	if (!mc || (mc->mc_flags & C_SUB) || policy > MDB_RDAHEAD_SEQUENTIAL)
+		return EINVAL;
+
+	mc->mc_rdahead = policy;
+	mc->mc_rdparent = P_INVALID;
+	mc->mc_rdrun = 0;
 	return MDB_SUCCESS;
 }
 
@@ -7980,6 +9017,7 @@ mdb_cursor_copy(const MDB_cursor *csrc, MDB_cursor *cdst)
 	cdst->mc_snum = csrc->mc_snum;
 	cdst->mc_top = csrc->mc_top;
 	cdst->mc_flags = csrc->mc_flags;
+	cdst->mc_rdahead = MDB_RDAHEAD_RANDOM;
 
 	for (i=0; i<csrc->mc_snum; i++) {
 		cdst->mc_pg[i] = csrc->mc_pg[i];
@@ -8892,6 +9930,8 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 	mc.mc_snum = 1;
 	mc.mc_top = 0;
 	mc.mc_txn = txn;
+	mc.mc_dbi = MAIN_DBI;	/* for #MDB_PAGESTATS */
+	mc.mc_rdahead = MDB_RDAHEAD_RANDOM;
 
 	rc = mdb_page_get(my->mc_txn, *pg, &mc.mc_pg[0], NULL);
 	if (rc)
@@ -9434,6 +10474,17 @@ mdb_env_stat(MDB_env *env, MDB_stat *arg)
 	return mdb_stat0(env, &meta->mm_dbs[MAIN_DBI], arg);
 }
 
+int ESECT
+mdb_env_pagestat(MDB_env *env, MDB_dbi dbi, MDB_pagestat *arg)
+{
+	if (env == NULL || arg == NULL || dbi >= env->me_maxdbs ||
+		!env->me_pgstats)
+		return EINVAL;
+
+	*arg = env->me_pgstats[dbi];
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_info(MDB_env *env, MDB_envinfo *arg)
 {
@@ -9573,6 +10624,7 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 		txn->mt_dbxs[slot].md_name.mv_data = namedup;
 		txn->mt_dbxs[slot].md_name.mv_size = len;
 		txn->mt_dbxs[slot].md_rel = NULL;
+		txn->mt_dbxs[slot].md_rdahead = MDB_RDAHEAD_DEFAULT;
 		txn->mt_dbflags[slot] = dbflag;
 		/* txn-> and env-> are the same in read txns, use
 		 * tmp variable to avoid undefined assignment
@@ -9581,6 +10633,17 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 		txn->mt_dbiseqs[slot] = seq;
 
 		memcpy(&txn->mt_dbs[slot], data.mv_data, sizeof(MDB_db));
+		/* Compression may be turned on for an existing DB */
+		if ((flags & MDB_COMPRESS) && !(txn->mt_flags & MDB_TXN_RDONLY) &&
+			!(txn->mt_dbs[slot].md_flags & (MDB_COMPRESS|MDB_DUPSORT))) {
+			txn->mt_dbs[slot].md_flags |= MDB_COMPRESS;
+			txn->mt_dbflags[slot] |= DB_DIRTY;
+			txn->mt_flags |= MDB_TXN_DIRTY;
+		}
+		/* Have the next commit mark the file as using it */
+		if ((txn->mt_dbs[slot].md_flags & (MDB_COMPRESS|MDB_DUPSORT)) ==
+			MDB_COMPRESS)
+			txn->mt_env->me_flags |= MDB_ENV_ZIP;
 		*dbi = slot;
 		mdb_default_cmp(txn, slot);
 		if (!unused) {
@@ -9609,6 +10672,90 @@ mdb_stat(MDB_txn *txn, MDB_dbi dbi, MDB_stat *arg)
 	return mdb_stat0(txn->mt_env, &txn->mt_dbs[dbi], arg);
 }
 
+/** A subtree found by #mdb_dbi_split() */
+typedef struct MDB_subtree {
+	pgno_t	ms_pgno;
+	MDB_val	ms_key;		/**< lowest key of the subtree, empty for the first */
+} MDB_subtree;
+
+int ESECT
+mdb_dbi_split(MDB_txn *txn, MDB_dbi dbi, MDB_val *keys, unsigned int *count)
+{
+	MDB_cursor mc;
+	MDB_xcursor mx;
+	MDB_page *mp;
+	MDB_subtree *st, *nt;
+	unsigned int i, j, k, n, nn, want;
+	int rc;
+
+	if (!count || (*count && !keys) || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	want = *count;
+	*count = 0;
+	if (!want)
+		return MDB_SUCCESS;
+
+	mdb_cursor_init(&mc, txn, dbi, &mx);
+	rc = mdb_page_search(&mc, NULL, MDB_PS_ROOTONLY);
+	if (rc)
+		return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+	if ((st = malloc(sizeof(MDB_subtree))) == NULL)
+		return ENOMEM;
+	st[0].ms_pgno = mc.mc_pg[0]->mp_pgno;
+	st[0].ms_key.mv_size = 0;
+	st[0].ms_key.mv_data = NULL;
+	n = 1;
+
+	/* Go down level by level until there are a few subtrees per
+	 * part, so the parts come out about the same size.
+	 */
+	while (n <= want * 4) {
+		if ((rc = mdb_page_get(txn, st[0].ms_pgno, &mp, NULL)) != 0)
+			goto done;
+		if (!IS_BRANCH(mp))
+			break;
+		for (i = nn = 0; i < n; i++) {
+			if ((rc = mdb_page_get(txn, st[i].ms_pgno, &mp, NULL)) != 0)
+				goto done;
+			nn += NUMKEYS(mp);
+		}
+		if ((nt = malloc(nn * sizeof(MDB_subtree))) == NULL) {
+			rc = ENOMEM;
+			goto done;
+		}
+		for (i = k = 0; i < n; i++) {
+			mdb_page_get(txn, st[i].ms_pgno, &mp, NULL);
+			for (j = 0; j < NUMKEYS(mp); j++, k++) {
+				MDB_node *node = NODEPTR(mp, j);
+				nt[k].ms_pgno = NODEPGNO(node);
+				if (j) {
+					MDB_GET_KEY2(node, nt[k].ms_key);
+				} else {
+					nt[k].ms_key = st[i].ms_key;
+				}
+			}
+		}
+		free(st);
+		st = nt;
+		n = nn;
+	}
+
+	/* Each subtree but the first starts with its key */
+	if (want > n - 1)
+		want = n - 1;
+	for (i = 1; i <= want; i++)
+		keys[i-1] = st[i * n / (want + 1)].ms_key;
+	*count = want;
+
+done:
+	free(st);
+	return rc;
+}
+
 void mdb_dbi_close(MDB_env *env, MDB_dbi dbi)
 {
 	char *ptr;
@@ -9621,6 +10768,7 @@ void mdb_dbi_close(MDB_env *env, MDB_dbi dbi)
 		env->me_dbxs[dbi].md_name.mv_size = 0;
 		env->me_dbflags[dbi] = 0;
 		env->me_dbiseqs[dbi]++;
+		memset(&env->me_pgstats[dbi], 0, sizeof(MDB_pagestat));
 		free(ptr);
 	}
 }
@@ -9775,6 +10923,276 @@ leave:
 	return rc;
 }
 
+/** Merge all freeDB records that no reader needs anymore into
+ * me_pghead, as #mdb_page_alloc() does when it looks for pages.
+ */
+static int
+mdb_freelist_load(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+	MDB_cursor m2;
+	MDB_cursor_op op = MDB_FIRST;
+	MDB_val key, data;
+	txnid_t oldest, last = env->me_pglast;
+	pgno_t *idl;
+	int rc;
+
+	oldest = env->me_pgoldest = mdb_find_oldest(txn);
+	mdb_cursor_init(&m2, txn, FREE_DBI, NULL);
+	if (last) {
+		op = MDB_SET_RANGE;
+		key.mv_data = &last; /* will look up last+1 */
+		key.mv_size = sizeof(last);
+	}
+	for (;; op = MDB_NEXT) {
+		if (oldest <= ++last)
+			break;
+		rc = mdb_cursor_get(&m2, &key, &data, op);
+		if (rc)
+			return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+		last = *(txnid_t *)key.mv_data;
+		if (oldest <= last)
+			break;
+		idl = data.mv_data;
+		if (!env->me_pghead) {
+			if (!(env->me_pghead = mdb_midl_alloc(idl[0])))
+				return ENOMEM;
+		} else if ((rc = mdb_midl_need(&env->me_pghead, idl[0])) != 0) {
+			return rc;
+		}
+		env->me_pglast = last;
+		if ((rc = mdb_pghead_merge(env, idl)) != 0)
+			return rc;
+	}
+	return MDB_SUCCESS;
+}
+
+/** Check for num contiguous free pages below pg in me_pghead. */
+static int
+mdb_compact_fits(MDB_env *env, int num, pgno_t pg)
+{
+	pgno_t *mop = env->me_pghead;
+	unsigned i, n2 = num-1;
+
+	if (!mop)
+		return 0;
+	/* me_pghead is sorted in descending order */
+	for (i = mop[0]; i > n2 && mop[i] < pg; i--)
+		if (mop[i-n2] == mop[i]+n2)
+			return 1;
+	return 0;
+}
+
+/** Touch the cursor's pages from the root down to the deepest one that
+ * is worth moving, i.e. is at or past thresh with free space below it.
+ * @param[in] mc The cursor.
+ * @param[in] thresh The first page of the tail of the file.
+ * @param[in] all Touch the whole stack, so the leaf can be modified.
+ * @param[in,out] moved Incremented by the number of pages moved.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_compact_touch(MDB_cursor *mc, pgno_t thresh, int all, unsigned int *moved)
+{
+	MDB_page *mp;
+	unsigned short snum = mc->mc_snum;
+	int i, top = -1, n = 0, rc;
+
+	for (i = 0; i < snum; i++) {
+		mp = mc->mc_pg[i];
+		if (mp->mp_flags & P_DIRTY)
+			continue;
+		n++;
+		if (all || (mp->mp_pgno >= thresh &&
+			mdb_compact_fits(mc->mc_txn->mt_env, 1, mp->mp_pgno)))
+			top = i;
+	}
+	if (top < 0)
+		return MDB_SUCCESS;
+	for (i = top+1; i < snum; i++)
+		if (!(mc->mc_pg[i]->mp_flags & P_DIRTY))
+			n--;
+	/* mdb_cursor_touch() does the whole stack, hide the rest of it */
+	mc->mc_snum = top+1;
+	rc = mdb_cursor_touch(mc);
+	mc->mc_snum = snum;
+	mc->mc_top = snum-1;
+	if (!rc)
+		*moved += n;
+	return rc;
+}
+
+/** Move the tail pages a leaf refers to: its overflow pages and the
+ * pages of its sub-DBs.
+ */
+static int
+mdb_compact_leaf(MDB_cursor *mc, pgno_t thresh, unsigned int *moved)
+{
+	MDB_txn *txn = mc->mc_txn;
+	MDB_env *env = txn->mt_env;
+	MDB_page *mp = mc->mc_pg[mc->mc_top], *omp, *np;
+	MDB_node *node;
+	MDB_cursor *mx;
+	pgno_t pg;
+	unsigned i, nkeys = NUMKEYS(mp);
+	int touched, rc;
+
+	for (i = 0; i < nkeys; i++) {
+		node = NODEPTR(mc->mc_pg[mc->mc_top], i);
+		if (node->mn_flags & F_BIGDATA) {
+			memcpy(&pg, NODEDATA(node), sizeof(pg));
+			if (pg < thresh)
+				continue;
+			if ((rc = mdb_page_get(txn, pg, &omp, NULL)) != 0)
+				return rc;
+			if ((omp->mp_flags & P_DIRTY) ||
+				!mdb_compact_fits(env, omp->mp_pages, pg))
+				continue;
+			if ((rc = mdb_compact_touch(mc, thresh, 1, moved)) != 0 ||
+				(rc = mdb_page_alloc(mc, omp->mp_pages, &np)) != 0)
+				return rc;
+			pg = np->mp_pgno;
+			memcpy(np, omp, (size_t)env->me_psize * omp->mp_pages);
+			np->mp_pgno = pg;
+			np->mp_flags |= P_DIRTY;
+			node = NODEPTR(mc->mc_pg[mc->mc_top], i);
+			memcpy(NODEDATA(node), &pg, sizeof(pg));
+			if ((rc = mdb_ovpage_free(mc, omp)) != 0)
+				return rc;
+			mc->mc_db->md_overflow_pages += np->mp_pages;
+			*moved += np->mp_pages;
+		} else if ((node->mn_flags & (F_DUPDATA|F_SUBDATA)) ==
+			(F_DUPDATA|F_SUBDATA)) {
+			mc->mc_ki[mc->mc_top] = i;
+			mdb_xcursor_init1(mc, node);
+			mx = &mc->mc_xcursor->mx_cursor;
+			if ((rc = mdb_page_search(mx, NULL, MDB_PS_FIRST)) != 0)
+				return rc;
+			touched = 0;
+			do {
+				unsigned int n = 0;
+				if ((rc = mdb_compact_touch(mx, thresh, 0, &n)) != 0)
+					return rc;
+				if (n) {
+					/* the sub-DB record in the leaf will change */
+					if (!touched &&
+						(rc = mdb_compact_touch(mc, thresh, 1, moved)) != 0)
+						return rc;
+					*moved += n;
+					touched = 1;
+				}
+			} while ((rc = mdb_cursor_sibling(mx, 1)) == MDB_SUCCESS);
+			if (rc != MDB_NOTFOUND)
+				return rc;
+			if (touched) {
+				node = NODEPTR(mc->mc_pg[mc->mc_top], i);
+				memcpy(NODEDATA(node), &mc->mc_xcursor->mx_db, sizeof(MDB_db));
+			}
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+int
+mdb_txn_compact(MDB_txn *txn, unsigned int max, unsigned int *moved)
+{
+	MDB_env *env;
+	MDB_cursor mc;
+	MDB_xcursor mx;
+	MDB_page *mp;
+	MDB_dbi dbi;
+	pgno_t *mop, thresh;
+	unsigned int i, n = 0, visits = 0, len;
+	int rc;
+
+	if (!txn || !moved || txn->mt_parent)
+		return EINVAL;
+	*moved = 0;
+	if (txn->mt_flags & MDB_TXN_RDONLY)
+		return EACCES;
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+	env = txn->mt_env;
+
+	if ((rc = mdb_freelist_load(txn)) != 0)
+		goto fail;
+
+	/* Free pages at the end of the file are given back */
+	mop = env->me_pghead;
+	len = mop ? mop[0] : 0;
+	for (i = 0; i < len && mop[i+1] == txn->mt_next_pgno - i - 1; i++)
+		;
+	if (i) {
+		DPRINTF(("compact: truncating %u pages at %"Z"u", i,
+			txn->mt_next_pgno - i));
+		txn->mt_next_pgno -= i;
+		txn->mt_flags |= MDB_TXN_DIRTY;
+		len -= i;
+		memmove(mop + 1, mop + 1 + i, len * sizeof(pgno_t));
+		mop[0] = len;
+		n = i;
+	}
+
+	/* Pages past the first len pages from the end have somewhere to go.
+	 * Those that do are moved by touching them, and only get to the
+	 * end of the free list in a later txn, when no reader needs them.
+	 */
+	if (!len || (txn->mt_flags & MDB_TXN_SPILLS))
+		goto done;
+	thresh = txn->mt_next_pgno - len;
+	if (env->me_cpdbi < MAIN_DBI || env->me_cpdbi >= txn->mt_numdbs) {
+		env->me_cpdbi = MAIN_DBI;
+		env->me_cpkey.mv_size = 0;
+	}
+	for (dbi = env->me_cpdbi; dbi < txn->mt_numdbs && n < max;
+		dbi = ++env->me_cpdbi, env->me_cpkey.mv_size = 0) {
+		if (!(txn->mt_dbflags[dbi] & DB_VALID) ||
+			txn->mt_dbs[dbi].md_root == P_INVALID)
+			continue;
+		if (dbi >= CORE_DBS && TXN_DBI_CHANGED(txn, dbi))
+			continue;
+		mdb_cursor_init(&mc, txn, dbi, &mx);
+		if (env->me_cpkey.mv_size) {
+			MDB_val key = env->me_cpkey;
+			rc = mdb_cursor_set(&mc, &key, NULL, MDB_SET_RANGE, NULL);
+		} else
+			rc = mdb_page_search(&mc, NULL, MDB_PS_FIRST);
+		while (!rc) {
+			if ((rc = mdb_compact_touch(&mc, thresh, 0, &n)) != 0 ||
+				(rc = mdb_compact_leaf(&mc, thresh, &n)) != 0)
+				goto fail;
+			if ((rc = mdb_cursor_sibling(&mc, 1)) != 0)
+				break;
+			/* Visiting pages costs too, stop after a while */
+			if (n >= max || ++visits >= max * 16) {
+				MDB_val key;
+				mp = mc.mc_pg[mc.mc_top];
+				MDB_GET_KEY(NODEPTR(mp, 0), &key);
+				if (!env->me_cpkey.mv_data &&
+					!(env->me_cpkey.mv_data = malloc(ENV_MAXKEY(env)))) {
+					rc = ENOMEM;
+					goto fail;
+				}
+				memcpy(env->me_cpkey.mv_data, key.mv_data, key.mv_size);
+				env->me_cpkey.mv_size = key.mv_size;
+				goto done;
+			}
+		}
+		if (rc != MDB_NOTFOUND)
+			goto fail;
+	}
+	if (env->me_cpdbi >= txn->mt_numdbs)
+		env->me_cpdbi = MAIN_DBI;
+
+done:
+	*moved = n;
+	return MDB_SUCCESS;
+
+fail:
+	txn->mt_flags |= MDB_TXN_ERROR;
+	return rc;
+}
+
 int mdb_set_compare(MDB_txn *txn, MDB_dbi dbi, MDB_cmp_func *cmp)
 {
 	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
@@ -9811,6 +11229,16 @@ int mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx)
 	return MDB_SUCCESS;
 }
 
+int mdb_set_readahead(MDB_txn *txn, MDB_dbi dbi, unsigned int policy)
+{
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID) ||
+		policy > MDB_RDAHEAD_SEQUENTIAL)
+		return EINVAL;
+
+	txn->mt_dbxs[dbi].md_rdahead = policy;
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_get_maxkeysize(MDB_env *env)
 {
@@ -9944,6 +11372,7 @@ mdb_reader_check0(MDB_env *env, int rlocked, int *dead)
 								DPRINTF(("clear stale reader pid %u txn %"Z"d",
 									(unsigned) pid, mr[j].mr_txnid));
 								mr[j].mr_pid = 0;
+								env->me_txns->mti_rdrefresh = 1;
 								count++;
 							}
 					if (rmutex)
@@ -9982,6 +11411,8 @@ mdb_mutex_failed(MDB_env *env, mdb_mutexref_t mutex, int rc)
 			 */
 			meta = mdb_env_pick_meta(env);
 			env->me_txns->mti_txnid = meta->mm_txnid;
+			/* It may have died while finding the oldest reader */
+			env->me_txns->mti_rdrefresh = 1;
 			/* env is hosed if the dead thread was ours */
 			if (env->me_txn) {
 				env->me_flags |= MDB_FATAL_ERROR;
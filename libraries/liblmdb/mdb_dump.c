@@ -21,11 +21,23 @@
 #include "lmdb.h"
 
 #ifdef _WIN32
+#include <windows.h>
 #define Z	"I"
+#define THREAD_RET	DWORD WINAPI
+#define pthread_t	HANDLE
+#define THREAD_CREATE(thr,start,arg)	thr=CreateThread(NULL,0,start,arg,0,NULL)
+#define THREAD_FINISH(thr)	WaitForSingleObject(thr, INFINITE)
 #else
+#include <pthread.h>
 #define Z	"z"
+#define THREAD_RET	void *
+#define THREAD_CREATE(thr,start,arg)	pthread_create(&thr,NULL,start,arg)
+#define THREAD_FINISH(thr)	pthread_join(thr,NULL)
 #endif
 
+/** Most streams for a parallel dump */
+#define MAXTHREADS	64
+
 #define PRINT	1
 static int mode;
 
@@ -41,6 +53,7 @@ flagbit dbflags[] = {
 	{ MDB_DUPFIXED, "dupfixed" },
 	{ MDB_INTEGERDUP, "integerdup" },
 	{ MDB_REVERSEDUP, "reversedup" },
+	{ MDB_COMPRESS, "compress" },
 	{ 0, NULL }
 };
 
@@ -53,51 +66,70 @@ static void dumpsig( int sig )
 
 static const char hexc[] = "0123456789abcdef";
 
-static void hex(unsigned char c)
-{
-	putchar(hexc[c >> 4]);
-	putchar(hexc[c & 0xf]);
-}
+/* Output is formatted a chunk at a time, so the streams of a parallel
+ * dump don't take the stdio lock for every character.
+ */
+#define OUTBUF	4096
 
-static void text(MDB_val *v)
+static void text(FILE *fp, MDB_val *v)
 {
 	unsigned char *c, *end;
+	char buf[OUTBUF], *ptr = buf;
 
-	putchar(' ');
+	*ptr++ = ' ';
 	c = v->mv_data;
 	end = c + v->mv_size;
 	while (c < end) {
+		if (ptr > buf + OUTBUF - 4) {
+			fwrite(buf, 1, ptr - buf, fp);
+			ptr = buf;
+		}
 		if (isprint(*c)) {
-			putchar(*c);
+			*ptr++ = *c;
 		} else {
-			putchar('\\');
-			hex(*c);
+			*ptr++ = '\\';
+			*ptr++ = hexc[*c >> 4];
+			*ptr++ = hexc[*c & 0xf];
 		}
 		c++;
 	}
-	putchar('\n');
+	*ptr++ = '\n';
+	fwrite(buf, 1, ptr - buf, fp);
 }
 
-static void byte(MDB_val *v)
+static void byte(FILE *fp, MDB_val *v)
 {
 	unsigned char *c, *end;
+	char buf[OUTBUF], *ptr = buf;
 
-	putchar(' ');
+	*ptr++ = ' ';
 	c = v->mv_data;
 	end = c + v->mv_size;
 	while (c < end) {
-		hex(*c++);
+		if (ptr > buf + OUTBUF - 3) {
+			fwrite(buf, 1, ptr - buf, fp);
+			ptr = buf;
+		}
+		*ptr++ = hexc[*c >> 4];
+		*ptr++ = hexc[*c & 0xf];
+		c++;
 	}
-	putchar('\n');
+	*ptr++ = '\n';
+	fwrite(buf, 1, ptr - buf, fp);
 }
 
-/* Dump in BDB-compatible format */
-static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
+/* Dump in BDB-compatible format. If lo or hi are given, only the
+ * keys from lo up to but not including hi are dumped. If they are
+ * the same, only the header is.
+ */
+static int dumpit(FILE *fp, MDB_txn *txn, MDB_dbi dbi, char *name,
+	MDB_val *lo, MDB_val *hi)
 {
 	MDB_cursor *mc;
 	MDB_stat ms;
 	MDB_val key, data;
 	MDB_envinfo info;
+	MDB_cursor_op op;
 	unsigned int flags;
 	int rc, i;
 
@@ -110,52 +142,260 @@ static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 	rc = mdb_env_info(mdb_txn_env(txn), &info);
 	if (rc) return rc;
 
-	printf("VERSION=3\n");
-	printf("format=%s\n", mode & PRINT ? "print" : "bytevalue");
+	fprintf(fp, "VERSION=3\n");
+	fprintf(fp, "format=%s\n", mode & PRINT ? "print" : "bytevalue");
 	if (name)
-		printf("database=%s\n", name);
-	printf("type=btree\n");
-	printf("mapsize=%" Z "u\n", info.me_mapsize);
+		fprintf(fp, "database=%s\n", name);
+	fprintf(fp, "type=btree\n");
+	fprintf(fp, "mapsize=%" Z "u\n", info.me_mapsize);
 	if (info.me_mapaddr)
-		printf("mapaddr=%p\n", info.me_mapaddr);
-	printf("maxreaders=%u\n", info.me_maxreaders);
+		fprintf(fp, "mapaddr=%p\n", info.me_mapaddr);
+	fprintf(fp, "maxreaders=%u\n", info.me_maxreaders);
 
 	if (flags & MDB_DUPSORT)
-		printf("duplicates=1\n");
+		fprintf(fp, "duplicates=1\n");
 
 	for (i=0; dbflags[i].bit; i++)
 		if (flags & dbflags[i].bit)
-			printf("%s=1\n", dbflags[i].name);
+			fprintf(fp, "%s=1\n", dbflags[i].name);
 
-	printf("db_pagesize=%d\n", ms.ms_psize);
-	printf("HEADER=END\n");
+	fprintf(fp, "db_pagesize=%d\n", ms.ms_psize);
+	fprintf(fp, "HEADER=END\n");
 
 	rc = mdb_cursor_open(txn, dbi, &mc);
 	if (rc) return rc;
 
-	while ((rc = mdb_cursor_get(mc, &key, &data, MDB_NEXT) == MDB_SUCCESS)) {
+	if (lo) {
+		key = *lo;
+		op = MDB_SET_RANGE;
+	} else {
+		op = MDB_FIRST;
+	}
+	rc = MDB_NOTFOUND;
+	while ((lo != hi || !lo) &&
+		(rc = mdb_cursor_get(mc, &key, &data, op)) == MDB_SUCCESS) {
+		op = MDB_NEXT;
 		if (gotsig) {
 			rc = EINTR;
 			break;
 		}
+		if (hi && mdb_cmp(txn, dbi, &key, hi) >= 0) {
+			rc = MDB_NOTFOUND;
+			break;
+		}
 		if (mode & PRINT) {
-			text(&key);
-			text(&data);
+			text(fp, &key);
+			text(fp, &data);
 		} else {
-			byte(&key);
-			byte(&data);
+			byte(fp, &key);
+			byte(fp, &data);
 		}
 	}
-	printf("DATA=END\n");
+	fprintf(fp, "DATA=END\n");
 	if (rc == MDB_NOTFOUND)
 		rc = MDB_SUCCESS;
+	mdb_cursor_close(mc);
 
 	return rc;
 }
 
+/* One part of a parallel dump */
+typedef struct dumpjob {
+	FILE *fp;
+	MDB_txn *txn;
+	MDB_dbi dbi;
+	char *name;
+	MDB_val *lo, *hi;
+	int rc;
+} dumpjob;
+
+static THREAD_RET dumpthread(void *arg)
+{
+	dumpjob *dj = arg;
+
+	dj->rc = dumpit(dj->fp, dj->txn, dj->dbi, dj->name, dj->lo, dj->hi);
+	return (THREAD_RET)0;
+}
+
+/* Dump a DB split by key range into one stream per txn. All the
+ * txns must see the same snapshot.
+ */
+static int dumppar(FILE **fps, MDB_txn **txns, int nthreads, MDB_dbi dbi,
+	char *name)
+{
+	MDB_val keys[MAXTHREADS];
+	dumpjob jobs[MAXTHREADS];
+	pthread_t thr[MAXTHREADS];
+	unsigned int nkeys = nthreads - 1;
+	int i, rc;
+
+	rc = mdb_dbi_split(txns[0], dbi, keys, &nkeys);
+	if (rc) return rc;
+
+	for (i=0; i<nthreads; i++) {
+		jobs[i].fp = fps[i];
+		jobs[i].txn = txns[i];
+		jobs[i].dbi = dbi;
+		jobs[i].name = name;
+		if (i > (int)nkeys) {
+			/* Nothing left for this stream */
+			jobs[i].lo = jobs[i].hi = &keys[0];
+		} else {
+			jobs[i].lo = i ? &keys[i-1] : NULL;
+			jobs[i].hi = i < (int)nkeys ? &keys[i] : NULL;
+		}
+		THREAD_CREATE(thr[i], dumpthread, &jobs[i]);
+	}
+	for (i=0; i<nthreads; i++) {
+		THREAD_FINISH(thr[i]);
+		if (jobs[i].rc && !rc)
+			rc = jobs[i].rc;
+	}
+	return rc;
+}
+
+/* Collect the names of the subDBs listed in the main DB */
+static int getnames(MDB_txn *txn, MDB_dbi dbi, char ***namesp, int *countp)
+{
+	MDB_cursor *cursor;
+	MDB_val key;
+	char **names = NULL, **n2;
+	int rc, count = 0;
+
+	rc = mdb_cursor_open(txn, dbi, &cursor);
+	if (rc) return rc;
+	while ((rc = mdb_cursor_get(cursor, &key, NULL, MDB_NEXT_NODUP)) == 0) {
+		if (memchr(key.mv_data, '\0', key.mv_size))
+			continue;
+		n2 = realloc(names, (count+1) * sizeof(char *));
+		if (!n2 || !(n2[count] = malloc(key.mv_size+1))) {
+			if (n2) names = n2;
+			rc = ENOMEM;
+			break;
+		}
+		names = n2;
+		memcpy(names[count], key.mv_data, key.mv_size);
+		names[count][key.mv_size] = '\0';
+		count++;
+	}
+	mdb_cursor_close(cursor);
+	*namesp = names;
+	*countp = count;
+	return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+}
+
+static void freenames(char **names, int count)
+{
+	int i;
+	for (i=0; i<count; i++)
+		free(names[i]);
+	free(names);
+}
+
+/* Count the subDBs, before the real env is opened */
+static int countdbs(char *envname, int envflags, int *countp)
+{
+	MDB_env *env;
+	MDB_txn *txn;
+	MDB_dbi dbi;
+	char **names;
+	int rc;
+
+	*countp = 0;
+	rc = mdb_env_create(&env);
+	if (rc) return rc;
+	rc = mdb_env_open(env, envname, envflags | MDB_RDONLY, 0664);
+	if (!rc)
+		rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (!rc) {
+		rc = mdb_open(txn, NULL, 0, &dbi);
+		if (!rc) {
+			rc = getnames(txn, dbi, &names, countp);
+			freenames(names, *countp);
+		}
+		mdb_txn_abort(txn);
+	}
+	mdb_env_close(env);
+	return rc;
+}
+
+/* Dump with several threads, each writing its key range of every
+ * DB to its own stream. All DB handles are opened and exported
+ * first, then each thread gets a read txn. The txns must all be
+ * on the same snapshot, so retry if a writer got in between.
+ */
+static int dumpall(MDB_env *env, char *prog, char *envname, char *subname,
+	int alldbs, FILE **fps, int nthreads)
+{
+	MDB_txn *txn, *txns[MAXTHREADS];
+	MDB_dbi dbi, *dbis = NULL;
+	char **names = NULL;
+	int i, n, count = 0, rc;
+	size_t id;
+
+	for (;;) {
+		rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+		if (rc) break;
+		rc = mdb_open(txn, subname, 0, &dbi);
+		if (!rc && alldbs) {
+			freenames(names, count);
+			free(dbis);
+			dbis = NULL;
+			rc = getnames(txn, dbi, &names, &count);
+			if (!rc && !count) {
+				fprintf(stderr, "%s: %s does not contain multiple databases\n", prog, envname);
+				rc = MDB_NOTFOUND;
+			}
+			if (!rc && !(dbis = malloc(count * sizeof(MDB_dbi))))
+				rc = ENOMEM;
+			for (i=0; !rc && i<count; i++) {
+				if (mdb_open(txn, names[i], 0, &dbis[i])) {
+					free(names[i]);
+					names[i] = NULL;
+				}
+			}
+		}
+		if (rc) {
+			mdb_txn_abort(txn);
+			break;
+		}
+		id = mdb_txn_id(txn);
+		rc = mdb_txn_commit(txn);
+		if (rc) break;
+
+		for (n=0; n<nthreads; n++) {
+			rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txns[n]);
+			if (rc) break;
+		}
+		if (!rc) {
+			for (i=0; i<nthreads && mdb_txn_id(txns[i]) == id; i++) ;
+			if (i == nthreads)
+				break;
+		}
+		while (n > 0)
+			mdb_txn_abort(txns[--n]);
+		if (rc) break;
+	}
+
+	if (!rc) {
+		if (alldbs) {
+			for (i=0; !rc && i<count; i++)
+				if (names[i])
+					rc = dumppar(fps, txns, nthreads, dbis[i], names[i]);
+		} else {
+			rc = dumppar(fps, txns, nthreads, dbi, subname);
+		}
+		for (i=0; i<nthreads; i++)
+			mdb_txn_abort(txns[i]);
+	}
+	freenames(names, count);
+	free(dbis);
+	return rc;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-f output] [-l] [-n] [-p] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-f output [-j threads]] [-l] [-n] [-p] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -167,8 +407,9 @@ int main(int argc, char *argv[])
 	MDB_dbi dbi;
 	char *prog = argv[0];
 	char *envname;
-	char *subname = NULL;
-	int alldbs = 0, envflags = 0, list = 0;
+	char *subname = NULL, *outname = NULL;
+	FILE *fps[MAXTHREADS];
+	int alldbs = 0, envflags = 0, list = 0, nthreads = 1, count = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -179,10 +420,11 @@ int main(int argc, char *argv[])
 	 * -n: use NOSUBDIR flag on env_open
 	 * -p: use printable characters
 	 * -f: write to file instead of stdout
+	 * -j: dump with this many threads, into as many files
 	 * -V: print version and exit
 	 * (default) dump only the main DB
 	 */
-	while ((i = getopt(argc, argv, "af:lnps:V")) != EOF) {
+	while ((i = getopt(argc, argv, "af:j:lnps:V")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -197,11 +439,12 @@ int main(int argc, char *argv[])
 			alldbs++;
 			break;
 		case 'f':
-			if (freopen(optarg, "w", stdout) == NULL) {
-				fprintf(stderr, "%s: %s: reopen: %s\n",
-					prog, optarg, strerror(errno));
-				exit(EXIT_FAILURE);
-			}
+			outname = optarg;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1 || nthreads > MAXTHREADS)
+				usage(prog);
 			break;
 		case 'n':
 			envflags |= MDB_NOSUBDIR;
@@ -222,6 +465,33 @@ int main(int argc, char *argv[])
 	if (optind != argc - 1)
 		usage(prog);
 
+	if (list)
+		nthreads = 1;
+	if (nthreads > 1) {
+		/* One file per thread, output.0 and on. Loading them in
+		 * that order restores the DBs.
+		 */
+		char *fname;
+		if (!outname)
+			usage(prog);
+		fname = malloc(strlen(outname) + sizeof(".64"));
+		for (i=0; i<nthreads; i++) {
+			sprintf(fname, "%s.%d", outname, i);
+			if ((fps[i] = fopen(fname, "w")) == NULL) {
+				fprintf(stderr, "%s: %s: open: %s\n",
+					prog, fname, strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+		}
+		free(fname);
+	} else if (outname) {
+		if (freopen(outname, "w", stdout) == NULL) {
+			fprintf(stderr, "%s: %s: reopen: %s\n",
+				prog, outname, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+
 #ifdef SIGPIPE
 	signal(SIGPIPE, dumpsig);
 #endif
@@ -232,6 +502,15 @@ int main(int argc, char *argv[])
 	signal(SIGTERM, dumpsig);
 
 	envname = argv[optind];
+	if (nthreads > 1 && alldbs) {
+		/* All the subDBs will be open at once */
+		rc = countdbs(envname, envflags, &count);
+		if (rc) {
+			fprintf(stderr, "%s: %s: %s\n", prog, envname, mdb_strerror(rc));
+			return EXIT_FAILURE;
+		}
+	}
+
 	rc = mdb_env_create(&env);
 	if (rc) {
 		fprintf(stderr, "mdb_env_create failed, error %d %s\n", rc, mdb_strerror(rc));
@@ -239,15 +518,27 @@ int main(int argc, char *argv[])
 	}
 
 	if (alldbs || subname) {
-		mdb_env_set_maxdbs(env, 2);
+		mdb_env_set_maxdbs(env, count > 2 ? count : 2);
 	}
 
+	if (nthreads > 1)
+		envflags |= MDB_NOTLS;
 	rc = mdb_env_open(env, envname, envflags | MDB_RDONLY, 0664);
 	if (rc) {
 		fprintf(stderr, "mdb_env_open failed, error %d %s\n", rc, mdb_strerror(rc));
 		goto env_close;
 	}
 
+	if (nthreads > 1) {
+		rc = dumpall(env, prog, envname, subname, alldbs, fps, nthreads);
+		if (rc && rc != MDB_NOTFOUND)
+			fprintf(stderr, "%s: %s: %s\n", prog, envname, mdb_strerror(rc));
+		for (i=0; i<nthreads; i++)
+			if (fclose(fps[i]) && !rc)
+				rc = errno;
+		goto env_close;
+	}
+
 	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
 	if (rc) {
 		fprintf(stderr, "mdb_txn_begin failed, error %d %s\n", rc, mdb_strerror(rc));
@@ -285,7 +576,7 @@ int main(int argc, char *argv[])
 					printf("%s\n", str);
 					list++;
 				} else {
-					rc = dumpit(txn, db2, str);
+					rc = dumpit(stdout, txn, db2, str, NULL, NULL);
 					if (rc)
 						break;
 				}
@@ -302,7 +593,7 @@ int main(int argc, char *argv[])
 			rc = MDB_SUCCESS;
 		}
 	} else {
-		rc = dumpit(txn, dbi, subname);
+		rc = dumpit(stdout, txn, dbi, subname, NULL, NULL);
 	}
 	if (rc && rc != MDB_NOTFOUND)
 		fprintf(stderr, "%s: %s: %s\n", prog, envname, mdb_strerror(rc));
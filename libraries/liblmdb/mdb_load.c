@@ -61,6 +61,7 @@ flagbit dbflags[] = {
 	{ MDB_DUPFIXED, S("dupfixed") },
 	{ MDB_INTEGERDUP, S("integerdup") },
 	{ MDB_REVERSEDUP, S("reversedup") },
+	{ MDB_COMPRESS, S("compress") },
 	{ 0, NULL, 0 }
 };
 
@@ -68,6 +69,7 @@ static void readhdr(void)
 {
 	char *ptr;
 
+	flags = 0;
 	while (fgets(dbuf.mv_data, dbuf.mv_size, stdin) != NULL) {
 		lineno++;
 		if (!strncmp(dbuf.mv_data, "VERSION=", STRLENOF("VERSION="))) {
@@ -276,7 +278,7 @@ badend:
 
 static void usage(void)
 {
-	fprintf(stderr, "usage: %s [-V] [-f input] [-n] [-s name] [-N] [-T] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-a] [-f input] [-n] [-s name] [-N] [-T] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -288,8 +290,9 @@ int main(int argc, char *argv[])
 	MDB_cursor *mc;
 	MDB_dbi dbi;
 	char *envname;
-	int envflags = 0, putflags = 0;
+	int envflags = 0, putflags = 0, append = 0, maxbatch = 100;
 	int dohdr = 0;
+	MDB_val prevk;
 
 	prog = argv[0];
 
@@ -297,19 +300,27 @@ int main(int argc, char *argv[])
 		usage();
 	}
 
-	/* -f: load file instead of stdin
+	/* -a: input is sorted, append the records
+	 * -f: load file instead of stdin
 	 * -n: use NOSUBDIR flag on env_open
 	 * -s: load into named subDB
 	 * -N: use NOOVERWRITE on puts
 	 * -T: read plaintext
 	 * -V: print version and exit
 	 */
-	while ((i = getopt(argc, argv, "f:ns:NTV")) != EOF) {
+	while ((i = getopt(argc, argv, "af:ns:NTV")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
 			break;
+		case 'a':
+			append = 1;
+			/* Appends only touch the right edge of the tree, so
+			 * fewer commits mostly save the syncs
+			 */
+			maxbatch = 10000;
+			break;
 		case 'f':
 			if (freopen(optarg, "r", stdin) == NULL) {
 				fprintf(stderr, "%s: %s: reopen: %s\n",
@@ -369,11 +380,11 @@ int main(int argc, char *argv[])
 
 	kbuf.mv_size = mdb_env_get_maxkeysize(env) * 2 + 2;
 	kbuf.mv_data = malloc(kbuf.mv_size);
+	prevk.mv_data = malloc(mdb_env_get_maxkeysize(env));
 
 	while(!Eof) {
 		MDB_val key, data;
 		int batch = 0;
-		flags = 0;
 
 		if (!dohdr) {
 			dohdr = 1;
@@ -398,7 +409,10 @@ int main(int argc, char *argv[])
 			goto txn_abort;
 		}
 
+		prevk.mv_size = 0;
 		while(1) {
+			int appflag = 0;
+
 			rc = readline(&key, &kbuf);
 			if (rc)  /* rc == EOF */
 				break;
@@ -409,7 +423,24 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 
-			rc = mdb_cursor_put(mc, &key, &data, putflags);
+			/* Sorted input fills the last leaf page and starts a
+			 * new one when it is full, without searching the tree
+			 * or splitting pages in the middle.
+			 */
+			if (append) {
+				appflag = MDB_APPEND;
+				if (flags & MDB_DUPSORT) {
+					if (prevk.mv_size == key.mv_size &&
+						!memcmp(prevk.mv_data, key.mv_data, key.mv_size)) {
+						appflag = MDB_APPENDDUP;
+					} else if (key.mv_size <= (size_t)mdb_env_get_maxkeysize(env)) {
+						memcpy(prevk.mv_data, key.mv_data, key.mv_size);
+						prevk.mv_size = key.mv_size;
+					}
+				}
+			}
+
+			rc = mdb_cursor_put(mc, &key, &data, putflags|appflag);
 			if (rc == MDB_KEYEXIST && putflags)
 				continue;
 			if (rc) {
@@ -417,7 +448,7 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 			batch++;
-			if (batch == 100) {
+			if (batch == maxbatch) {
 				rc = mdb_txn_commit(txn);
 				if (rc) {
 					fprintf(stderr, "%s: line %" Z "d: txn_commit: %s\n",
@@ -25,6 +25,7 @@
 
 static void prstat(MDB_stat *ms)
 {
+	size_t pages = ms->ms_branch_pages + ms->ms_leaf_pages + ms->ms_overflow_pages;
 #if 0
 	printf("  Page size: %u\n", ms->ms_psize);
 #endif
@@ -32,12 +33,84 @@ static void prstat(MDB_stat *ms)
 	printf("  Branch pages: %"Z"u\n", ms->ms_branch_pages);
 	printf("  Leaf pages: %"Z"u\n", ms->ms_leaf_pages);
 	printf("  Overflow pages: %"Z"u\n", ms->ms_overflow_pages);
+	/* a high share suggests a larger page size, see mdb_env_set_pagesize() */
+	if (pages)
+		printf("  Overflow ratio: %.1f%%\n", 100.0 * ms->ms_overflow_pages / pages);
 	printf("  Entries: %"Z"u\n", ms->ms_entries);
 }
 
+static void prlevels(MDB_pagestat *ps, size_t div)
+{
+	int i, n;
+
+	for (n = MDB_PAGESTAT_LEVELS; n > 1 && !ps->ps_level[n-1]; n--) ;
+	printf("    Pages by level:");
+	for (i = 0; i < n; i++)
+		printf(" %.2f", (double)ps->ps_level[i] / div);
+	printf("\n");
+}
+
+/* Read all items in order, then look up every key from the root,
+ * and show how many pages either took.
+ */
+static int probe(MDB_env *env, MDB_txn *txn, MDB_dbi dbi)
+{
+	MDB_cursor *seq;
+	MDB_val key, data;
+	MDB_pagestat p0, p1, sum;
+	size_t n = 0, pages;
+	int i, rc;
+
+	rc = mdb_cursor_open(txn, dbi, &seq);
+	if (rc)
+		return rc;
+
+	mdb_env_pagestat(env, dbi, &p0);
+	while ((rc = mdb_cursor_get(seq, &key, &data, MDB_NEXT)) == 0)
+		n++;
+	if (rc != MDB_NOTFOUND)
+		goto leave;
+	mdb_env_pagestat(env, dbi, &p1);
+	for (i = 0; i < MDB_PAGESTAT_LEVELS; i++)
+		p1.ps_level[i] -= p0.ps_level[i];
+	printf("  Sequential read of %"Z"u items: %"Z"u seeks, %"Z"u steps, "
+		"%"Z"u overflow pages\n", n, p1.ps_seek - p0.ps_seek,
+		p1.ps_step - p0.ps_step, p1.ps_overflow - p0.ps_overflow);
+	prlevels(&p1, 1);
+
+	memset(&sum, 0, sizeof(sum));
+	n = 0;
+	while ((rc = mdb_cursor_get(seq, &key, NULL,
+		n ? MDB_NEXT_NODUP : MDB_FIRST)) == 0) {
+		mdb_env_pagestat(env, dbi, &p0);
+		rc = mdb_get(txn, dbi, &key, &data);
+		if (rc)
+			goto leave;
+		mdb_env_pagestat(env, dbi, &p1);
+		for (i = 0; i < MDB_PAGESTAT_LEVELS; i++)
+			sum.ps_level[i] += p1.ps_level[i] - p0.ps_level[i];
+		sum.ps_overflow += p1.ps_overflow - p0.ps_overflow;
+		n++;
+	}
+	if (rc != MDB_NOTFOUND)
+		goto leave;
+	rc = MDB_SUCCESS;
+	if (n) {
+		for (i = 0, pages = 0; i < MDB_PAGESTAT_LEVELS; i++)
+			pages += sum.ps_level[i];
+		printf("  Lookup of %"Z"u keys: %.2f pages, %.2f overflow pages per key\n",
+			n, (double)pages / n, (double)sum.ps_overflow / n);
+		prlevels(&sum, n);
+	}
+
+leave:
+	mdb_cursor_close(seq);
+	return rc;
+}
+
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
+	fprintf(stderr, "usage: %s [-V] [-n] [-e] [-p] [-r[r]] [-f[f[f]]] [-a|-s subdb] dbpath\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -53,6 +126,7 @@ int main(int argc, char *argv[])
 	char *envname;
 	char *subname = NULL;
 	int alldbs = 0, envinfo = 0, envflags = 0, freinfo = 0, rdrinfo = 0;
+	int pginfo = 0;
 
 	if (argc < 2) {
 		usage(prog);
@@ -64,10 +138,11 @@ int main(int argc, char *argv[])
 	 * -f: print freelist info
 	 * -r: print reader info
 	 * -n: use NOSUBDIR flag on env_open
+	 * -p: print pages read by a scan and by key lookups
 	 * -V: print version and exit
 	 * (default) print stat of only the main DB
 	 */
-	while ((i = getopt(argc, argv, "Vaefnrs:")) != EOF) {
+	while ((i = getopt(argc, argv, "Vaefnprs:")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -87,6 +162,10 @@ int main(int argc, char *argv[])
 		case 'n':
 			envflags |= MDB_NOSUBDIR;
 			break;
+		case 'p':
+			pginfo++;
+			envflags |= MDB_PAGESTATS;
+			break;
 		case 'r':
 			rdrinfo++;
 			break;
@@ -216,6 +295,10 @@ int main(int argc, char *argv[])
 	}
 	printf("Status of %s\n", subname ? subname : "Main DB");
 	prstat(&mst);
+	if (pginfo && (rc = probe(env, txn, dbi))) {
+		fprintf(stderr, "probe failed, error %d %s\n", rc, mdb_strerror(rc));
+		goto txn_abort;
+	}
 
 	if (alldbs) {
 		MDB_cursor *cursor;
@@ -245,6 +328,10 @@ int main(int argc, char *argv[])
 				goto txn_abort;
 			}
 			prstat(&mst);
+			if (pginfo && (rc = probe(env, txn, db2))) {
+				fprintf(stderr, "probe failed, error %d %s\n", rc, mdb_strerror(rc));
+				goto txn_abort;
+			}
 			mdb_close(env, db2);
 		}
 		mdb_cursor_close(cursor);
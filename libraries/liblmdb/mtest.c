@@ -47,6 +47,8 @@ int main(int argc,char * argv[])
 		E(mdb_env_create(&env));
 		E(mdb_env_set_maxreaders(env, 1));
 		E(mdb_env_set_mapsize(env, 10485760));
+		if (argc > 1)
+			E(mdb_env_set_pagesize(env, atoi(argv[1])));
 		E(mdb_env_open(env, "./testdb", MDB_FIXEDMAP /*|MDB_NOSYNC*/, 0664));
 
 		E(mdb_txn_begin(env, NULL, 0, &txn));
@@ -70,6 +72,8 @@ int main(int argc,char * argv[])
 		if (j) printf("%d duplicates skipped\n", j);
 		E(mdb_txn_commit(txn));
 		E(mdb_env_stat(env, &mst));
+		printf("Page size %u: %lu leaf, %lu overflow pages\n", mst.ms_psize,
+			(unsigned long)mst.ms_leaf_pages, (unsigned long)mst.ms_overflow_pages);
 
 		E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
 		E(mdb_cursor_open(txn, dbi, &cursor));
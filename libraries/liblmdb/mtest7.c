@@ -0,0 +1,126 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2015 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Benchmark for allocating overflow pages from a fragmented freelist.
+ * Fill the DB with values of one overflow page each, delete every
+ * other one, then time txns that store values of several pages.
+ * Usage: mtest7 [<values>]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc, count = 200000, rounds = 200, per = 20;
+	MDB_env *env;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn;
+	MDB_stat mst;
+	MDB_envinfo info;
+	size_t kval;
+	char *val;
+	double t, dt, total = 0, max = 0;
+
+	if (argc > 1)
+		count = atoi(argv[1]);
+	srand(time(NULL));
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, (size_t)count * 16384 + 104857600));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, NULL, MDB_INTEGERKEY, &dbi));
+	E(mdb_stat(txn, dbi, &mst));
+	val = calloc(1, mst.ms_psize * 8);
+	key.mv_size = sizeof(kval);
+	key.mv_data = &kval;
+
+	/* Values that just need one overflow page, laid out in key order */
+	data.mv_size = mst.ms_psize - 64;
+	data.mv_data = val;
+	for (i = 0; i < count; i++) {
+		kval = i;
+		E(mdb_put(txn, dbi, &key, &data, MDB_APPEND));
+		if (i % 10000 == 9999) {
+			E(mdb_txn_commit(txn));
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+		}
+	}
+	E(mdb_txn_commit(txn));
+
+	/* Every other one leaves a freelist of single pages, in many
+	 * freeDB records
+	 */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < count; i += 2) {
+		kval = i;
+		E(mdb_del(txn, dbi, &key, NULL));
+		if (i % 100 == 98) {
+			E(mdb_txn_commit(txn));
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+		}
+	}
+	E(mdb_txn_commit(txn));
+	/* Let the pages become reusable */
+	for (i = 0; i < 2; i++) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		kval = count;
+		E(mdb_put(txn, dbi, &key, &data, 0));
+		E(mdb_txn_commit(txn));
+	}
+	mdb_env_info(env, &info);
+	printf("filled %d values, %zu pages\n", count, info.me_last_pgno + 1);
+
+	/* Now values of 2 to 8 pages */
+	for (j = 0; j < rounds; j++) {
+		t = now();
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		for (i = 0; i < per; i++) {
+			kval = count + 1 + rand() % count;
+			data.mv_size = mst.ms_psize * (1 + rand() % 7) + 64;
+			E(mdb_put(txn, dbi, &key, &data, 0));
+		}
+		E(mdb_txn_commit(txn));
+		dt = now() - t;
+		total += dt;
+		if (dt > max)
+			max = dt;
+	}
+	mdb_env_info(env, &info);
+	printf("%d txns of %d big values: avg %.2f ms, max %.2f ms, %zu pages\n",
+		rounds, per, total / rounds, max, info.me_last_pgno + 1);
+
+	mdb_dbi_close(env, dbi);
+	mdb_env_close(env);
+	free(val);
+
+	return 0;
+}
@@ -0,0 +1,204 @@
+/* mtest8.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2015 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for MDB_COMPRESS. Values of all sizes, compressible or not,
+ * must read back as written: from the writing txn, after commit, after
+ * being overwritten with other sizes, and after reopening the env.
+ * The file must then carry the compressed data version.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define RES(err, expr) ((rc = expr) == (err) || (CHECK(!rc, #expr), 0))
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define COUNT	64
+#define MAXLEN	(64*1024)
+
+/* Value i at generation g: sizes from a few bytes to many pages,
+ * every third one random and so not compressible.
+ */
+static size_t vsize(int i, int g)
+{
+	static const size_t sizes[] = { 10, 100, 1000, 2000, 4000, 5000,
+		8192, 12000, 30000, MAXLEN };
+	return sizes[(i + g) % (sizeof(sizes)/sizeof(sizes[0]))];
+}
+
+static void vfill(char *buf, int i, int g)
+{
+	size_t j, len = vsize(i, g);
+	unsigned int seed = i * 31 + g;
+
+	for (j = 0; j < len; j++) {
+		if (i % 3 == 0) {
+			seed = seed * 1103515245 + 12345;
+			buf[j] = seed >> 16;
+		} else {
+			buf[j] = "abcdefgh"[(j / 16 + i + g) % 8];
+		}
+	}
+}
+
+/* The mm_version of meta page n, just past the page header */
+static unsigned int file_version(const char *path, size_t psize, int n)
+{
+	FILE *fp;
+	unsigned int v[2];
+	int rc = 0;
+
+	fp = fopen(path, "rb");
+	CHECK(fp != NULL, "fopen");
+	CHECK(fseek(fp, n * psize + 16, SEEK_SET) == 0, "fseek");
+	CHECK(fread(v, sizeof(v[0]), 2, fp) == 2, "fread");
+	fclose(fp);
+	return v[1];
+}
+
+static void check(MDB_txn *txn, MDB_dbi dbi, int g, char *buf)
+{
+	MDB_val key, data;
+	int i, rc;
+
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = sizeof(i);
+		key.mv_data = &i;
+		E(mdb_get(txn, dbi, &key, &data));
+		vfill(buf, i, g);
+		CHECK(data.mv_size == vsize(i, g), "value size");
+		CHECK(!memcmp(data.mv_data, buf, data.mv_size), "value data");
+	}
+}
+
+static void put_all(MDB_txn *txn, MDB_dbi dbi, int g, char *buf)
+{
+	MDB_val key, data;
+	int i, rc;
+
+	for (i = 0; i < COUNT; i++) {
+		key.mv_size = sizeof(i);
+		key.mv_data = &i;
+		vfill(buf, i, g);
+		data.mv_size = vsize(i, g);
+		data.mv_data = buf;
+		E(mdb_put(txn, dbi, &key, &data, 0));
+	}
+}
+
+int main(int argc,char * argv[])
+{
+	int i, g, rc;
+	MDB_env *env;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn;
+	MDB_cursor *cursor;
+	MDB_stat mst;
+	unsigned int flags;
+	char *buf;
+	unsigned int plain;
+
+	buf = malloc(MAXLEN);
+
+	/* A file without compressed DBs keeps the plain version */
+	E(mdb_env_create(&env));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_open(env, "./testdb/plain.mdb", MDB_NOSUBDIR|MDB_NOSYNC, 0664));
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, "plain", MDB_CREATE, &dbi));
+	put_all(txn, dbi, 0, buf);
+	E(mdb_txn_commit(txn));
+	E(mdb_env_stat(env, &mst));
+	mdb_env_close(env);
+	plain = file_version("./testdb/plain.mdb", mst.ms_psize, 0);
+	CHECK(plain == file_version("./testdb/plain.mdb", mst.ms_psize, 1),
+		"plain file versions");
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_set_mapsize(env, 104857600));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, "zip", MDB_CREATE|MDB_COMPRESS|MDB_INTEGERKEY, &dbi));
+	E(mdb_dbi_flags(txn, dbi, &flags));
+	CHECK(flags & MDB_COMPRESS, "MDB_COMPRESS not recorded");
+	put_all(txn, dbi, 0, buf);
+	check(txn, dbi, 0, buf);
+	E(mdb_txn_commit(txn));
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	check(txn, dbi, 0, buf);
+	E(mdb_stat(txn, dbi, &mst));
+	printf("gen 0: %lu overflow pages\n", (unsigned long)mst.ms_overflow_pages);
+	mdb_txn_abort(txn);
+
+	/* Overwrite with other sizes, so compressed values replace plain
+	 * ones and big values replace small ones and back.
+	 */
+	for (g = 1; g < 4; g++) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		put_all(txn, dbi, g, buf);
+		E(mdb_txn_commit(txn));
+	}
+	g--;
+
+	/* Reads through a cursor, and a nested txn that is aborted */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_cursor_open(txn, dbi, &cursor));
+	i = 0;
+	while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) == 0) {
+		CHECK(*(int *)key.mv_data == i, "cursor key");
+		vfill(buf, i, g);
+		CHECK(data.mv_size == vsize(i, g), "cursor value size");
+		CHECK(!memcmp(data.mv_data, buf, data.mv_size), "cursor value data");
+		i++;
+	}
+	CHECK(rc == MDB_NOTFOUND, "mdb_cursor_get");
+	CHECK(i == COUNT, "cursor count");
+	mdb_cursor_close(cursor);
+	{
+		MDB_txn *child;
+		E(mdb_txn_begin(env, txn, 0, &child));
+		put_all(child, dbi, g + 1, buf);
+		check(child, dbi, g + 1, buf);
+		mdb_txn_abort(child);
+	}
+	check(txn, dbi, g, buf);
+	mdb_txn_abort(txn);
+	mdb_env_close(env);
+
+	/* Libraries without compression must refuse the file */
+	for (i = 0; i < 2; i++) {
+		unsigned int v = file_version("./testdb/data.mdb", mst.ms_psize, i);
+		printf("meta %d: data version %u, plain is %u\n", i, v, plain);
+		CHECK(v != plain, "compressed file has the plain version");
+	}
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_open(env, "./testdb", MDB_RDONLY, 0664));
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	E(mdb_dbi_open(txn, "zip", 0, &dbi));
+	check(txn, dbi, g, buf);
+	mdb_txn_abort(txn);
+	mdb_env_close(env);
+
+	free(buf);
+	return 0;
+}
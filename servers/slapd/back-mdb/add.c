@@ -65,6 +65,7 @@ mdb_add(Operation *op, SlapReply *rs )
 	}
 
 	/* begin transaction */
+	opinfo.moi_flag = MOI_GROUP;
 	rs->sr_err = mdb_opinfo_get( op, mdb, 0, &moi );
 	rs->sr_text = NULL;
 	if( rs->sr_err != 0 ) {
@@ -368,13 +369,13 @@ mdb_add(Operation *op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if ( op->o_noop ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		}
 
-		rs->sr_err = mdb_txn_commit( txn );
+		rs->sr_err = mdb_opinfo_commit( mdb, moi );
 		txn = NULL;
 		if ( rs->sr_err != 0 ) {
 			rs->sr_text = "txn_commit failed";
@@ -386,6 +387,8 @@ mdb_add(Operation *op, SlapReply *rs )
 		}
 	}
 
+	mdb_reader_expire( mdb, 0 );
+
 	Debug(LDAP_DEBUG_TRACE,
 		LDAP_XSTRING(mdb_add) ": added%s id=%08lx dn=\"%s\"\n",
 		op->o_noop ? " (no-op)" : "",
@@ -400,7 +403,7 @@ return_results:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
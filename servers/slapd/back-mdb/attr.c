@@ -164,6 +164,9 @@ mdb_attr_dbs_open(
 				}
 			}
 			mdb_attr_flush( mdb );
+		} else {
+			/* parked read txns can't see the new handles */
+			mdb_reader_expire( mdb, 1 );
 		}
 		ch_free( dbis );
 	}
@@ -372,6 +375,19 @@ fail:
 			goto fail;
 		}
 
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERED ) &&
+			!mdb_index_ordered_ok( ad->ad_type ) )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"ordered index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
 		Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
 			ad->ad_cname.bv_val, mask, 0 ); 
 
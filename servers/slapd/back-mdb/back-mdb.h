@@ -32,7 +32,9 @@ LDAP_BEGIN_DECL
 #define MDB_AD2ID		0
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
-#define MDB_NDB			3
+#define MDB_ID2ATTR		3
+#define MDB_ID2VAL		4
+#define MDB_NDB			5
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -50,6 +52,20 @@ LDAP_BEGIN_DECL
 /* Most users will never see this */
 #define DEFAULT_RTXN_SIZE	10000
 
+/* Threads generating keys when indices are added online */
+#define DEFAULT_INDEX_THREADS	4
+
+/* Index IDs read at about the cost of testing one entry, see
+ * list_candidates()
+ */
+#define DEFAULT_PLAN_COST	64
+
+/* liblmdb's reader table size, and the slots kept beyond
+ * the thread pool size when that is larger
+ */
+#define MDB_READERS_DEFAULT	126
+#define MDB_READERS_SLACK	32
+
 #define MDB_MONITOR_IDX
 
 typedef struct mdb_monitor_t {
@@ -60,6 +76,64 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* Attributes stored apart from their entries, see id2entry.c */
+typedef struct mdb_coldattr {
+	AttributeDescription *ca_desc;
+	ber_len_t	ca_minsize;
+} mdb_coldattr;
+
+/* Multi-valued attributes kept in their own sorted duplicates */
+typedef struct mdb_multival {
+	AttributeDescription *mv_desc;
+	unsigned	mv_hi;	/* move values out at this many */
+	unsigned	mv_lo;	/* move them back below this many */
+} mdb_multival;
+
+/* Progress of the online index task, see config.c */
+typedef struct mdb_ixstate {
+	ldap_pvt_thread_mutex_t	ix_mutex;
+	ldap_pvt_thread_cond_t	ix_cond;
+	int			ix_running;
+	int			ix_rc;
+	int			ix_workers;	/* worker tasks not yet finished */
+	int			ix_nready;
+	struct mdb_ixbatch	*ix_ready;	/* batches waiting to be written */
+	AttributeName	*ix_an;	/* attributes the new indices need */
+	ID			*ix_touched;	/* entries written while it runs */
+	ID			ix_next;	/* next ID to hand out */
+	ID			ix_last;
+	ID			ix_total;
+	ID			ix_done;
+	time_t		ix_start;
+} mdb_ixstate;
+
+/* Write ops sharing the commit of one txn, see id2entry.c */
+typedef struct mdb_gcstate {
+	ldap_pvt_thread_mutex_t	gc_mutex;
+	ldap_pvt_thread_cond_t	gc_cond;
+	MDB_txn		*gc_txn;	/* parent txn of the open batch */
+	int			gc_starting;	/* a leader is waiting for the write lock */
+	int			gc_busy;	/* an op is running in a child txn */
+	int			gc_waiting;	/* ops waiting to start a child txn */
+	int			gc_nops;	/* ops in the open batch */
+	unsigned long	gc_batch;	/* number of the open batch */
+	unsigned long	gc_done;	/* last batch committed */
+	int			gc_rc;	/* and its result */
+} mdb_gcstate;
+
+/* A pool thread's read txn, see id2entry.c */
+typedef struct mdb_rtxn {
+	ldap_pvt_thread_mutex_t	rt_mutex;
+	MDB_txn		*rt_txn;
+	struct mdb_info	*rt_mdb;
+	time_t		rt_pinned;	/* when its snapshot was taken */
+	int			rt_state;
+#define	MDB_RT_RESET	0
+#define	MDB_RT_ACTIVE	1	/* in use by an operation */
+#define	MDB_RT_PARKED	2	/* idle, kept on the latest snapshot */
+	LDAP_LIST_ENTRY(mdb_rtxn)	rt_next;
+} mdb_rtxn;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -69,6 +143,7 @@ struct mdb_info {
 	int			mi_dbenv_mode;
 
 	size_t		mi_mapsize;
+	unsigned int	mi_psize;	/* page size for a new env, 0 for default */
 	ID			mi_nextid;
 	size_t		mi_maxentrysize;
 
@@ -78,13 +153,31 @@ struct mdb_info {
 	void		*mi_search_stack;
 	int			mi_search_stack_depth;
 	int			mi_readers;
+	ldap_pvt_thread_mutex_t	mi_rtxn_mutex;
+	LDAP_LIST_HEAD(mdb_rtxn_list, mdb_rtxn)	mi_rtxns;
 
 	uint32_t	mi_rtxn_size;
 	int			mi_txn_cp;
+	uint32_t	mi_gc_max;	/* ops per group commit, 0 for none */
+	mdb_gcstate	mi_gc;
+	int			mi_compress;	/* compress big entries and cold attrs */
 	uint32_t	mi_txn_cp_min;
 	uint32_t	mi_txn_cp_kbyte;
 	struct re_s		*mi_txn_cp_task;
+	uint32_t	mi_compact_pages;	/* pages to move per run, 0 for none */
+	uint32_t	mi_compact_interval;
+	size_t		mi_compact_txnid;	/* last txn seen by the compact task */
+	struct re_s		*mi_compact_task;
 	struct re_s		*mi_index_task;
+	int			mi_index_threads;
+	mdb_ixstate	mi_ix;
+	uint32_t	mi_plan_cost;	/* IDs per entry test, 0 disables planning */
+
+	int			mi_ncoldattrs;
+	mdb_coldattr	*mi_coldattrs;
+
+	int			mi_nmultivals;
+	mdb_multival	*mi_multivals;
 
 	mdb_monitor_t	mi_monitor;
 
@@ -108,18 +201,24 @@ struct mdb_info {
 };
 
 #define mi_id2entry	mi_dbis[MDB_ID2ENTRY]
+#define mi_id2attr	mi_dbis[MDB_ID2ATTR]
+#define mi_id2val	mi_dbis[MDB_ID2VAL]
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
 	MDB_txn*	moi_txn;
+	mdb_rtxn	*moi_rtxn;	/* if moi_txn is the thread's read txn */
+	unsigned long	moi_batch;	/* if moi_txn is a child in a group commit */
 	int			moi_ref;
 	char		moi_flag;
 } mdb_op_info;
 #define MOI_READER	0x01
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
+#define MOI_GROUP	0x08	/* may join a group commit */
+#define MOI_LEADER	0x10	/* commits the group's parent txn */
 
 /* Copy an ID "src" to pointer "dst" in big-endian byte order */
 #define MDB_ID2DISK( src, dst )	\
@@ -163,6 +262,32 @@ typedef struct mdb_attrixinfo {
 	AttrInfo *ai_ai;
 } AttrIxInfo;
 
+/* Keys generated for the online indexer. The workers collect the keys
+ * of a range of entries here, the task writes them out sorted.
+ */
+typedef struct mdb_ixkey {
+	AttrInfo	*ik_ai;
+	ID			ik_id;
+	size_t		ik_off;	/* key bytes in ib_buf */
+	ber_len_t	ik_len;
+	char		*ik_val;	/* set once ib_buf is final */
+} mdb_ixkey;
+
+typedef struct mdb_ixbatch {
+	OpExtra		ib_oe;
+	struct mdb_ixbatch	*ib_next;
+	AttrInfo	*ib_ai;	/* index of the keys being added */
+	mdb_ixkey	*ib_keys;
+	int			ib_nkeys;
+	int			ib_maxkeys;
+	char		*ib_buf;
+	size_t		ib_len;
+	size_t		ib_size;
+	ID			ib_lo;	/* entry IDs covered */
+	ID			ib_hi;
+	ID			ib_nentries;
+} mdb_ixbatch;
+
 /* These flags must not clash with SLAP_INDEX flags or ops in slap.h! */
 #define	MDB_INDEX_DELETING	0x8000U	/* index is being modified */
 #define	MDB_INDEX_UPDATE_OP	0x03	/* performing an index update */
@@ -185,6 +310,10 @@ typedef struct AttrList {
 #define	ALIGNER	(sizeof(size_t)-1)
 #endif
 
+/* Ordered index keys: a two byte prefix followed by the value */
+#define MDB_ORDERED_PREFIXLEN	2
+#define MDB_ORDERED_KEYLEN	128
+
 typedef struct IndexRbody {
 	AttrInfo *ai;
 	AttrList *attrs;
@@ -26,6 +26,7 @@ mdb_compare( Operation *op, SlapReply *rs )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	Entry		*e = NULL;
+	Attribute	*a;
 	int		manageDSAit = get_manageDSAit( op );
 
 	MDB_txn		*rtxn;
@@ -114,7 +115,26 @@ mdb_compare( Operation *op, SlapReply *rs )
 		goto done;
 	}
 
-	rs->sr_err = slap_compare_entry( op, e, op->orc_ava );
+	/* values kept in id2v can be looked up directly */
+	a = attrs_find( e->e_attrs, op->orc_ava->aa_desc );
+	if ( a && ( a->a_flags & SLAP_ATTR_BIG_MULTI ) &&
+		a->a_desc == op->orc_ava->aa_desc &&
+		!attrs_find( a->a_next, op->orc_ava->aa_desc ) &&
+		!get_assert( op ) &&
+		access_allowed( op, e, a->a_desc, &op->orc_ava->aa_value,
+			ACL_COMPARE, NULL ))
+	{
+		rs->sr_err = mdb_id2v_find( op, rtxn, e->e_id, a,
+			&op->orc_ava->aa_value );
+		if ( rs->sr_err == MDB_SUCCESS )
+			rs->sr_err = LDAP_COMPARE_TRUE;
+		else if ( rs->sr_err == MDB_NOTFOUND )
+			rs->sr_err = LDAP_COMPARE_FALSE;
+		else
+			rs->sr_err = slap_compare_entry( op, e, op->orc_ava );
+	} else {
+		rs->sr_err = slap_compare_entry( op, e, op->orc_ava );
+	}
 
 return_results:
 	send_ldap_result( op, rs );
@@ -128,7 +148,7 @@ return_results:
 
 done:
 	if ( moi == &opinfo ) {
-		mdb_txn_reset( moi->moi_txn );
+		mdb_reader_release( mdb, moi, 1 );
 		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
 	} else {
 		moi->moi_ref--;
@@ -22,6 +22,7 @@
 #include <ac/errno.h>
 
 #include "back-mdb.h"
+#include "idl.h"
 
 #include "config.h"
 
@@ -32,6 +33,9 @@ static ConfigDriver mdb_cf_gen;
 
 enum {
 	MDB_CHKPT = 1,
+	MDB_COLDATTRS,
+	MDB_COMPACT,
+	MDB_COMPRESSION,
 	MDB_DIRECTORY,
 	MDB_DBNOSYNC,
 	MDB_ENVFLAGS,
@@ -39,6 +43,8 @@ enum {
 	MDB_MAXREADERS,
 	MDB_MAXSIZE,
 	MDB_MODE,
+	MDB_MULTIVAL,
+	MDB_PAGESIZE,
 	MDB_SSTACK,
 };
 
@@ -52,6 +58,19 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.2 NAME 'olcDbCheckpoint' "
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",NULL, NULL },
+	{ "coldattrs", "attrs> <minsize", 2, 3, 0, ARG_MAGIC|MDB_COLDATTRS,
+		mdb_cf_gen, "( OLcfgDbAt:12.6 NAME 'olcDbColdAttrs' "
+			"DESC 'Attributes to store apart from their entries' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "compact", "pages> <seconds", 3, 3, 0, ARG_MAGIC|MDB_COMPACT,
+		mdb_cf_gen, "( OLcfgDbAt:12.12 NAME 'olcDbCompact' "
+			"DESC 'Pages to move per idle interval, and the interval in seconds' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "compress", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_COMPRESSION,
+		mdb_cf_gen, "( OLcfgDbAt:12.10 NAME 'olcDbCompress' "
+			"DESC 'Compress entries too large to fit in a page' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "dbnosync", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DBNOSYNC,
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
@@ -61,11 +80,26 @@ static ConfigTable mdbcfg[] = {
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "filterplan", "ids", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_plan_cost),
+		"( OLcfgDbAt:12.13 NAME 'olcDbFilterPlan' "
+		"DESC 'Index IDs worth reading per entry test when planning filters, 0 to disable planning' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "groupcommit", "num", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_gc_max),
+		"( OLcfgDbAt:12.9 NAME 'olcDbGroupCommit' "
+		"DESC 'Maximum number of write operations sharing one commit' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "indexthreads", "num", 2, 2, 0, ARG_INT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_index_threads),
+		"( OLcfgDbAt:12.8 NAME 'olcDbIndexThreads' "
+		"DESC 'Number of threads generating keys when indices are added online' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "maxentrysize", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_maxentrysize),
 		"( OLcfgDbAt:12.4 NAME 'olcDbMaxEntrySize' "
@@ -83,6 +117,15 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:0.3 NAME 'olcDbMode' "
 		"DESC 'Unix permissions of database files' "
 		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "multival", "attrs> <hi[,lo]", 3, 3, 0, ARG_MAGIC|MDB_MULTIVAL,
+		mdb_cf_gen, "( OLcfgDbAt:12.7 NAME 'olcDbMultival' "
+		"DESC 'Value counts at which attributes move to and from separate storage' "
+		"EQUALITY caseIgnoreMatch "
+		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "pagesize", "size", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_PAGESIZE,
+		mdb_cf_gen, "( OLcfgDbAt:12.11 NAME 'olcDbPageSize' "
+		"DESC 'Page size in bytes of a newly created database' "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
@@ -105,7 +148,10 @@ static ConfigOCs mdbocs[] = {
 		"MUST olcDbDirectory "
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
-		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize ) )",
+		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
+		"olcDbColdAttrs $ olcDbMultival $ olcDbIndexThreads $ "
+		"olcDbGroupCommit $ olcDbCompress $ olcDbPageSize $ olcDbCompact $ "
+		"olcDbFilterPlan ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -116,6 +162,7 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("pagestats"),	MDB_PAGESTATS },
 	{ BER_BVNULL, 0 }
 };
 
@@ -133,6 +180,462 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
+/* Move pages from the end of the file into free space, so the file
+ * can shrink after many entries were deleted. Only runs if nothing
+ * else has been committed since the last run, and then moves at most
+ * mi_compact_pages pages in one txn.
+ */
+static void *
+mdb_compact( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	struct mdb_info *mdb = rtask->arg;
+	MDB_envinfo mei;
+	MDB_txn *txn;
+	unsigned int moved = 0;
+	int rc;
+
+	if ( !( mdb->mi_flags & MDB_IS_OPEN ))
+		goto leave;
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	if ( mei.me_last_txnid != mdb->mi_compact_txnid ) {
+		mdb->mi_compact_txnid = mei.me_last_txnid;
+		goto leave;
+	}
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc == 0 ) {
+		rc = mdb_txn_compact( txn, mdb->mi_compact_pages, &moved );
+		if ( rc == 0 && moved ) {
+			rc = mdb_txn_commit( txn );
+		} else {
+			mdb_txn_abort( txn );
+		}
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_compact: failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+	} else if ( moved ) {
+		Debug( LDAP_DEBUG_TRACE, "mdb_compact: moved %u pages\n",
+			moved, 0, 0 );
+		/* let go of the pages that were just moved */
+		mdb_reader_expire( mdb, 0 );
+		mdb_env_info( mdb->mi_dbenv, &mei );
+		mdb->mi_compact_txnid = mei.me_last_txnid;
+	}
+
+leave:
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
+
+/* Online indexing.
+ *
+ * The entries are handed out in ranges of MDB_IX_CHUNK IDs. Worker tasks
+ * decode the entries of a range in a read txn and collect the keys of
+ * the new indices in an mdb_ixbatch. The index task itself writes the
+ * finished batches, all that are waiting in one txn with their keys in
+ * sorted order, and works on a range of its own whenever none are.
+ *
+ * Writers already maintain the new indices while this runs, but a
+ * worker may have read an entry before it was written. The IDs of all
+ * entries written meanwhile are kept in ix_touched, and such entries
+ * are indexed again from the task's write txn instead.
+ */
+#define MDB_IX_CHUNK	1024
+
+/* Collect the keys of one index for the batch, called from indexer() */
+int
+mdb_ixbatch_keys(
+	BackendDB	*be,
+	MDB_cursor	*mc,
+	struct berval *keys,
+	ID			id )
+{
+	mdb_ixbatch *ib = (mdb_ixbatch *)mc;
+	mdb_ixkey *ik;
+	int i;
+
+	for ( i = 0; !BER_BVISNULL( &keys[i] ); i++ ) {
+		if ( ib->ib_nkeys == ib->ib_maxkeys ) {
+			ib->ib_maxkeys = ib->ib_maxkeys ? ib->ib_maxkeys * 2 : 1024;
+			ib->ib_keys = ch_realloc( ib->ib_keys,
+				ib->ib_maxkeys * sizeof( mdb_ixkey ));
+		}
+		if ( ib->ib_len + keys[i].bv_len > ib->ib_size ) {
+			if ( !ib->ib_size )
+				ib->ib_size = 65536;
+			while ( ib->ib_len + keys[i].bv_len > ib->ib_size )
+				ib->ib_size *= 2;
+			ib->ib_buf = ch_realloc( ib->ib_buf, ib->ib_size );
+		}
+		ik = &ib->ib_keys[ib->ib_nkeys++];
+		ik->ik_ai = ib->ib_ai;
+		ik->ik_id = id;
+		ik->ik_off = ib->ib_len;
+		ik->ik_len = keys[i].bv_len;
+		AC_MEMCPY( ib->ib_buf + ib->ib_len, keys[i].bv_val, keys[i].bv_len );
+		ib->ib_len += keys[i].bv_len;
+	}
+	return 0;
+}
+
+/* Note an entry written while the index task runs */
+void
+mdb_online_index_touch( struct mdb_info *mdb, ID id )
+{
+	if ( !mdb->mi_ix.ix_running )
+		return;
+	ldap_pvt_thread_mutex_lock( &mdb->mi_ix.ix_mutex );
+	if ( mdb->mi_ix.ix_touched )
+		mdb_idl_insert( mdb->mi_ix.ix_touched, id );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_ix.ix_mutex );
+}
+
+static int
+mdb_ix_touched( ID *ids, ID id )
+{
+	unsigned x;
+
+	if ( MDB_IDL_IS_RANGE( ids ))
+		return id >= MDB_IDL_RANGE_FIRST( ids ) &&
+			id <= MDB_IDL_RANGE_LAST( ids );
+	x = mdb_idl_search( ids, id );
+	return x <= ids[0] && ids[x] == id;
+}
+
+static void
+mdb_ix_free( mdb_ixbatch *ib )
+{
+	mdb_ixbatch *next;
+
+	for ( ; ib; ib = next ) {
+		next = ib->ib_next;
+		ch_free( ib->ib_keys );
+		ch_free( ib->ib_buf );
+		ch_free( ib );
+	}
+}
+
+/* Wait for the other threads, without holding up a pool pause */
+static void
+mdb_ix_wait( mdb_ixstate *ix )
+{
+	ldap_pvt_thread_pool_idle( &connection_pool );
+	ldap_pvt_thread_cond_wait( &ix->ix_cond, &ix->ix_mutex );
+	ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+	ldap_pvt_thread_pool_unidle( &connection_pool );
+	ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+}
+
+/* Hand out the next range of entries, ix_mutex must be held */
+static mdb_ixbatch *
+mdb_ix_range( mdb_ixstate *ix )
+{
+	mdb_ixbatch *ib;
+
+	if ( ix->ix_rc || slapd_shutdown || ix->ix_next > ix->ix_last )
+		return NULL;
+
+	ib = ch_calloc( 1, sizeof( mdb_ixbatch ));
+	ib->ib_lo = ix->ix_next;
+	if ( ix->ix_last - ib->ib_lo < MDB_IX_CHUNK )
+		ib->ib_hi = ix->ix_last;
+	else
+		ib->ib_hi = ib->ib_lo + MDB_IX_CHUNK - 1;
+	ix->ix_next = ib->ib_hi + 1;
+	return ib;
+}
+
+/* Generate the keys of the entries in the batch's range. The thread's
+ * read txn is only held meanwhile, and goes through the same state
+ * changes as an operation's so that writers and the monitor see it.
+ */
+static int
+mdb_ix_chunk(
+	Operation *op,
+	mdb_op_info *moi,
+	MDB_cursor *mc,
+	mdb_ixbatch *ib )
+{
+	struct mdb_info *mdb = op->o_bd->be_private;
+	MDB_txn *txn = moi->moi_txn;
+	MDB_val key, data;
+	Entry *e;
+	ID id;
+	int rc;
+
+	rc = mdb_reader_renew( mdb, moi );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_renew( txn, mc );
+	if ( rc )
+		goto done;
+
+	ib->ib_oe.oe_key = &mdb->mi_ix;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &ib->ib_oe, oe_next );
+
+	id = ib->ib_lo;
+	key.mv_data = &id;
+	key.mv_size = sizeof( ID );
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+	while ( rc == 0 ) {
+		memcpy( &id, key.mv_data, sizeof( ID ));
+		if ( id > ib->ib_hi )
+			break;
+		/* skip stubs from missing parents */
+		if ( data.mv_size ) {
+			rc = mdb_entry_decode( op, txn, &data, id, mdb->mi_ix.ix_an, &e );
+			if ( rc )
+				break;
+			e->e_id = id;
+			e->e_name.bv_val = NULL;
+			e->e_nname.bv_val = NULL;
+			rc = mdb_index_entry( op, NULL, MDB_INDEX_UPDATE_OP, e );
+			mdb_entry_return( op, e );
+			if ( rc )
+				break;
+			ib->ib_nentries++;
+		}
+		rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, &ib->ib_oe, OpExtra, oe_next );
+done:
+	mdb_reader_release( mdb, moi, 0 );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"reading entries failed: %s (%d)\n",
+			op->o_bd->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	}
+	return rc;
+}
+
+static int
+mdb_ix_keycmp( const void *v1, const void *v2 )
+{
+	const mdb_ixkey *k1 = v1, *k2 = v2;
+	ber_len_t len;
+	int rc;
+
+	if ( k1->ik_ai != k2->ik_ai )
+		return k1->ik_ai->ai_dbi < k2->ik_ai->ai_dbi ? -1 : 1;
+	len = k1->ik_len < k2->ik_len ? k1->ik_len : k2->ik_len;
+	rc = memcmp( k1->ik_val, k2->ik_val, len );
+	if ( rc == 0 )
+		rc = ( k1->ik_len > k2->ik_len ) - ( k1->ik_len < k2->ik_len );
+	if ( rc == 0 )
+		rc = ( k1->ik_id > k2->ik_id ) - ( k1->ik_id < k2->ik_id );
+	return rc;
+}
+
+/* Write out a list of batches in one txn, then free them */
+static int
+mdb_ix_commit( Operation *op, mdb_ixbatch *list )
+{
+	struct mdb_info *mdb = op->o_bd->be_private;
+	mdb_ixstate *ix = &mdb->mi_ix;
+	mdb_ixbatch *ib;
+	mdb_ixkey *ik, *sorted = NULL;
+	AttrInfo *ai = NULL;
+	MDB_txn *txn;
+	MDB_cursor *mc = NULL, *mci = NULL;
+	MDB_val key, data;
+	struct berval keys[2];
+	Entry *e;
+	ID *touched = NULL, id, nentries = 0;
+	size_t size;
+	int i, n, rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc )
+		goto leave;
+
+	/* Writers are locked out now, so these are all the entries
+	 * that may have changed since the batches were read.
+	 */
+	ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+	size = MDB_IDL_SIZEOF( ix->ix_touched );
+	touched = ch_malloc( size );
+	AC_MEMCPY( touched, ix->ix_touched, size );
+	ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+
+	n = 0;
+	for ( ib = list; ib; ib = ib->ib_next )
+		n += ib->ib_nkeys;
+	if ( n ) {
+		sorted = ch_malloc( n * sizeof( mdb_ixkey ));
+		n = 0;
+		for ( ib = list; ib; ib = ib->ib_next ) {
+			for ( i = 0; i < ib->ib_nkeys; i++ ) {
+				if ( mdb_ix_touched( touched, ib->ib_keys[i].ik_id ))
+					continue;
+				sorted[n] = ib->ib_keys[i];
+				sorted[n].ik_val = ib->ib_buf + sorted[n].ik_off;
+				n++;
+			}
+		}
+		qsort( sorted, n, sizeof( mdb_ixkey ), mdb_ix_keycmp );
+	}
+
+	BER_BVZERO( &keys[1] );
+	for ( i = 0; i < n; i++ ) {
+		ik = &sorted[i];
+		if ( ik->ik_ai != ai ) {
+			if ( mc )
+				mdb_cursor_close( mc );
+			mc = NULL;
+			ai = ik->ik_ai;
+			rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+			if ( rc )
+				goto fail;
+		}
+		keys[0].bv_val = ik->ik_val;
+		keys[0].bv_len = ik->ik_len;
+		rc = mdb_idl_insert_keys( op->o_bd, mc, keys, ik->ik_id );
+		if ( rc )
+			goto fail;
+	}
+
+	/* Index the entries that were written meanwhile as they are now */
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mci );
+	if ( rc )
+		goto fail;
+	for ( ib = list; ib; ib = ib->ib_next ) {
+		nentries += ib->ib_nentries;
+		if ( MDB_IDL_IS_ZERO( touched ) ||
+			MDB_IDL_FIRST( touched ) > ib->ib_hi ||
+			MDB_IDL_LAST( touched ) < ib->ib_lo )
+			continue;
+		id = ib->ib_lo;
+		key.mv_data = &id;
+		key.mv_size = sizeof( ID );
+		rc = mdb_cursor_get( mci, &key, &data, MDB_SET_RANGE );
+		while ( rc == 0 ) {
+			memcpy( &id, key.mv_data, sizeof( ID ));
+			if ( id > ib->ib_hi )
+				break;
+			if ( mdb_ix_touched( touched, id ) && data.mv_size ) {
+				rc = mdb_entry_decode( op, txn, &data, id, mdb->mi_ix.ix_an, &e );
+				if ( rc )
+					break;
+				e->e_id = id;
+				e->e_name.bv_val = NULL;
+				e->e_nname.bv_val = NULL;
+				rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+				mdb_entry_return( op, e );
+				if ( rc )
+					break;
+			}
+			rc = mdb_cursor_get( mci, &key, &data, MDB_NEXT );
+		}
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		if ( rc )
+			goto fail;
+	}
+
+	rc = mdb_txn_commit( txn );
+	txn = NULL;
+	if ( rc == 0 ) {
+		mdb_reader_expire( mdb, 0 );
+		ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+		ix->ix_done += nentries;
+		ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+	}
+
+fail:
+	if ( txn )
+		mdb_txn_abort( txn );
+leave:
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"writing index keys failed: %s (%d)\n",
+			op->o_bd->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	}
+	ch_free( sorted );
+	ch_free( touched );
+	mdb_ix_free( list );
+	return rc;
+}
+
+/* Generate keys for ranges of entries while there are any left */
+static void *
+mdb_ix_worker( void *ctx, void *arg )
+{
+	BackendDB *be = arg;
+	struct mdb_info *mdb = be->be_private;
+	mdb_ixstate *ix = &mdb->mi_ix;
+
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+
+	MDB_cursor *mc = NULL;
+	mdb_ixbatch *ib;
+	int rc, maxready;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	op->o_bd = be;
+
+	/* let each worker get one batch ahead of the writes */
+	maxready = 2 * mdb->mi_index_threads;
+
+	rc = mdb_opinfo_get( op, mdb, 1, &moi );
+	if ( rc == 0 ) {
+		rc = mdb_cursor_open( moi->moi_txn, mdb->mi_id2entry, &mc );
+		mdb_reader_release( mdb, moi, 0 );
+	}
+
+	while ( rc == 0 ) {
+		ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+		while ( ix->ix_nready >= maxready && !ix->ix_rc && !slapd_shutdown )
+			mdb_ix_wait( ix );
+		ib = mdb_ix_range( ix );
+		ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+		if ( !ib )
+			break;
+
+		rc = mdb_ix_chunk( op, moi, mc, ib );
+
+		ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+		if ( rc == 0 ) {
+			ib->ib_next = ix->ix_ready;
+			ix->ix_ready = ib;
+			ix->ix_nready++;
+		}
+		ldap_pvt_thread_cond_broadcast( &ix->ix_cond );
+		ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+		if ( rc )
+			mdb_ix_free( ib );
+
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+	}
+
+	if ( mc )
+		mdb_cursor_close( mc );
+	if ( moi == &opinfo )
+		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
+
+	ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+	if ( rc && !ix->ix_rc )
+		ix->ix_rc = rc;
+	ix->ix_workers--;
+	ldap_pvt_thread_cond_broadcast( &ix->ix_cond );
+	ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+
+	return NULL;
+}
+
 /* reindex entries on the fly */
 static void *
 mdb_online_index( void *ctx, void *arg )
@@ -140,91 +643,153 @@ mdb_online_index( void *ctx, void *arg )
 	struct re_s *rtask = arg;
 	BackendDB *be = rtask->arg;
 	struct mdb_info *mdb = be->be_private;
+	mdb_ixstate *ix = &mdb->mi_ix;
 
 	Connection conn = {0};
 	OperationBuffer opbuf;
 	Operation *op;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
 
-	MDB_cursor *curs;
+	MDB_cursor *curs = NULL;
 	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
-	Entry *e;
-	int rc, getnext = 1;
-	int i;
+	MDB_stat st;
+	mdb_ixbatch *ib;
+	ID last = 0;
+	int rc, i, n;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
 
 	op->o_bd = be;
 
-	id = 1;
-	key.mv_size = sizeof(ID);
+	/* Only the attributes of the new indices need decoding */
+	ix->ix_an = ch_calloc( mdb->mi_nattrs + 1, sizeof( AttributeName ));
+	for ( i = 0, n = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+		if ( ai->ai_indexmask & MDB_INDEX_DELETING
+			|| !( ai->ai_newmask & ~ai->ai_indexmask ))
+			continue;
+		ix->ix_an[n].an_desc = ai->ai_desc;
+		ix->ix_an[n].an_name = ai->ai_desc->ad_cname;
+		n++;
+	}
 
-	while ( 1 ) {
-		if ( slapd_shutdown )
-			break;
+	memset( &st, 0, sizeof( st ));
+	rc = mdb_opinfo_get( op, mdb, 1, &moi );
+	if ( rc == 0 ) {
+		rc = mdb_stat( moi->moi_txn, mdb->mi_id2entry, &st );
+		if ( rc == 0 )
+			rc = mdb_cursor_open( moi->moi_txn, mdb->mi_id2entry, &curs );
+		if ( rc == 0 && n ) {
+			rc = mdb_cursor_get( curs, &key, &data, MDB_LAST );
+			if ( rc == 0 )
+				memcpy( &last, key.mv_data, sizeof( ID ));
+			else if ( rc == MDB_NOTFOUND )
+				rc = 0;
+		}
+		mdb_reader_release( mdb, moi, 0 );
+	}
 
+	ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+	ix->ix_touched = ch_malloc( MDB_IDL_DB_SIZE * sizeof( ID ));
+	MDB_IDL_ZERO( ix->ix_touched );
+	ix->ix_rc = rc;
+	ix->ix_next = 1;
+	ix->ix_last = last;
+	ix->ix_total = last ? st.ms_entries : 0;
+	ix->ix_done = 0;
+	ix->ix_start = slap_get_time();
+	ix->ix_running = 1;
+	ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+
+	/* A writer that started before ix_running was set did not note
+	 * its entries. Wait for it to finish before reading anything.
+	 */
+	if ( rc == 0 && last ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
-		if ( rc )
-			break;
-		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
-		if ( rc ) {
+		if ( rc == 0 )
 			mdb_txn_abort( txn );
+	}
+
+	/* The workers run in the connection pool. This task writes their
+	 * batches, so it is not left waiting for workers that can't start.
+	 */
+	n = 0;
+	if ( rc == 0 && last > MDB_IX_CHUNK )
+		n = mdb->mi_index_threads - 1;
+	ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+	if ( rc )
+		ix->ix_rc = rc;
+	for ( ix->ix_workers = 0; ix->ix_workers < n; ix->ix_workers++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_ix_worker, be ))
 			break;
-		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
-			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
-				break;
-			}
-			memcpy( &id, key.mv_data, sizeof( id ));
-		}
+	}
 
-		rc = mdb_id2entry( op, curs, id, &e );
-		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
+	while ( 1 ) {
+		if ( ix->ix_ready ) {
+			ib = ix->ix_ready;
+			ix->ix_ready = NULL;
+			ix->ix_nready = 0;
+			ldap_pvt_thread_cond_broadcast( &ix->ix_cond );
+			if ( ix->ix_rc || slapd_shutdown ) {
+				mdb_ix_free( ib );
 				continue;
 			}
-			break;
-		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
-		if ( rc == 0 ) {
-			rc = mdb_txn_commit( txn );
-			txn = NULL;
+			ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+			rc = mdb_ix_commit( op, ib );
+
+		} else if (( ib = mdb_ix_range( ix )) != NULL ) {
+			ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+			rc = mdb_ix_chunk( op, moi, curs, ib );
+			if ( rc == 0 )
+				rc = mdb_ix_commit( op, ib );
+			else
+				mdb_ix_free( ib );
+
+		} else if ( ix->ix_workers ) {
+			/* workers that have not started yet are not needed */
+			while ( ix->ix_workers && ldap_pvt_thread_pool_retract(
+				&connection_pool, mdb_ix_worker, be ) > 0 )
+				ix->ix_workers--;
+			if ( ix->ix_workers )
+				mdb_ix_wait( ix );
+			continue;
+
 		} else {
-			mdb_txn_abort( txn );
-			txn = NULL;
-		}
-		if ( rc ) {
-			Debug( LDAP_DEBUG_ANY,
-				LDAP_XSTRING(mdb_online_index) ": database %s: "
-				"txn_commit failed: %s (%d)\n",
-				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
 			break;
 		}
-		id++;
-		getnext = 1;
+
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+		ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+		if ( rc && !ix->ix_rc )
+			ix->ix_rc = rc;
 	}
+	rc = ix->ix_rc;
+	ix->ix_running = 0;
+	ch_free( ix->ix_touched );
+	ix->ix_touched = NULL;
+	ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
 
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
-		{
-			continue;
+	if ( curs )
+		mdb_cursor_close( curs );
+	if ( moi == &opinfo )
+		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
+	ch_free( ix->ix_an );
+	ix->ix_an = NULL;
+
+	/* Leave unfinished indices unused, they would miss entries */
+	if ( rc == 0 && !slapd_shutdown ) {
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
+				|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
+			{
+				continue;
+			}
+			mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
+			mdb->mi_attrs[ i ]->ai_newmask = 0;
 		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
 	}
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
@@ -293,6 +858,23 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			} break;
 
+		case MDB_COMPACT:
+			if ( mdb->mi_compact_pages ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_compact_pages, mdb->mi_compact_interval );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp ) {
 				char buf[64];
@@ -310,6 +892,43 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_COLDATTRS: {
+			int i;
+			for ( i=0; i<mdb->mi_ncoldattrs; i++ ) {
+				char buf[SLAP_TEXT_BUFLEN];
+				struct berval bv;
+				mdb_coldattr *ca = &mdb->mi_coldattrs[i];
+				if ( ca->ca_minsize )
+					bv.bv_len = snprintf( buf, sizeof(buf), "%s %lu",
+						ca->ca_desc->ad_cname.bv_val,
+						(unsigned long) ca->ca_minsize );
+				else
+					bv.bv_len = snprintf( buf, sizeof(buf), "%s",
+						ca->ca_desc->ad_cname.bv_val );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				}
+			}
+			if ( !c->rvalue_vals ) rc = 1;
+			} break;
+
+		case MDB_MULTIVAL: {
+			int i;
+			for ( i=0; i<mdb->mi_nmultivals; i++ ) {
+				char buf[SLAP_TEXT_BUFLEN];
+				struct berval bv;
+				mdb_multival *mv = &mdb->mi_multivals[i];
+				bv.bv_len = snprintf( buf, sizeof(buf), "%s %u,%u",
+					mv->mv_desc->ad_cname.bv_val, mv->mv_hi, mv->mv_lo );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				}
+			}
+			if ( !c->rvalue_vals ) rc = 1;
+			} break;
+
 		case MDB_DIRECTORY:
 			if ( mdb->mi_dbenv_home ) {
 				c->value_string = ch_strdup( mdb->mi_dbenv_home );
@@ -318,6 +937,10 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_COMPRESSION:
+			c->value_int = mdb->mi_compress;
+			break;
+
 		case MDB_DBNOSYNC:
 			if ( mdb->mi_dbenv_flags & MDB_NOSYNC )
 				c->value_int = 1;
@@ -346,6 +969,13 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			c->value_ulong = mdb->mi_mapsize;
 			break;
+
+		case MDB_PAGESIZE:
+			if ( mdb->mi_psize )
+				c->value_uint = mdb->mi_psize;
+			else
+				rc = 1;
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -365,6 +995,10 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			break;
 
+		case MDB_PAGESIZE:
+			mdb->mi_psize = 0;
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp_task ) {
 				struct re_s *re = mdb->mi_txn_cp_task;
@@ -377,6 +1011,49 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			mdb->mi_txn_cp = 0;
 			break;
+		case MDB_COMPACT:
+			if ( mdb->mi_compact_task ) {
+				struct re_s *re = mdb->mi_compact_task;
+				mdb->mi_compact_task = NULL;
+				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+				if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ) )
+					ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+				ldap_pvt_runqueue_remove( &slapd_rq, re );
+				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			}
+			mdb->mi_compact_pages = 0;
+			mdb->mi_compact_interval = 0;
+			break;
+		/* only affects entries written from now on, existing
+		 * id2a records are still found by the readers
+		 */
+		case MDB_COLDATTRS:
+			if ( c->valx == -1 || mdb->mi_ncoldattrs <= 1 ) {
+				ch_free( mdb->mi_coldattrs );
+				mdb->mi_coldattrs = NULL;
+				mdb->mi_ncoldattrs = 0;
+			} else if ( c->valx < mdb->mi_ncoldattrs ) {
+				mdb->mi_ncoldattrs--;
+				AC_MEMCPY( &mdb->mi_coldattrs[c->valx],
+					&mdb->mi_coldattrs[c->valx+1],
+					( mdb->mi_ncoldattrs - c->valx ) * sizeof(mdb_coldattr));
+			}
+			break;
+		/* like coldattrs, existing id2v values stay readable and
+		 * move back into their entries when next written
+		 */
+		case MDB_MULTIVAL:
+			if ( c->valx == -1 || mdb->mi_nmultivals <= 1 ) {
+				ch_free( mdb->mi_multivals );
+				mdb->mi_multivals = NULL;
+				mdb->mi_nmultivals = 0;
+			} else if ( c->valx < mdb->mi_nmultivals ) {
+				mdb->mi_nmultivals--;
+				AC_MEMCPY( &mdb->mi_multivals[c->valx],
+					&mdb->mi_multivals[c->valx+1],
+					( mdb->mi_nmultivals - c->valx ) * sizeof(mdb_multival));
+			}
+			break;
 		case MDB_DIRECTORY:
 			mdb->mi_flags |= MDB_RE_OPEN;
 			ch_free( mdb->mi_dbenv_home );
@@ -384,6 +1061,17 @@ mdb_cf_gen( ConfigArgs *c )
 			c->cleanup = mdb_cf_cleanup;
 			ldap_pvt_thread_pool_purgekey( mdb->mi_dbenv );
 			break;
+		case MDB_COMPRESSION:
+			/* the open database records whether it is compressed */
+			if ( mdb->mi_compress && ( mdb->mi_flags & MDB_IS_OPEN )) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"compress cannot be turned off for a compressed database" );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+				rc = 1;
+				break;
+			}
+			mdb->mi_compress = 0;
+			break;
 		case MDB_DBNOSYNC:
 			mdb_env_set_flags( mdb->mi_dbenv, MDB_NOSYNC, 0 );
 			mdb->mi_dbenv_flags &= ~MDB_NOSYNC;
@@ -563,6 +1251,154 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		} break;
 
+	case MDB_COMPACT: {
+		unsigned pages, secs;
+		if ( lutil_atoux( &pages, c->argv[1], 0 ) != 0 || !pages ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid pages \"%s\"", c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( lutil_atoux( &secs, c->argv[2], 0 ) != 0 || !secs ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid seconds \"%s\"", c->argv[0], c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_compact_pages = pages;
+		mdb->mi_compact_interval = secs;
+		if ( slapMode & SLAP_SERVER_MODE ) {
+			struct re_s *re = mdb->mi_compact_task;
+			if ( re ) {
+				re->interval.tv_sec = secs;
+			} else {
+				if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
+					snprintf( c->cr_msg, sizeof( c->cr_msg ),
+						"%s: must occur after \"suffix\"", c->argv[0] );
+					Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+					return 1;
+				}
+				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+				mdb->mi_compact_task = ldap_pvt_runqueue_insert( &slapd_rq,
+					secs, mdb_compact, mdb,
+					LDAP_XSTRING(mdb_compact), c->be->be_suffix[0].bv_val );
+				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			}
+		}
+		} break;
+
+	case MDB_COLDATTRS: {
+		char **attrs;
+		unsigned long l = 0;
+		int i, n;
+
+		if ( c->argc > 2 && lutil_atoulx( &l, c->argv[2], 0 ) != 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid minsize \"%s\"", c->argv[0], c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		attrs = ldap_str2charray( c->argv[1], "," );
+		if ( !attrs ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: no attributes specified", c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		for ( n = 0; attrs[n]; n++ );
+		mdb->mi_coldattrs = ch_realloc( mdb->mi_coldattrs,
+			( mdb->mi_ncoldattrs + n ) * sizeof(mdb_coldattr));
+		for ( i = 0; i < n; i++ ) {
+			AttributeDescription *ad = NULL;
+			const char *text;
+
+			if ( slap_str2ad( attrs[i], &ad, &text ) != LDAP_SUCCESS ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: attribute \"%s\" undefined: %s",
+					c->argv[0], attrs[i], text );
+				Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+				ldap_charray_free( attrs );
+				return 1;
+			}
+			/* naming and structural attributes must stay with the entry */
+			if ( ad == slap_schema.si_ad_objectClass ||
+				ad == slap_schema.si_ad_structuralObjectClass ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: attribute \"%s\" cannot be stored apart",
+					c->argv[0], attrs[i] );
+				Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+				ldap_charray_free( attrs );
+				return 1;
+			}
+			mdb->mi_coldattrs[mdb->mi_ncoldattrs].ca_desc = ad;
+			mdb->mi_coldattrs[mdb->mi_ncoldattrs].ca_minsize = l;
+			mdb->mi_ncoldattrs++;
+		}
+		ldap_charray_free( attrs );
+		} break;
+
+	case MDB_MULTIVAL: {
+		char **attrs, *next;
+		unsigned long hi, lo;
+		int i, n;
+
+		hi = strtoul( c->argv[2], &next, 10 );
+		if ( next == c->argv[2] || !hi ) {
+			next = NULL;
+		} else if ( *next == ',' ) {
+			char *ptr = next + 1;
+			lo = strtoul( ptr, &next, 10 );
+			if ( next == ptr || lo > hi )
+				next = NULL;
+		} else {
+			lo = hi / 2;
+		}
+		if ( !next || *next ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid counts \"%s\"", c->argv[0], c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		attrs = ldap_str2charray( c->argv[1], "," );
+		if ( !attrs ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: no attributes specified", c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		for ( n = 0; attrs[n]; n++ );
+		mdb->mi_multivals = ch_realloc( mdb->mi_multivals,
+			( mdb->mi_nmultivals + n ) * sizeof(mdb_multival));
+		for ( i = 0; i < n; i++ ) {
+			AttributeDescription *ad = NULL;
+			const char *text;
+
+			if ( slap_str2ad( attrs[i], &ad, &text ) != LDAP_SUCCESS ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: attribute \"%s\" undefined: %s",
+					c->argv[0], attrs[i], text );
+				Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+				ldap_charray_free( attrs );
+				return 1;
+			}
+			if ( ad == slap_schema.si_ad_objectClass ||
+				ad == slap_schema.si_ad_structuralObjectClass ||
+				!ad->ad_type->sat_equality ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s: attribute \"%s\" cannot be stored apart",
+					c->argv[0], attrs[i] );
+				Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+				ldap_charray_free( attrs );
+				return 1;
+			}
+			mdb->mi_multivals[mdb->mi_nmultivals].mv_desc = ad;
+			mdb->mi_multivals[mdb->mi_nmultivals].mv_hi = hi;
+			mdb->mi_multivals[mdb->mi_nmultivals].mv_lo = lo;
+			mdb->mi_nmultivals++;
+		}
+		ldap_charray_free( attrs );
+		} break;
+
 	case MDB_DIRECTORY: {
 		FILE *f;
 		char *ptr, *testpath;
@@ -593,6 +1429,24 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_COMPRESSION:
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			if ( mdb->mi_compress && !c->value_int ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"%s cannot be turned off for a compressed database",
+					c->argv[0] );
+				Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+				return 1;
+			}
+			/* only takes effect when the database is opened */
+			if ( !mdb->mi_compress && c->value_int ) {
+				mdb->mi_flags |= MDB_RE_OPEN;
+				c->cleanup = mdb_cf_cleanup;
+			}
+		}
+		mdb->mi_compress = c->value_int;
+		break;
+
 	case MDB_DBNOSYNC:
 		if ( c->value_int )
 			mdb->mi_dbenv_flags |= MDB_NOSYNC;
@@ -683,6 +1537,17 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	/* only used when the database is created, no need to reopen */
+	case MDB_PAGESIZE:
+		if ( c->value_uint & ( c->value_uint - 1 )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: size must be a power of 2", c->argv[0] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_psize = c->value_uint;
+		break;
+
 	}
 	return 0;
 }
@@ -391,6 +391,8 @@ mdb_delete( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	mdb_reader_expire( mdb, 0 );
+
 	Debug( LDAP_DEBUG_TRACE,
 		LDAP_XSTRING(mdb_delete) ": deleted%s id=%08lx dn=\"%s\"\n",
 		op->o_noop ? " (no-op)" : "",
@@ -643,8 +643,8 @@ mdb_idscope(
 
 	ida = mdb_idl_first( ids, &cid );
 
-	/* Don't bother moving out of ids if it's a range */
-	if (!MDB_IDL_IS_RANGE(ids)) {
+	/* Don't bother moving out of ids if it's a range or bitmap */
+	if (!MDB_IDL_IS_RANGE(ids) && !MDB_IDL_IS_BMAP(ids)) {
 		idc = ids[0];
 		ci0 = cid;
 	}
@@ -687,7 +687,7 @@ mdb_idscope(
 		}
 		ida = mdb_idl_next( ids, &cid );
 	}
-	if (!MDB_IDL_IS_RANGE( ids ))
+	if (!MDB_IDL_IS_RANGE( ids ) && !MDB_IDL_IS_BMAP( ids ))
 		ids[0] = idc;
 
 leave:
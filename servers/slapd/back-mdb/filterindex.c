@@ -167,8 +167,7 @@ mdb_filter_candidates(
 	case LDAP_FILTER_GE:
 		/* if no GE index, use pres */
 		Debug( LDAP_DEBUG_FILTER, "\tGE\n", 0, 0, 0 );
-		if( f->f_ava->aa_desc->ad_type->sat_ordering &&
-			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
+		if( f->f_ava->aa_desc->ad_type->sat_ordering )
 			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_GE );
 		else
 			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
@@ -177,8 +176,7 @@ mdb_filter_candidates(
 	case LDAP_FILTER_LE:
 		/* if no LE index, use pres */
 		Debug( LDAP_DEBUG_FILTER, "\tLE\n", 0, 0, 0 );
-		if( f->f_ava->aa_desc->ad_type->sat_ordering &&
-			( f->f_ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) )
+		if( f->f_ava->aa_desc->ad_type->sat_ordering )
 			rc = inequality_candidates( op, rtxn, f->f_ava, ids, tmp, LDAP_FILTER_LE );
 		else
 			rc = presence_candidates( op, rtxn, f->f_ava->aa_desc, ids );
@@ -558,6 +556,233 @@ base:
 	return 0;
 }
 
+/* Filter planning
+ *
+ * Before the components of an AND or OR are evaluated, each one gets
+ * a cheap estimate of how many candidates it will produce, taken from
+ * the sizes recorded with its index keys. ANDs then evaluate their most
+ * selective components first, and stop once the candidate list is so
+ * short that testing the entries is cheaper than reading the rest of
+ * the keys. The plan is logged at the "filter" debug level.
+ *
+ * The "filterplan" setting is the number of index IDs that cost about
+ * as much to read as testing one entry against the filter. Setting it
+ * to 0 evaluates components in filter order, as before planning.
+ */
+#define PLAN_ALL		NOID		/* component does not narrow the search */
+#define PLAN_UNKNOWN	(NOID-1)	/* indexed, but no cheap estimate */
+#define PLAN_MAX		(NOID-2)
+
+/* Always skip a component without an estimate once no more than this
+ * many candidates remain.
+ */
+#define PLAN_SMALL		16
+
+static void
+plan_key( struct berval *bv, MDB_val *key, int *kbuf )
+{
+#ifndef MISALIGNED_OK
+	if (( bv->bv_len & ALIGNER ) && bv->bv_len < 2*sizeof(int) ) {
+		key->mv_size = 2*sizeof(int);
+		key->mv_data = kbuf;
+		kbuf[0] = kbuf[1] = 0;
+		memcpy( kbuf, bv->bv_val, bv->bv_len );
+	} else
+#endif
+	{
+		key->mv_size = bv->bv_len;
+		key->mv_data = bv->bv_val;
+	}
+}
+
+/* The smallest count of the keys, all of which have to match */
+static ID
+plan_keys(
+	MDB_txn *rtxn,
+	MDB_dbi dbi,
+	struct berval *keys )
+{
+	MDB_val key;
+	ID est = PLAN_ALL, count;
+	int i, kbuf[2];
+
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		plan_key( &keys[i], &key, kbuf );
+		if ( mdb_idl_fetch_count( rtxn, dbi, &key, &count ))
+			return PLAN_UNKNOWN;
+		if ( count < est )
+			est = count;
+		if ( !est )
+			break;
+	}
+	return est;
+}
+
+static ID
+plan_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f )
+{
+	AttributeDescription *ad;
+	MatchingRule *mr;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	slap_mask_t mask;
+	MDB_dbi dbi;
+	ID est, e;
+	void *assertion;
+	int ftype, rc;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED )
+		return 0;
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_FALSE ||
+			f->f_result == SLAPD_COMPARE_UNDEFINED )
+			return 0;
+		return PLAN_ALL;
+
+	case LDAP_FILTER_AND:
+		est = PLAN_ALL;
+		for ( f = f->f_and; f; f = f->f_next ) {
+			e = plan_estimate( op, rtxn, f );
+			if ( e < est )
+				est = e;
+		}
+		return est;
+
+	case LDAP_FILTER_OR:
+		est = 0;
+		for ( f = f->f_or; f; f = f->f_next ) {
+			e = plan_estimate( op, rtxn, f );
+			if ( e >= PLAN_UNKNOWN ) {
+				if ( e == PLAN_ALL )
+					return e;
+				est = e;
+			} else if ( est < PLAN_UNKNOWN ) {
+				est = ( est + e > PLAN_MAX || est + e < e ) ?
+					PLAN_MAX : est + e;
+			}
+		}
+		return est;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		if ( ad == slap_schema.si_ad_objectClass )
+			return PLAN_ALL;
+		if ( mdb_index_param( op->o_bd, ad, LDAP_FILTER_PRESENT,
+			&dbi, &mask, &prefix ) != LDAP_SUCCESS || !prefix.bv_val )
+			return PLAN_ALL;
+		{
+			struct berval pkeys[2];
+			pkeys[0] = prefix;
+			BER_BVZERO( &pkeys[1] );
+			return plan_keys( rtxn, dbi, pkeys );
+		}
+
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_ava->aa_desc;
+		if ( ad == slap_schema.si_ad_entryDN )
+			return 1;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( ad ))
+			return PLAN_UNKNOWN;
+#endif
+		mr = ad->ad_type->sat_equality;
+		ftype = LDAP_FILTER_EQUALITY;
+		assertion = &f->f_ava->aa_value;
+		break;
+
+	case LDAP_FILTER_APPROX:
+		ad = f->f_ava->aa_desc;
+		mr = ad->ad_type->sat_approx;
+		if ( !mr )
+			mr = ad->ad_type->sat_equality;
+		ftype = LDAP_FILTER_APPROX;
+		assertion = &f->f_ava->aa_value;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		mr = ad->ad_type->sat_substr;
+		ftype = LDAP_FILTER_SUBSTRINGS;
+		assertion = f->f_sub;
+		break;
+
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_EXT:
+		return PLAN_UNKNOWN;
+
+	default:
+		/* NOT and anything unknown match all IDs */
+		return PLAN_ALL;
+	}
+
+	if ( mdb_index_param( op->o_bd, ad, ftype, &dbi, &mask, &prefix )
+		!= LDAP_SUCCESS || !mr || !mr->smr_filter )
+		return PLAN_ALL;
+	rc = (mr->smr_filter)( ftype, mask, ad->ad_type->sat_syntax, mr,
+		&prefix, assertion, &keys, op->o_tmpmemctx );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		return PLAN_ALL;
+	est = plan_keys( rtxn, dbi, keys );
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return est;
+}
+
+typedef struct plan_step {
+	Filter *ps_f;
+	ID ps_est;
+} plan_step;
+
+/* Order the components of a list by ascending estimate. Returns the
+ * number of steps, or -1 if the list has nothing to plan.
+ */
+static int
+plan_list(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *flist,
+	plan_step **stepsp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	plan_step *steps, st;
+	Filter *f;
+	int i, j, n = 0;
+
+	if ( !mdb->mi_plan_cost )
+		return -1;
+
+	for ( f = flist; f; f = f->f_next ) {
+		/* precomputed scopes are not evaluated */
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+		     f->f_result == LDAP_SUCCESS )
+			continue;
+		n++;
+	}
+	if ( n < 2 )
+		return -1;
+
+	steps = op->o_tmpalloc( n * sizeof( plan_step ), op->o_tmpmemctx );
+	for ( i = 0, f = flist; f; f = f->f_next ) {
+		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
+		     f->f_result == LDAP_SUCCESS )
+			continue;
+		st.ps_f = f;
+		st.ps_est = plan_estimate( op, rtxn, f );
+		/* insertion sort, lists are short and mostly in order */
+		for ( j = i; j > 0 && steps[j-1].ps_est > st.ps_est; j-- )
+			steps[j] = steps[j-1];
+		steps[j] = st;
+		i++;
+	}
+	*stepsp = steps;
+	return n;
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -568,16 +793,85 @@ list_candidates(
 	ID *tmp,
 	ID *save )
 {
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int rc = 0;
 	Filter	*f;
+	plan_step *steps = NULL;
+	int i, n, first;
+	ID count;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
-	for ( f = flist; f != NULL; f = f->f_next ) {
+
+	/* With a precomputed scope in front, everything else narrows it */
+	first = !( flist->f_choice == SLAPD_FILTER_COMPUTED &&
+		flist->f_result == LDAP_SUCCESS );
+
+	n = plan_list( op, rtxn, flist, &steps );
+	if ( steps ) {
+		for ( i = 0; i < n; i++ ) {
+			if ( steps[i].ps_est >= PLAN_UNKNOWN ) {
+				Debug( LDAP_DEBUG_FILTER,
+					"mdb_list_candidates: plan %d: estimate %s\n", i,
+					steps[i].ps_est == PLAN_ALL ? "all" : "unknown", 0 );
+			} else {
+				Debug( LDAP_DEBUG_FILTER,
+					"mdb_list_candidates: plan %d: estimate %ld\n", i,
+					(long) steps[i].ps_est, 0 );
+			}
+		}
+		if ( ftype == LDAP_FILTER_AND && steps[0].ps_est == 0 ) {
+			/* some component cannot match */
+			Debug( LDAP_DEBUG_FILTER,
+				"mdb_list_candidates: plan: no matches\n", 0, 0, 0 );
+			MDB_IDL_ZERO( ids );
+			goto done;
+		}
+		if ( ftype == LDAP_FILTER_OR && steps[n-1].ps_est == PLAN_ALL ) {
+			Debug( LDAP_DEBUG_FILTER,
+				"mdb_list_candidates: plan: all IDs\n", 0, 0, 0 );
+			MDB_IDL_ALL( ids );
+			goto done;
+		}
+	}
+
+	for ( i = 0, f = NULL; ; i++ ) {
+		if ( steps ) {
+			if ( i == n )
+				break;
+			f = steps[i].ps_f;
+		} else {
+			f = f ? f->f_next : flist;
+			if ( !f )
+				break;
+		}
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
 			continue;
 		}
+
+		if ( steps && !first ) {
+			if ( ftype == LDAP_FILTER_AND ) {
+				/* the rest only narrows the list, stop once the
+				 * entries are cheaper to test than the keys to read
+				 */
+				count = MDB_IDL_N( ids );
+				if ( steps[i].ps_est == PLAN_ALL ||
+					( steps[i].ps_est == PLAN_UNKNOWN ?
+						count <= PLAN_SMALL :
+						count <= steps[i].ps_est / mdb->mi_plan_cost ))
+				{
+					Debug( LDAP_DEBUG_FILTER,
+						"mdb_list_candidates: plan: skipping %d of %d "
+						"with %ld candidates\n", n - i, n, (long) count );
+					break;
+				}
+			} else if ( steps[i].ps_est == 0 ) {
+				/* nothing to add */
+				continue;
+			}
+		}
+
 		MDB_IDL_ZERO( save );
 		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
 			save+MDB_IDL_UM_SIZE );
@@ -592,22 +886,28 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
+			first = 0;
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
 		} else {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_union( ids, save );
 			}
+			first = 0;
 		}
 	}
 
+done:
+	if ( steps )
+		op->o_tmpfree( steps, op->o_tmpmemctx );
+
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= mdb_list_candidates: id=%ld first=%ld last=%ld\n",
@@ -1059,6 +1359,89 @@ substring_candidates(
 	return( rc );
 }
 
+/* Answer an inequality from an ordered index by walking the keys
+ * between the asserted value and the end of the ordered keys for GE,
+ * or between the start of the ordered keys and the value for LE.
+ */
+static int
+ordered_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	MDB_dbi dbi,
+	slap_mask_t mask,
+	struct berval *prefix,
+	AttributeAssertion *ava,
+	ID *ids,
+	ID *tmp,
+	int gtorlt )
+{
+	struct berval *keys = NULL;
+	MDB_val lo, hi, *hp = NULL;
+	ID limit = 0;
+	int rc;
+#ifndef MISALIGNED_OK
+	int kbuf[2][2];
+#endif
+
+	rc = mdb_index_ordered_keys( ava->aa_desc, prefix, mask,
+		&ava->aa_value, 1, &keys, op->o_tmpmemctx );
+
+	if( rc != LDAP_SUCCESS || keys == NULL ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= mdb_ordered_candidates: (%s) no keys (%d)\n",
+			ava->aa_desc->ad_cname.bv_val, rc, 0 );
+		return 0;
+	}
+
+	lo.mv_data = keys[0].bv_val;
+	if ( gtorlt == LDAP_FILTER_GE ) {
+		lo.mv_size = keys[0].bv_len;
+	} else {
+		lo.mv_size = MDB_ORDERED_PREFIXLEN;
+		hi.mv_data = keys[0].bv_val;
+		hi.mv_size = keys[0].bv_len;
+		hp = &hi;
+	}
+#ifndef MISALIGNED_OK
+	/* short keys are padded when they're stored, see mdb_idl_insert_keys */
+	if (( lo.mv_size & ALIGNER ) && lo.mv_size < sizeof(kbuf[0]) ) {
+		kbuf[0][0] = kbuf[0][1] = 0;
+		memcpy( kbuf[0], lo.mv_data, lo.mv_size );
+		lo.mv_data = kbuf[0];
+		lo.mv_size = sizeof(kbuf[0]);
+	}
+	if ( hp && ( hi.mv_size & ALIGNER ) && hi.mv_size < sizeof(kbuf[1]) ) {
+		kbuf[1][0] = kbuf[1][1] = 0;
+		memcpy( kbuf[1], hi.mv_data, hi.mv_size );
+		hi.mv_data = kbuf[1];
+		hi.mv_size = sizeof(kbuf[1]);
+	}
+#endif
+
+	if( op->ors_limit && op->ors_limit->lms_s_unchecked > 0 )
+		limit = op->ors_limit->lms_s_unchecked;
+
+	rc = mdb_idl_fetch_range( op->o_bd, rtxn, dbi, &lo, hp,
+		MDB_ORDERED_PREFIXLEN, ids, tmp, limit );
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= mdb_ordered_candidates: (%s) "
+			"range read failed (%d)\n",
+			ava->aa_desc->ad_cname.bv_val, rc, 0 );
+		MDB_IDL_ALL( ids );
+		return 0;
+	}
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_ordered_candidates: id=%ld, first=%ld, last=%ld\n",
+		(long) ids[0],
+		(long) MDB_IDL_FIRST(ids),
+		(long) MDB_IDL_LAST(ids) );
+	return 0;
+}
+
 static int
 inequality_candidates(
 	Operation *op,
@@ -1081,6 +1464,19 @@ inequality_candidates(
 
 	MDB_IDL_ALL( ids );
 
+	rc = mdb_index_param( op->o_bd, ava->aa_desc, gtorlt,
+		&dbi, &mask, &prefix );
+
+	if ( rc == LDAP_SUCCESS ) {
+		return ordered_candidates( op, rtxn, dbi, mask, &prefix,
+			ava, ids, tmp, gtorlt );
+	}
+
+	/* Otherwise only ordered equality keys can be walked */
+	if( !( ava->aa_desc->ad_type->sat_ordering->smr_usage & SLAP_MR_ORDERED_INDEX ) ) {
+		return presence_candidates( op, rtxn, ava->aa_desc, ids );
+	}
+
 	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
 		&dbi, &mask, &prefix );
 
@@ -1171,3 +1567,451 @@ inequality_candidates(
 		(long) MDB_IDL_LAST(ids) );
 	return( rc );
 }
+
+/* Candidate cursors
+ *
+ * Rather than computing the whole candidate IDL before the first entry
+ * is looked at, a search can walk a tree of cursors built from the
+ * filter. AND nodes move their children forward together until they
+ * agree on an ID, OR nodes return the lowest ID of their children, and
+ * equality, presence and substring leaves read their index keys in
+ * place through key cursors. Other filter components are still
+ * evaluated into an IDL of their own. IDs come out in ascending order,
+ * and only as many are produced as the search asks for.
+ */
+#define	CC_ZERO	0	/* no IDs */
+#define	CC_ALL	1	/* every ID */
+#define	CC_KEY	2
+#define	CC_IDL	3
+#define	CC_AND	4
+#define	CC_OR	5
+
+struct mdb_candcur {
+	int cc_type;
+	ID cc_id;			/* last ID returned, NOID at the end */
+	ID cc_count;		/* upper bound of the number of IDs */
+	mdb_keycur *cc_kc;
+	ID *cc_ids;
+	struct mdb_candcur *cc_kids;
+	struct mdb_candcur *cc_next;
+};
+
+static mdb_candcur *
+cc_new( int type )
+{
+	mdb_candcur *cc = ch_calloc( 1, sizeof( mdb_candcur ));
+
+	cc->cc_type = type;
+	if ( type == CC_ALL )
+		cc->cc_count = NOID;
+	return cc;
+}
+
+void
+mdb_candcur_free( mdb_candcur *cc )
+{
+	mdb_candcur *kid, *next;
+
+	for ( kid = cc->cc_kids; kid; kid = next ) {
+		next = kid->cc_next;
+		mdb_candcur_free( kid );
+	}
+	if ( cc->cc_kc )
+		mdb_idl_keycur_close( cc->cc_kc );
+	if ( cc->cc_ids )
+		ch_free( cc->cc_ids );
+	ch_free( cc );
+}
+
+/* Simplify an AND or OR node once all of its children are known */
+static mdb_candcur *
+cc_reduce( mdb_candcur *cc, int sort )
+{
+	mdb_candcur **prev, *kid;
+	int and = cc->cc_type == CC_AND;
+	ID count = and ? NOID : 0;
+
+	for ( prev = &cc->cc_kids; ( kid = *prev ) != NULL; ) {
+		/* ALL changes nothing in an AND and decides an OR,
+		 * ZERO is the other way around
+		 */
+		if ( kid->cc_type == ( and ? CC_ALL : CC_ZERO )) {
+			*prev = kid->cc_next;
+			ch_free( kid );
+			continue;
+		}
+		if ( kid->cc_type == ( and ? CC_ZERO : CC_ALL )) {
+			mdb_candcur_free( cc );
+			return cc_new( and ? CC_ZERO : CC_ALL );
+		}
+		if ( and ) {
+			if ( kid->cc_count < count )
+				count = kid->cc_count;
+		} else {
+			count += kid->cc_count;
+			if ( count < kid->cc_count )
+				count = NOID;
+		}
+		prev = &kid->cc_next;
+	}
+
+	/* Let the most selective child lead an AND */
+	if ( and && sort ) {
+		mdb_candcur *sorted = NULL, *next;
+
+		for ( kid = cc->cc_kids; kid; kid = next ) {
+			next = kid->cc_next;
+			for ( prev = &sorted; *prev && (*prev)->cc_count <= kid->cc_count;
+				prev = &(*prev)->cc_next )
+				;
+			kid->cc_next = *prev;
+			*prev = kid;
+		}
+		cc->cc_kids = sorted;
+	}
+
+	kid = cc->cc_kids;
+	if ( !kid ) {
+		ch_free( cc );
+		return cc_new( and ? CC_ALL : CC_ZERO );
+	}
+	if ( !kid->cc_next ) {
+		ch_free( cc );
+		return kid;
+	}
+	cc->cc_count = count;
+	return cc;
+}
+
+/* All of the keys must match */
+static int
+cc_keys(
+	MDB_txn *rtxn,
+	MDB_dbi dbi,
+	struct berval *keys,
+	mdb_candcur **ccp )
+{
+	mdb_candcur *cc, *kid;
+	MDB_val key;
+	int i, rc = 0;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+	cc = cc_new( CC_AND );
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+#ifndef MISALIGNED_OK
+		if (( keys[i].bv_len & ALIGNER ) && keys[i].bv_len < sizeof(kbuf) ) {
+			key.mv_size = sizeof(kbuf);
+			key.mv_data = kbuf;
+			kbuf[0] = kbuf[1] = 0;
+			memcpy( kbuf, keys[i].bv_val, keys[i].bv_len );
+		} else
+#endif
+		{
+			key.mv_size = keys[i].bv_len;
+			key.mv_data = keys[i].bv_val;
+		}
+		kid = cc_new( CC_KEY );
+		rc = mdb_idl_keycur_open( rtxn, dbi, &key, &kid->cc_kc );
+		if ( rc ) {
+			ch_free( kid );
+			mdb_candcur_free( cc );
+			return rc;
+		}
+		kid->cc_count = mdb_idl_keycur_count( kid->cc_kc );
+		/* a missing key leaves a ZERO node */
+		if ( !kid->cc_count ) {
+			mdb_idl_keycur_close( kid->cc_kc );
+			kid->cc_kc = NULL;
+			kid->cc_type = CC_ZERO;
+		}
+		kid->cc_next = cc->cc_kids;
+		cc->cc_kids = kid;
+	}
+	*ccp = cc_reduce( cc, 1 );
+	return 0;
+}
+
+static int
+cc_build(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	mdb_candcur **ccp,
+	ID *ids,
+	ID *tmp,
+	ID *stack )
+{
+	AttributeDescription *ad = NULL;
+	MatchingRule *mr = NULL;
+	struct berval prefix = {0, NULL};
+	struct berval *keys = NULL;
+	mdb_candcur *cc, **prev;
+	slap_mask_t mask;
+	MDB_dbi dbi;
+	int rc, ftype = 0;
+	void *assertion = NULL;
+
+	*ccp = NULL;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		*ccp = cc_new( CC_ZERO );
+		return 0;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		*ccp = cc_new( f->f_result == LDAP_COMPARE_FALSE ||
+			f->f_result == SLAPD_COMPARE_UNDEFINED ? CC_ZERO : CC_ALL );
+		return 0;
+
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		cc = cc_new( f->f_choice == LDAP_FILTER_AND ? CC_AND : CC_OR );
+		prev = &cc->cc_kids;
+		for ( f = f->f_list; f; f = f->f_next ) {
+			rc = cc_build( op, rtxn, f, prev, ids, tmp, stack );
+			if ( rc ) {
+				mdb_candcur_free( cc );
+				return rc;
+			}
+			prev = &(*prev)->cc_next;
+		}
+		*ccp = cc_reduce( cc,
+			((struct mdb_info *) op->o_bd->be_private)->mi_plan_cost != 0 );
+		return 0;
+
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		if ( ad == slap_schema.si_ad_objectClass ) {
+			*ccp = cc_new( CC_ALL );
+			return 0;
+		}
+		rc = mdb_index_param( op->o_bd, ad, LDAP_FILTER_PRESENT,
+			&dbi, &mask, &prefix );
+		if ( rc != LDAP_SUCCESS || prefix.bv_val == NULL ) {
+			*ccp = cc_new( CC_ALL );
+			return 0;
+		}
+		{
+			struct berval pkeys[2];
+			pkeys[0] = prefix;
+			BER_BVZERO( &pkeys[1] );
+			return cc_keys( rtxn, dbi, pkeys, ccp );
+		}
+
+	case LDAP_FILTER_EQUALITY:
+		ad = f->f_ava->aa_desc;
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( ad ))
+			break;
+#endif
+		if ( ad == slap_schema.si_ad_entryDN )
+			break;
+		mr = ad->ad_type->sat_equality;
+		ftype = LDAP_FILTER_EQUALITY;
+		assertion = &f->f_ava->aa_value;
+		break;
+
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		mr = ad->ad_type->sat_substr;
+		ftype = LDAP_FILTER_SUBSTRINGS;
+		assertion = f->f_sub;
+		break;
+
+	default:
+		break;
+	}
+
+	if ( ftype ) {
+		rc = mdb_index_param( op->o_bd, ad, ftype, &dbi, &mask, &prefix );
+		if ( rc != LDAP_SUCCESS || !mr || !mr->smr_filter ) {
+			*ccp = cc_new( CC_ALL );
+			return 0;
+		}
+		rc = (mr->smr_filter)( ftype, mask, ad->ad_type->sat_syntax,
+			mr, &prefix, assertion, &keys, op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS || keys == NULL ) {
+			*ccp = cc_new( CC_ALL );
+			return 0;
+		}
+		rc = cc_keys( rtxn, dbi, keys, ccp );
+		ber_bvarray_free_x( keys, op->o_tmpmemctx );
+		return rc;
+	}
+
+	/* Anything else gets an IDL of its own */
+	MDB_IDL_ZERO( ids );
+	rc = mdb_filter_candidates( op, rtxn, f, ids, tmp, stack );
+	if ( rc )
+		return rc;
+	if ( MDB_IDL_IS_ZERO( ids )) {
+		*ccp = cc_new( CC_ZERO );
+		return 0;
+	}
+	cc = cc_new( CC_IDL );
+	cc->cc_ids = ch_malloc( MDB_IDL_SIZEOF( ids ));
+	/* take over a bitmap, don't copy it */
+	AC_MEMCPY( cc->cc_ids, ids, MDB_IDL_SIZEOF( ids ));
+	cc->cc_count = MDB_IDL_N( cc->cc_ids );
+	*ccp = cc;
+	return 0;
+}
+
+/* Does the filter have any component that can be read from a key
+ * cursor, outside of a NOT?
+ */
+static int
+cc_usable( Filter *f )
+{
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( cc_usable( f ))
+				return 1;
+		}
+		return 0;
+	case LDAP_FILTER_PRESENT:
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_SUBSTRINGS:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int
+cc_haskey( mdb_candcur *cc )
+{
+	mdb_candcur *kid;
+
+	if ( cc->cc_type == CC_KEY )
+		return 1;
+	for ( kid = cc->cc_kids; kid; kid = kid->cc_next ) {
+		if ( cc_haskey( kid ))
+			return 1;
+	}
+	return 0;
+}
+
+/* Build a candidate cursor for the filter. If nothing in the filter
+ * can be streamed *ccp is left NULL and the caller should compute the
+ * candidates with mdb_filter_candidates() instead. ids, tmp and stack
+ * are used as scratch space.
+ */
+int
+mdb_filter_cursor(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f,
+	mdb_candcur **ccp,
+	ID *ids,
+	ID *tmp,
+	ID *stack )
+{
+	mdb_candcur *cc = NULL;
+	int rc;
+
+	*ccp = NULL;
+	if ( !cc_usable( f ))
+		return 0;
+
+	rc = cc_build( op, rtxn, f, &cc, ids, tmp, stack );
+	if ( rc )
+		return rc;
+
+	if ( cc->cc_type != CC_ZERO && !cc_haskey( cc )) {
+		mdb_candcur_free( cc );
+		return 0;
+	}
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_filter_cursor: at most %ld candidates\n",
+		(long) cc->cc_count, 0, 0 );
+	*ccp = cc;
+	return 0;
+}
+
+/* Return the first candidate >= id, or NOID. Seeks only go forward. */
+ID
+mdb_candcur_seek( mdb_candcur *cc, ID id )
+{
+	mdb_candcur *kid;
+	ID x, y;
+	int again;
+
+	if ( cc->cc_id == NOID || id <= cc->cc_id )
+		return cc->cc_id;
+
+	switch ( cc->cc_type ) {
+	case CC_ALL:
+		x = id;
+		break;
+
+	case CC_KEY:
+		x = mdb_idl_keycur_seek( cc->cc_kc, id );
+		break;
+
+	case CC_IDL:
+		y = id;
+		x = mdb_idl_first( cc->cc_ids, &y );
+		if ( x != NOID && x > MDB_IDL_LAST( cc->cc_ids ))
+			x = NOID;
+		break;
+
+	case CC_AND:
+		/* keep moving until all children agree */
+		x = id;
+		do {
+			again = 0;
+			for ( kid = cc->cc_kids; kid; kid = kid->cc_next ) {
+				y = mdb_candcur_seek( kid, x );
+				if ( y == NOID ) {
+					x = NOID;
+					goto done;
+				}
+				if ( y > x ) {
+					x = y;
+					again = 1;
+				}
+			}
+		} while ( again );
+		break;
+
+	case CC_OR:
+		x = NOID;
+		for ( kid = cc->cc_kids; kid; kid = kid->cc_next ) {
+			y = mdb_candcur_seek( kid, id );
+			if ( y < x )
+				x = y;
+		}
+		break;
+
+	default:
+		x = NOID;
+	}
+done:
+	cc->cc_id = x;
+	return x;
+}
+
+ID
+mdb_candcur_count( mdb_candcur *cc )
+{
+	return cc->cc_count;
+}
+
+/* The read txn was renewed, reopen the key cursors */
+void
+mdb_candcur_renew( MDB_txn *txn, mdb_candcur *cc )
+{
+	mdb_candcur *kid;
+
+	if ( cc->cc_kc )
+		mdb_idl_keycur_renew( txn, cc->cc_kc );
+	for ( kid = cc->cc_kids; kid; kid = kid->cc_next )
+		mdb_candcur_renew( txn, kid );
+}
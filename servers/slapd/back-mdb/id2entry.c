@@ -34,9 +34,22 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data,
 	Ecount *ec);
 static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals );
+static int mdb_id2attr_put( Operation *op, MDB_txn *txn, Entry *e,
+	int update );
+static int mdb_id2v_put( Operation *op, MDB_txn *txn, Entry *e,
+	int update );
+static ber_len_t mdb_id2v_size( struct berval *val, struct berval *nval );
 
 #define ADD_FLAGS	(MDB_NOOVERWRITE|MDB_APPEND)
 
+#define HIGH_BIT (1<<(sizeof(unsigned int)*CHAR_BIT-1))
+
+/* numvals recorded in the entry for attributes whose values are
+ * in id2a (COLD_MARK) or in id2v (MULTI_MARK)
+ */
+#define COLD_MARK	0
+#define MULTI_MARK	HIGH_BIT
+
 static int mdb_id2entry_put(
 	Operation *op,
 	MDB_txn *txn,
@@ -46,7 +59,7 @@ static int mdb_id2entry_put(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	Ecount ec;
-	MDB_val key, data;
+	MDB_val key, data, edata;
 	int rc;
 
 	/* We only store rdns, and they go in the dn2id database. */
@@ -58,24 +71,59 @@ static int mdb_id2entry_put(
 	if (rc)
 		return LDAP_OTHER;
 
-	flag |= MDB_RESERVE;
-
 	if (e->e_id < mdb->mi_nextid)
 		flag &= ~MDB_APPEND;
 
 	if (mdb->mi_maxentrysize && ec.len > mdb->mi_maxentrysize)
 		return LDAP_ADMINLIMIT_EXCEEDED;
 
+	if ( mdb->mi_compress ) {
+		/* LMDB only compresses what it's given, not reserved space */
+		edata.mv_size = ec.len;
+		edata.mv_data = op->o_tmpalloc( ec.len, op->o_tmpmemctx );
+		rc = mdb_entry_encode( op, e, &edata, &ec );
+		if( rc != LDAP_SUCCESS )
+			goto leave;
+	} else {
+		edata.mv_data = NULL;
+		flag |= MDB_RESERVE;
+	}
+
 again:
 	data.mv_size = ec.len;
+	data.mv_data = edata.mv_data;
 	if ( mc )
 		rc = mdb_cursor_put( mc, &key, &data, flag );
 	else
 		rc = mdb_put( txn, mdb->mi_id2entry, &key, &data, flag );
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_entry_encode( op, e, &data, &ec );
-		if( rc != LDAP_SUCCESS )
-			return rc;
+		if ( flag & MDB_RESERVE ) {
+			rc = mdb_entry_encode( op, e, &data, &ec );
+			if( rc != LDAP_SUCCESS )
+				return rc;
+		}
+		if ( mdb->mi_ncoldattrs || !(flag & MDB_NOOVERWRITE) ) {
+			rc = mdb_id2attr_put( op, txn, e, !(flag & MDB_NOOVERWRITE) );
+			if ( rc != MDB_SUCCESS ) {
+				Debug( LDAP_DEBUG_ANY,
+					"mdb_id2entry_put: mdb_id2attr_put failed: %s(%d) \"%s\"\n",
+					mdb_strerror(rc), rc,
+					e->e_nname.bv_val );
+				rc = LDAP_OTHER;
+				goto leave;
+			}
+		}
+		if ( mdb->mi_nmultivals || !(flag & MDB_NOOVERWRITE) ) {
+			rc = mdb_id2v_put( op, txn, e, !(flag & MDB_NOOVERWRITE) );
+			if ( rc != MDB_SUCCESS ) {
+				Debug( LDAP_DEBUG_ANY,
+					"mdb_id2entry_put: mdb_id2v_put failed: %s(%d) \"%s\"\n",
+					mdb_strerror(rc), rc,
+					e->e_nname.bv_val );
+				rc = LDAP_OTHER;
+				goto leave;
+			}
+		}
 	}
 	if (rc) {
 		/* Was there a hole from slapadd? */
@@ -90,6 +138,9 @@ again:
 		if ( rc != MDB_KEYEXIST )
 			rc = LDAP_OTHER;
 	}
+leave:
+	if ( edata.mv_data )
+		op->o_tmpfree( edata.mv_data, op->o_tmpmemctx );
 	return rc;
 }
 
@@ -191,7 +242,7 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, e );
+	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, NULL, e );
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
@@ -201,6 +252,40 @@ int mdb_id2entry(
 	return rc;
 }
 
+/* Remove all of an entry's records from id2a or id2v */
+static int
+mdb_id2x_delete(
+	MDB_txn *tid,
+	MDB_dbi dbi,
+	ID id )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID kbuf[2], *kp;
+	int rc;
+
+	rc = mdb_cursor_open( tid, dbi, &mc );
+	if ( rc )
+		return rc;
+	kbuf[0] = id;
+	kbuf[1] = 0;
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+	while ( rc == MDB_SUCCESS ) {
+		kp = key.mv_data;
+		if ( kp[0] != id )
+			break;
+		rc = mdb_cursor_del( mc, MDB_NODUPDATA );
+		if ( rc == MDB_SUCCESS )
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_NODUP );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = MDB_SUCCESS;
+	mdb_cursor_close( mc );
+	return rc;
+}
+
 int mdb_id2entry_delete(
 	BackendDB *be,
 	MDB_txn *tid,
@@ -217,6 +302,574 @@ int mdb_id2entry_delete(
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 
+	/* and any attributes that were stored apart */
+	if ( rc == MDB_SUCCESS && mdb->mi_id2attr )
+		rc = mdb_id2x_delete( tid, mdb->mi_id2attr, e->e_id );
+	if ( rc == MDB_SUCCESS && mdb->mi_id2val )
+		rc = mdb_id2x_delete( tid, mdb->mi_id2val, e->e_id );
+
+	return rc;
+}
+
+/* Attributes listed in olcDbMultival with at least mv_hi values keep
+ * each value as a sorted duplicate in id2v, under the same kind of key
+ * as id2a. A modify then only has to add or delete the values it
+ * touches, and a value can be looked up without reading the others.
+ * Once there, an attribute moves back into the entry only when it
+ * drops below mv_lo values. Values too large for a duplicate, or an
+ * attribute without an equality rule, keep the attribute in the entry.
+ */
+static int
+mdb_attr_is_multi( struct mdb_info *mdb, Attribute *a )
+{
+	ber_len_t max;
+	unsigned n;
+	int i, j, nv;
+
+	for ( i=0; i<mdb->mi_nmultivals; i++ ) {
+		if ( !is_ad_subtype( a->a_desc, mdb->mi_multivals[i].mv_desc ))
+			continue;
+		n = ( a->a_flags & SLAP_ATTR_BIG_MULTI ) ?
+			mdb->mi_multivals[i].mv_lo : mdb->mi_multivals[i].mv_hi;
+		if ( a->a_numvals < n || !a->a_numvals ||
+			!a->a_desc->ad_type->sat_equality )
+			return 0;
+		max = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+		nv = a->a_nvals != a->a_vals;
+		for ( j=0; j<a->a_numvals; j++ ) {
+			if ( mdb_id2v_size( nv ? &a->a_vals[j] : NULL,
+				&a->a_nvals[j] ) > max )
+				return 0;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/* Attributes listed in olcDbColdAttrs are kept out of the id2entry
+ * record and stored in id2a, keyed by the entry ID and the attribute
+ * index. The entry record only keeps the attribute index with a value
+ * count of zero, so reading an entry never has to touch these values
+ * unless the attribute is actually wanted.
+ */
+static int
+mdb_attr_is_cold( struct mdb_info *mdb, Attribute *a )
+{
+	ber_len_t len;
+	int i, j;
+
+	if ( !a->a_numvals || mdb_attr_is_multi( mdb, a ))
+		return 0;
+	for ( i=0; i<mdb->mi_ncoldattrs; i++ ) {
+		if ( !is_ad_subtype( a->a_desc, mdb->mi_coldattrs[i].ca_desc ))
+			continue;
+		if ( !mdb->mi_coldattrs[i].ca_minsize )
+			return 1;
+		len = 0;
+		for ( j=0; j<a->a_numvals; j++ )
+			len += a->a_vals[j].bv_len;
+		if ( a->a_nvals != a->a_vals ) {
+			for ( j=0; j<a->a_numvals; j++ )
+				len += a->a_nvals[j].bv_len;
+		}
+		if ( len >= mdb->mi_coldattrs[i].ca_minsize )
+			return 1;
+	}
+	return 0;
+}
+
+/* An id2a record holds the value count, with the high bit set if
+ * normalized values are present, the value lengths, the normalized
+ * value lengths, and then the NUL terminated values themselves,
+ * just as they would have been laid out in the entry record.
+ */
+static ber_len_t
+mdb_attr_partsize( Attribute *a )
+{
+	ber_len_t len = sizeof(int);
+	int i;
+
+	for ( i=0; i<a->a_numvals; i++ )
+		len += a->a_vals[i].bv_len + 1 + sizeof(int);
+	if ( a->a_nvals != a->a_vals ) {
+		for ( i=0; i<a->a_numvals; i++ )
+			len += a->a_nvals[i].bv_len + 1 + sizeof(int);
+	}
+	return (len + sizeof(ID)-1) & ~(sizeof(ID)-1);
+}
+
+static void
+mdb_attr_encode( Attribute *a, unsigned char *buf, ber_len_t len )
+{
+	unsigned int *lp = (unsigned int *)buf, l;
+	unsigned char *ptr;
+	int i, nv = a->a_nvals != a->a_vals;
+
+	l = a->a_numvals;
+	if ( nv )
+		l |= HIGH_BIT;
+	*lp++ = l;
+	ptr = (unsigned char *)(lp + a->a_numvals * ( nv + 1 ));
+	for ( i=0; i<a->a_numvals; i++ ) {
+		*lp++ = a->a_vals[i].bv_len;
+		memcpy( ptr, a->a_vals[i].bv_val, a->a_vals[i].bv_len );
+		ptr += a->a_vals[i].bv_len;
+		*ptr++ = '\0';
+	}
+	if ( nv ) {
+		for ( i=0; i<a->a_numvals; i++ ) {
+			*lp++ = a->a_nvals[i].bv_len;
+			memcpy( ptr, a->a_nvals[i].bv_val, a->a_nvals[i].bv_len );
+			ptr += a->a_nvals[i].bv_len;
+			*ptr++ = '\0';
+		}
+	}
+	/* zero the padding so unchanged records compare equal */
+	while ( ptr < buf + len )
+		*ptr++ = '\0';
+}
+
+/* An id2v record holds one value: the length of the normalized value,
+ * with the high bit set if the presented value is also stored, the NUL
+ * terminated normalized value, and then the length and NUL terminated
+ * presented value if any. Records are sorted on the normalized value
+ * only, so a lookup just supplies that part.
+ */
+static ber_len_t
+mdb_id2v_size( struct berval *val, struct berval *nval )
+{
+	ber_len_t len = sizeof(unsigned int) + nval->bv_len + 1;
+
+	if ( val )
+		len += sizeof(unsigned int) + val->bv_len + 1;
+	return len;
+}
+
+static void
+mdb_id2v_encode( unsigned char *buf, struct berval *val, struct berval *nval )
+{
+	unsigned int l;
+
+	l = nval->bv_len;
+	if ( val )
+		l |= HIGH_BIT;
+	memcpy( buf, &l, sizeof(l) );
+	buf += sizeof(l);
+	memcpy( buf, nval->bv_val, nval->bv_len );
+	buf += nval->bv_len;
+	*buf++ = '\0';
+	if ( val ) {
+		l = val->bv_len;
+		memcpy( buf, &l, sizeof(l) );
+		buf += sizeof(l);
+		memcpy( buf, val->bv_val, val->bv_len );
+		buf += val->bv_len;
+		*buf = '\0';
+	}
+}
+
+int
+mdb_id2v_dupsort( const MDB_val *a, const MDB_val *b )
+{
+	unsigned int la, lb;
+	int rc;
+
+	memcpy( &la, a->mv_data, sizeof(la) );
+	memcpy( &lb, b->mv_data, sizeof(lb) );
+	la &= ~HIGH_BIT;
+	lb &= ~HIGH_BIT;
+	rc = memcmp( (char *)a->mv_data + sizeof(la),
+		(char *)b->mv_data + sizeof(lb), la < lb ? la : lb );
+	if ( rc )
+		return rc;
+	return la < lb ? -1 : la > lb;
+}
+
+/* Store the cold attributes of an entry. On update, records for
+ * attributes that are gone or no longer cold are removed, and
+ * records whose contents did not change are left alone.
+ */
+static int
+mdb_id2attr_put(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e,
+	int update )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_val key, data;
+	ID kbuf[2], *kp;
+	Attribute *a;
+	unsigned char *buf = NULL;
+	ber_len_t len, buflen = 0;
+	int rc = 0;
+
+	if ( !mdb->mi_id2attr )
+		return 0;
+
+	/* without coldattrs there is only something to remove if
+	 * an earlier configuration stored anything
+	 */
+	if ( !mdb->mi_ncoldattrs ) {
+		MDB_stat ms;
+
+		rc = mdb_stat( txn, mdb->mi_id2attr, &ms );
+		if ( rc || !ms.ms_entries )
+			return rc;
+	}
+
+	kbuf[0] = e->e_id;
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+
+	if ( update ) {
+		MDB_cursor *mc;
+
+		rc = mdb_cursor_open( txn, mdb->mi_id2attr, &mc );
+		if ( rc )
+			return rc;
+		kbuf[1] = 0;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+		while ( rc == MDB_SUCCESS ) {
+			kp = key.mv_data;
+			if ( kp[0] != e->e_id )
+				break;
+			for ( a=e->e_attrs; a; a=a->a_next ) {
+				if ( mdb->mi_adxs[a->a_desc->ad_index] == kp[1] )
+					break;
+			}
+			if ( !a || !mdb_attr_is_cold( mdb, a )) {
+				rc = mdb_cursor_del( mc, 0 );
+				if ( rc )
+					break;
+			}
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT );
+		}
+		mdb_cursor_close( mc );
+		if ( rc && rc != MDB_NOTFOUND )
+			return rc;
+		rc = 0;
+		key.mv_data = kbuf;
+		key.mv_size = sizeof(kbuf);
+	}
+
+	for ( a=e->e_attrs; a; a=a->a_next ) {
+		if ( !mdb_attr_is_cold( mdb, a ))
+			continue;
+		len = mdb_attr_partsize( a );
+		if ( len > buflen ) {
+			buf = op->o_tmprealloc( buf, len, op->o_tmpmemctx );
+			buflen = len;
+		}
+		mdb_attr_encode( a, buf, len );
+		kbuf[1] = mdb->mi_adxs[a->a_desc->ad_index];
+		if ( update ) {
+			rc = mdb_get( txn, mdb->mi_id2attr, &key, &data );
+			if ( rc == MDB_SUCCESS && data.mv_size == len &&
+				!memcmp( data.mv_data, buf, len ))
+				continue;
+		}
+		data.mv_data = buf;
+		data.mv_size = len;
+		rc = mdb_put( txn, mdb->mi_id2attr, &key, &data, 0 );
+		if ( rc )
+			break;
+	}
+	if ( buf )
+		op->o_tmpfree( buf, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Store the id2v values of an entry. On update, an attribute still
+ * flagged SLAP_ATTR_BIG_MULTI had its values kept in step by
+ * mdb_id2v_modify, anything else stored for the entry is rewritten.
+ */
+static int
+mdb_id2v_put(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e,
+	int update )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID kbuf[2], *kp;
+	Attribute *a;
+	unsigned char *buf = NULL;
+	ber_len_t len, buflen = 0;
+	int i, nv, rc;
+
+	if ( !mdb->mi_id2val )
+		return 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2val, &mc );
+	if ( rc )
+		return rc;
+
+	kbuf[0] = e->e_id;
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+
+	if ( update ) {
+		kbuf[1] = 0;
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET_RANGE );
+		while ( rc == MDB_SUCCESS ) {
+			kp = key.mv_data;
+			if ( kp[0] != e->e_id )
+				break;
+			for ( a=e->e_attrs; a; a=a->a_next ) {
+				if ( mdb->mi_adxs[a->a_desc->ad_index] == kp[1] )
+					break;
+			}
+			if ( !a || !( a->a_flags & SLAP_ATTR_BIG_MULTI ) ||
+				!mdb_attr_is_multi( mdb, a )) {
+				rc = mdb_cursor_del( mc, MDB_NODUPDATA );
+				if ( rc )
+					break;
+			}
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_NODUP );
+		}
+		if ( rc && rc != MDB_NOTFOUND )
+			goto done;
+		key.mv_data = kbuf;
+		key.mv_size = sizeof(kbuf);
+	}
+
+	rc = 0;
+	for ( a=e->e_attrs; a; a=a->a_next ) {
+		if ( update && ( a->a_flags & SLAP_ATTR_BIG_MULTI ))
+			continue;
+		if ( !mdb_attr_is_multi( mdb, a ))
+			continue;
+		kbuf[1] = mdb->mi_adxs[a->a_desc->ad_index];
+		nv = a->a_nvals != a->a_vals;
+		for ( i=0; i<a->a_numvals; i++ ) {
+			len = mdb_id2v_size( nv ? &a->a_vals[i] : NULL, &a->a_nvals[i] );
+			if ( len > buflen ) {
+				buf = op->o_tmprealloc( buf, len, op->o_tmpmemctx );
+				buflen = len;
+			}
+			mdb_id2v_encode( buf, nv ? &a->a_vals[i] : NULL, &a->a_nvals[i] );
+			data.mv_data = buf;
+			data.mv_size = len;
+			rc = mdb_cursor_put( mc, &key, &data, MDB_NODUPDATA );
+			if ( rc )
+				goto done;
+		}
+	}
+
+done:
+	mdb_cursor_close( mc );
+	if ( buf )
+		op->o_tmpfree( buf, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Apply a modification of an attribute kept in id2v directly to its
+ * records. a is the attribute after the modification was applied to
+ * the entry. Anything other than 0 means the records could not be
+ * kept in step, the caller must clear SLAP_ATTR_BIG_MULTI so that
+ * mdb_id2v_put rewrites them.
+ */
+int
+mdb_id2v_modify(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	Attribute *a,
+	Modification *mod )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID kbuf[2];
+	BerVarray nvals;
+	unsigned char *buf = NULL;
+	ber_len_t len, buflen = 0;
+	size_t n;
+	int i, nv, add, rc;
+
+	switch ( mod->sm_op ) {
+	case SLAP_MOD_ADD_IF_NOT_PRESENT:
+		/* the attribute was already present, nothing was added */
+		return 0;
+	case LDAP_MOD_ADD:
+	case SLAP_MOD_SOFTADD:
+		add = 1;
+		break;
+	case LDAP_MOD_DELETE:
+	case SLAP_MOD_SOFTDEL:
+		add = 0;
+		break;
+	default:
+		return LDAP_OTHER;
+	}
+	if ( !mdb->mi_id2val || !mod->sm_values )
+		return LDAP_OTHER;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2val, &mc );
+	if ( rc )
+		return rc;
+
+	kbuf[0] = id;
+	kbuf[1] = mdb->mi_adxs[a->a_desc->ad_index];
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	nvals = mod->sm_nvalues ? mod->sm_nvalues : mod->sm_values;
+	nv = add && a->a_nvals != a->a_vals;
+
+	for ( i=0; i<mod->sm_numvals; i++ ) {
+		len = mdb_id2v_size( nv ? &mod->sm_values[i] : NULL, &nvals[i] );
+		if ( len > buflen ) {
+			buf = op->o_tmprealloc( buf, len, op->o_tmpmemctx );
+			buflen = len;
+		}
+		mdb_id2v_encode( buf, nv ? &mod->sm_values[i] : NULL, &nvals[i] );
+		data.mv_data = buf;
+		data.mv_size = len;
+		if ( add ) {
+			rc = mdb_cursor_put( mc, &key, &data, MDB_NODUPDATA );
+			if ( rc == MDB_KEYEXIST )
+				rc = 0;
+		} else {
+			rc = mdb_cursor_get( mc, &key, &data, MDB_GET_BOTH );
+			if ( rc == MDB_SUCCESS )
+				rc = mdb_cursor_del( mc, 0 );
+			else if ( rc == MDB_NOTFOUND )
+				rc = 0;
+		}
+		if ( rc )
+			break;
+	}
+
+	/* a soft add or delete may have left the entry itself alone */
+	if ( rc == MDB_SUCCESS ) {
+		rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+		if ( rc == MDB_SUCCESS )
+			rc = mdb_cursor_count( mc, &n );
+		if ( rc == MDB_SUCCESS && n != a->a_numvals )
+			rc = LDAP_OTHER;
+	}
+
+	mdb_cursor_close( mc );
+	if ( buf )
+		op->o_tmpfree( buf, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Look for a normalized value of an attribute kept in id2v.
+ * Returns 0 if it is there, MDB_NOTFOUND if not.
+ */
+int
+mdb_id2v_find(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	Attribute *a,
+	struct berval *nval )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID kbuf[2];
+	unsigned char *buf;
+	int rc;
+
+	if ( !mdb->mi_id2val )
+		return MDB_NOTFOUND;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2val, &mc );
+	if ( rc )
+		return rc;
+	kbuf[0] = id;
+	kbuf[1] = mdb->mi_adxs[a->a_desc->ad_index];
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	data.mv_size = mdb_id2v_size( NULL, nval );
+	buf = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
+	mdb_id2v_encode( buf, NULL, nval );
+	data.mv_data = buf;
+	/* data is pointed at the stored record if found */
+	rc = mdb_cursor_get( mc, &key, &data, MDB_GET_BOTH );
+	op->o_tmpfree( buf, op->o_tmpmemctx );
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+/* Point an attribute's values at its id2v records. bp is advanced
+ * past the berval slots used, which must not go beyond bend.
+ */
+static int
+mdb_id2v_read(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id,
+	unsigned adx,
+	Attribute *a,
+	BerVarray *bp,
+	BerVarray bend )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID kbuf[2];
+	BerVarray bptr = *bp, nptr;
+	unsigned char *ptr;
+	unsigned int l;
+	size_t n;
+	int nv, rc;
+
+	a->a_numvals = 0;
+	rc = mdb_cursor_open( txn, mdb->mi_id2val, &mc );
+	if ( rc )
+		return rc;
+	kbuf[0] = id;
+	kbuf[1] = adx;
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	rc = mdb_cursor_get( mc, &key, &data, MDB_SET );
+	if ( rc == MDB_SUCCESS )
+		rc = mdb_cursor_count( mc, &n );
+	if ( rc )
+		goto done;
+
+	memcpy( &l, data.mv_data, sizeof(l) );
+	nv = ( l & HIGH_BIT ) != 0;
+	if ( bptr + ( n + 1 ) * ( nv + 1 ) > bend ) {
+		rc = LDAP_OTHER;
+		goto done;
+	}
+	a->a_numvals = n;
+	a->a_vals = bptr;
+	a->a_nvals = nv ? bptr + n + 1 : bptr;
+	nptr = a->a_nvals;
+	do {
+		ptr = data.mv_data;
+		memcpy( &l, ptr, sizeof(l) );
+		ptr += sizeof(l);
+		nptr->bv_len = l & ~HIGH_BIT;
+		nptr->bv_val = (char *)ptr;
+		ptr += nptr->bv_len + 1;
+		nptr++;
+		if ( nv ) {
+			memcpy( &l, ptr, sizeof(l) );
+			ptr += sizeof(l);
+			bptr->bv_len = l;
+			bptr->bv_val = (char *)ptr;
+			bptr++;
+		}
+	} while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP )) == MDB_SUCCESS );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( nv ) {
+		BER_BVZERO( bptr );
+	}
+	BER_BVZERO( nptr );
+	*bp = nptr + 1;
+	a->a_flags |= SLAP_ATTR_BIG_MULTI;
+
+done:
+	mdb_cursor_close( mc );
 	return rc;
 }
 
@@ -287,7 +940,7 @@ int mdb_entry_release(
 				if (( moi->moi_flag & (MOI_FREEIT|MOI_KEEPER)) == MOI_FREEIT ) {
 					moi->moi_ref--;
 					if ( moi->moi_ref < 1 ) {
-						mdb_txn_reset( moi->moi_txn );
+						mdb_reader_release( mdb, moi, 1 );
 						moi->moi_ref = 0;
 						LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
 						op->o_tmpfree( moi, op->o_tmpmemctx );
@@ -387,9 +1040,18 @@ return_results:
 static void
 mdb_reader_free( void *key, void *data )
 {
-	MDB_txn *txn = data;
+	mdb_rtxn *rt = data;
+
+	if ( rt ) {
+		struct mdb_info *mdb = rt->rt_mdb;
 
-	if ( txn ) mdb_txn_abort( txn );
+		ldap_pvt_thread_mutex_lock( &mdb->mi_rtxn_mutex );
+		LDAP_LIST_REMOVE( rt, rt_next );
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_rtxn_mutex );
+		mdb_txn_abort( rt->rt_txn );
+		ldap_pvt_thread_mutex_destroy( &rt->rt_mutex );
+		ch_free( rt );
+	}
 }
 
 /* free up any keys used by the main thread */
@@ -405,6 +1067,234 @@ mdb_reader_flush( MDB_env *env )
 	}
 }
 
+/* Is this the snapshot a new read txn would get? */
+int
+mdb_reader_current( struct mdb_info *mdb, MDB_txn *txn )
+{
+	MDB_envinfo mei;
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	return mdb_txn_id( txn ) == mei.me_last_txnid;
+}
+
+/* Start an operation on the thread's read txn. A parked txn that
+ * is still on the latest snapshot is used as is, which also keeps
+ * the DBI handles it already looked up.
+ */
+static int
+mdb_reader_pin( struct mdb_info *mdb, mdb_rtxn *rt )
+{
+	int rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &rt->rt_mutex );
+	if ( rt->rt_state != MDB_RT_PARKED ||
+		!mdb_reader_current( mdb, rt->rt_txn )) {
+		mdb_txn_reset( rt->rt_txn );
+		rc = mdb_txn_renew( rt->rt_txn );
+		rt->rt_pinned = slap_get_time();
+	}
+	rt->rt_state = rc ? MDB_RT_RESET : MDB_RT_ACTIVE;
+	ldap_pvt_thread_mutex_unlock( &rt->rt_mutex );
+	return rc;
+}
+
+/* Take up the read txn of an op again after mdb_reader_release(),
+ * for tasks that read in several steps with the same op.
+ */
+int
+mdb_reader_renew( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	if ( !moi->moi_rtxn )
+		return mdb_txn_renew( moi->moi_txn );
+	return mdb_reader_pin( mdb, moi->moi_rtxn );
+}
+
+/* An operation is done with its read txn. Unless told otherwise,
+ * keep the snapshot while no writer has committed since, so the
+ * thread's next operation can join it. Writers let go of the ones
+ * they made stale in mdb_reader_expire().
+ */
+void
+mdb_reader_release( struct mdb_info *mdb, mdb_op_info *moi, int park )
+{
+	mdb_rtxn *rt = moi->moi_rtxn;
+
+	if ( !rt ) {
+		mdb_txn_reset( moi->moi_txn );
+		return;
+	}
+	ldap_pvt_thread_mutex_lock( &rt->rt_mutex );
+	if ( rt->rt_state == MDB_RT_ACTIVE ) {
+		/* a parked txn would hold on to the entries it decompressed */
+		if ( park && !mdb->mi_compress &&
+			mdb_reader_current( mdb, rt->rt_txn )) {
+			rt->rt_state = MDB_RT_PARKED;
+		} else {
+			mdb_txn_reset( rt->rt_txn );
+			rt->rt_state = MDB_RT_RESET;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &rt->rt_mutex );
+}
+
+/* Called after a commit. Parked snapshots older than the latest one
+ * would keep the pages the writer just freed from being reused, so
+ * drop them. With all set, drop every parked snapshot, e.g. when new
+ * DBI handles were opened.
+ */
+void
+mdb_reader_expire( struct mdb_info *mdb, int all )
+{
+	mdb_rtxn *rt;
+	MDB_envinfo mei;
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_rtxn_mutex );
+	LDAP_LIST_FOREACH( rt, &mdb->mi_rtxns, rt_next ) {
+		ldap_pvt_thread_mutex_lock( &rt->rt_mutex );
+		if ( rt->rt_state == MDB_RT_PARKED &&
+			( all || mdb_txn_id( rt->rt_txn ) != mei.me_last_txnid )) {
+			mdb_txn_reset( rt->rt_txn );
+			rt->rt_state = MDB_RT_RESET;
+		}
+		ldap_pvt_thread_mutex_unlock( &rt->rt_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_rtxn_mutex );
+}
+
+/* Start a child txn in the open batch of a group commit, or open
+ * a new batch if there is none. The thread that opens a batch holds
+ * the write lock, so it leads the batch and must commit it itself.
+ */
+static int
+mdb_gc_begin( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_gcstate *gc = &mdb->mi_gc;
+	MDB_txn *parent;
+	int rc = 0;
+
+	moi->moi_flag &= ~MOI_LEADER;
+	ldap_pvt_thread_mutex_lock( &gc->gc_mutex );
+	for (;;) {
+		if ( !gc->gc_txn && !gc->gc_starting ) {
+			gc->gc_starting = 1;
+			ldap_pvt_thread_mutex_unlock( &gc->gc_mutex );
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &parent );
+			ldap_pvt_thread_mutex_lock( &gc->gc_mutex );
+			if ( rc ) {
+				gc->gc_starting = 0;
+				ldap_pvt_thread_cond_broadcast( &gc->gc_cond );
+				goto done;
+			}
+			/* the previous leader may not have posted its result yet */
+			while ( gc->gc_done != gc->gc_batch )
+				ldap_pvt_thread_cond_wait( &gc->gc_cond, &gc->gc_mutex );
+			gc->gc_starting = 0;
+			gc->gc_txn = parent;
+			gc->gc_batch++;
+			gc->gc_nops = 0;
+			moi->moi_flag |= MOI_LEADER;
+		}
+		if ( gc->gc_txn && !gc->gc_busy && gc->gc_nops < mdb->mi_gc_max )
+			break;
+		gc->gc_waiting++;
+		ldap_pvt_thread_cond_wait( &gc->gc_cond, &gc->gc_mutex );
+		gc->gc_waiting--;
+	}
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, gc->gc_txn, 0, &moi->moi_txn );
+	if ( rc == 0 ) {
+		gc->gc_busy = 1;
+		gc->gc_nops++;
+		moi->moi_batch = gc->gc_batch;
+	} else if ( moi->moi_flag & MOI_LEADER ) {
+		/* nobody else joined yet, give up the batch */
+		mdb_txn_abort( gc->gc_txn );
+		gc->gc_txn = NULL;
+		gc->gc_done = gc->gc_batch;
+		gc->gc_rc = rc;
+		moi->moi_flag ^= MOI_LEADER;
+		ldap_pvt_thread_cond_broadcast( &gc->gc_cond );
+	}
+done:
+	ldap_pvt_thread_mutex_unlock( &gc->gc_mutex );
+	return rc;
+}
+
+/* An op is done with its child txn. The leader lets the ops that
+ * are already queued run, then commits the batch with a single sync.
+ * With wait set, return only once the op's batch is committed, with
+ * the result of that commit.
+ */
+static int
+mdb_gc_end( struct mdb_info *mdb, mdb_op_info *moi, int wait )
+{
+	mdb_gcstate *gc = &mdb->mi_gc;
+	unsigned long batch = moi->moi_batch;
+	MDB_txn *parent;
+	int rc = 0;
+
+	moi->moi_batch = 0;
+	ldap_pvt_thread_mutex_lock( &gc->gc_mutex );
+	gc->gc_busy = 0;
+	ldap_pvt_thread_cond_broadcast( &gc->gc_cond );
+	if ( moi->moi_flag & MOI_LEADER ) {
+		moi->moi_flag ^= MOI_LEADER;
+		while ( gc->gc_busy ||
+			( gc->gc_waiting && gc->gc_nops < mdb->mi_gc_max ))
+			ldap_pvt_thread_cond_wait( &gc->gc_cond, &gc->gc_mutex );
+		parent = gc->gc_txn;
+		gc->gc_txn = NULL;
+		/* ops that found the batch full can start the next one */
+		ldap_pvt_thread_cond_broadcast( &gc->gc_cond );
+		ldap_pvt_thread_mutex_unlock( &gc->gc_mutex );
+
+		rc = mdb_txn_commit( parent );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_gc_end: commit of batch %lu failed: %s(%d)\n",
+				batch, mdb_strerror(rc), rc );
+		}
+
+		ldap_pvt_thread_mutex_lock( &gc->gc_mutex );
+		gc->gc_done = batch;
+		gc->gc_rc = rc;
+		ldap_pvt_thread_cond_broadcast( &gc->gc_cond );
+	} else if ( wait ) {
+		while ( gc->gc_done < batch )
+			ldap_pvt_thread_cond_wait( &gc->gc_cond, &gc->gc_mutex );
+		rc = gc->gc_rc;
+	}
+	ldap_pvt_thread_mutex_unlock( &gc->gc_mutex );
+	return rc;
+}
+
+/* Commit the write txn of an op. If the op joined a group commit,
+ * this returns once the whole batch is durable.
+ */
+int
+mdb_opinfo_commit( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	int rc, rc2;
+
+	rc = mdb_txn_commit( moi->moi_txn );
+	moi->moi_txn = NULL;
+	if ( moi->moi_batch ) {
+		rc2 = mdb_gc_end( mdb, moi, rc == 0 );
+		if ( rc == 0 )
+			rc = rc2;
+	}
+	return rc;
+}
+
+void
+mdb_opinfo_abort( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_txn_abort( moi->moi_txn );
+	moi->moi_txn = NULL;
+	if ( moi->moi_batch )
+		mdb_gc_end( mdb, moi, 0 );
+}
+
 extern MDB_txn *mdb_tool_txn;
 
 int
@@ -414,6 +1304,7 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 	void *data;
 	void *ctx;
 	mdb_op_info *moi = NULL;
+	mdb_rtxn *rt = NULL;
 	OpExtra *oex;
 
 	assert( op != NULL );
@@ -450,6 +1341,8 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		moi->moi_oe.oe_key = mdb;
 		moi->moi_ref = 0;
 		moi->moi_txn = NULL;
+		moi->moi_rtxn = NULL;
+		moi->moi_batch = 0;
 	}
 
 	if ( !rdonly ) {
@@ -465,6 +1358,16 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		if ( !moi->moi_txn ) {
 			if (( slapMode & SLAP_TOOL_MODE ) && mdb_tool_txn ) {
 				moi->moi_txn = mdb_tool_txn;
+			/* nested txns don't work with a writable map */
+			} else if (( moi->moi_flag & MOI_GROUP ) && mdb->mi_gc_max &&
+				!get_lazyCommit( op ) &&
+				!( mdb->mi_dbenv_flags & MDB_WRITEMAP )) {
+				rc = mdb_gc_begin( mdb, moi );
+				if (rc) {
+					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
+						mdb_strerror(rc), rc, 0 );
+				}
+				return rc;
 			} else {
 				int flag = 0;
 				if ( get_lazyCommit( op ))
@@ -496,25 +1399,37 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 			return rc;
 		}
 		if ( ldap_pvt_thread_pool_getkey( ctx, mdb->mi_dbenv, &data, NULL ) ) {
-			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &moi->moi_txn );
+			rt = ch_calloc( 1, sizeof( mdb_rtxn ));
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &rt->rt_txn );
 			if (rc) {
+				ch_free( rt );
 				Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 					mdb_strerror(rc), rc, 0 );
 				return rc;
 			}
-			data = moi->moi_txn;
+			ldap_pvt_thread_mutex_init( &rt->rt_mutex );
+			rt->rt_mdb = mdb;
+			rt->rt_pinned = slap_get_time();
+			rt->rt_state = MDB_RT_ACTIVE;
+			data = rt;
 			if ( ( rc = ldap_pvt_thread_pool_setkey( ctx, mdb->mi_dbenv,
 				data, mdb_reader_free, NULL, NULL ) ) ) {
-				mdb_txn_abort( moi->moi_txn );
-				moi->moi_txn = NULL;
+				mdb_txn_abort( rt->rt_txn );
+				ldap_pvt_thread_mutex_destroy( &rt->rt_mutex );
+				ch_free( rt );
 				Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: thread_pool_setkey failed err (%d)\n",
 					rc, 0, 0 );
 				return rc;
 			}
+			ldap_pvt_thread_mutex_lock( &mdb->mi_rtxn_mutex );
+			LDAP_LIST_INSERT_HEAD( &mdb->mi_rtxns, rt, rt_next );
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_rtxn_mutex );
 		} else {
-			moi->moi_txn = data;
+			rt = data;
 			renew = 1;
 		}
+		moi->moi_txn = rt->rt_txn;
+		moi->moi_rtxn = rt;
 		moi->moi_flag |= MOI_READER;
 	}
 ok:
@@ -522,7 +1437,7 @@ ok:
 		moi->moi_ref = 0;
 	}
 	if ( renew ) {
-		rc = mdb_txn_renew( moi->moi_txn );
+		rc = mdb_reader_pin( mdb, rt );
 		assert(!rc);
 	}
 	moi->moi_ref++;
@@ -549,6 +1464,8 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 		return rc;
 	case SLAP_TXN_COMMIT:
 		rc = mdb_txn_commit( moi->moi_txn );
+		if ( rc == 0 )
+			mdb_reader_expire( mdb, 0 );
 		op->o_tmpfree( moi, op->o_tmpmemctx );
 		return rc;
 	case SLAP_TXN_ABORT:
@@ -565,7 +1482,7 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	Ecount *eh)
 {
 	ber_len_t len;
-	int i, nat = 0, nval = 0, nnval = 0;
+	int i, nat = 0, nval = 0, nwords = 0;
 	Attribute *a;
 
 	len = 4*sizeof(int);	/* nattrs, nvals, ocflags, offset */
@@ -583,13 +1500,20 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 				return rc;
 		}
 		len += 2*sizeof(int);	/* AD index, numvals */
+		nwords += 2;
 		nval += a->a_numvals + 1;	/* empty berval at end */
+		if (a->a_nvals != a->a_vals)
+			nval += a->a_numvals + 1;
+		/* values stored in id2a or id2v only leave their header here */
+		if ((mdb->mi_nmultivals && mdb_attr_is_multi(mdb, a)) ||
+			(mdb->mi_ncoldattrs && mdb_attr_is_cold(mdb, a)))
+			continue;
 		for (i=0; i<a->a_numvals; i++) {
 			len += a->a_vals[i].bv_len + 1 + sizeof(int);	/* len */
 		}
+		nwords += a->a_numvals;
 		if (a->a_nvals != a->a_vals) {
-			nval += a->a_numvals + 1;
-			nnval++;
+			nwords += a->a_numvals;
 			for (i=0; i<a->a_numvals; i++) {
 				len += a->a_nvals[i].bv_len + 1 + sizeof(int);;
 			}
@@ -600,12 +1524,10 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	eh->len = len;
 	eh->nattrs = nat;
 	eh->nvals = nval;
-	eh->offset = nat + nval - nnval;
+	eh->offset = nwords;
 	return 0;
 }
 
-#define HIGH_BIT (1<<(sizeof(unsigned int)*CHAR_BIT-1))
-
 /* Flatten an Entry into a buffer. The buffer starts with the count of the
  * number of attributes in the entry, the total number of values in the
  * entry, and the e_ocflags. It then contains a list of integers for each
@@ -622,7 +1544,9 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
  * for the last attribute, the actual values are copied, with a NUL
  * terminator after each value. The buffer is padded to the sizeof(ID).
  * The entire buffer size is precomputed so that a single malloc can be
- * performed.
+ * performed. Attributes stored in id2a are written with a numvals of
+ * COLD_MARK and no lengths or values, those stored in id2v likewise
+ * with MULTI_MARK.
  */
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 {
@@ -651,9 +1575,21 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
 		if (!a->a_desc->ad_index)
 			return LDAP_UNDEFINED_TYPE;
 		l = mdb->mi_adxs[a->a_desc->ad_index];
+		if (mdb->mi_nmultivals && mdb_attr_is_multi(mdb, a)) {
+			/* id2v order is not the sorted order */
+			*lp++ = l;
+			*lp++ = MULTI_MARK;
+			continue;
+		}
+		/* values go back into the entry, nothing is left in id2v */
+		a->a_flags &= ~SLAP_ATTR_BIG_MULTI;
 		if (a->a_flags & SLAP_ATTR_SORTED_VALS)
 			l |= HIGH_BIT;
 		*lp++ = l;
+		if (mdb->mi_ncoldattrs && mdb_attr_is_cold(mdb, a)) {
+			*lp++ = COLD_MARK;
+			continue;
+		}
 		l = a->a_numvals;
 		if (a->a_nvals != a->a_vals)
 			l |= HIGH_BIT;
@@ -691,20 +1627,26 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  * Note: everything is stored in a single contiguous block, so
  * you can not free individual attributes or names from this
  * structure. Attempting to do so will likely corrupt memory.
+ *
+ * Attribute values point straight into the DB map, they stay valid
+ * for the life of the read txn. If an is given, attributes not in
+ * that list are skipped without building their value arrays. An
+ * attribute with a numvals of COLD_MARK or MULTI_MARK has its values
+ * in id2a or id2v, they are only fetched if the attribute is wanted.
  */
-
-int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
+int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data,
+	ID id, AttributeName *an, Entry **e)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	int i, j, nattrs, nvals;
+	int i, j, nattrs, nvals, numvals;
 	int rc;
 	Attribute *a;
 	Entry *x;
 	const char *text;
 	AttributeDescription *ad;
-	unsigned int *lp = (unsigned int *)data->mv_data;
-	unsigned char *ptr;
-	BerVarray bptr;
+	unsigned int *lp = (unsigned int *)data->mv_data, *vlp;
+	unsigned char *ptr, *vptr;
+	BerVarray bptr, bend;
 
 	Debug( LDAP_DEBUG_TRACE,
 		"=> mdb_entry_decode:\n",
@@ -719,6 +1661,7 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 	}
 	a = x->e_attrs;
 	bptr = a->a_vals;
+	bend = bptr + nvals;
 	i = *lp++;
 	ptr = (unsigned char *)(lp + i);
 
@@ -742,16 +1685,75 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 			}
 		}
 		a->a_desc = mdb->mi_ads[i];
-		a->a_numvals = *lp++;
-		if (a->a_numvals & HIGH_BIT) {
-			a->a_numvals ^= HIGH_BIT;
-			have_nval = 1;
+		numvals = *lp++;
+		if (numvals == MULTI_MARK) {
+			if (!mdb->mi_id2val || (an && !ad_inlist(a->a_desc, an)))
+				continue;
+			rc = mdb_id2v_read(mdb, txn, id, i, a, &bptr, bend);
+			if (rc == MDB_NOTFOUND || (!rc && !a->a_numvals))
+				continue;
+			if (rc) {
+				Debug( LDAP_DEBUG_ANY,
+					"mdb_entry_decode: id2v lookup failed: %s(%d)\n",
+					mdb_strerror(rc), rc, 0 );
+				return LDAP_OTHER;
+			}
+			goto sort;
+		} else if (numvals == COLD_MARK) {
+			MDB_val key, cdata;
+			ID kbuf[2];
+
+			if (!mdb->mi_id2attr || (an && !ad_inlist(a->a_desc, an)))
+				continue;
+			kbuf[0] = id;
+			kbuf[1] = i;
+			key.mv_data = kbuf;
+			key.mv_size = sizeof(kbuf);
+			rc = mdb_get(txn, mdb->mi_id2attr, &key, &cdata);
+			if (rc == MDB_NOTFOUND) {
+				/* the entry says its values are there */
+				Debug( LDAP_DEBUG_ANY,
+					"mdb_entry_decode: id2a record missing for %s in entry %lu\n",
+					a->a_desc->ad_cname.bv_val, (unsigned long) id, 0 );
+				continue;
+			}
+			if (rc) {
+				Debug( LDAP_DEBUG_ANY,
+					"mdb_entry_decode: id2a lookup failed: %s(%d)\n",
+					mdb_strerror(rc), rc, 0 );
+				return LDAP_OTHER;
+			}
+			vlp = cdata.mv_data;
+			numvals = *vlp++;
+			if (numvals & HIGH_BIT) {
+				numvals ^= HIGH_BIT;
+				have_nval = 1;
+			}
+			vptr = (unsigned char *)(vlp + numvals * (have_nval + 1));
+		} else {
+			if (numvals & HIGH_BIT) {
+				numvals ^= HIGH_BIT;
+				have_nval = 1;
+			}
+			vlp = lp;
+			vptr = ptr;
 		}
+		if (an && !ad_inlist(a->a_desc, an)) {
+			/* not wanted, just step over its values */
+			for (i=0; i<numvals; i++)
+				ptr += *lp++ + 1;
+			if (have_nval) {
+				for (i=0; i<numvals; i++)
+					ptr += *lp++ + 1;
+			}
+			continue;
+		}
+		a->a_numvals = numvals;
 		a->a_vals = bptr;
 		for (i=0; i<a->a_numvals; i++) {
-			bptr->bv_len = *lp++;;
-			bptr->bv_val = (char *)ptr;
-			ptr += bptr->bv_len+1;
+			bptr->bv_len = *vlp++;
+			bptr->bv_val = (char *)vptr;
+			vptr += bptr->bv_len+1;
 			bptr++;
 		}
 		bptr->bv_val = NULL;
@@ -761,9 +1763,9 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 		if (have_nval) {
 			a->a_nvals = bptr;
 			for (i=0; i<a->a_numvals; i++) {
-				bptr->bv_len = *lp++;
-				bptr->bv_val = (char *)ptr;
-				ptr += bptr->bv_len+1;
+				bptr->bv_len = *vlp++;
+				bptr->bv_val = (char *)vptr;
+				vptr += bptr->bv_len+1;
 				bptr++;
 			}
 			bptr->bv_val = NULL;
@@ -772,6 +1774,12 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 		} else {
 			a->a_nvals = a->a_vals;
 		}
+		if (lp[-1]) {
+			/* values were inline, move past them */
+			lp = vlp;
+			ptr = vptr;
+		}
+sort:
 		/* FIXME: This is redundant once a sorted entry is saved into the DB */
 		if (( a->a_desc->ad_type->sat_flags & SLAP_AT_SORTED_VAL )
 			&& !(a->a_flags & SLAP_ATTR_SORTED_VALS)) {
@@ -789,7 +1797,10 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, Entry **e)
 		a->a_next = a+1;
 		a = a->a_next;
 	}
-	a[-1].a_next = NULL;
+	if (a == x->e_attrs)
+		x->e_attrs = NULL;
+	else
+		a[-1].a_next = NULL;
 done:
 
 	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n",
@@ -258,6 +258,713 @@ mdb_show_key(
 	}
 }
 
+/* Bitmap IDLs
+ *
+ * The words of a bitmap IDL live in an MDB_bitmap, allocated from a
+ * per-thread pool. Each bitmap is stamped with the pool generation
+ * current when it was allocated, so a caller can take a mark with
+ * mdb_idl_bmap_mark() and drop everything allocated since then with
+ * mdb_idl_bmap_release(), without tracking the individual IDLs.
+ * A bitmap belongs to the IDL buffer holding its header; MDB_IDL_CPY
+ * makes a private copy.
+ */
+typedef struct mdb_bmpool mdb_bmpool;
+
+typedef struct MDB_bitmap {
+	struct MDB_bitmap *mb_next, *mb_prev;
+	mdb_bmpool *mb_pool;
+	unsigned long mb_gen;
+	ID mb_count;		/* number of IDs set */
+	ID mb_nwords;		/* number of words in use */
+	ID mb_maxwords;		/* number of words allocated */
+	ID mb_pos;			/* last word looked up */
+	ID mb_words[1];
+} MDB_bitmap;
+
+struct mdb_bmpool {
+	MDB_bitmap *bp_head;
+	unsigned long bp_gen;
+};
+
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define mdb_bm_popcount(w)	((ID)__builtin_popcountl(w))
+#define mdb_bm_lobit(w)	((ID)__builtin_ctzl(w))
+#define mdb_bm_hibit(w)	((ID)(sizeof(ID)*8 - 1 - __builtin_clzl(w)))
+#else
+static ID mdb_bm_popcount( ID w )
+{
+	ID n;
+	for ( n = 0; w; n++ )
+		w &= w - 1;
+	return n;
+}
+
+static ID mdb_bm_lobit( ID w )
+{
+	ID n = 0;
+	while ( !( w & 1 )) {
+		w >>= 1;
+		n++;
+	}
+	return n;
+}
+
+static ID mdb_bm_hibit( ID w )
+{
+	ID n = 0;
+	while ( w >>= 1 )
+		n++;
+	return n;
+}
+#endif
+
+/* ID of bit b in word number n */
+#define BM_ID(n,b)	(((ID)(n) << MDB_BM_SHIFT) | (b))
+
+static void
+mdb_bmpool_free( void *key, void *data )
+{
+	mdb_bmpool *bp = data;
+	MDB_bitmap *bm, *next;
+
+	for ( bm = bp->bp_head; bm; bm = next ) {
+		next = bm->mb_next;
+		ch_free( bm );
+	}
+	ch_free( bp );
+}
+
+static mdb_bmpool *
+mdb_bmpool_get( void )
+{
+	void *ctx = ldap_pvt_thread_pool_context();
+	void *data = NULL;
+
+	ldap_pvt_thread_pool_getkey( ctx, (void *)mdb_bmpool_get, &data, NULL );
+	if ( !data ) {
+		data = ch_calloc( 1, sizeof( mdb_bmpool ));
+		ldap_pvt_thread_pool_setkey( ctx, (void *)mdb_bmpool_get, data,
+			mdb_bmpool_free, NULL, NULL );
+	}
+	return data;
+}
+
+unsigned long
+mdb_idl_bmap_mark( void )
+{
+	mdb_bmpool *bp = mdb_bmpool_get();
+
+	return bp->bp_gen++;
+}
+
+void
+mdb_idl_bmap_release( unsigned long mark )
+{
+	mdb_bmpool *bp = mdb_bmpool_get();
+	MDB_bitmap *bm;
+
+	/* newest bitmaps are at the head of the list */
+	while (( bm = bp->bp_head ) && bm->mb_gen > mark ) {
+		bp->bp_head = bm->mb_next;
+		ch_free( bm );
+	}
+	if ( bp->bp_head )
+		bp->bp_head->mb_prev = NULL;
+}
+
+static MDB_bitmap *
+mdb_bmap_alloc( ID maxwords )
+{
+	mdb_bmpool *bp = mdb_bmpool_get();
+	MDB_bitmap *bm;
+
+	if ( !maxwords )
+		maxwords = 1;
+	bm = ch_malloc( sizeof( MDB_bitmap ) + ( maxwords - 1 ) * sizeof( ID ));
+	bm->mb_pool = bp;
+	bm->mb_gen = bp->bp_gen;
+	bm->mb_count = 0;
+	bm->mb_nwords = 0;
+	bm->mb_maxwords = maxwords;
+	bm->mb_pos = 0;
+	bm->mb_prev = NULL;
+	bm->mb_next = bp->bp_head;
+	if ( bp->bp_head )
+		bp->bp_head->mb_prev = bm;
+	bp->bp_head = bm;
+	return bm;
+}
+
+static void
+mdb_bmap_free( MDB_bitmap *bm )
+{
+	if ( bm->mb_prev )
+		bm->mb_prev->mb_next = bm->mb_next;
+	else
+		bm->mb_pool->bp_head = bm->mb_next;
+	if ( bm->mb_next )
+		bm->mb_next->mb_prev = bm->mb_prev;
+	ch_free( bm );
+}
+
+static MDB_bitmap *
+mdb_bmap_ptr( ID *ids )
+{
+	MDB_bitmap *bm;
+
+	memcpy( &bm, ids+4, sizeof( bm ));
+	return bm;
+}
+
+static void
+mdb_bmap_drop( ID *ids )
+{
+	if ( MDB_IDL_IS_BMAP( ids ))
+		mdb_bmap_free( mdb_bmap_ptr( ids ));
+}
+
+static MDB_bitmap *
+mdb_bmap_dup( MDB_bitmap *bm )
+{
+	MDB_bitmap *b2 = mdb_bmap_alloc( bm->mb_nwords );
+
+	AC_MEMCPY( b2->mb_words, bm->mb_words, bm->mb_nwords * sizeof( ID ));
+	b2->mb_nwords = bm->mb_nwords;
+	b2->mb_count = bm->mb_count;
+	return b2;
+}
+
+/* Store a bitmap in an IDL buffer. Small bitmaps are turned back
+ * into a plain list, so callers never see an empty or tiny bitmap.
+ */
+static void
+mdb_bmap_set( ID *ids, MDB_bitmap *bm )
+{
+	ID i, n, w, bits;
+
+	if ( bm->mb_count > MDB_IDL_DB_MAX ) {
+		w = bm->mb_words[0];
+		ids[1] = BM_ID( MDB_BM_WORDNO( w ), mdb_bm_lobit( w & MDB_BM_MASK ));
+		w = bm->mb_words[bm->mb_nwords-1];
+		ids[2] = BM_ID( MDB_BM_WORDNO( w ), mdb_bm_hibit( w & MDB_BM_MASK ));
+		ids[3] = bm->mb_count;
+		memcpy( ids+4, &bm, sizeof( bm ));
+		ids[0] = MDB_IDL_BMAP_MARK;
+		bm->mb_pos = 0;
+		return;
+	}
+
+	n = 0;
+	for ( i = 0; i < bm->mb_nwords; i++ ) {
+		w = bm->mb_words[i];
+		for ( bits = w & MDB_BM_MASK; bits; bits &= bits - 1 )
+			ids[++n] = BM_ID( MDB_BM_WORDNO( w ), mdb_bm_lobit( bits ));
+	}
+	mdb_bmap_free( bm );
+	if ( n )
+		ids[0] = n;
+	else
+		MDB_IDL_ZERO( ids );
+}
+
+/* Return the index of the first word whose number is >= wno */
+static ID
+mdb_bmap_find( MDB_bitmap *bm, ID wno )
+{
+	ID *w = bm->mb_words;
+	ID base = 0, n = bm->mb_nwords, pivot;
+
+	/* lookups are usually in ascending order, try the last spot first */
+	if ( bm->mb_pos < n && MDB_BM_WORDNO( w[bm->mb_pos] ) <= wno ) {
+		base = bm->mb_pos;
+		if ( MDB_BM_WORDNO( w[base] ) == wno )
+			return base;
+		base++;
+		if ( base == n || MDB_BM_WORDNO( w[base] ) >= wno ) {
+			bm->mb_pos = base;
+			return base;
+		}
+		n -= base;
+	}
+	while ( n ) {
+		pivot = n >> 1;
+		if ( MDB_BM_WORDNO( w[base + pivot] ) < wno ) {
+			base += pivot + 1;
+			n -= pivot + 1;
+		} else {
+			n = pivot;
+		}
+	}
+	bm->mb_pos = base;
+	return base;
+}
+
+static int
+mdb_bmap_test( MDB_bitmap *bm, ID id )
+{
+	ID wno = MDB_BM_WNUM( id ), x;
+
+	if ( id > MDB_BM_MAXID )
+		return 0;
+	x = mdb_bmap_find( bm, wno );
+	return x < bm->mb_nwords && MDB_BM_WORDNO( bm->mb_words[x] ) == wno &&
+		( bm->mb_words[x] & MDB_BM_BIT( id ));
+}
+
+/* Return the first ID >= id in the bitmap, or NOID */
+static ID
+mdb_bmap_next( MDB_bitmap *bm, ID id )
+{
+	ID wno = MDB_BM_WNUM( id ), x, w;
+
+	if ( id > MDB_BM_MAXID )
+		return NOID;
+	x = mdb_bmap_find( bm, wno );
+	if ( x < bm->mb_nwords && MDB_BM_WORDNO( bm->mb_words[x] ) == wno ) {
+		w = bm->mb_words[x] & MDB_BM_MASK & ~( MDB_BM_BIT( id ) - 1 );
+		if ( w )
+			return BM_ID( wno, mdb_bm_lobit( w ));
+		x++;
+	}
+	if ( x >= bm->mb_nwords )
+		return NOID;
+	bm->mb_pos = x;
+	w = bm->mb_words[x];
+	return BM_ID( MDB_BM_WORDNO( w ), mdb_bm_lobit( w & MDB_BM_MASK ));
+}
+
+/* Return the last ID <= id in the bitmap, or NOID */
+static ID
+mdb_bmap_prev( MDB_bitmap *bm, ID id )
+{
+	ID wno, x, w;
+
+	if ( id > MDB_BM_MAXID )
+		id = MDB_BM_MAXID;
+	wno = MDB_BM_WNUM( id );
+	x = mdb_bmap_find( bm, wno );
+	if ( x < bm->mb_nwords && MDB_BM_WORDNO( bm->mb_words[x] ) == wno ) {
+		w = bm->mb_words[x] & MDB_BM_MASK &
+			( MDB_BM_BIT( id ) | ( MDB_BM_BIT( id ) - 1 ));
+		if ( w )
+			return BM_ID( wno, mdb_bm_hibit( w ));
+	}
+	if ( !x )
+		return NOID;
+	x--;
+	bm->mb_pos = x;
+	w = bm->mb_words[x];
+	return BM_ID( MDB_BM_WORDNO( w ), mdb_bm_hibit( w & MDB_BM_MASK ));
+}
+
+/* Build a bitmap from a sorted list. IDs beyond MDB_BM_MAXID are
+ * ignored; callers that need them must check first.
+ */
+static MDB_bitmap *
+mdb_bmap_from_list( ID *ids )
+{
+	MDB_bitmap *bm = mdb_bmap_alloc( ids[0] );
+	ID i, wno, bits, *w = bm->mb_words;
+
+	for ( i = 1; i <= ids[0] && ids[i] <= MDB_BM_MAXID; ) {
+		wno = MDB_BM_WNUM( ids[i] );
+		bits = 0;
+		do {
+			bits |= MDB_BM_BIT( ids[i] );
+			bm->mb_count++;
+			i++;
+		} while ( i <= ids[0] && MDB_BM_WNUM( ids[i] ) == wno );
+		*w++ = MDB_BM_MKWORD( wno, bits );
+	}
+	bm->mb_nwords = w - bm->mb_words;
+	return bm;
+}
+
+/* Return a new bitmap holding a | b */
+static MDB_bitmap *
+mdb_bmap_or( MDB_bitmap *a, MDB_bitmap *b )
+{
+	MDB_bitmap *c = mdb_bmap_alloc( a->mb_nwords + b->mb_nwords );
+	ID i = 0, j = 0, n = 0, w;
+
+	while ( i < a->mb_nwords || j < b->mb_nwords ) {
+		if ( j == b->mb_nwords || ( i < a->mb_nwords &&
+			MDB_BM_WORDNO( a->mb_words[i] ) < MDB_BM_WORDNO( b->mb_words[j] ))) {
+			w = a->mb_words[i++];
+		} else if ( i == a->mb_nwords ||
+			MDB_BM_WORDNO( b->mb_words[j] ) < MDB_BM_WORDNO( a->mb_words[i] )) {
+			w = b->mb_words[j++];
+		} else {
+			w = a->mb_words[i++] | b->mb_words[j++];
+		}
+		c->mb_words[n++] = w;
+		c->mb_count += mdb_bm_popcount( w & MDB_BM_MASK );
+	}
+	c->mb_nwords = n;
+	return c;
+}
+
+/* a = a & b, or a = a & ~b if invert is set */
+static void
+mdb_bmap_and( MDB_bitmap *a, MDB_bitmap *b, int invert )
+{
+	ID i = 0, j = 0, n = 0, w, count = 0;
+
+	while ( i < a->mb_nwords ) {
+		w = a->mb_words[i];
+		while ( j < b->mb_nwords &&
+			MDB_BM_WORDNO( b->mb_words[j] ) < MDB_BM_WORDNO( w ))
+			j++;
+		if ( j < b->mb_nwords &&
+			MDB_BM_WORDNO( b->mb_words[j] ) == MDB_BM_WORDNO( w )) {
+			if ( invert )
+				w &= ~( b->mb_words[j] & MDB_BM_MASK );
+			else
+				w &= b->mb_words[j];
+		} else if ( !invert ) {
+			w = 0;
+		}
+		if ( w & MDB_BM_MASK ) {
+			a->mb_words[n++] = w;
+			count += mdb_bm_popcount( w & MDB_BM_MASK );
+		}
+		i++;
+	}
+	a->mb_nwords = n;
+	a->mb_count = count;
+	a->mb_pos = 0;
+}
+
+/* Restrict a bitmap to the IDs in lo..hi. If copy is set the result
+ * goes to a new bitmap and the original is left alone.
+ */
+static MDB_bitmap *
+mdb_bmap_clip( MDB_bitmap *bm, ID lo, ID hi, int copy )
+{
+	MDB_bitmap *dst;
+	ID i, end, n = 0, w, count = 0, lw, hw;
+
+	if ( hi > MDB_BM_MAXID )
+		hi = MDB_BM_MAXID;
+	lw = MDB_BM_WNUM( lo );
+	hw = MDB_BM_WNUM( hi );
+	i = mdb_bmap_find( bm, lw );
+	end = mdb_bmap_find( bm, hw + 1 );
+	dst = copy ? mdb_bmap_alloc( end - i ) : bm;
+
+	for ( ; i < end; i++ ) {
+		w = bm->mb_words[i];
+		if ( MDB_BM_WORDNO( w ) == lw )
+			w &= ~( MDB_BM_BIT( lo ) - 1 );
+		if ( MDB_BM_WORDNO( w ) == hw )
+			w &= ~MDB_BM_MASK | (( MDB_BM_BIT( hi ) << 1 ) - 1 );
+		if ( w & MDB_BM_MASK ) {
+			dst->mb_words[n++] = w;
+			count += mdb_bm_popcount( w & MDB_BM_MASK );
+		}
+	}
+	dst->mb_nwords = n;
+	dst->mb_count = count;
+	dst->mb_pos = 0;
+	return dst;
+}
+
+/* Intersection where at least one side is a bitmap */
+static int
+mdb_idl_bmap_intersection( ID *a, ID *b )
+{
+	MDB_bitmap *bm;
+	ID i, n;
+
+	if ( MDB_IDL_IS_BMAP( a )) {
+		bm = mdb_bmap_ptr( a );
+		if ( MDB_IDL_IS_BMAP( b )) {
+			mdb_bmap_and( bm, mdb_bmap_ptr( b ), 0 );
+		} else if ( MDB_IDL_IS_RANGE( b )) {
+			mdb_bmap_clip( bm, b[1], b[2], 0 );
+		} else {
+			/* the result can't be larger than the list */
+			for ( i = 1, n = 0; i <= b[0]; i++ ) {
+				if ( mdb_bmap_test( bm, b[i] ))
+					a[++n] = b[i];
+			}
+			mdb_bmap_free( bm );
+			a[0] = n;
+			return 0;
+		}
+	} else {
+		bm = mdb_bmap_ptr( b );
+		if ( MDB_IDL_IS_RANGE( a )) {
+			bm = mdb_bmap_clip( bm, a[1], a[2], 1 );
+		} else {
+			for ( i = 1, n = 0; i <= a[0]; i++ ) {
+				if ( mdb_bmap_test( bm, a[i] ))
+					a[++n] = a[i];
+			}
+			a[0] = n;
+			return 0;
+		}
+	}
+	mdb_bmap_set( a, bm );
+	return 0;
+}
+
+/* Union where neither side is a range */
+static int
+mdb_idl_bmap_union( ID *a, ID *b )
+{
+	MDB_bitmap *ba, *bb;
+
+	ba = MDB_IDL_IS_BMAP( a ) ? mdb_bmap_ptr( a ) : mdb_bmap_from_list( a );
+	bb = MDB_IDL_IS_BMAP( b ) ? mdb_bmap_ptr( b ) : mdb_bmap_from_list( b );
+	mdb_bmap_set( a, mdb_bmap_or( ba, bb ));
+	mdb_bmap_free( ba );
+	if ( !MDB_IDL_IS_BMAP( b ))
+		mdb_bmap_free( bb );
+	return 0;
+}
+
+int
+mdb_idl_bmap_test( ID *ids, ID id )
+{
+	return mdb_bmap_test( mdb_bmap_ptr( ids ), id );
+}
+
+void
+mdb_idl_cpy( ID *dst, ID *src )
+{
+	if ( MDB_IDL_IS_BMAP( src )) {
+		MDB_bitmap *bm = mdb_bmap_dup( mdb_bmap_ptr( src ));
+		AC_MEMCPY( dst, src, 4 * sizeof( ID ));
+		memcpy( dst+4, &bm, sizeof( bm ));
+	} else {
+		AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ));
+	}
+}
+
+/* Read a key stored as a bitmap: { 0, words..., NOID } */
+static int
+mdb_bmap_fetch( MDB_cursor *cursor, MDB_val *key, ID *ids )
+{
+	MDB_val data;
+	MDB_bitmap *bm;
+	size_t count;
+	ID *w, n, i;
+	int rc;
+
+	rc = mdb_cursor_count( cursor, &count );
+	if ( rc )
+		return rc;
+	bm = mdb_bmap_alloc( count );
+	w = bm->mb_words;
+	rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 && w + data.mv_size / sizeof(ID) <= bm->mb_words + count ) {
+		memcpy( w, data.mv_data, data.mv_size );
+		w += data.mv_size / sizeof(ID);
+		rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND ) {
+		mdb_bmap_free( bm );
+		return rc ? rc : -1;
+	}
+	n = w - bm->mb_words;
+	if ( n < 3 || bm->mb_words[0] != 0 || bm->mb_words[n-1] != NOID ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
+			"malformed bitmap of %ld words\n", (long) n, 0, 0 );
+		mdb_bmap_free( bm );
+		return -1;
+	}
+	n -= 2;
+	AC_MEMCPY( bm->mb_words, bm->mb_words+1, n * sizeof(ID) );
+	bm->mb_nwords = n;
+	for ( i = 0; i < n; i++ )
+		bm->mb_count += mdb_bm_popcount( bm->mb_words[i] & MDB_BM_MASK );
+	mdb_bmap_set( ids, bm );
+	return 0;
+}
+
+/* Convert a list key holding count IDs to a bitmap, adding id */
+static int
+mdb_bmap_store( MDB_cursor *cursor, MDB_val *key, size_t count, ID id )
+{
+	MDB_val k2, data, mv[2];
+	ID *ids, i, n, x, wno, bits;
+	int rc;
+
+	ids = ch_malloc(( count + 3 ) * sizeof(ID) );
+	n = 0;
+	k2 = *key;
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_FIRST_DUP );
+	if ( rc == 0 )
+		rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 && n + data.mv_size / sizeof(ID) <= count ) {
+		memcpy( ids+1+n, data.mv_data, data.mv_size );
+		n += data.mv_size / sizeof(ID);
+		rc = mdb_cursor_get( cursor, &k2, &data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND ) {
+		ch_free( ids );
+		return rc ? rc : -1;
+	}
+	ids[0] = n;
+	x = mdb_idl_search( ids, id );
+	if ( x > n || ids[x] != id ) {
+		AC_MEMCPY( &ids[x+1], &ids[x], ( n+1-x ) * sizeof(ID) );
+		ids[x] = id;
+		n++;
+	}
+
+	/* Pack into words in place, the output never overtakes the input */
+	x = 1;
+	for ( i = 1; i <= n; ) {
+		wno = MDB_BM_WNUM( ids[i] );
+		bits = 0;
+		do {
+			bits |= MDB_BM_BIT( ids[i] );
+			i++;
+		} while ( i <= n && MDB_BM_WNUM( ids[i] ) == wno );
+		ids[x++] = MDB_BM_MKWORD( wno, bits );
+	}
+	ids[0] = 0;
+	ids[x++] = NOID;
+
+	rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+	if ( rc == 0 ) {
+		mv[0].mv_size = sizeof(ID);
+		mv[0].mv_data = ids;
+		mv[1].mv_size = x;
+		mv[1].mv_data = NULL;
+		rc = mdb_cursor_put( cursor, key, mv, MDB_MULTIPLE );
+	}
+	ch_free( ids );
+	return rc;
+}
+
+/* Set or clear the bit for id in a key stored as a bitmap */
+static int
+mdb_bmap_update( MDB_cursor *cursor, MDB_val *key, ID id, int del )
+{
+	MDB_val k2, data;
+	ID wno = MDB_BM_WNUM( id ), w, cur;
+	size_t count;
+	int rc;
+
+	k2 = *key;
+	w = MDB_BM_MKWORD( wno, 0 );
+	/* word 0 would match the leading 0 marker, seek past it */
+	if ( w == 0 )
+		w = 1;
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	/* the trailing NOID guarantees a match */
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_GET_BOTH_RANGE );
+	if ( rc )
+		return rc;
+	memcpy( &cur, data.mv_data, sizeof(ID) );
+	data.mv_size = sizeof(ID);
+	data.mv_data = &w;
+	if ( cur == NOID || MDB_BM_WORDNO( cur ) != wno ) {
+		/* no word yet */
+		if ( del )
+			return 0;
+		w = MDB_BM_MKWORD( wno, MDB_BM_BIT( id ));
+		return mdb_cursor_put( cursor, key, &data, MDB_NODUPDATA );
+	}
+	if ( del ) {
+		w = cur & ~MDB_BM_BIT( id );
+		if ( w == cur )
+			return 0;
+		if ( w & MDB_BM_MASK )
+			return mdb_cursor_put( cursor, key, &data, MDB_CURRENT );
+		rc = mdb_cursor_del( cursor, 0 );
+		if ( rc )
+			return rc;
+		/* only the 0 and NOID markers left? */
+		rc = mdb_cursor_count( cursor, &count );
+		if ( rc == 0 && count <= 2 )
+			rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+		return rc;
+	}
+	w = cur | MDB_BM_BIT( id );
+	if ( w == cur )
+		return 0;
+	return mdb_cursor_put( cursor, key, &data, MDB_CURRENT );
+}
+
+/* Turn a bitmap key into a range when id can't be represented */
+static int
+mdb_bmap_to_range( MDB_cursor *cursor, MDB_val *key, ID id )
+{
+	MDB_val k2, data;
+	ID w, r[3];
+	int rc;
+
+	k2 = *key;
+	rc = mdb_cursor_get( cursor, &k2, &data, MDB_FIRST_DUP );
+	if ( rc == 0 )
+		rc = mdb_cursor_get( cursor, &k2, &data, MDB_NEXT_DUP );
+	if ( rc )
+		return rc;
+	memcpy( &w, data.mv_data, sizeof(ID) );
+	r[0] = 0;
+	r[1] = BM_ID( MDB_BM_WORDNO( w ), mdb_bm_lobit( w & MDB_BM_MASK ));
+	r[2] = id;
+	rc = mdb_cursor_del( cursor, MDB_NODUPDATA );
+	data.mv_size = sizeof(ID);
+	for ( w = 0; rc == 0 && w < 3; w++ ) {
+		data.mv_data = &r[w];
+		rc = mdb_cursor_put( cursor, key, &data, 0 );
+	}
+	return rc;
+}
+
+/* Read the IDs of the key under the cursor, which must be positioned
+ * on the key's first data item. On success data->mv_size is set to
+ * the size of the resulting IDL.
+ */
+static int
+mdb_idl_read( MDB_cursor *cursor, MDB_val *key, MDB_val *data, ID *ids )
+{
+	ID *i = data->mv_data;
+	int rc;
+
+	if ( *i == 0 ) {
+		/* A range or a bitmap; only a bitmap ends with NOID */
+		size_t count;
+		rc = mdb_cursor_count( cursor, &count );
+		if ( rc )
+			return rc;
+		if ( count > MDB_IDL_RANGE_SIZE || i[2] == NOID ) {
+			rc = mdb_bmap_fetch( cursor, key, ids );
+			data->mv_size = MDB_IDL_SIZEOF(ids);
+			return rc;
+		}
+	}
+
+	i = ids+1;
+	rc = mdb_cursor_get( cursor, key, data, MDB_GET_MULTIPLE );
+	while (rc == 0) {
+		memcpy( i, data->mv_data, data->mv_size );
+		i += data->mv_size / sizeof(ID);
+		rc = mdb_cursor_get( cursor, key, data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+	ids[0] = i - &ids[1];
+	/* On disk, a range is denoted by 0 in the first element */
+	if (ids[1] == 0) {
+		if (ids[0] != MDB_IDL_RANGE_SIZE) {
+			Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
+				"range size mismatch: expected %d, got %ld\n",
+				MDB_IDL_RANGE_SIZE, ids[0], 0 );
+			return -1;
+		}
+		MDB_IDL_RANGE( ids, ids[2], ids[3] );
+	}
+	data->mv_size = MDB_IDL_SIZEOF(ids);
+	return 0;
+}
+
 int
 mdb_idl_fetch_key(
 	BackendDB	*be,
@@ -270,7 +977,6 @@ mdb_idl_fetch_key(
 {
 	MDB_val data, key2, *kptr;
 	MDB_cursor *cursor;
-	ID *i;
 	size_t len;
 	int rc;
 	MDB_cursor_op opflag;
@@ -332,27 +1038,7 @@ mdb_idl_fetch_key(
 		rc = MDB_NOTFOUND;
 	}
 	if (rc == 0) {
-		i = ids+1;
-		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
-		while (rc == 0) {
-			memcpy( i, data.mv_data, data.mv_size );
-			i += data.mv_size / sizeof(ID);
-			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
-		}
-		if ( rc == MDB_NOTFOUND ) rc = 0;
-		ids[0] = i - &ids[1];
-		/* On disk, a range is denoted by 0 in the first element */
-		if (ids[1] == 0) {
-			if (ids[0] != MDB_IDL_RANGE_SIZE) {
-				Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
-					"range size mismatch: expected %d, got %ld\n",
-					MDB_IDL_RANGE_SIZE, ids[0], 0 );
-				mdb_cursor_close( cursor );
-				return -1;
-			}
-			MDB_IDL_RANGE( ids, ids[2], ids[3] );
-		}
-		data.mv_size = MDB_IDL_SIZEOF(ids);
+		rc = mdb_idl_read( cursor, key, &data, ids );
 	}
 
 	if ( saved_cursor && rc == 0 ) {
@@ -389,6 +1075,399 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/* Read the IDs of the key under the cursor. The cursor may be on any
+ * of the key's data items. It is positioned again with MDB_SET, since
+ * moving onto a key with a single data item leaves the duplicate state
+ * of the previous key behind for MDB_GET_MULTIPLE.
+ */
+int
+mdb_idl_fetch_current( MDB_cursor *cursor, ID *ids )
+{
+	MDB_val key, data;
+	int rc;
+
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_GET_CURRENT );
+	if ( rc == 0 )
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+	if ( rc == 0 )
+		rc = mdb_idl_read( cursor, &key, &data, ids );
+	if ( rc == MDB_NOTFOUND )
+		MDB_IDL_ZERO( ids );
+	return rc;
+}
+
+/* Key cursors
+ *
+ * A key cursor returns the IDs of one index key in ascending order
+ * straight from the database, without copying the whole slot into an
+ * IDL first. mdb_idl_keycur_seek() positions it on the first ID at or
+ * after a given ID, so intersections can skip over the IDs that can't
+ * match. Seeks must not go backwards.
+ */
+#define	KC_EMPTY	0
+#define	KC_LIST	1
+#define	KC_RANGE	2
+#define	KC_BMAP	3
+
+struct mdb_keycur {
+	MDB_cursor *kc_mc;
+	MDB_val kc_key;
+	int kc_form;
+	int kc_stale;		/* cursor needs repositioning */
+	ID kc_id;			/* last ID returned */
+	ID kc_lo, kc_hi;	/* bounds of a range */
+	ID kc_count;		/* upper bound of the number of IDs */
+};
+
+/* Find out how the key is stored */
+static int
+mdb_keycur_init( mdb_keycur *kc )
+{
+	MDB_val key, data;
+	ID *i;
+	size_t count;
+	int rc;
+
+	key = kc->kc_key;
+	kc->kc_form = KC_EMPTY;
+	kc->kc_count = 0;
+	kc->kc_stale = 1;
+	rc = mdb_cursor_get( kc->kc_mc, &key, &data, MDB_SET );
+	if ( rc == MDB_NOTFOUND )
+		return 0;
+	if ( rc == 0 )
+		rc = mdb_cursor_count( kc->kc_mc, &count );
+	if ( rc )
+		return rc;
+
+	i = data.mv_data;
+	if ( *i != 0 ) {
+		kc->kc_form = KC_LIST;
+		kc->kc_count = count;
+	} else if ( count > MDB_IDL_RANGE_SIZE || i[2] == NOID ) {
+		kc->kc_form = KC_BMAP;
+		kc->kc_count = ( count - 2 ) * MDB_BM_BITS;
+	} else {
+		rc = mdb_cursor_get( kc->kc_mc, &key, &data, MDB_NEXT_DUP );
+		if ( rc == 0 ) {
+			memcpy( &kc->kc_lo, data.mv_data, sizeof(ID) );
+			rc = mdb_cursor_get( kc->kc_mc, &key, &data, MDB_NEXT_DUP );
+		}
+		if ( rc )
+			return rc;
+		memcpy( &kc->kc_hi, data.mv_data, sizeof(ID) );
+		kc->kc_form = KC_RANGE;
+		kc->kc_count = kc->kc_hi - kc->kc_lo + 1;
+	}
+	return 0;
+}
+
+int
+mdb_idl_keycur_open(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	mdb_keycur	**kcp )
+{
+	mdb_keycur *kc;
+	int rc;
+
+	kc = ch_malloc( sizeof( mdb_keycur ) + key->mv_size );
+	kc->kc_key.mv_size = key->mv_size;
+	kc->kc_key.mv_data = kc+1;
+	memcpy( kc->kc_key.mv_data, key->mv_data, key->mv_size );
+	kc->kc_id = 0;
+
+	rc = mdb_cursor_open( txn, dbi, &kc->kc_mc );
+	if ( rc == 0 ) {
+		rc = mdb_keycur_init( kc );
+		if ( rc )
+			mdb_cursor_close( kc->kc_mc );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_keycur_open: "
+			"get failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+		ch_free( kc );
+		return rc;
+	}
+	*kcp = kc;
+	return 0;
+}
+
+/* Return the first ID >= id, or NOID */
+ID
+mdb_idl_keycur_seek( mdb_keycur *kc, ID id )
+{
+	MDB_val key, data;
+	MDB_cursor_op op;
+	ID w, wno, bits;
+	int rc;
+
+	if ( kc->kc_id == NOID || id <= kc->kc_id )
+		return kc->kc_id;
+
+	switch ( kc->kc_form ) {
+	case KC_LIST:
+		key = kc->kc_key;
+		data.mv_size = sizeof(ID);
+		data.mv_data = &id;
+		/* stepping to the next ID is cheaper than a lookup */
+		op = ( !kc->kc_stale && id == kc->kc_id + 1 ) ?
+			MDB_NEXT_DUP : MDB_GET_BOTH_RANGE;
+		rc = mdb_cursor_get( kc->kc_mc, &key, &data, op );
+		if ( rc ) {
+			kc->kc_id = NOID;
+			break;
+		}
+		kc->kc_stale = 0;
+		memcpy( &kc->kc_id, data.mv_data, sizeof(ID) );
+		break;
+
+	case KC_RANGE:
+		if ( id < kc->kc_lo )
+			id = kc->kc_lo;
+		kc->kc_id = id > kc->kc_hi ? NOID : id;
+		break;
+
+	case KC_BMAP:
+		if ( id > MDB_BM_MAXID ) {
+			kc->kc_id = NOID;
+			break;
+		}
+		key = kc->kc_key;
+		wno = MDB_BM_WNUM( id );
+		w = MDB_BM_MKWORD( wno, 0 );
+		data.mv_size = sizeof(ID);
+		data.mv_data = &w;
+		op = MDB_GET_BOTH_RANGE;
+		if ( !kc->kc_stale && MDB_BM_WNUM( kc->kc_id ) == wno ) {
+			op = MDB_GET_CURRENT;
+		}
+		/* the trailing NOID ends the walk */
+		while (( rc = mdb_cursor_get( kc->kc_mc, &key, &data, op )) == 0 ) {
+			memcpy( &w, data.mv_data, sizeof(ID) );
+			if ( w == NOID )
+				break;
+			bits = w & MDB_BM_MASK;
+			if ( MDB_BM_WORDNO( w ) == wno )
+				bits &= ~( MDB_BM_BIT( id ) - 1 );
+			if ( bits && MDB_BM_WORDNO( w ) >= wno ) {
+				kc->kc_stale = 0;
+				kc->kc_id = BM_ID( MDB_BM_WORDNO( w ), mdb_bm_lobit( bits ));
+				return kc->kc_id;
+			}
+			op = MDB_NEXT_DUP;
+		}
+		kc->kc_id = NOID;
+		break;
+
+	default:
+		kc->kc_id = NOID;
+	}
+	return kc->kc_id;
+}
+
+ID
+mdb_idl_keycur_count( mdb_keycur *kc )
+{
+	return kc->kc_count;
+}
+
+/* The read txn was renewed, pick up the current state of the key */
+int
+mdb_idl_keycur_renew( MDB_txn *txn, mdb_keycur *kc )
+{
+	int rc;
+
+	rc = mdb_cursor_renew( txn, kc->kc_mc );
+	if ( rc == 0 )
+		rc = mdb_keycur_init( kc );
+	if ( rc )
+		kc->kc_form = KC_EMPTY;
+	return rc;
+}
+
+void
+mdb_idl_keycur_close( mdb_keycur *kc )
+{
+	mdb_cursor_close( kc->kc_mc );
+	ch_free( kc );
+}
+
+/* Return an upper bound of the number of IDs stored under key,
+ * without reading them. Lists know their exact size, ranges and
+ * bitmaps are bounded by their span.
+ */
+int
+mdb_idl_fetch_count(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count )
+{
+	mdb_keycur kc;
+	int rc;
+
+	*count = 0;
+	rc = mdb_cursor_open( txn, dbi, &kc.kc_mc );
+	if ( rc )
+		return rc;
+	kc.kc_key = *key;
+	rc = mdb_keycur_init( &kc );
+	mdb_cursor_close( kc.kc_mc );
+	if ( rc == 0 )
+		*count = kc.kc_count;
+	return rc;
+}
+
+/* Sort a list and drop duplicate IDs */
+static void
+mdb_idl_uniq( ID *ids, ID *tmp )
+{
+	ID i, n = 0;
+
+	mdb_idl_sort( ids, tmp );
+	for ( i = 1; i <= ids[0]; i++ ) {
+		if ( !n || ids[i] != ids[n] )
+			ids[++n] = ids[i];
+	}
+	ids[0] = n;
+}
+
+/* Fold the unsorted list in ids into the bitmap acc, emptying ids */
+static MDB_bitmap *
+mdb_idl_fold( ID *ids, ID *tmp, MDB_bitmap *acc )
+{
+	MDB_bitmap *bm, *b2;
+
+	mdb_idl_uniq( ids, tmp );
+	bm = mdb_bmap_from_list( ids );
+	ids[0] = 0;
+	if ( !acc )
+		return bm;
+	b2 = mdb_bmap_or( acc, bm );
+	mdb_bmap_free( acc );
+	mdb_bmap_free( bm );
+	return b2;
+}
+
+/* Return the union of all keys from lo up to and including hi that
+ * share the first plen bytes of lo. With no hi the walk only stops
+ * at the end of the prefix. Small keys are gathered into ids and
+ * sorted once at the end; bitmap keys are merged as they are found.
+ * The walk stops early once at least limit IDs were collected.
+ */
+int
+mdb_idl_fetch_range(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	size_t		plen,
+	ID			*ids,
+	ID			*tmp,
+	ID			limit )
+{
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	MDB_bitmap *acc = NULL, *bm;
+	ID range[3], n;
+	int rc;
+
+	char keybuf[16];
+
+	Debug( LDAP_DEBUG_ARGS,
+		"mdb_idl_fetch_range: %s\n",
+		mdb_show_key( keybuf, lo->mv_data, lo->mv_size ), 0, 0 );
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if( rc != 0 ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_range: "
+			"cursor failed: %s (%d)\n", mdb_strerror(rc), rc, 0 );
+		return rc;
+	}
+
+	MDB_IDL_ZERO( ids );
+	MDB_IDL_ZERO( range );
+	key = *lo;
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET_RANGE );
+	while ( rc == 0 ) {
+		if ( key.mv_size < plen || memcmp( key.mv_data, lo->mv_data, plen ))
+			break;
+		if ( hi && mdb_cmp( txn, dbi, &key, hi ) > 0 )
+			break;
+		rc = mdb_idl_read( cursor, &key, &data, tmp );
+		if ( rc )
+			break;
+
+		if ( MDB_IDL_IS_RANGE( tmp ) || MDB_IDL_LAST( tmp ) > MDB_BM_MAXID ) {
+			/* a range swallows everything else */
+			if ( MDB_IDL_IS_ZERO( range )) {
+				MDB_IDL_RANGE( range, MDB_IDL_FIRST( tmp ), MDB_IDL_LAST( tmp ));
+			} else {
+				range[1] = IDL_MIN( range[1], MDB_IDL_FIRST( tmp ));
+				range[2] = IDL_MAX( range[2], MDB_IDL_LAST( tmp ));
+			}
+		} else if ( MDB_IDL_IS_BMAP( tmp )) {
+			bm = mdb_bmap_ptr( tmp );
+			if ( acc ) {
+				MDB_bitmap *b2 = mdb_bmap_or( acc, bm );
+				mdb_bmap_free( acc );
+				mdb_bmap_free( bm );
+				acc = b2;
+			} else {
+				acc = bm;
+			}
+		} else {
+			if ( ids[0] + tmp[0] > MDB_IDL_UM_MAX )
+				acc = mdb_idl_fold( ids, tmp, acc );
+			AC_MEMCPY( ids+ids[0]+1, tmp+1, tmp[0] * sizeof(ID) );
+			ids[0] += tmp[0];
+		}
+
+		if ( limit ) {
+			/* only count what is certain to be in the result */
+			n = ids[0] + ( acc ? acc->mb_count : 0 );
+			if ( n >= limit && ids[0] ) {
+				acc = mdb_idl_fold( ids, tmp, acc );
+				n = acc->mb_count;
+			}
+			if ( !MDB_IDL_IS_ZERO( range ))
+				n = IDL_MAX( n, range[2] - range[1] + 1 );
+			if ( n >= limit )
+				break;
+		}
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_NODUP );
+	}
+	mdb_cursor_close( cursor );
+
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_range: "
+			"get failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+		if ( acc )
+			mdb_bmap_free( acc );
+		MDB_IDL_ZERO( ids );
+		return rc;
+	}
+
+	if ( acc ) {
+		if ( ids[0] )
+			acc = mdb_idl_fold( ids, tmp, acc );
+		mdb_bmap_set( ids, acc );
+	} else {
+		mdb_idl_uniq( ids, tmp );
+	}
+	if ( !MDB_IDL_IS_ZERO( range ))
+		mdb_idl_union( ids, range );
+
+	return 0;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -415,18 +1494,15 @@ mdb_idl_insert_keys(
 
 	assert( id != NOID );
 
-#ifndef MISALIGNED_OK
-	if (keys[0].bv_len & ALIGNER)
-		kbuf[1] = 0;
-#endif
 	for ( k=0; keys[k].bv_val; k++ ) {
 	/* Fetch the first data item for this key, to see if it
 	 * exists and if it's a range.
 	 */
 #ifndef MISALIGNED_OK
-	if (keys[k].bv_len & ALIGNER) {
+	if ((keys[k].bv_len & ALIGNER) && keys[k].bv_len < sizeof(kbuf)) {
 		key.mv_size = sizeof(kbuf);
 		key.mv_data = kbuf;
+		kbuf[0] = kbuf[1] = 0;
 		memcpy(key.mv_data, keys[k].bv_val, keys[k].bv_len);
 	} else
 #endif
@@ -448,7 +1524,6 @@ mdb_idl_insert_keys(
 				goto fail;
 			}
 			if ( count >= MDB_IDL_DB_MAX ) {
-			/* No room, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
 				if ( rc != 0 && rc != MDB_NOTFOUND ) {
@@ -457,6 +1532,16 @@ mdb_idl_insert_keys(
 				}
 				i = data.mv_data;
 				hi = *i;
+				if ( IDL_MAX( hi, id ) <= MDB_BM_MAXID ) {
+				/* No room, convert to a bitmap */
+					rc = mdb_bmap_store( cursor, &key, count, id );
+					if ( rc != 0 ) {
+						err = "c_put bitmap";
+						goto fail;
+					}
+					continue;
+				}
+				/* IDs too large for a bitmap, convert to a range */
 				/* Update hi/lo if needed */
 				if ( id < lo ) {
 					lo = id;
@@ -497,6 +1582,25 @@ mdb_idl_insert_keys(
 				goto put1;
 			}
 		} else {
+			size_t count;
+			rc = mdb_cursor_count( cursor, &count );
+			if ( rc != 0 ) {
+				err = "c_count";
+				goto fail;
+			}
+			if ( count > MDB_IDL_RANGE_SIZE || i[2] == NOID ) {
+				/* It's a bitmap, set the ID's bit */
+				if ( id > MDB_BM_MAXID ) {
+					rc = mdb_bmap_to_range( cursor, &key, id );
+					err = "c_put range";
+				} else {
+					rc = mdb_bmap_update( cursor, &key, id, 0 );
+					err = "c_put bitmap";
+				}
+				if ( rc != 0 )
+					goto fail;
+				continue;
+			}
 			/* It's a range, see if we need to rewrite
 			 * the boundaries
 			 */
@@ -573,18 +1677,15 @@ mdb_idl_delete_keys(
 	}
 	assert( id != NOID );
 
-#ifndef MISALIGNED_OK
-	if (keys[0].bv_len & ALIGNER)
-		kbuf[1] = 0;
-#endif
 	for ( k=0; keys[k].bv_val; k++) {
 	/* Fetch the first data item for this key, to see if it
 	 * exists and if it's a range.
 	 */
 #ifndef MISALIGNED_OK
-	if (keys[k].bv_len & ALIGNER) {
+	if ((keys[k].bv_len & ALIGNER) && keys[k].bv_len < sizeof(kbuf)) {
 		key.mv_size = sizeof(kbuf);
 		key.mv_data = kbuf;
+		kbuf[0] = kbuf[1] = 0;
 		memcpy(key.mv_data, keys[k].bv_val, keys[k].bv_len);
 	} else
 #endif
@@ -611,6 +1712,21 @@ mdb_idl_delete_keys(
 				goto fail;
 			}
 		} else {
+			size_t count;
+			rc = mdb_cursor_count( cursor, &count );
+			if ( rc != 0 ) {
+				err = "c_count";
+				goto fail;
+			}
+			if ( count > MDB_IDL_RANGE_SIZE || i[2] == NOID ) {
+				/* It's a bitmap, clear the ID's bit */
+				rc = mdb_bmap_update( cursor, &key, id, 1 );
+				if ( rc != 0 ) {
+					err = "c_del bitmap";
+					goto fail;
+				}
+				continue;
+			}
 			/* It's a range, see if we need to rewrite
 			 * the boundaries
 			 */
@@ -680,10 +1796,14 @@ mdb_idl_intersection(
 	int swap = 0;
 
 	if ( MDB_IDL_IS_ZERO( a ) || MDB_IDL_IS_ZERO( b ) ) {
+		mdb_bmap_drop( a );
 		a[0] = 0;
 		return 0;
 	}
 
+	if ( MDB_IDL_IS_BMAP( a ) || MDB_IDL_IS_BMAP( b ) )
+		return mdb_idl_bmap_intersection( a, b );
+
 	idmin = IDL_MAX( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 	idmax = IDL_MIN( MDB_IDL_LAST(a), MDB_IDL_LAST(b) );
 	if ( idmin > idmax ) {
@@ -777,12 +1897,20 @@ mdb_idl_union(
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ) {
 over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		idb = IDL_MAX( MDB_IDL_LAST(a), MDB_IDL_LAST(b) );
+		mdb_bmap_drop( a );
 		a[0] = NOID;
 		a[1] = ida;
 		a[2] = idb;
 		return 0;
 	}
 
+	if ( MDB_IDL_IS_BMAP( a ) || MDB_IDL_IS_BMAP( b ) ) {
+		if ( MDB_IDL_LAST( a ) > MDB_BM_MAXID ||
+			MDB_IDL_LAST( b ) > MDB_BM_MAXID )
+			goto over;
+		return mdb_idl_bmap_union( a, b );
+	}
+
 	ida = mdb_idl_first( a, &cursora );
 	idb = mdb_idl_first( b, &cursorb );
 
@@ -792,7 +1920,11 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 	while( ida != NOID || idb != NOID ) {
 		if ( ida < idb ) {
 			if( ++cursorc > MDB_IDL_UM_MAX ) {
-				goto over;
+				/* Too big for a list, switch to a bitmap */
+				if ( MDB_IDL_LLAST( a ) > MDB_BM_MAXID ||
+					MDB_IDL_LLAST( b ) > MDB_BM_MAXID )
+					goto over;
+				return mdb_idl_bmap_union( a, b );
 			}
 			b[cursorc] = ida;
 			ida = mdb_idl_next( a, &cursora );
@@ -826,7 +1958,6 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 }
 
 
-#if 0
 /*
  * mdb_idl_notin - return a intersection ~b (or a minus b)
  */
@@ -852,6 +1983,29 @@ mdb_idl_notin(
 		return 0;
 	}
 
+	if( MDB_IDL_IS_BMAP( a ) ) {
+		MDB_bitmap *bm = mdb_bmap_dup( mdb_bmap_ptr( a ));
+		if( MDB_IDL_IS_BMAP( b ) ) {
+			mdb_bmap_and( bm, mdb_bmap_ptr( b ), 1 );
+		} else {
+			MDB_bitmap *bb = mdb_bmap_from_list( b );
+			mdb_bmap_and( bm, bb, 1 );
+			mdb_bmap_free( bb );
+		}
+		mdb_bmap_set( ids, bm );
+		return 0;
+	}
+
+	if( MDB_IDL_IS_BMAP( b ) ) {
+		MDB_bitmap *bm = mdb_bmap_ptr( b );
+		ids[0] = 0;
+		for( cursora = 1; cursora <= a[0]; cursora++ ) {
+			if( !mdb_bmap_test( bm, a[cursora] ))
+				ids[++ids[0]] = a[cursora];
+		}
+		return 0;
+	}
+
 	ida = mdb_idl_first( a, &cursora ),
 	idb = mdb_idl_first( b, &cursorb );
 
@@ -878,7 +2032,6 @@ mdb_idl_notin(
 
 	return 0;
 }
-#endif
 
 ID mdb_idl_first( ID *ids, ID *cursor )
 {
@@ -896,6 +2049,12 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 		return *cursor;
 	}
 
+	/* For bitmaps, the cursor is the last ID returned */
+	if ( MDB_IDL_IS_BMAP( ids ) ) {
+		*cursor = mdb_bmap_next( mdb_bmap_ptr( ids ), *cursor );
+		return *cursor;
+	}
+
 	if ( *cursor == 0 )
 		pos = 1;
 	else
@@ -918,6 +2077,12 @@ ID mdb_idl_next( ID *ids, ID *cursor )
 		return *cursor;
 	}
 
+	if ( MDB_IDL_IS_BMAP( ids ) ) {
+		if ( *cursor != NOID )
+			*cursor = mdb_bmap_next( mdb_bmap_ptr( ids ), *cursor + 1 );
+		return *cursor;
+	}
+
 	if ( ++(*cursor) <= ids[0] ) {
 		return ids[*cursor];
 	}
@@ -925,6 +2090,52 @@ ID mdb_idl_next( ID *ids, ID *cursor )
 	return NOID;
 }
 
+/* Return the first ID in ids that is greater than id, or NOID */
+ID mdb_idl_after( ID *ids, ID id )
+{
+	unsigned i;
+
+	if ( ids[0] == 0 || id == NOID )
+		return NOID;
+	id++;
+
+	if ( MDB_IDL_IS_RANGE( ids ) ) {
+		if ( id < ids[1] )
+			return ids[1];
+		return id <= ids[2] ? id : NOID;
+	}
+
+	if ( MDB_IDL_IS_BMAP( ids ) )
+		return mdb_bmap_next( mdb_bmap_ptr( ids ), id );
+
+	i = mdb_idl_search( ids, id );
+	return i <= ids[0] ? ids[i] : NOID;
+}
+
+/* Return the last ID in ids that is less than id, or NOID */
+ID mdb_idl_before( ID *ids, ID id )
+{
+	unsigned i;
+
+	if ( ids[0] == 0 || id == 0 )
+		return NOID;
+	id--;
+
+	if ( MDB_IDL_IS_RANGE( ids ) ) {
+		if ( id > ids[2] )
+			return ids[2];
+		return id >= ids[1] ? id : NOID;
+	}
+
+	if ( MDB_IDL_IS_BMAP( ids ) )
+		return mdb_bmap_prev( mdb_bmap_ptr( ids ), id );
+
+	i = mdb_idl_search( ids, id );
+	if ( i <= ids[0] && ids[i] == id )
+		return id;
+	return i > 1 ? ids[i-1] : NOID;
+}
+
 /* Add one ID to an unsorted list. We ensure that the first element is the
  * minimum and the last element is the maximum, for fast range compaction.
  *   this means IDLs up to length 3 are always sorted...
@@ -981,6 +2192,10 @@ int mdb_idl_append( ID *a, ID *b )
 		return 0;
 	}
 
+	if ( MDB_IDL_IS_BMAP( a ) || MDB_IDL_IS_BMAP( b ) ) {
+		return mdb_idl_union( a, b );
+	}
+
 	ida = MDB_IDL_LAST( a );
 	idb = MDB_IDL_LAST( b );
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ||
@@ -1031,7 +2246,7 @@ mdb_idl_sort( ID *ids, ID *tmp )
 	int i,j,k,l,ir,jstack;
 	ID a, itmp;
 
-	if ( MDB_IDL_IS_RANGE( ids ))
+	if ( MDB_IDL_IS_RANGE( ids ) || MDB_IDL_IS_BMAP( ids ))
 		return;
 
 	ir = ids[0];
@@ -33,7 +33,33 @@
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
 #define MDB_IDL_SIZEOF(ids)		((MDB_IDL_IS_RANGE(ids) \
-	? MDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
+	? MDB_IDL_RANGE_SIZE : MDB_IDL_IS_BMAP(ids) \
+	? MDB_IDL_BMAP_SIZE : ((ids)[0]+1)) * sizeof(ID))
+
+/* A bitmap IDL is used when a list outgrows MDB_IDL_DB_MAX. The IDL
+ * buffer only holds a header: the marker, the first and last IDs, the
+ * number of IDs, and a pointer to the words, which live in a per-thread
+ * pool (see idl.c). Membership stays exact at any cardinality.
+ */
+#define MDB_IDL_BMAP_MARK	(NOID-1)
+#define MDB_IDL_IS_BMAP(ids)	((ids)[0] == MDB_IDL_BMAP_MARK)
+#define MDB_IDL_BMAP_SIZE	(4 + (sizeof(void *)+sizeof(ID)-1)/sizeof(ID))
+#define MDB_IDL_BMAP_COUNT(ids)	((ids)[3])
+
+/* Each bitmap word carries its word number in the upper half of an ID
+ * and the member bits in the lower half, so words can be stored as
+ * ordinary sorted DUPFIXED IDs. Words with no bits set are omitted.
+ * On disk a bitmap key is stored as { 0, words..., NOID }; the trailing
+ * NOID tells it apart from a { 0, lo, hi } range.
+ */
+#define MDB_BM_BITS		(sizeof(ID)*4)
+#define MDB_BM_SHIFT	(sizeof(ID) == 8 ? 5 : 4)
+#define MDB_BM_MASK		((((ID)1) << MDB_BM_BITS) - 1)
+#define MDB_BM_WNUM(id)	((id) >> MDB_BM_SHIFT)
+#define MDB_BM_BIT(id)	(((ID)1) << ((id) & (MDB_BM_BITS-1)))
+#define MDB_BM_WORDNO(w)	((w) >> MDB_BM_BITS)
+#define MDB_BM_MKWORD(n,bits)	(((ID)(n) << MDB_BM_BITS) | (bits))
+#define MDB_BM_MAXID	((MDB_BM_MASK << MDB_BM_SHIFT) - 1)
 
 #define MDB_IDL_RANGE_FIRST(ids)	((ids)[1])
 #define MDB_IDL_RANGE_LAST(ids)		((ids)[2])
@@ -56,18 +82,19 @@
 #define MDB_IDL_IS_ALL( range, ids ) ( (ids)[0] == NOID \
 	&& (ids)[1] <= (range)[1] && (range)[2] <= (ids)[2] )
 
-#define MDB_IDL_CPY( dst, src ) (AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ) ))
+#define MDB_IDL_CPY( dst, src ) mdb_idl_cpy( dst, src )
 
 #define MDB_IDL_ID( mdb, ids, id ) MDB_IDL_RANGE( ids, id, NOID )
 #define MDB_IDL_ALL( ids ) MDB_IDL_RANGE( ids, 1, NOID )
 
 #define MDB_IDL_FIRST( ids )	( (ids)[1] )
 #define MDB_IDL_LLAST( ids )	( (ids)[(ids)[0]] )
-#define MDB_IDL_LAST( ids )		( MDB_IDL_IS_RANGE(ids) \
+#define MDB_IDL_LAST( ids )		( (ids)[0] >= MDB_IDL_BMAP_MARK \
 	? (ids)[2] : (ids)[(ids)[0]] )
 
 #define MDB_IDL_N( ids )		( MDB_IDL_IS_RANGE(ids) \
-	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
+	? ((ids)[2]-(ids)[1])+1 : MDB_IDL_IS_BMAP(ids) \
+	? MDB_IDL_BMAP_COUNT(ids) : (ids)[0] )
 
 	/** An ID2 is an ID/value pair.
 	 */
@@ -100,6 +100,10 @@ int mdb_index_param(
 		case LDAP_FILTER_SUBSTRINGS:
 			type = SLAP_INDEX_SUBSTR;
 			break;
+		case LDAP_FILTER_GE:
+		case LDAP_FILTER_LE:
+			type = SLAP_INDEX_ORDERED;
+			break;
 		default:
 			return LDAP_INAPPROPRIATE_MATCHING;
 		}
@@ -145,6 +149,14 @@ int mdb_index_param(
 		}
 		break;
 
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		type = SLAP_INDEX_ORDERED;
+		if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERED ) ) {
+			goto done;
+		}
+		break;
+
 	default:
 		return LDAP_OTHER;
 	}
@@ -161,6 +173,103 @@ done:
 	return LDAP_SUCCESS;
 }
 
+/* Ordered index keys share the attribute's database with its other
+ * keys. They are the ordered index prefix and a NUL, followed by a
+ * form of the value whose byte order matches the ordering rule, so
+ * that inequality filters can be answered by walking a key range.
+ * Matching rules that flag SLAP_MR_ORDERED_INDEX already produce such
+ * keys; for plain octet string ordering the normalized value itself
+ * is used, cut off at MDB_ORDERED_KEYLEN bytes. Truncation keeps the
+ * order, it only costs some false positives.
+ */
+int
+mdb_index_ordered_ok( AttributeType *at )
+{
+	MatchingRule *mr = at->sat_equality;
+
+	if ( mr && ( mr->smr_usage & SLAP_MR_ORDERED_INDEX ) &&
+		mr->smr_indexer && mr->smr_filter )
+		return 1;
+
+	mr = at->sat_ordering;
+	return mr && mr->smr_match == octetStringOrderingMatch;
+}
+
+/* Build the ordered key for a single value */
+static void
+ordered_key( struct berval *val, struct berval *key, void *ctx )
+{
+	ber_len_t len = val->bv_len;
+
+	if ( len > MDB_ORDERED_KEYLEN - MDB_ORDERED_PREFIXLEN )
+		len = MDB_ORDERED_KEYLEN - MDB_ORDERED_PREFIXLEN;
+	key->bv_len = len + MDB_ORDERED_PREFIXLEN;
+	key->bv_val = slap_sl_malloc( key->bv_len + 1, ctx );
+	key->bv_val[0] = SLAP_INDEX_ORDERED_PREFIX;
+	key->bv_val[1] = '\0';
+	AC_MEMCPY( key->bv_val + MDB_ORDERED_PREFIXLEN, val->bv_val, len );
+	key->bv_val[key->bv_len] = '\0';
+}
+
+/* Generate the ordered keys for vals, or for the single asserted
+ * value in vals[0] if filter is set.
+ */
+int
+mdb_index_ordered_keys(
+	AttributeDescription *ad,
+	struct berval *atname,
+	slap_mask_t mask,
+	BerVarray vals,
+	int filter,
+	BerVarray *keysp,
+	void *ctx )
+{
+	MatchingRule *mr = ad->ad_type->sat_equality;
+	BerVarray keys;
+	struct berval bv;
+	int i, n, rc;
+
+	*keysp = NULL;
+
+	if ( mr && ( mr->smr_usage & SLAP_MR_ORDERED_INDEX ) &&
+		mr->smr_indexer && mr->smr_filter ) {
+		if ( filter ) {
+			rc = mr->smr_filter( LDAP_FILTER_EQUALITY, mask,
+				ad->ad_type->sat_syntax, mr, atname, vals,
+				&keys, ctx );
+		} else {
+			rc = mr->smr_indexer( LDAP_FILTER_EQUALITY, mask,
+				ad->ad_type->sat_syntax, mr, atname, vals,
+				&keys, ctx );
+		}
+		if ( rc != LDAP_SUCCESS || keys == NULL )
+			return rc;
+		for ( i = 0; !BER_BVISNULL( &keys[i] ); i++ ) {
+			ordered_key( &keys[i], &bv, ctx );
+			slap_sl_free( keys[i].bv_val, ctx );
+			keys[i] = bv;
+		}
+
+	} else if ( mdb_index_ordered_ok( ad->ad_type )) {
+		if ( filter ) {
+			n = 1;
+		} else {
+			for ( n = 0; !BER_BVISNULL( &vals[n] ); n++ )
+				;
+		}
+		keys = slap_sl_malloc( ( n + 1 ) * sizeof( struct berval ), ctx );
+		for ( i = 0; i < n; i++ )
+			ordered_key( &vals[i], &keys[i], ctx );
+		BER_BVZERO( &keys[n] );
+
+	} else {
+		return LDAP_INAPPROPRIATE_MATCHING;
+	}
+
+	*keysp = keys;
+	return LDAP_SUCCESS;
+}
+
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -176,10 +285,27 @@ static int indexer(
 	struct berval *keys;
 	MDB_cursor *mc = ai->ai_cursor;
 	mdb_idl_keyfunc *keyfunc;
+	mdb_ixbatch *ib = NULL;
 	char *err;
 
 	assert( mask != 0 );
 
+	/* Without a txn the online indexer only wants the keys */
+	if ( !txn ) {
+		OpExtra *oex;
+		struct mdb_info *mdb = op->o_bd->be_private;
+		LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+			if ( oex->oe_key == &mdb->mi_ix )
+				break;
+		}
+		assert( oex != NULL );
+		ib = (mdb_ixbatch *)oex;
+		ib->ib_ai = ai;
+		keyfunc = mdb_ixbatch_keys;
+		mc = (MDB_cursor *)ib;
+		goto keys;
+	}
+
 	if ( !mc ) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
@@ -201,6 +327,7 @@ static int indexer(
 	} else
 		keyfunc = mdb_idl_delete_keys;
 
+keys:
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) ) {
 		rc = keyfunc( op->o_bd, mc, presence_key, id );
 		if( rc ) {
@@ -248,6 +375,22 @@ static int indexer(
 		rc = LDAP_SUCCESS;
 	}
 
+	if( IS_SLAP_INDEX( mask, SLAP_INDEX_ORDERED ) ) {
+		rc = mdb_index_ordered_keys( ad, atname, mask, vals, 0,
+			&keys, op->o_tmpmemctx );
+
+		if( rc == LDAP_SUCCESS && keys != NULL ) {
+			rc = keyfunc( op->o_bd, mc, keys, id );
+			ber_bvarray_free_x( keys, op->o_tmpmemctx );
+			if ( rc ) {
+				err = "ordered";
+				goto done;
+			}
+		}
+
+		rc = LDAP_SUCCESS;
+	}
+
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_SUBSTR ) ) {
 		rc = ad->ad_type->sat_substr->smr_indexer(
 			LDAP_FILTER_SUBSTRINGS,
@@ -269,7 +412,7 @@ static int indexer(
 	}
 
 done:
-	if ( !(slapMode & SLAP_TOOL_QUICK))
+	if ( !(slapMode & SLAP_TOOL_QUICK) && !ib )
 		mdb_cursor_close( mc );
 	switch( rc ) {
 	/* The callers all know how to deal with these results */
@@ -385,6 +528,10 @@ int mdb_index_values(
 	if ( id == 0 )
 		return 0;
 
+	/* Tell a running online index task this entry changed */
+	if ( opid != MDB_INDEX_UPDATE_OP )
+		mdb_online_index_touch( op->o_bd->be_private, id );
+
 	rc = index_at_values( op, txn, desc,
 		desc->ad_type, &desc->ad_tags,
 		vals, id, opid );
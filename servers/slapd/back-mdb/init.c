@@ -27,10 +27,12 @@
 #include <ldap_rq.h>
 #include "config.h"
 
-static const struct berval mdmi_databases[] = {
+const struct berval mdmi_databases[] = {
 	BER_BVC("ad2i"),
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
+	BER_BVC("id2a"),
+	BER_BVC("id2v"),
 	BER_BVNULL
 };
 
@@ -40,6 +42,17 @@ mdb_id_compare( const MDB_val *a, const MDB_val *b )
 	return *(ID *)a->mv_data < *(ID *)b->mv_data ? -1 : *(ID *)a->mv_data > *(ID *)b->mv_data;
 }
 
+/* id2a and id2v keys are an entry ID followed by an attribute index */
+static int
+mdb_id2a_compare( const MDB_val *a, const MDB_val *b )
+{
+	ID *ia = a->mv_data, *ib = b->mv_data;
+
+	if ( ia[0] != ib[0] )
+		return ia[0] < ib[0] ? -1 : 1;
+	return ia[1] < ib[1] ? -1 : ia[1] > ib[1];
+}
+
 static int
 mdb_db_init( BackendDB *be, ConfigReply *cr )
 {
@@ -63,6 +76,14 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 	mdb->mi_rtxn_size = DEFAULT_RTXN_SIZE;
+	mdb->mi_index_threads = DEFAULT_INDEX_THREADS;
+	mdb->mi_plan_cost = DEFAULT_PLAN_COST;
+	ldap_pvt_thread_mutex_init( &mdb->mi_rtxn_mutex );
+	ldap_pvt_thread_mutex_init( &mdb->mi_gc.gc_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_gc.gc_cond );
+	LDAP_LIST_INIT( &mdb->mi_rtxns );
+	ldap_pvt_thread_mutex_init( &mdb->mi_ix.ix_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_ix.ix_cond );
 
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
@@ -122,8 +143,11 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
-	if ( mdb->mi_readers ) {
-		rc = mdb_env_set_maxreaders( mdb->mi_dbenv, mdb->mi_readers );
+	/* Each slapd thread keeps a reader slot, leave room for tools */
+	if ( mdb->mi_readers || connection_pool_max + MDB_READERS_SLACK >
+		MDB_READERS_DEFAULT ) {
+		rc = mdb_env_set_maxreaders( mdb->mi_dbenv, mdb->mi_readers ?
+			mdb->mi_readers : connection_pool_max + MDB_READERS_SLACK );
 		if( rc != 0 ) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
@@ -133,6 +157,17 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
+	if ( mdb->mi_psize ) {
+		rc = mdb_env_set_pagesize( mdb->mi_dbenv, mdb->mi_psize );
+		if( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+				"mdb_env_set_pagesize failed: %s (%d).\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			goto fail;
+		}
+	}
+
 	rc = mdb_env_set_mapsize( mdb->mi_dbenv, mdb->mi_mapsize );
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -195,7 +230,13 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 	/* open (and create) main databases */
 	for( i = 0; mdmi_databases[i].bv_val; i++ ) {
 		flags = MDB_INTEGERKEY;
-		if( i == MDB_ID2ENTRY ) {
+		if( i == MDB_ID2ENTRY || i == MDB_ID2ATTR || i == MDB_ID2VAL ) {
+			if ( i == MDB_ID2ATTR )
+				flags = 0;
+			else if ( i == MDB_ID2VAL )
+				flags = MDB_DUPSORT;
+			if ( mdb->mi_compress && i != MDB_ID2VAL )
+				flags |= MDB_COMPRESS;
 			if ( !(slapMode & (SLAP_TOOL_READMAIN|SLAP_TOOL_READONLY) ))
 				flags |= MDB_CREATE;
 		} else {
@@ -210,6 +251,16 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* databases from before id2a and id2v existed have no
+		 * attributes stored apart, readers can do without them
+		 */
+		if ( rc == MDB_NOTFOUND && ( i == MDB_ID2ATTR || i == MDB_ID2VAL ) &&
+			!( flags & MDB_CREATE )) {
+			mdb->mi_dbis[i] = 0;
+			rc = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -222,9 +273,27 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			goto fail;
 		}
 
-		if ( i == MDB_ID2ENTRY )
+		if ( i == MDB_ID2ENTRY ) {
+			unsigned int dbflags;
 			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id_compare );
-		else if ( i == MDB_DN2ID ) {
+			/* compression is recorded in the database and cannot be
+			 * turned off again, go by what the database says
+			 */
+			mdb_dbi_flags( txn, mdb->mi_dbis[i], &dbflags );
+			if (( dbflags & MDB_COMPRESS ) && !mdb->mi_compress ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+					"compress is off but the database is compressed, "
+					"keeping it on.\n",
+					be->be_suffix[0].bv_val, 0, 0 );
+			}
+			mdb->mi_compress = ( dbflags & MDB_COMPRESS ) != 0;
+		} else if ( i == MDB_ID2ATTR )
+			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id2a_compare );
+		else if ( i == MDB_ID2VAL ) {
+			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id2a_compare );
+			mdb_set_dupsort( txn, mdb->mi_dbis[i], mdb_id2v_dupsort );
+		} else if ( i == MDB_DN2ID ) {
 			MDB_cursor *mc;
 			MDB_val key, data;
 			ID id;
@@ -361,12 +430,30 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 	}
 
+	/* stop and remove compact task */
+	if ( mdb->mi_compact_task ) {
+		struct re_s *re = mdb->mi_compact_task;
+		mdb->mi_compact_task = NULL;
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ) )
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+
 	/* monitor handling */
 	(void)mdb_monitor_db_destroy( be );
 
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
 
 	mdb_attr_index_destroy( mdb );
+	if ( mdb->mi_coldattrs ) ch_free( mdb->mi_coldattrs );
+	if ( mdb->mi_multivals ) ch_free( mdb->mi_multivals );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_ix.ix_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_ix.ix_mutex );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_rtxn_mutex );
+	ldap_pvt_thread_cond_destroy( &mdb->mi_gc.gc_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_gc.gc_mutex );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -46,7 +46,7 @@ mdb_key_read(
 	Debug( LDAP_DEBUG_TRACE, "=> key_read\n", 0, 0, 0 );
 
 #ifndef MISALIGNED_OK
-	if (k->bv_len & ALIGNER) {
+	if ((k->bv_len & ALIGNER) && k->bv_len < sizeof(kbuf)) {
 		key.mv_size = sizeof(kbuf);
 		key.mv_data = kbuf;
 		kbuf[1] = 0;
@@ -78,7 +78,7 @@ int mdb_modify_internal(
 	Modification	*mod;
 	Modifications	*ml;
 	Attribute	*save_attrs;
-	Attribute 	*ap;
+	Attribute 	*ap, *a;
 	int			glue_attr_delete = 0;
 	int			got_delete;
 
@@ -93,6 +93,10 @@ int mdb_modify_internal(
 	save_attrs = e->e_attrs;
 	e->e_attrs = attrs_dup( e->e_attrs );
 
+	/* attrs_dup() drops the id2v flag, carry it over to the copy */
+	for ( a = save_attrs, ap = e->e_attrs; a; a = a->a_next, ap = ap->a_next )
+		ap->a_flags |= a->a_flags & SLAP_ATTR_BIG_MULTI;
+
 	for ( ml = modlist; ml != NULL; ml = ml->sml_next ) {
 		int match;
 		mod = &ml->sml_mod;
@@ -282,6 +286,15 @@ int mdb_modify_internal(
 			return err; 
 		}
 
+		/* apply it directly to values kept in id2v, or have
+		 * them rewritten if that is not possible
+		 */
+		ap = attr_find( e->e_attrs, mod->sm_desc );
+		if ( ap && ( ap->a_flags & SLAP_ATTR_BIG_MULTI ) && !op->o_noop &&
+			mdb_id2v_modify( op, tid, e->e_id, ap, mod ) != LDAP_SUCCESS ) {
+			ap->a_flags &= ~SLAP_ATTR_BIG_MULTI;
+		}
+
 		/* If objectClass was modified, reset the flags */
 		if ( mod->sm_desc == slap_schema.si_ad_objectClass ) {
 			e->e_ocflags = 0;
@@ -470,6 +483,7 @@ mdb_modify( Operation *op, SlapReply *rs )
 	ctrls[num_ctrls] = NULL;
 
 	/* begin transaction */
+	opinfo.moi_flag = MOI_GROUP;
 	rs->sr_err = mdb_opinfo_get( op, mdb, 0, &moi );
 	rs->sr_text = NULL;
 	if( rs->sr_err != 0 ) {
@@ -635,12 +649,12 @@ mdb_modify( Operation *op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_opinfo_commit( mdb, moi );
 			txn = NULL;
 		}
 	}
@@ -656,6 +670,8 @@ mdb_modify( Operation *op, SlapReply *rs )
 		goto return_results;
 	}
 
+	mdb_reader_expire( mdb, 0 );
+
 	Debug( LDAP_DEBUG_TRACE,
 		LDAP_XSTRING(mdb_modify) ": updated%s id=%08lx dn=\"%s\"\n",
 		op->o_noop ? " (no-op)" : "",
@@ -683,7 +699,7 @@ done:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb_txn_abort( txn );
+			mdb_opinfo_abort( mdb, moi );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
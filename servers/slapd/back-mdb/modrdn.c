@@ -569,6 +569,8 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		goto return_results;
 	}
 
+	mdb_reader_expire( mdb, 0 );
+
 	Debug(LDAP_DEBUG_TRACE,
 		LDAP_XSTRING(mdb_modrdn)
 		": rdn modified%s id=%08lx dn=\"%s\"\n",
@@ -32,6 +32,8 @@
 static ObjectClass		*oc_olmMDBDatabase;
 
 static AttributeDescription *ad_olmDbDirectory;
+static AttributeDescription *ad_olmMDBIndexProgress, *ad_olmMDBIndexETA;
+static AttributeDescription *ad_olmMDBReaders, *ad_olmMDBPageStats;
 
 #ifdef MDB_MONITOR_IDX
 static int
@@ -59,7 +61,7 @@ static struct {
 	char			*name;
 	char			*oid;
 }		s_oid[] = {
-	{ "olmMDBAttributes",			"olmDatabaseAttributes:1" },
+	{ "olmMDBAttributes",			"olmDatabaseAttributes:3" },
 	{ "olmMDBObjectClasses",		"olmDatabaseObjectClasses:1" },
 
 	{ NULL }
@@ -88,6 +90,38 @@ static struct {
 		&ad_olmDbNotIndexed },
 #endif /* MDB_MONITOR_IDX */
 
+	{ "( olmMDBAttributes:1 "
+		"NAME ( 'olmMDBIndexProgress' ) "
+		"DESC 'Entries done and in total by the online index task' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexProgress },
+
+	{ "( olmMDBAttributes:2 "
+		"NAME ( 'olmMDBIndexETA' ) "
+		"DESC 'Estimated completion time of the online index task' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexETA },
+
+	{ "( olmMDBAttributes:3 "
+		"NAME ( 'olmMDBReaders' ) "
+		"DESC 'Snapshots held by the read txns of the threads' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBReaders },
+
+	{ "( olmMDBAttributes:4 "
+		"NAME ( 'olmMDBPageStats' ) "
+		"DESC 'Page access counters of each database' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBPageStats },
+
 	{ NULL }
 };
 
@@ -105,12 +139,159 @@ static struct {
 #ifdef MDB_MONITOR_IDX
 			"$ olmDbNotIndexed "
 #endif /* MDB_MONITOR_IDX */
+			"$ olmMDBIndexProgress "
+			"$ olmMDBIndexETA "
+			"$ olmMDBReaders "
+			"$ olmMDBPageStats "
 			") )",
 		&oc_olmMDBDatabase },
 
 	{ NULL }
 };
 
+/* Show how far a running online index task got, and when it
+ * should be done at its rate so far.
+ */
+static void
+mdb_monitor_ix_update(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	mdb_ixstate	*ix = &mdb->mi_ix;
+	ID		done = 0, total = 0;
+	time_t		start = 0, now, eta;
+	int		running;
+	char		buf[ 64 ];
+	struct berval	bv;
+
+	ldap_pvt_thread_mutex_lock( &ix->ix_mutex );
+	running = ix->ix_running;
+	if ( running ) {
+		done = ix->ix_done;
+		total = ix->ix_total;
+		start = ix->ix_start;
+	}
+	ldap_pvt_thread_mutex_unlock( &ix->ix_mutex );
+
+	attr_delete( &e->e_attrs, ad_olmMDBIndexProgress );
+	attr_delete( &e->e_attrs, ad_olmMDBIndexETA );
+	if ( !running )
+		return;
+
+	if ( done > total )
+		total = done;
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu/%lu",
+		(unsigned long)done, (unsigned long)total );
+	attr_merge_one( e, ad_olmMDBIndexProgress, &bv, NULL );
+
+	if ( done ) {
+		now = slap_get_time();
+		eta = now + (time_t)((double)( now - start ) * ( total - done ) / done );
+		bv.bv_len = sizeof( buf );
+		slap_timestamp( &eta, &bv );
+		attr_merge_one( e, ad_olmMDBIndexETA, &bv, NULL );
+	}
+}
+
+/* List the snapshots the threads' read txns hold, with how many
+ * commits they are behind and how long ago they were taken. Old
+ * ones keep the pages freed since from being reused.
+ */
+static void
+mdb_monitor_rtxn_update(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	mdb_rtxn	*rt;
+	MDB_envinfo	mei;
+	time_t		now;
+	size_t		txnid;
+	char		buf[ 128 ];
+	struct berval	bv;
+
+	attr_delete( &e->e_attrs, ad_olmMDBReaders );
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	now = slap_get_time();
+	bv.bv_val = buf;
+	ldap_pvt_thread_mutex_lock( &mdb->mi_rtxn_mutex );
+	LDAP_LIST_FOREACH( rt, &mdb->mi_rtxns, rt_next ) {
+		ldap_pvt_thread_mutex_lock( &rt->rt_mutex );
+		if ( rt->rt_state != MDB_RT_RESET ) {
+			txnid = mdb_txn_id( rt->rt_txn );
+			bv.bv_len = snprintf( buf, sizeof( buf ),
+				"txnid=%lu behind=%lu age=%ld state=%s",
+				(unsigned long)txnid,
+				(unsigned long)( mei.me_last_txnid - txnid ),
+				(long)( now - rt->rt_pinned ),
+				rt->rt_state == MDB_RT_ACTIVE ? "active" : "parked" );
+			attr_merge_one( e, ad_olmMDBReaders, &bv, NULL );
+		}
+		ldap_pvt_thread_mutex_unlock( &rt->rt_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_rtxn_mutex );
+}
+
+/* With envflags pagestats, show for each database the pages read
+ * at each level of its tree, the overflow pages read, how often
+ * cursors searched from the root or stepped to a neighbour page,
+ * and the pages written.
+ */
+static void
+mdb_monitor_pgstat_one(
+	struct mdb_info	*mdb,
+	Entry		*e,
+	MDB_dbi		dbi,
+	const struct berval	*name )
+{
+	MDB_pagestat	ps;
+	char		buf[ 512 ], *ptr, *end;
+	struct berval	bv;
+	int		i, n;
+
+	if ( !dbi || mdb_env_pagestat( mdb->mi_dbenv, dbi, &ps ))
+		return;
+
+	for ( n = MDB_PAGESTAT_LEVELS; n > 1 && !ps.ps_level[n-1]; n-- ) ;
+	ptr = buf;
+	end = buf + sizeof( buf );
+	ptr += snprintf( ptr, end - ptr, "db=%s levels=", name->bv_val );
+	for ( i = 0; i < n && ptr < end; i++ )
+		ptr += snprintf( ptr, end - ptr, "%s%lu", i ? "/" : "",
+			(unsigned long)ps.ps_level[i] );
+	if ( ptr < end )
+		ptr += snprintf( ptr, end - ptr,
+			" overflow=%lu seeks=%lu steps=%lu dirty=%lu spilled=%lu txns=%lu",
+			(unsigned long)ps.ps_overflow, (unsigned long)ps.ps_seek,
+			(unsigned long)ps.ps_step, (unsigned long)ps.ps_dirty,
+			(unsigned long)ps.ps_spill, (unsigned long)ps.ps_txns );
+	if ( ptr >= end )
+		ptr = end - 1;
+	bv.bv_val = buf;
+	bv.bv_len = ptr - buf;
+	attr_merge_one( e, ad_olmMDBPageStats, &bv, NULL );
+}
+
+static void
+mdb_monitor_pgstat_update(
+	struct mdb_info	*mdb,
+	Entry		*e )
+{
+	int		i;
+
+	attr_delete( &e->e_attrs, ad_olmMDBPageStats );
+	if ( !( mdb->mi_dbenv_flags & MDB_PAGESTATS ))
+		return;
+
+	for ( i = 0; i < MDB_NDB; i++ )
+		mdb_monitor_pgstat_one( mdb, e, mdb->mi_dbis[i],
+			&mdmi_databases[i] );
+	for ( i = 0; i < mdb->mi_nattrs; i++ )
+		mdb_monitor_pgstat_one( mdb, e, mdb->mi_attrs[i]->ai_dbi,
+			&mdb->mi_attrs[i]->ai_desc->ad_cname );
+}
+
 static int
 mdb_monitor_update(
 	Operation	*op,
@@ -124,6 +305,10 @@ mdb_monitor_update(
 	mdb_monitor_idx_entry_add( mdb, e );
 #endif /* MDB_MONITOR_IDX */
 
+	mdb_monitor_ix_update( mdb, e );
+	mdb_monitor_rtxn_update( mdb, e );
+	mdb_monitor_pgstat_update( mdb, e );
+
 	return SLAP_CB_CONTINUE;
 }
 
@@ -55,6 +55,8 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
 int mdb_back_init_cf( BackendInfo *bi );
 
+void mdb_online_index_touch( struct mdb_info *mdb, ID id );
+
 /*
  * dn2entry.c
  */
@@ -164,6 +166,21 @@ int mdb_filter_candidates(
 	ID *tmp,
 	ID *stack );
 
+typedef struct mdb_candcur mdb_candcur;
+
+int mdb_filter_cursor(
+	Operation *op,
+	MDB_txn *txn,
+	Filter	*f,
+	mdb_candcur **ccp,
+	ID *ids,
+	ID *tmp,
+	ID *stack );
+ID mdb_candcur_seek( mdb_candcur *cc, ID id );
+ID mdb_candcur_count( mdb_candcur *cc );
+void mdb_candcur_renew( MDB_txn *txn, mdb_candcur *cc );
+void mdb_candcur_free( mdb_candcur *cc );
+
 /*
  * id2entry.c
  */
@@ -202,10 +219,33 @@ BI_entry_release_rw mdb_entry_release;
 BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
-int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, Entry **e );
+int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data,
+	ID id, AttributeName *an, Entry **e );
+
+MDB_cmp_func mdb_id2v_dupsort;
+
+int mdb_id2v_modify(
+	Operation *op,
+	MDB_txn *tid,
+	ID id,
+	Attribute *a,
+	Modification *mod );
+
+int mdb_id2v_find(
+	Operation *op,
+	MDB_txn *tid,
+	ID id,
+	Attribute *a,
+	struct berval *nval );
 
 void mdb_reader_flush( MDB_env *env );
+int mdb_reader_current( struct mdb_info *mdb, MDB_txn *txn );
+int mdb_reader_renew( struct mdb_info *mdb, mdb_op_info *moi );
+void mdb_reader_release( struct mdb_info *mdb, mdb_op_info *moi, int park );
+void mdb_reader_expire( struct mdb_info *mdb, int all );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
+int mdb_opinfo_commit( struct mdb_info *mdb, mdb_op_info *moi );
+void mdb_opinfo_abort( struct mdb_info *mdb, mdb_op_info *moi );
 
 /*
  * idl.c
@@ -222,6 +262,21 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_fetch_current(
+	MDB_cursor	*cursor,
+	ID			*ids );
+
+int mdb_idl_fetch_range(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*lo,
+	MDB_val		*hi,
+	size_t		plen,
+	ID			*ids,
+	ID			*tmp,
+	ID			limit );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
@@ -232,6 +287,7 @@ typedef int (mdb_idl_keyfunc)(
 
 mdb_idl_keyfunc mdb_idl_insert_keys;
 mdb_idl_keyfunc mdb_idl_delete_keys;
+mdb_idl_keyfunc mdb_ixbatch_keys;	/* online indexer, in config.c */
 
 int
 mdb_idl_intersection(
@@ -243,8 +299,39 @@ mdb_idl_union(
 	ID *a,
 	ID *b );
 
+int
+mdb_idl_notin(
+	ID *a,
+	ID *b,
+	ID *ids );
+
+void mdb_idl_cpy( ID *dst, ID *src );
+int mdb_idl_bmap_test( ID *ids, ID id );
+unsigned long mdb_idl_bmap_mark( void );
+void mdb_idl_bmap_release( unsigned long mark );
+
 ID mdb_idl_first( ID *ids, ID *cursor );
 ID mdb_idl_next( ID *ids, ID *cursor );
+ID mdb_idl_after( ID *ids, ID id );
+ID mdb_idl_before( ID *ids, ID id );
+
+typedef struct mdb_keycur mdb_keycur;
+
+int mdb_idl_keycur_open(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	mdb_keycur	**kcp );
+ID mdb_idl_keycur_seek( mdb_keycur *kc, ID id );
+ID mdb_idl_keycur_count( mdb_keycur *kc );
+int mdb_idl_keycur_renew( MDB_txn *txn, mdb_keycur *kc );
+void mdb_idl_keycur_close( mdb_keycur *kc );
+
+int mdb_idl_fetch_count(
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count );
 
 void mdb_idl_sort( ID *ids, ID *tmp );
 int mdb_idl_append( ID *a, ID *b );
@@ -270,6 +357,20 @@ mdb_index_param LDAP_P((
 	slap_mask_t *mask,
 	struct berval *prefix ));
 
+extern int
+mdb_index_ordered_ok LDAP_P((
+	AttributeType *at ));
+
+extern int
+mdb_index_ordered_keys LDAP_P((
+	AttributeDescription *ad,
+	struct berval *atname,
+	slap_mask_t mask,
+	BerVarray vals,
+	int filter,
+	BerVarray *keys,
+	void *ctx ));
+
 extern int
 mdb_index_values LDAP_P((
 	Operation *op,
@@ -303,6 +404,12 @@ int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+/*
+ * init.c
+ */
+
+extern const struct berval mdmi_databases[];
+
 /*
  * key.c
  */
@@ -353,6 +460,27 @@ mdb_monitor_idx_add(
 	slap_mask_t		type );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * sort.c
+ */
+
+typedef struct mdb_sortcur mdb_sortcur;
+
+OpExtraSort *mdb_sort_request( Operation *op, MDB_txn *txn, ID ncand );
+
+int mdb_sortcur_open(
+	Operation *op,
+	MDB_txn *txn,
+	struct IdScopes *isc,
+	ID base,
+	ID *cands,
+	ID ncand,
+	mdb_sortcur **scp );
+
+ID mdb_sortcur_next( mdb_sortcur *sc );
+void mdb_sortcur_renew( MDB_txn *txn, mdb_sortcur *sc );
+void mdb_sortcur_close( mdb_sortcur *sc );
+
 /*
  * former external.h
  */
@@ -140,7 +140,7 @@ mdb_referrals( Operation *op, SlapReply *rs )
 
 done:
 	if ( moi == &opinfo ) {
-		mdb_txn_reset( moi->moi_txn );
+		mdb_reader_release( mdb, moi, 1 );
 		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
 	} else {
 		moi->moi_ref--;
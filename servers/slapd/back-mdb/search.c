@@ -34,7 +34,8 @@ static int search_candidates(
 	IdScopes *isc,
 	MDB_cursor *mci,
 	ID	*ids,
-	ID *stack );
+	ID *stack,
+	mdb_candcur **ccp );
 
 static int parse_paged_cookie( Operation *op, SlapReply *rs );
 
@@ -281,6 +282,63 @@ mdb_get_nextid(MDB_cursor *mci, ID *cursor)
 	return 0;
 }
 
+/* Searches with at least this many candidates read id2entry in
+ * order for long enough to be worth asking for its pages ahead.
+ */
+#define	MDB_RDAHEAD_MINCAND	256
+
+/* Entry data of the next candidates, read in one pass over id2entry
+ * instead of one lookup per candidate.
+ */
+#define	EB_SIZE	32
+
+typedef struct edata_batch {
+	int eb_n;
+	int eb_pos;
+	ID eb_ids[EB_SIZE];
+	MDB_val eb_data[EB_SIZE];
+} edata_batch;
+
+static int
+mdb_batch_edata(
+	MDB_cursor *mci,
+	ID *candidates,
+	ID cursor,
+	edata_batch *eb,
+	ID id,
+	MDB_val *data )
+{
+	MDB_val keys[EB_SIZE];
+	int i, rc;
+
+	while ( eb->eb_pos < eb->eb_n && eb->eb_ids[eb->eb_pos] < id )
+		eb->eb_pos++;
+	if ( eb->eb_pos == eb->eb_n || eb->eb_ids[eb->eb_pos] != id ) {
+		/* fetch this candidate and the ones after it */
+		eb->eb_ids[0] = id;
+		for ( i = 1; i < EB_SIZE; i++ ) {
+			eb->eb_ids[i] = mdb_idl_next( candidates, &cursor );
+			if ( eb->eb_ids[i] == NOID )
+				break;
+		}
+		for ( eb->eb_n = 0; eb->eb_n < i; eb->eb_n++ ) {
+			keys[eb->eb_n].mv_data = &eb->eb_ids[eb->eb_n];
+			keys[eb->eb_n].mv_size = sizeof(ID);
+		}
+		eb->eb_pos = 0;
+		rc = mdb_cursor_get_batch( mci, keys, eb->eb_data, eb->eb_n );
+		if ( rc ) {
+			eb->eb_n = 0;
+			return rc;
+		}
+	}
+	*data = eb->eb_data[eb->eb_pos];
+	/* missing, or stubs from missing parents */
+	if ( !data->mv_size )
+		return MDB_NOTFOUND;
+	return MDB_SUCCESS;
+}
+
 static void scope_chunk_free( void *key, void *data )
 {
 	ID2 *p1, *p2;
@@ -323,6 +381,7 @@ static void *search_stack( Operation *op );
 
 typedef struct ww_ctx {
 	MDB_txn *txn;
+	mdb_rtxn *rt;
 	MDB_cursor *mcd;	/* if set, save cursor context */
 	ID key;
 	MDB_val data;
@@ -352,7 +411,14 @@ mdb_rtxn_snap( Operation *op, ww_ctx *ww )
 		ww->data.mv_data = op->o_tmpalloc( data.mv_size, op->o_tmpmemctx );
 		memcpy(ww->data.mv_data, data.mv_data, data.mv_size);
 	}
-	mdb_txn_reset( ww->txn );
+	if ( ww->rt ) {
+		ldap_pvt_thread_mutex_lock( &ww->rt->rt_mutex );
+		mdb_txn_reset( ww->txn );
+		ww->rt->rt_state = MDB_RT_RESET;
+		ldap_pvt_thread_mutex_unlock( &ww->rt->rt_mutex );
+	} else {
+		mdb_txn_reset( ww->txn );
+	}
 	ww->flag = 1;
 }
 
@@ -371,7 +437,15 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	MDB_val key;
 	int rc = 0;
 	ww->flag = 0;
-	mdb_txn_renew( ww->txn );
+	if ( ww->rt ) {
+		ldap_pvt_thread_mutex_lock( &ww->rt->rt_mutex );
+		mdb_txn_renew( ww->txn );
+		ww->rt->rt_pinned = slap_get_time();
+		ww->rt->rt_state = MDB_RT_ACTIVE;
+		ldap_pvt_thread_mutex_unlock( &ww->rt->rt_mutex );
+	} else {
+		mdb_txn_renew( ww->txn );
+	}
 	mdb_cursor_renew( ww->txn, mci );
 	mdb_cursor_renew( ww->txn, mcd );
 
@@ -412,6 +486,162 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	return rc;
 }
 
+/* Entries in a search are decoded with only the attributes that the
+ * search can look at: the requested ones, those in the filter, and
+ * those the ACLs refer to. This is only done when nothing else gets to
+ * see the entries, i.e. there are no response callbacks from overlays
+ * or internal searches, and no ACLs that can evaluate arbitrary
+ * attributes of the target entry.
+ */
+typedef struct decode_attrs {
+	AttributeName *da_an;
+	int da_num;
+	int da_max;
+} decode_attrs;
+
+static void
+decode_add( Operation *op, decode_attrs *da, AttributeDescription *ad )
+{
+	if ( da->da_num == da->da_max ) {
+		da->da_max *= 2;
+		da->da_an = op->o_tmprealloc( da->da_an,
+			( da->da_max + 1 ) * sizeof( AttributeName ), op->o_tmpmemctx );
+	}
+	da->da_an[da->da_num].an_name = ad->ad_cname;
+	da->da_an[da->da_num].an_desc = ad;
+	da->da_an[da->da_num].an_oc = NULL;
+	da->da_an[da->da_num].an_flags = 0;
+	da->da_num++;
+}
+
+static int
+decode_filter( Operation *op, decode_attrs *da, Filter *f )
+{
+	AttributeDescription *ad;
+
+	switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+	case LDAP_FILTER_AND:
+	case LDAP_FILTER_OR:
+	case LDAP_FILTER_NOT:
+		for ( f = f->f_list; f; f = f->f_next ) {
+			if ( decode_filter( op, da, f ))
+				return -1;
+		}
+		return 0;
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+	case LDAP_FILTER_EXT:
+		/* without a type it can match any attribute */
+		ad = f->f_mr_desc;
+		break;
+	case SLAPD_FILTER_COMPUTED:
+		return 0;
+	default:
+		return -1;
+	}
+	if ( !ad )
+		return -1;
+#ifdef LDAP_COMP_MATCH
+	if ( is_aliased_attribute && is_aliased_attribute( ad ))
+		return -1;
+#endif
+	decode_add( op, da, ad );
+	return 0;
+}
+
+static int
+decode_acls( Operation *op, decode_attrs *da, AccessControl *a )
+{
+	Access *b;
+
+	for ( ; a; a = a->acl_next ) {
+		if ( a->acl_filter && decode_filter( op, da, a->acl_filter ))
+			return -1;
+		for ( b = a->acl_access; b; b = b->a_next ) {
+			if ( !BER_BVISNULL( &b->a_set_pat ))
+				return -1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return -1;
+#endif
+			if ( b->a_dn_at )
+				decode_add( op, da, b->a_dn_at );
+			if ( b->a_realdn_at )
+				decode_add( op, da, b->a_realdn_at );
+			/* the group may be the target entry itself */
+			if ( b->a_group_at )
+				decode_add( op, da, b->a_group_at );
+		}
+	}
+	return 0;
+}
+
+/* Returns NULL if entries must be decoded in full */
+static AttributeName *
+search_decode_attrs( Operation *op )
+{
+	decode_attrs da;
+	slap_callback *sc;
+	int i;
+
+	if ( !op->ors_attrs ||
+		( an_find( op->ors_attrs, slap_bv_all_user_attrs ) &&
+		an_find( op->ors_attrs, slap_bv_all_operational_attrs )))
+		return NULL;
+
+	for ( sc = op->o_callback; sc; sc = sc->sc_next ) {
+		if ( sc->sc_response )
+			return NULL;
+	}
+
+	for ( i = 0; !BER_BVISNULL( &op->ors_attrs[i].an_name ); i++ )
+		;
+	da.da_num = i;
+	da.da_max = i + 8;
+	da.da_an = op->o_tmpalloc( ( da.da_max + 1 ) * sizeof( AttributeName ),
+		op->o_tmpmemctx );
+	AC_MEMCPY( da.da_an, op->ors_attrs, i * sizeof( AttributeName ));
+
+	/* used by the search loop itself */
+	decode_add( op, &da, slap_schema.si_ad_objectClass );
+	decode_add( op, &da, slap_schema.si_ad_structuralObjectClass );
+	decode_add( op, &da, slap_schema.si_ad_ref );
+	decode_add( op, &da, slap_schema.si_ad_aliasedObjectName );
+
+	if ( decode_filter( op, &da, op->ors_filter ) ||
+		( !be_isroot( op ) && (
+		decode_acls( op, &da, op->o_bd->be_acl ) ||
+		decode_acls( op, &da, frontendDB->be_acl ))))
+	{
+		op->o_tmpfree( da.da_an, op->o_tmpmemctx );
+		return NULL;
+	}
+	BER_BVZERO( &da.da_an[da.da_num].an_name );
+	return da.da_an;
+}
+
+/* Paged results always iterate the candidates, and a size limit
+ * below the scope size usually ends the search before the candidates
+ * run out, so neither needs the full candidate list up front.
+ */
+static int
+search_stops_early( Operation *op, ID nsubs )
+{
+	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED )
+		return 1;
+	return op->ors_slimit > 0 && (ID) op->ors_slimit < nsubs;
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
@@ -422,6 +652,7 @@ mdb_search( Operation *op, SlapReply *rs )
 	ID		iscopes[MDB_IDL_DB_SIZE];
 	ID2		*scopes;
 	void	*stack;
+	unsigned long	bmark;
 	Entry		*e = NULL, *base = NULL;
 	Entry		*matched = NULL;
 	AttributeName	*attrs;
@@ -431,7 +662,11 @@ mdb_search( Operation *op, SlapReply *rs )
 	int		tentries = 0;
 	IdScopes	isc;
 	MDB_cursor	*mci, *mcd;
+	mdb_candcur	*cc = NULL;
+	mdb_sortcur	*sc = NULL;
+	AttributeName	*decode_an = NULL;
 	ww_ctx wwctx;
+	edata_batch eb;
 	slap_callback cb = { 0 };
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
@@ -468,6 +703,7 @@ mdb_search( Operation *op, SlapReply *rs )
 
 	scopes = scope_chunk_get( op );
 	stack = search_stack( op );
+	bmark = mdb_idl_bmap_mark();
 	isc.mt = ltid;
 	isc.mc = mcd;
 	isc.scopes = scopes;
@@ -666,25 +902,60 @@ dn2entry_retry:
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
 		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
-		ncand = MDB_IDL_N( candidates );
+			&isc, mci, candidates, stack, &cc );
+		if ( cc ) {
+			/* The cursor only knows an upper bound. If that is
+			 * enough to pick candidate-based iteration, and to
+			 * stay within the unchecked limit, stream the
+			 * candidates. A paged or size limited search that
+			 * stops before it could walk the whole scope streams
+			 * them too. Otherwise, or when the results are to
+			 * be sorted, compute the real list.
+			 */
+			ncand = mdb_candcur_count( cc );
+			if ( ncand != 0 && (( nsubs < ncand &&
+				!search_stops_early( op, nsubs )) || ( op->ors_limit &&
+				op->ors_limit->lms_s_unchecked != -1 &&
+				ncand > (unsigned) op->ors_limit->lms_s_unchecked ) ||
+				mdb_sort_request( op, ltid, ncand )))
+			{
+				mdb_candcur_free( cc );
+				cc = NULL;
+				MDB_IDL_ZERO( candidates );
+				rs->sr_err = search_candidates( op, rs, base,
+					&isc, mci, candidates, stack, NULL );
+			} else if ( nsubs < ncand ) {
+				nsubs = ncand;	/* skip the scope walk */
+			}
+		}
+		if ( !cc )
+			ncand = MDB_IDL_N( candidates );
 		if ( !base->e_id || ncand == NOID ) {
 			/* grab entry count from id2entry stat
 			 */
 			MDB_stat ms;
 			mdb_stat( ltid, mdb->mi_id2entry, &ms );
-			if ( !base->e_id )
+			if ( !base->e_id && !cc )
 				nsubs = ms.ms_entries;
 			if ( ncand == NOID )
 				ncand = ms.ms_entries;
 		}
+		/* Let an ordered index put the entries in the order
+		 * the sssvlv overlay asked for.
+		 */
+		if ( !cc && ncand && mdb_sortcur_open( op, ltid, &isc,
+			base->e_id, candidates, nsubs < ncand ? nsubs : ncand,
+			&sc ) == 0 )
+		{
+			nsubs = ncand;	/* the sort cursor decides the order */
+		}
 	}
 
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
 
-	if ( candidates[0] == 0 ) {
+	if ( cc ? ncand == 0 : candidates[0] == 0 ) {
 		Debug( LDAP_DEBUG_TRACE,
 			LDAP_XSTRING(mdb_search) ": no candidates\n",
 			0, 0, 0 );
@@ -709,12 +980,24 @@ dn2entry_retry:
 		tentries = ncand;
 	}
 
+	/* With readahead off, have LMDB ask for the entries of a big
+	 * search ahead of time, as long as they are read in ID order.
+	 */
+	if ( !sc && ( mdb->mi_dbenv_flags & MDB_NORDAHEAD ) &&
+		( cc || MDB_IDL_IS_RANGE( candidates ) ||
+		ncand >= MDB_RDAHEAD_MINCAND ))
+		mdb_cursor_set_readahead( mci, MDB_RDAHEAD_SEQUENTIAL );
+
+	decode_an = search_decode_attrs( op );
+
 	wwctx.flag = 0;
+	eb.eb_n = eb.eb_pos = 0;
 	/* If we're running in our own read txn */
 	if (  moi == &opinfo ) {
 		cb.sc_writewait = mdb_writewait;
 		cb.sc_private = &wwctx;
 		wwctx.txn = ltid;
+		wwctx.rt = moi->moi_rtxn;
 		wwctx.mcd = NULL;
 		cb.sc_next = op->o_callback;
 		op->o_callback = &cb;
@@ -736,7 +1019,12 @@ dn2entry_retry:
 			send_ldap_result( op, rs );
 			goto done;
 		}
-		id = mdb_idl_first( candidates, &cursor );
+		if ( cc ) {
+			id = mdb_candcur_seek( cc, cursor + 1 );
+			cursor = id;
+		} else {
+			id = mdb_idl_first( candidates, &cursor );
+		}
 		if ( id == NOID ) {
 			Debug( LDAP_DEBUG_TRACE, 
 				LDAP_XSTRING(mdb_search)
@@ -747,12 +1035,14 @@ dn2entry_retry:
 			rs->sr_err = LDAP_OTHER;
 			goto done;
 		}
-		if ( id == (ID)ps->ps_cookie )
+		if ( !cc && id == (ID)ps->ps_cookie )
 			id = mdb_idl_next( candidates, &cursor );
 		nsubs = ncand;	/* always bypass scope'd search */
 		goto loop_begin;
 	}
-	if ( nsubs < ncand ) {
+	if ( sc ) {
+		id = mdb_sortcur_next( sc );
+	} else if ( nsubs < ncand ) {
 		int rc;
 		/* Do scope-based search */
 
@@ -779,6 +1069,9 @@ dn2entry_retry:
 		else
 			id = isc.id;
 		cscope = 0;
+	} else if ( cc ) {
+		id = mdb_candcur_seek( cc, 1 );
+		cursor = id;
 	} else {
 		id = mdb_idl_first( candidates, &cursor );
 	}
@@ -826,6 +1119,8 @@ loop_begin:
 				if ( id >= MDB_IDL_RANGE_FIRST( candidates ) &&
 					id <= MDB_IDL_RANGE_LAST( candidates ))
 					scopeok = 1;
+			} else if (MDB_IDL_IS_BMAP( candidates )) {
+				scopeok = mdb_idl_bmap_test( candidates, id );
 			} else {
 				i = mdb_idl_search( candidates, id );
 				if (i <= candidates[0] && candidates[i] == id )
@@ -888,13 +1183,17 @@ scopeok:
 		} else {
 
 			/* get the entry */
-			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
+			if ( !sc && !cc && nsubs >= ncand )
+				rs->sr_err = mdb_batch_edata( mci, candidates, cursor,
+					&eb, id, &edata );
+			else
+				rs->sr_err = mdb_id2edata( op, mci, id, &edata );
 			if ( rs->sr_err == MDB_NOTFOUND ) {
 notfound:
-				if( nsubs < ncand )
+				if( nsubs < ncand || sc )
 					goto loop_continue;
 
-				if( !MDB_IDL_IS_RANGE(candidates) ) {
+				if( !cc && !MDB_IDL_IS_RANGE(candidates) ) {
 					/* only complain for non-range IDLs */
 					Debug( LDAP_DEBUG_TRACE,
 						LDAP_XSTRING(mdb_search)
@@ -923,7 +1222,7 @@ notfound:
 				goto done;
 			}
 
-			rs->sr_err = mdb_entry_decode( op, ltid, &edata, &e );
+			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, decode_an, &e );
 			if ( rs->sr_err ) {
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
@@ -1124,7 +1423,12 @@ loop_continue:
 			wwctx.nentries++;
 			if ( wwctx.nentries >= mdb->mi_rtxn_size ) {
 				wwctx.nentries = 0;
-				mdb_rtxn_snap( op, &wwctx );
+				/* move up to the latest snapshot, if there's a newer one.
+				 * Always let go when compressing, the entries decompressed
+				 * so far are only freed when the txn is reset.
+				 */
+				if ( mdb->mi_compress || !mdb_reader_current( mdb, ltid ))
+					mdb_rtxn_snap( op, &wwctx );
 			}
 		}
 		if ( wwctx.flag ) {
@@ -1133,6 +1437,11 @@ loop_continue:
 				send_ldap_result( op, rs );
 				goto done;
 			}
+			eb.eb_n = 0;
+			if ( cc )
+				mdb_candcur_renew( ltid, cc );
+			if ( sc )
+				mdb_sortcur_renew( ltid, sc );
 		}
 
 		if( e != NULL ) {
@@ -1143,7 +1452,9 @@ loop_continue:
 			rs->sr_entry = NULL;
 		}
 
-		if ( nsubs < ncand ) {
+		if ( sc ) {
+			id = mdb_sortcur_next( sc );
+		} else if ( nsubs < ncand ) {
 			int rc = mdb_dn2id_walk( op, &isc );
 			if (rc) {
 				id = NOID;
@@ -1170,6 +1481,9 @@ loop_continue:
 				}
 			} else
 				id = isc.id;
+		} else if ( cc ) {
+			id = mdb_candcur_seek( cc, cursor + 1 );
+			cursor = id;
 		} else {
 			id = mdb_idl_next( candidates, &cursor );
 		}
@@ -1203,7 +1517,7 @@ done:
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
 	if ( moi == &opinfo ) {
-		mdb_txn_reset( moi->moi_txn );
+		mdb_reader_release( mdb, moi, 1 );
 		LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
 	} else {
 		moi->moi_ref--;
@@ -1215,6 +1529,13 @@ done:
 	if (base)
 		mdb_entry_return( op, base );
 	scope_chunk_ret( op, scopes );
+	if ( cc )
+		mdb_candcur_free( cc );
+	if ( sc )
+		mdb_sortcur_close( sc );
+	if ( decode_an )
+		op->o_tmpfree( decode_an, op->o_tmpmemctx );
+	mdb_idl_bmap_release( bmark );
 
 	return rs->sr_err;
 }
@@ -1305,7 +1626,8 @@ static int search_candidates(
 	IdScopes *isc,
 	MDB_cursor *mci,
 	ID	*ids,
-	ID *stack )
+	ID *stack,
+	mdb_candcur **ccp )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int rc, depth = 1;
@@ -1372,6 +1694,20 @@ static int search_candidates(
 		rc = LDAP_SUCCESS;
 	}
 
+	/* Stream the candidates if we can. Dereferenced aliases add
+	 * scopes to the list, so they always need the full IDL.
+	 */
+	if ( rc == LDAP_SUCCESS && ccp && !( op->ors_deref & LDAP_DEREF_SEARCHING )) {
+		rc = mdb_filter_cursor( op, isc->mt, f, ccp, ids,
+			stack, stack+MDB_IDL_UM_SIZE );
+		if ( rc == LDAP_SUCCESS && *ccp ) {
+			if ( depth+1 > mdb->mi_search_stack_depth )
+				ch_free( stack );
+			return rc;
+		}
+		MDB_IDL_ZERO( ids );
+	}
+
 	if ( rc == LDAP_SUCCESS ) {
 		rc = mdb_filter_candidates( op, isc->mt, f, ids,
 			stack, stack+MDB_IDL_UM_SIZE );
@@ -0,0 +1,983 @@
+/* sort.c - server side sorting from ordered indices */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* Sort cursors
+ *
+ * When the sssvlv overlay asks for a single key sort and the key has
+ * an ordered index, the search candidates are returned in the order
+ * of that index instead of in ID order, so the overlay does not need
+ * to collect and sort the whole result.
+ *
+ * The overlay compares the least value of each entry, so an entry is
+ * only returned under the index key of its least value. Ordered keys
+ * can be shared by different values, when values are longer than the
+ * key or the rule's keys are lossy; the IDs of such a key are sorted
+ * by their values before they are returned. Entries that don't have
+ * the attribute come after all the others, or first for a reverse
+ * sort, unless the filter only matches entries that have it.
+ *
+ * For a virtual list view only the requested window is returned.
+ * Lookups by offset skip over the index keys by their candidate
+ * counts without reading the entries, so the target position is an
+ * estimate, as the VLV spec allows. Lookups by value seek the index
+ * to the value and read backwards for the entries before it.
+ */
+
+/* Walking the whole index is only worth it when a fair share of the
+ * database is a candidate. Below that, sorting in the overlay reads
+ * fewer entries.
+ */
+#define MDB_SORT_SCAN_RATIO	16
+
+#define SS_INDEX	0
+#define SS_MISSING	1
+#define SS_DONE		2
+
+/* Cursor states in SS_INDEX */
+#define SS_UNSET	0	/* start at the first key in ss_dir */
+#define SS_SEEK		1	/* start at ss_key */
+#define SS_AT		2	/* on a key that wasn't read yet */
+#define SS_LOADED	3	/* returning the IDs of ss_key */
+
+typedef struct sort_val {
+	ID sv_id;
+	struct berval sv_val;
+} sort_val;
+
+typedef struct sort_stream {
+	MDB_cursor *ss_mc;
+	int ss_dir;			/* 1 ascending, -1 descending keys */
+	int ss_back;		/* walking against the sort order */
+	int ss_phase;
+	int ss_state;
+	int ss_strict;		/* SS_SEEK: skip ss_key itself */
+	int ss_stale;		/* the txn was renewed */
+	int ss_lossy;		/* the current key may hold several values */
+	unsigned long ss_mark;
+	ID ss_idcur;
+	sort_val *ss_buf;	/* the current key's IDs, in order */
+	int ss_nbuf, ss_pos, ss_maxbuf;
+	int ss_buffered;
+	int ss_bufmatch;	/* the buffer only holds matching entries */
+	int ss_match;		/* only return entries that match the search */
+	ID ss_mid;			/* last ID looked at in SS_MISSING */
+	MDB_val ss_key;
+	ID ss_keybuf[MDB_ORDERED_KEYLEN / sizeof(ID) + 1];
+} sort_stream;
+
+struct mdb_sortcur {
+	Operation *sc_op;
+	OpExtraSort *sc_oes;
+	MDB_txn *sc_txn;
+	MDB_dbi sc_dbi;
+	slap_mask_t sc_mask;
+	struct berval sc_prefix;
+	MDB_cursor *sc_mci;
+	MDB_cursor *sc_mcd;
+	IdScopes *sc_isc;
+	ID sc_base;
+	ID *sc_cands;
+	ID *sc_ids;			/* IDs of the key being read */
+	AttributeName sc_an[2];
+	int sc_eqkeys;		/* keys come from the equality rule */
+	int sc_missing;		/* entries without the attribute may match */
+	sort_stream sc_ss;
+	ID *sc_win;			/* window entries found before the target */
+	int sc_nwin, sc_winpos;
+	int sc_left;		/* window entries left, or -1 */
+	int sc_pos;			/* list position of the next entry */
+};
+
+static int
+sc_cand( ID *ids, ID id )
+{
+	unsigned i;
+
+	if ( MDB_IDL_IS_RANGE( ids ))
+		return id >= MDB_IDL_RANGE_FIRST( ids ) &&
+			id <= MDB_IDL_RANGE_LAST( ids );
+	if ( MDB_IDL_IS_BMAP( ids ))
+		return mdb_idl_bmap_test( ids, id );
+	i = mdb_idl_search( ids, id );
+	return i <= ids[0] && ids[i] == id;
+}
+
+/* Set up a key the way mdb_idl_insert_keys() stores it */
+static void
+sc_setkey( MDB_val *key, struct berval *bv, ID *buf )
+{
+#ifndef MISALIGNED_OK
+	if (( bv->bv_len & ALIGNER ) && bv->bv_len < 2 * sizeof(int) ) {
+		memset( buf, 0, 2 * sizeof(int) );
+		memcpy( buf, bv->bv_val, bv->bv_len );
+		key->mv_data = buf;
+		key->mv_size = 2 * sizeof(int);
+		return;
+	}
+#endif
+	if ( bv->bv_len > MDB_ORDERED_KEYLEN )
+		bv->bv_len = MDB_ORDERED_KEYLEN;
+	memcpy( buf, bv->bv_val, bv->bv_len );
+	key->mv_data = buf;
+	key->mv_size = bv->bv_len;
+}
+
+static int
+sc_isordered( MDB_val *key )
+{
+	char *ptr = key->mv_data;
+
+	return key->mv_size >= MDB_ORDERED_PREFIXLEN &&
+		ptr[0] == SLAP_INDEX_ORDERED_PREFIX && ptr[1] == '\0';
+}
+
+/* The least value, as the sssvlv overlay picks it */
+static struct berval *
+sc_least( mdb_sortcur *sc, Attribute *a )
+{
+	MatchingRule *mr = sc->sc_oes->oe_mr;
+	struct berval *bv = a->a_nvals;
+	unsigned i;
+	int cmp;
+
+	for ( i = 1; i < a->a_numvals; i++ ) {
+		mr->smr_match( &cmp, 0, mr->smr_syntax, mr, bv, &a->a_nvals[i] );
+		if ( cmp > 0 )
+			bv = &a->a_nvals[i];
+	}
+	return bv;
+}
+
+/* Does bv belong under the current key? */
+static int
+sc_keyis( mdb_sortcur *sc, sort_stream *ss, struct berval *bv )
+{
+	Operation *op = sc->sc_op;
+	struct berval vals[2], *keys;
+	MDB_val key;
+	ID buf[MDB_ORDERED_KEYLEN / sizeof(ID) + 1];
+	int rc;
+
+	vals[0] = *bv;
+	BER_BVZERO( &vals[1] );
+	if ( mdb_index_ordered_keys( sc->sc_oes->oe_ad, &sc->sc_prefix,
+		sc->sc_mask, vals, 0, &keys, op->o_tmpmemctx ) || !keys )
+		return 0;
+	sc_setkey( &key, &keys[0], buf );
+	rc = key.mv_size == ss->ss_key.mv_size &&
+		!memcmp( key.mv_data, ss->ss_key.mv_data, key.mv_size );
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return rc;
+}
+
+/* Is the entry in the search scope? */
+static int
+sc_inscope( mdb_sortcur *sc, ID id )
+{
+	IdScopes *isc = sc->sc_isc;
+
+	if ( id == sc->sc_base )
+		return sc->sc_op->ors_scope == LDAP_SCOPE_SUBTREE;
+	isc->id = id;
+	isc->nscope = 0;
+	isc->numrdns = 0;
+	return !mdb_idscopes( sc->sc_op, isc ) && isc->nscope;
+}
+
+/* Is the entry part of the search result? This repeats the tests of
+ * mdb_search(), to find the entries of a VLV window.
+ */
+static int
+sc_match( mdb_sortcur *sc, Entry *e )
+{
+	Operation *op = sc->sc_op;
+
+	if ( mdb_id2name( op, sc->sc_txn, &sc->sc_mcd, e->e_id,
+			&e->e_name, &e->e_nname ))
+		return 0;
+	if ( is_entry_subentry( e ) ? !get_subentries_visibility( op ) :
+			get_subentries_visibility( op ))
+		return 0;
+	if ( !get_manageDSAit( op ) &&
+			( is_entry_glue( e ) || is_entry_referral( e )))
+		return 0;
+	return test_filter( op, e, op->ors_filter ) == LDAP_COMPARE_TRUE;
+}
+
+/* Read the sort attribute of an entry. Returns -1 if the entry is
+ * gone, or if the stream only returns matching entries and it does
+ * not match; 0 if it has no values, and 1 otherwise. With a val, the
+ * least value is copied there. The entry is only decoded once, in
+ * full if it has to be matched.
+ */
+static int
+sc_value( mdb_sortcur *sc, sort_stream *ss, ID id, struct berval *val )
+{
+	Operation *op = sc->sc_op;
+	MDB_val data;
+	Entry *e;
+	Attribute *a;
+	struct berval *bv = NULL;
+	int rc = 0;
+
+	if ( ss->ss_match && !sc_inscope( sc, id ))
+		return -1;
+	if ( mdb_id2edata( op, sc->sc_mci, id, &data ) ||
+		mdb_entry_decode( op, sc->sc_txn, &data, id,
+			ss->ss_match ? NULL : sc->sc_an, &e ))
+		return -1;
+	e->e_id = id;
+	BER_BVZERO( &e->e_name );
+	BER_BVZERO( &e->e_nname );
+
+	a = attr_find( e->e_attrs, sc->sc_oes->oe_ad );
+	if ( a && a->a_numvals ) {
+		rc = 1;
+		if ( ss->ss_phase == SS_INDEX ) {
+			bv = sc_least( sc, a );
+			if ( a->a_numvals > 1 && !sc_keyis( sc, ss, bv ))
+				rc = 0;
+		}
+	}
+	/* only the entries this phase returns need the search tests */
+	if ( ss->ss_match && rc == ( ss->ss_phase == SS_INDEX ) &&
+		!sc_match( sc, e ))
+		rc = -1;
+	if ( rc > 0 && val && bv )
+		ber_dupbv_x( val, bv, op->o_tmpmemctx );
+	mdb_entry_return( op, e );
+	return rc;
+}
+
+/* Should the entry be returned under the current key? */
+static int
+sc_keep( mdb_sortcur *sc, sort_stream *ss, ID id, struct berval *val )
+{
+	if ( !sc_cand( sc->sc_cands, id ))
+		return 0;
+	return sc_value( sc, ss, id, val ) > 0;
+}
+
+static int
+sc_valcmp( mdb_sortcur *sc, sort_stream *ss, sort_val *a, sort_val *b )
+{
+	MatchingRule *mr = sc->sc_oes->oe_mr;
+	int cmp;
+
+	mr->smr_match( &cmp, 0, mr->smr_syntax, mr, &a->sv_val, &b->sv_val );
+	if ( cmp )
+		return cmp * ss->ss_dir;
+	/* equal values keep the order they were found in */
+	cmp = a->sv_id < b->sv_id ? -1 : a->sv_id > b->sv_id;
+	return ss->ss_back ? -cmp : cmp;
+}
+
+/* Shell sort; the buffer rarely holds more than a few IDs */
+static void
+sc_sortbuf( mdb_sortcur *sc, sort_stream *ss )
+{
+	static const int gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+	sort_val *buf = ss->ss_buf, tmp;
+	int g, i, j, gap;
+
+	for ( g = 0; g < sizeof(gaps)/sizeof(gaps[0]); g++ ) {
+		gap = gaps[g];
+		for ( i = gap; i < ss->ss_nbuf; i++ ) {
+			tmp = buf[i];
+			for ( j = i; j >= gap &&
+				sc_valcmp( sc, ss, &buf[j-gap], &tmp ) > 0; j -= gap )
+				buf[j] = buf[j-gap];
+			buf[j] = tmp;
+		}
+	}
+}
+
+static void
+sc_unload( mdb_sortcur *sc, sort_stream *ss )
+{
+	Operation *op = sc->sc_op;
+
+	for ( ; ss->ss_pos < ss->ss_nbuf; ss->ss_pos++ ) {
+		if ( !BER_BVISNULL( &ss->ss_buf[ss->ss_pos].sv_val ))
+			op->o_tmpfree( ss->ss_buf[ss->ss_pos].sv_val.bv_val,
+				op->o_tmpmemctx );
+	}
+	ss->ss_nbuf = ss->ss_pos = 0;
+	ss->ss_buffered = 0;
+	mdb_idl_bmap_release( ss->ss_mark );
+}
+
+/* Read the key under the cursor. Keys that are read against the sort
+ * order, and keys that may hold several values, are filtered into a
+ * buffer first so they can be put in order.
+ */
+static int
+sc_load( mdb_sortcur *sc, sort_stream *ss, int buffer )
+{
+	ID *ids = sc->sc_ids, id;
+	sort_val *sv;
+	int rc;
+
+	ss->ss_mark = mdb_idl_bmap_mark();
+	rc = mdb_idl_fetch_current( ss->ss_mc, ids );
+	if ( rc ) {
+		mdb_idl_bmap_release( ss->ss_mark );
+		return rc;
+	}
+	ss->ss_state = SS_LOADED;
+	ss->ss_idcur = 0;
+	ss->ss_lossy = sc->sc_eqkeys ||
+		ss->ss_key.mv_size == MDB_ORDERED_KEYLEN;
+	if ( !buffer && !ss->ss_back && ( !ss->ss_lossy || MDB_IDL_N( ids ) < 2 ))
+		return 0;
+
+	ss->ss_buffered = 1;
+	ss->ss_bufmatch = ss->ss_match;
+	for ( id = mdb_idl_first( ids, &ss->ss_idcur ); id != NOID;
+		id = mdb_idl_next( ids, &ss->ss_idcur ))
+	{
+		if ( ss->ss_nbuf == ss->ss_maxbuf ) {
+			ss->ss_maxbuf = ss->ss_maxbuf ? ss->ss_maxbuf * 2 : 64;
+			ss->ss_buf = ch_realloc( ss->ss_buf,
+				ss->ss_maxbuf * sizeof(sort_val) );
+		}
+		sv = &ss->ss_buf[ss->ss_nbuf];
+		sv->sv_id = id;
+		BER_BVZERO( &sv->sv_val );
+		if ( sc_keep( sc, ss, id, ss->ss_lossy ? &sv->sv_val : NULL ))
+			ss->ss_nbuf++;
+	}
+	if ( ss->ss_lossy ) {
+		sc_sortbuf( sc, ss );
+	} else {
+		/* IDs come in ascending order, turn them around */
+		int i, j;
+		sort_val tmp;
+		for ( i = 0, j = ss->ss_nbuf - 1; i < j; i++, j-- ) {
+			tmp = ss->ss_buf[i];
+			ss->ss_buf[i] = ss->ss_buf[j];
+			ss->ss_buf[j] = tmp;
+		}
+	}
+	return 0;
+}
+
+/* Position a cursor on the first key at or after key in the
+ * direction of the stream, or strictly after it.
+ */
+static int
+sc_seek( sort_stream *ss, MDB_val *key, int strict )
+{
+	MDB_val k = *key, data;
+	int rc;
+
+	rc = mdb_cursor_get( ss->ss_mc, &k, &data, MDB_SET_RANGE );
+	if ( ss->ss_dir > 0 ) {
+		if ( rc == 0 && strict && k.mv_size == key->mv_size &&
+			!memcmp( k.mv_data, key->mv_data, k.mv_size ))
+			rc = mdb_cursor_get( ss->ss_mc, &k, &data, MDB_NEXT_NODUP );
+	} else {
+		if ( rc == MDB_NOTFOUND )
+			rc = mdb_cursor_get( ss->ss_mc, &k, &data, MDB_LAST );
+		else if ( rc == 0 && ( strict || k.mv_size != key->mv_size ||
+			memcmp( k.mv_data, key->mv_data, k.mv_size )))
+			rc = mdb_cursor_get( ss->ss_mc, &k, &data, MDB_PREV_NODUP );
+	}
+	return rc;
+}
+
+/* Move to the next key of the stream */
+static int
+sc_step( mdb_sortcur *sc, sort_stream *ss )
+{
+	MDB_val key, data;
+	struct berval bv;
+	char pbuf[MDB_ORDERED_PREFIXLEN];
+	int rc;
+
+	switch ( ss->ss_state ) {
+	case SS_UNSET:
+		/* the ordered keys end where the next prefix starts */
+		pbuf[0] = SLAP_INDEX_ORDERED_PREFIX;
+		pbuf[1] = ss->ss_dir > 0 ? '\0' : '\1';
+		bv.bv_val = pbuf;
+		bv.bv_len = sizeof(pbuf);
+		sc_setkey( &key, &bv, ss->ss_keybuf );
+		rc = sc_seek( ss, &key, ss->ss_dir < 0 );
+		break;
+	case SS_SEEK:
+		rc = sc_seek( ss, &ss->ss_key, ss->ss_strict );
+		break;
+	case SS_AT:
+		if ( !ss->ss_stale )
+			return 0;
+		rc = sc_seek( ss, &ss->ss_key, 0 );
+		break;
+	default:
+		if ( ss->ss_stale ) {
+			rc = sc_seek( ss, &ss->ss_key, 1 );
+		} else {
+			rc = mdb_cursor_get( ss->ss_mc, &key, &data,
+				ss->ss_dir > 0 ? MDB_NEXT_NODUP : MDB_PREV_NODUP );
+		}
+		break;
+	}
+	ss->ss_stale = 0;
+	if ( rc == 0 )
+		rc = mdb_cursor_get( ss->ss_mc, &key, &data, MDB_GET_CURRENT );
+	if ( rc == 0 && !sc_isordered( &key ))
+		rc = MDB_NOTFOUND;
+	if ( rc == 0 ) {
+		if ( key.mv_size > sizeof(ss->ss_keybuf) )
+			key.mv_size = sizeof(ss->ss_keybuf);
+		memcpy( ss->ss_keybuf, key.mv_data, key.mv_size );
+		ss->ss_key.mv_data = ss->ss_keybuf;
+		ss->ss_key.mv_size = key.mv_size;
+		ss->ss_state = SS_AT;
+	}
+	return rc;
+}
+
+/* Next candidate without a value, walking the candidate list */
+static ID
+sc_nextmissing( mdb_sortcur *sc, sort_stream *ss )
+{
+	ID id;
+
+	for (;;) {
+		if ( ss->ss_back )
+			id = mdb_idl_before( sc->sc_cands, ss->ss_mid );
+		else
+			id = mdb_idl_after( sc->sc_cands, ss->ss_mid );
+		if ( id == NOID )
+			return NOID;
+		ss->ss_mid = id;
+		if ( sc_value( sc, ss, id, NULL ) == 0 )
+			return id;
+	}
+}
+
+/* Return the next candidate in the order of the stream */
+static ID
+sc_next( mdb_sortcur *sc, sort_stream *ss )
+{
+	ID id;
+	int rc;
+
+	for (;;) {
+		switch ( ss->ss_phase ) {
+		case SS_INDEX:
+			if ( ss->ss_state == SS_LOADED ) {
+				if ( ss->ss_buffered ) {
+					if ( ss->ss_pos < ss->ss_nbuf ) {
+						sort_val *sv = &ss->ss_buf[ss->ss_pos++];
+						if ( !BER_BVISNULL( &sv->sv_val ))
+							sc->sc_op->o_tmpfree( sv->sv_val.bv_val,
+								sc->sc_op->o_tmpmemctx );
+						/* a key buffered by sc_skip() is not matched yet */
+						if ( ss->ss_match && !ss->ss_bufmatch &&
+							sc_value( sc, ss, sv->sv_id, NULL ) <= 0 )
+							continue;
+						return sv->sv_id;
+					}
+				} else {
+					id = ss->ss_idcur ?
+						mdb_idl_next( sc->sc_ids, &ss->ss_idcur ) :
+						mdb_idl_first( sc->sc_ids, &ss->ss_idcur );
+					for ( ; id != NOID;
+						id = mdb_idl_next( sc->sc_ids, &ss->ss_idcur )) {
+						if ( sc_keep( sc, ss, id, NULL ))
+							return id;
+					}
+				}
+				sc_unload( sc, ss );
+			}
+			rc = sc_step( sc, ss );
+			if ( rc == 0 )
+				rc = sc_load( sc, ss, 0 );
+			if ( rc == 0 )
+				continue;
+			if ( rc != MDB_NOTFOUND ) {
+				Debug( LDAP_DEBUG_ANY, "=> mdb_sortcur_next: "
+					"index read failed: %s (%d)\n",
+					mdb_strerror(rc), rc, 0 );
+			}
+			ss->ss_phase = ( ss->ss_dir > 0 && sc->sc_missing ) ?
+				SS_MISSING : SS_DONE;
+			break;
+
+		case SS_MISSING:
+			id = sc_nextmissing( sc, ss );
+			if ( id != NOID )
+				return id;
+			ss->ss_phase = ss->ss_dir < 0 ? SS_INDEX : SS_DONE;
+			break;
+
+		default:
+			return NOID;
+		}
+	}
+}
+
+/* Pass over n candidates, counting whole keys where possible. Returns
+ * how many are left when the stream ends first.
+ */
+static ID
+sc_skip( mdb_sortcur *sc, sort_stream *ss, ID n )
+{
+	ID *ids = sc->sc_ids, *cands = sc->sc_cands, id, cur, count;
+	unsigned long mark;
+	int rc, skipped = 0;
+
+	while ( n ) {
+		if ( ss->ss_phase == SS_INDEX &&
+			( skipped || ss->ss_state != SS_LOADED )) {
+			skipped = 0;
+			rc = sc_step( sc, ss );
+			if ( rc == 0 ) {
+				mark = mdb_idl_bmap_mark();
+				rc = mdb_idl_fetch_current( ss->ss_mc, ids );
+				if ( rc == 0 ) {
+					if ( MDB_IDL_IS_RANGE( cands ) &&
+						MDB_IDL_FIRST( ids ) >= MDB_IDL_RANGE_FIRST( cands ) &&
+						MDB_IDL_LAST( ids ) <= MDB_IDL_RANGE_LAST( cands )) {
+						count = MDB_IDL_N( ids );
+					} else {
+						count = 0;
+						cur = 0;
+						for ( id = mdb_idl_first( ids, &cur ); id != NOID;
+							id = mdb_idl_next( ids, &cur ))
+							count += sc_cand( cands, id );
+					}
+				}
+				mdb_idl_bmap_release( mark );
+				if ( rc == 0 && count <= n ) {
+					/* pass over the whole key */
+					n -= count;
+					ss->ss_state = SS_LOADED;
+					skipped = 1;
+					continue;
+				}
+			}
+			if ( rc == 0 ) {
+				/* The rest is inside this key. Pass over the same
+				 * share of the entries that are kept under it, so
+				 * that positions keep growing with n.
+				 */
+				rc = sc_load( sc, ss, 1 );
+				if ( rc == 0 ) {
+					n = n * ss->ss_nbuf / count;
+					for ( ; n; n-- ) {
+						sort_val *sv = &ss->ss_buf[ss->ss_pos++];
+						if ( !BER_BVISNULL( &sv->sv_val ))
+							sc->sc_op->o_tmpfree( sv->sv_val.bv_val,
+								sc->sc_op->o_tmpmemctx );
+					}
+					break;
+				}
+			}
+			ss->ss_phase = ( ss->ss_dir > 0 && sc->sc_missing ) ?
+				SS_MISSING : SS_DONE;
+			continue;
+		}
+		if ( sc_next( sc, ss ) == NOID )
+			break;
+		n--;
+	}
+	if ( skipped ) {
+		/* leave an empty key for sc_next() to step over */
+		ss->ss_mark = mdb_idl_bmap_mark();
+		ss->ss_buffered = 0;
+		ss->ss_idcur = 0;
+		MDB_IDL_ZERO( ids );
+	}
+	return n;
+}
+
+static void
+sc_stream_init( mdb_sortcur *sc, sort_stream *ss, int dir, int back )
+{
+	memset( ss, 0, sizeof( *ss ));
+	ss->ss_dir = dir;
+	ss->ss_back = back;
+	ss->ss_mid = back ? NOID : 0;
+	ss->ss_phase = ( dir < 0 && sc->sc_missing ) ? SS_MISSING : SS_INDEX;
+	ss->ss_state = SS_UNSET;
+}
+
+/* Start a stream at key instead of at the beginning */
+static void
+sc_stream_seek( sort_stream *ss, MDB_val *key, int strict )
+{
+	ss->ss_phase = SS_INDEX;
+	ss->ss_state = SS_SEEK;
+	ss->ss_strict = strict;
+	memcpy( ss->ss_keybuf, key->mv_data, key->mv_size );
+	ss->ss_key.mv_data = ss->ss_keybuf;
+	ss->ss_key.mv_size = key->mv_size;
+}
+
+static void
+sc_stream_close( mdb_sortcur *sc, sort_stream *ss )
+{
+	if ( ss->ss_phase == SS_INDEX && ss->ss_state == SS_LOADED )
+		sc_unload( sc, ss );
+	if ( ss->ss_mc )
+		mdb_cursor_close( ss->ss_mc );
+	ch_free( ss->ss_buf );
+}
+
+/* Read up to n matching entries against the sort order, from key or
+ * from the end of the list. They are stored in sc_win in sort order.
+ * Returns nonzero if the list has no more entries.
+ */
+static int
+sc_readback( mdb_sortcur *sc, MDB_val *key, int n )
+{
+	sort_stream back;
+	ID id;
+	int i, rc;
+
+	sc_stream_init( sc, &back, -sc->sc_ss.ss_dir, 1 );
+	back.ss_match = 1;
+	if ( key )
+		sc_stream_seek( &back, key, 1 );
+	rc = mdb_cursor_open( sc->sc_txn, sc->sc_dbi, &back.ss_mc );
+	if ( rc )
+		return 1;
+
+	sc->sc_win = ch_malloc(( n + 1 ) * sizeof(ID) );
+	sc->sc_nwin = 0;
+	while ( sc->sc_nwin < n ) {
+		id = sc_next( sc, &back );
+		if ( id == NOID )
+			break;
+		sc->sc_win[n - ++sc->sc_nwin] = id;
+	}
+	sc_stream_close( sc, &back );
+
+	/* move them to the front */
+	for ( i = 0; i < sc->sc_nwin; i++ )
+		sc->sc_win[i] = sc->sc_win[n - sc->sc_nwin + i];
+	return sc->sc_nwin < n;
+}
+
+/* Count the candidates in the keys before key, or in all keys if
+ * key is NULL. Only index keys are read, entries without the attribute
+ * are not counted.
+ */
+static ID
+sc_countbefore( mdb_sortcur *sc, MDB_val *key )
+{
+	sort_stream ss;
+	ID *ids = sc->sc_ids, *cands = sc->sc_cands, id, cur, count = 0;
+	unsigned long mark;
+	int rc;
+
+	sc_stream_init( sc, &ss, sc->sc_ss.ss_dir, 0 );
+	if ( mdb_cursor_open( sc->sc_txn, sc->sc_dbi, &ss.ss_mc ))
+		return 0;
+	while (( rc = sc_step( sc, &ss )) == 0 ) {
+		if ( key && mdb_cmp( sc->sc_txn, sc->sc_dbi, &ss.ss_key, key ) *
+			ss.ss_dir >= 0 )
+			break;
+		mark = mdb_idl_bmap_mark();
+		if ( mdb_idl_fetch_current( ss.ss_mc, ids ) == 0 ) {
+			if ( MDB_IDL_IS_RANGE( cands ) &&
+				MDB_IDL_FIRST( ids ) >= MDB_IDL_RANGE_FIRST( cands ) &&
+				MDB_IDL_LAST( ids ) <= MDB_IDL_RANGE_LAST( cands )) {
+				count += MDB_IDL_N( ids );
+			} else {
+				cur = 0;
+				for ( id = mdb_idl_first( ids, &cur ); id != NOID;
+					id = mdb_idl_next( ids, &cur ))
+					count += sc_cand( cands, id );
+			}
+		}
+		mdb_idl_bmap_release( mark );
+		ss.ss_state = SS_LOADED;
+	}
+	mdb_cursor_close( ss.ss_mc );
+	return count;
+}
+
+/* Does the filter only match entries that have a value of ad? */
+static int
+sc_needs_value( Filter *f, AttributeDescription *ad )
+{
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_PRESENT:
+		return f->f_desc == ad;
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+	case LDAP_FILTER_APPROX:
+		return f->f_av_desc == ad;
+	case LDAP_FILTER_SUBSTRINGS:
+		return f->f_sub_desc == ad;
+	case LDAP_FILTER_AND:
+		for ( f = f->f_and; f; f = f->f_next )
+			if ( sc_needs_value( f, ad ))
+				return 1;
+		return 0;
+	case LDAP_FILTER_OR:
+		for ( f = f->f_or; f; f = f->f_next )
+			if ( !sc_needs_value( f, ad ))
+				return 0;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Return the sort request of the op if this search can answer it
+ * from an ordered index.
+ */
+OpExtraSort *
+mdb_sort_request( Operation *op, MDB_txn *txn, ID ncand )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	OpExtra *oex;
+	OpExtraSort *oes = NULL;
+	MDB_dbi dbi;
+	slap_mask_t mask;
+	struct berval prefix;
+	MDB_stat ms;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == (void *)slap_sort_oe_key ) {
+			oes = (OpExtraSort *)oex;
+			break;
+		}
+	}
+	if ( !oes || !ncand )
+		return NULL;
+
+	/* Paged searches keep their own position, and aliases pull in
+	 * other subtrees; leave those to the overlay.
+	 */
+	if ( op->ors_scope == LDAP_SCOPE_BASE ||
+		( op->ors_deref & LDAP_DEREF_SEARCHING ) ||
+		get_pagedresults( op ) > SLAP_CONTROL_IGNORED )
+		return NULL;
+
+	if ( oes->oe_mr != oes->oe_ad->ad_type->sat_ordering ||
+		mdb_index_param( op->o_bd, oes->oe_ad, LDAP_FILTER_GE,
+			&dbi, &mask, &prefix ) != LDAP_SUCCESS )
+		return NULL;
+
+	if ( mdb_stat( txn, mdb->mi_id2entry, &ms ) ||
+		ncand < ms.ms_entries / MDB_SORT_SCAN_RATIO )
+		return NULL;
+
+	return oes;
+}
+
+int
+mdb_sortcur_open(
+	Operation	*op,
+	MDB_txn		*txn,
+	IdScopes	*isc,
+	ID			base,
+	ID			*cands,
+	ID			ncand,
+	mdb_sortcur	**scp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	OpExtraSort *oes;
+	mdb_sortcur *sc;
+	MatchingRule *mr;
+	struct berval *keys = NULL, vals[2];
+	MDB_val key;
+	ID kbuf[MDB_ORDERED_KEYLEN / sizeof(ID) + 1];
+	ID target, skip, nb;
+	int rc;
+
+	*scp = NULL;
+	oes = mdb_sort_request( op, txn, ncand );
+	if ( !oes )
+		return LDAP_UNWILLING_TO_PERFORM;
+
+	sc = ch_calloc( 1, sizeof( mdb_sortcur ));
+	sc->sc_op = op;
+	sc->sc_oes = oes;
+	sc->sc_txn = txn;
+	sc->sc_isc = isc;
+	sc->sc_base = base;
+	sc->sc_cands = cands;
+	sc->sc_left = -1;
+	sc->sc_an[0].an_desc = oes->oe_ad;
+	sc->sc_an[0].an_name = oes->oe_ad->ad_cname;
+	mdb_index_param( op->o_bd, oes->oe_ad, LDAP_FILTER_GE,
+		&sc->sc_dbi, &sc->sc_mask, &sc->sc_prefix );
+	mr = oes->oe_ad->ad_type->sat_equality;
+	sc->sc_eqkeys = mr && ( mr->smr_usage & SLAP_MR_ORDERED_INDEX );
+	sc->sc_missing = !sc_needs_value( op->ors_filter, oes->oe_ad );
+	sc_stream_init( sc, &sc->sc_ss, oes->oe_reverse ? -1 : 1, 0 );
+
+	if ( oes->oe_vlv && !BER_BVISNULL( &oes->oe_value )) {
+		vals[0] = oes->oe_value;
+		BER_BVZERO( &vals[1] );
+		rc = mdb_index_ordered_keys( oes->oe_ad, &sc->sc_prefix,
+			sc->sc_mask, vals, 1, &keys, op->o_tmpmemctx );
+		if ( rc || !keys ) {
+			ch_free( sc );
+			return rc ? rc : LDAP_INAPPROPRIATE_MATCHING;
+		}
+		sc_setkey( &key, &keys[0], kbuf );
+		ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	}
+
+	rc = mdb_cursor_open( txn, sc->sc_dbi, &sc->sc_ss.ss_mc );
+	if ( rc == 0 )
+		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &sc->sc_mci );
+	if ( rc ) {
+		mdb_sortcur_close( sc );
+		return rc;
+	}
+	sc->sc_ids = ch_malloc( MDB_IDL_UM_SIZEOF );
+
+	Debug( LDAP_DEBUG_TRACE, "mdb_sortcur_open: sorting by %s%s\n",
+		oes->oe_reverse ? "-" : "", oes->oe_ad->ad_cname.bv_val, 0 );
+
+	oes->oe_sorted = 1;
+	if ( !oes->oe_vlv ) {
+		*scp = sc;
+		return 0;
+	}
+
+	oes->oe_content = ncand;
+	if ( !BER_BVISNULL( &oes->oe_value )) {
+		/* by value: the target is the first entry at or after it */
+		sc_stream_seek( &sc->sc_ss, &key, 0 );
+		if ( sc_readback( sc, &key, oes->oe_before )) {
+			target = sc->sc_nwin + 1;
+		} else {
+			target = sc_countbefore( sc, &key ) + 1;
+			if ( sc->sc_ss.ss_dir < 0 && sc->sc_missing ) {
+				/* the entries without a value come first */
+				ID nkeys = sc_countbefore( sc, NULL );
+				if ( nkeys < ncand )
+					target += ncand - nkeys;
+			}
+		}
+		if ( target > ncand + 1 )
+			target = ncand + 1;
+		nb = sc->sc_nwin;
+		sc->sc_left = oes->oe_after + 1;
+
+	} else {
+		/* by offset, estimated like the overlay does */
+		target = oes->oe_offset;
+		if ( oes->oe_count && oes->oe_count != ncand )
+			target = (ID)((double)ncand * oes->oe_offset / oes->oe_count );
+		if ( target < 1 )
+			target = 1;
+		nb = oes->oe_before;
+		if ( nb > target - 1 )
+			nb = target - 1;
+
+		skip = 0;
+		if ( target < ncand )
+			skip = sc_skip( sc, &sc->sc_ss, target - nb - 1 );
+		if ( target >= ncand || skip ) {
+			/* wants the end of the list */
+			if ( sc_readback( sc, NULL, oes->oe_before + 1 ))
+				oes->oe_content = sc->sc_nwin;
+			target = oes->oe_content;
+			nb = sc->sc_nwin;
+			sc->sc_left = 0;
+		} else {
+			sc->sc_left = nb + oes->oe_after + 1;
+		}
+	}
+	oes->oe_target = target;
+	sc->sc_pos = target - nb;
+	sc->sc_ss.ss_match = 1;
+
+	Debug( LDAP_DEBUG_TRACE, "mdb_sortcur_open: vlv target %d of %d\n",
+		oes->oe_target, oes->oe_content, 0 );
+
+	*scp = sc;
+	return 0;
+}
+
+/* Return the next ID in sort order. Within a VLV window, only IDs
+ * of entries that match the search are returned.
+ */
+ID
+mdb_sortcur_next( mdb_sortcur *sc )
+{
+	OpExtraSort *oes = sc->sc_oes;
+	ID id;
+
+	if ( sc->sc_winpos < sc->sc_nwin ) {
+		sc->sc_pos++;
+		return sc->sc_win[sc->sc_winpos++];
+	}
+	if ( !sc->sc_left )
+		return NOID;
+
+	id = sc_next( sc, &sc->sc_ss );
+	if ( id != NOID ) {
+		if ( sc->sc_left > 0 ) {
+			sc->sc_left--;
+			sc->sc_pos++;
+		}
+		return id;
+	}
+	if ( sc->sc_left > 0 ) {
+		/* we reached the end, so we know how long the list is */
+		oes->oe_content = sc->sc_pos - 1;
+		if ( oes->oe_target > oes->oe_content + 1 )
+			oes->oe_target = oes->oe_content + 1;
+	}
+	sc->sc_left = 0;
+	return NOID;
+}
+
+/* The read txn was renewed */
+void
+mdb_sortcur_renew( MDB_txn *txn, mdb_sortcur *sc )
+{
+	sc->sc_txn = txn;
+	mdb_cursor_renew( txn, sc->sc_mci );
+	if ( sc->sc_mcd )
+		mdb_cursor_renew( txn, sc->sc_mcd );
+	mdb_cursor_renew( txn, sc->sc_ss.ss_mc );
+	sc->sc_ss.ss_stale = 1;
+}
+
+void
+mdb_sortcur_close( mdb_sortcur *sc )
+{
+	sc_stream_close( sc, &sc->sc_ss );
+	if ( sc->sc_mci )
+		mdb_cursor_close( sc->sc_mci );
+	if ( sc->sc_mcd )
+		mdb_cursor_close( sc->sc_mcd );
+	ch_free( sc->sc_win );
+	ch_free( sc->sc_ids );
+	ch_free( sc );
+}
@@ -394,7 +394,7 @@ mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep )
 			}
 		}
 	}
-	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, &e );
+	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, id, NULL, &e );
 	e->e_id = id;
 	if ( !BER_BVISNULL( &dn )) {
 		e->e_name = dn;
@@ -962,6 +962,7 @@ ID mdb_tool_entry_modify(
 	struct mdb_info *mdb;
 	Operation op = {0};
 	Opheader ohdr = {0};
+	Attribute *a;
 
 	assert( be != NULL );
 	assert( slapMode & SLAP_TOOL_MODE );
@@ -1000,6 +1001,12 @@ ID mdb_tool_entry_modify(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
+	/* the caller changed the values itself, so anything
+	 * kept in id2v must be rewritten
+	 */
+	for ( a = e->e_attrs; a; a = a->a_next )
+		a->a_flags &= ~SLAP_ATTR_BIG_MULTI;
+
 	/* id2entry index */
 	rc = mdb_id2entry_update( &op, mdb_tool_txn, NULL, e );
 	if( rc != 0 ) {
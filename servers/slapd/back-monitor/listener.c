@@ -27,6 +27,12 @@
 #include "slap.h"
 #include "back-monitor.h"
 
+static int
+monitor_subsys_listener_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e );
+
 int
 monitor_subsys_listener_init(
 	BackendDB		*be,
@@ -54,6 +60,8 @@ monitor_subsys_listener_init(
 
 	mi = ( monitor_info_t * )be->be_private;
 
+	ms->mss_update = monitor_subsys_listener_update;
+
 	if ( monitor_cache_get( mi, &ms->mss_ndn, &e_listener ) ) {
 		Debug( LDAP_DEBUG_ANY,
 			"monitor_subsys_listener_init: "
@@ -110,6 +118,16 @@ monitor_subsys_listener_init(
 		}
 #endif /* HAVE_TLS */
 
+		/* the daemon thread that accepts on this socket */
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+				"thread %d", l[ i ]->sl_tid );
+		bv.bv_val = buf;
+		attr_merge_normalize_one( e, mi->mi_ad_monitoredInfo,
+				&bv, NULL );
+
+		BER_BVSTR( &bv, "0" );
+		attr_merge_one( e, mi->mi_ad_monitorCounter, &bv, NULL );
+
 		mp = monitor_entrypriv_create();
 		if ( mp == NULL ) {
 			return -1;
@@ -136,3 +154,47 @@ monitor_subsys_listener_init(
 	return( 0 );
 }
 
+static int
+monitor_subsys_listener_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry                   *e )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )op->o_bd->be_private;
+
+	struct berval		nrdn;
+	ldap_pvt_mp_t		n;
+	Attribute		*a;
+	Listener		**l;
+	char			*p;
+	int			i;
+
+	assert( mi != NULL );
+	assert( e != NULL );
+
+	/* "cn=Listener <n>" */
+	dnRdn( &e->e_nname, &nrdn );
+	p = strchr( nrdn.bv_val, ' ' );
+	if ( p == NULL || p - nrdn.bv_val >= nrdn.bv_len ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	l = slapd_get_listeners();
+	i = atoi( p + 1 );
+	for ( ; l && *l && i > 0; l++, i-- )
+		/* count */ ;
+	if ( l == NULL || *l == NULL ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	a = attr_find( e->e_attrs, mi->mi_ad_monitorCounter );
+	if ( a == NULL ) {
+		return SLAP_CB_CONTINUE;
+	}
+
+	ldap_pvt_mp_init_set( n, (*l)->sl_naccept );
+	UI2BV( &a->a_vals[ 0 ], n );
+	ldap_pvt_mp_clear( n );
+
+	return SLAP_CB_CONTINUE;
+}
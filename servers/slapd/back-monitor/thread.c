@@ -34,6 +34,8 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_QUEUES,
+	MT_CLASSES,
 
 	MT_LAST
 } monitor_thread_t;
@@ -87,6 +89,12 @@ static struct {
 	{ BER_BVC( "cn=Tasklist" ),
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
+	{ BER_BVC( "cn=Queues" ),
+		BER_BVC("Pending tasks and tasks taken from other queues, per work queue"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_QUEUES },
+	{ BER_BVC( "cn=Classes" ),
+		BER_BVC("Scheduling and queue wait time (microseconds), per class of operations"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_CLASSES },
 
 	{ BER_BVNULL }
 };
@@ -318,6 +326,90 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_QUEUES:
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			bv.bv_val = buf;
+			for ( i = 0; ldap_pvt_thread_pool_query_q( &connection_pool, i,
+				LDAP_PVT_THREAD_POOL_PARAM_PENDING, (void *)&count ) == 0; i++ )
+			{
+				unsigned long	steals = 0;
+
+				(void)ldap_pvt_thread_pool_query_q( &connection_pool, i,
+					LDAP_PVT_THREAD_POOL_PARAM_STEALS, (void *)&steals );
+				bv.bv_len = snprintf( buf, sizeof( buf ),
+					"{%d}pending=%d steals=%lu", i, count, steals );
+				if ( bv.bv_len < sizeof( buf ) ) {
+					value_add_one( &vals, &bv );
+				}
+			}
+
+			if ( vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+				ber_bvarray_free( vals );
+
+			} else {
+				attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			}
+			break;
+
+		case MT_CLASSES:
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			bv.bv_val = buf;
+			for ( i = 0; i < SLAP_OPCLASS_LAST; i++ ) {
+				int		active = 0, max = 0;
+				unsigned long	tasks = 0, wait = 0;
+
+				if ( ldap_pvt_thread_pool_query_class( &connection_pool, i,
+					LDAP_PVT_THREAD_POOL_PARAM_PENDING, (void *)&count ) != 0 )
+				{
+					break;
+				}
+				(void)ldap_pvt_thread_pool_query_class( &connection_pool, i,
+					LDAP_PVT_THREAD_POOL_PARAM_ACTIVE, (void *)&active );
+				(void)ldap_pvt_thread_pool_query_class( &connection_pool, i,
+					LDAP_PVT_THREAD_POOL_PARAM_MAX, (void *)&max );
+				(void)ldap_pvt_thread_pool_query_class( &connection_pool, i,
+					LDAP_PVT_THREAD_POOL_PARAM_TASKS, (void *)&tasks );
+				(void)ldap_pvt_thread_pool_query_class( &connection_pool, i,
+					LDAP_PVT_THREAD_POOL_PARAM_WAIT, (void *)&wait );
+				bv.bv_len = snprintf( buf, sizeof( buf ),
+					"{%d}%s weight=%d max=%d active=%d pending=%d "
+					"tasks=%lu wait=%lu avgwait=%lu",
+					i, slap_opclasses[ i ].soc_name.bv_val,
+					slap_opclasses[ i ].soc_weight, max, active, count,
+					tasks, wait, tasks ? wait / tasks : 0 );
+				if ( bv.bv_len < sizeof( buf ) ) {
+					value_add_one( &vals, &bv );
+				}
+			}
+
+			if ( vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+				ber_bvarray_free( vals );
+
+			} else {
+				attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			}
+			break;
+
 		default:
 			assert( 0 );
 		}
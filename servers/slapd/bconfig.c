@@ -125,6 +125,9 @@ static ConfigDriver config_suffix;
 #ifdef LDAP_TCP_BUFFER
 static ConfigDriver config_tcp_buffer; 
 #endif /* LDAP_TCP_BUFFER */
+#ifndef NO_THREADS
+static ConfigDriver config_threadclass;
+#endif
 static ConfigDriver config_rootdn;
 static ConfigDriver config_rootpw;
 static ConfigDriver config_restrict;
@@ -693,6 +696,16 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:95 NAME 'olcThreadQueues' "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadclass", "class> <[weight=<n>] [max=<n>] [dn.exact=<dn>] [dn.subtree=<dn>]", 3, 0, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_MAGIC, &config_threadclass,
+#endif
+		"( OLcfgGlAt:97 NAME 'olcThreadClass' "
+			"DESC 'Scheduling of a class of operations' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
@@ -864,7 +877,7 @@ static ConfigOCs cf_ocs[] = {
 		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
 		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcThreadQueues $ "
+		 "olcThreads $ olcThreadQueues $ olcThreadClass $ "
 		 "olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
@@ -3094,6 +3107,148 @@ done:;
 }
 #endif /* LDAP_TCP_BUFFER */
 
+#ifndef NO_THREADS
+static void
+threadclass_unparse( slap_opclass *oc, struct berval *bv )
+{
+	char buf[ 64 ], *ptr;
+	ber_len_t len;
+	int i;
+
+	len = snprintf( buf, sizeof( buf ), "%s weight=%d max=%d",
+		oc->soc_name.bv_val, oc->soc_weight, oc->soc_max );
+	for ( i = 0; oc->soc_ndn && !BER_BVISNULL( &oc->soc_ndn[ i ] ); i++ )
+		len += STRLENOF( " dn.exact=\"\"" ) + oc->soc_ndn[ i ].bv_len;
+	for ( i = 0; oc->soc_ndn_subtree && !BER_BVISNULL( &oc->soc_ndn_subtree[ i ] ); i++ )
+		len += STRLENOF( " dn.subtree=\"\"" ) + oc->soc_ndn_subtree[ i ].bv_len;
+
+	bv->bv_len = len;
+	bv->bv_val = ch_malloc( len + 1 );
+	ptr = lutil_strcopy( bv->bv_val, buf );
+	for ( i = 0; oc->soc_ndn && !BER_BVISNULL( &oc->soc_ndn[ i ] ); i++ ) {
+		ptr = lutil_strcopy( ptr, " dn.exact=\"" );
+		ptr = lutil_strcopy( ptr, oc->soc_ndn[ i ].bv_val );
+		*ptr++ = '"';
+	}
+	for ( i = 0; oc->soc_ndn_subtree && !BER_BVISNULL( &oc->soc_ndn_subtree[ i ] ); i++ ) {
+		ptr = lutil_strcopy( ptr, " dn.subtree=\"" );
+		ptr = lutil_strcopy( ptr, oc->soc_ndn_subtree[ i ].bv_val );
+		*ptr++ = '"';
+	}
+	*ptr = '\0';
+}
+
+static int
+config_threadclass( ConfigArgs *c )
+{
+	slap_opclass *oc, tmp = { BER_BVNULL, 1, 0 };
+	struct berval name;
+	int i;
+
+	if ( c->op == SLAP_CONFIG_EMIT ) {
+		struct berval bv;
+
+		for ( i = 0; i < SLAP_OPCLASS_LAST; i++ ) {
+			oc = &slap_opclasses[ i ];
+			if ( oc->soc_weight == 1 && !oc->soc_max &&
+				!oc->soc_ndn && !oc->soc_ndn_subtree )
+				continue;
+			threadclass_unparse( oc, &bv );
+			ber_bvarray_add( &c->rvalue_vals, &bv );
+		}
+		return c->rvalue_vals ? 0 : 1;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		if ( !c->line ) {
+			for ( i = 0; i < SLAP_OPCLASS_LAST; i++ ) {
+				connection_opclass_reset( &slap_opclasses[ i ] );
+				connection_opclass_apply( &slap_opclasses[ i ] );
+			}
+		} else {
+			/* the tokens in c->argv are gone by now */
+			name.bv_val = c->line;
+			name.bv_len = strcspn( c->line, " \t" );
+			oc = connection_opclass_find( &name );
+			if ( oc == NULL )
+				return 1;
+			connection_opclass_reset( oc );
+			connection_opclass_apply( oc );
+		}
+		return 0;
+	}
+
+	ber_str2bv( c->argv[ 1 ], 0, 0, &name );
+	oc = connection_opclass_find( &name );
+	if ( oc == NULL ) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ),
+			"<%s> unknown class \"%s\"", c->argv[ 0 ], c->argv[ 1 ] );
+		goto fail;
+	}
+
+	for ( i = 2; i < c->argc; i++ ) {
+		char *arg = c->argv[ i ];
+		struct berval dn, ndn;
+		BerVarray *dns = NULL;
+
+		if ( strncasecmp( arg, "weight=", STRLENOF( "weight=" ) ) == 0 ) {
+			if ( lutil_atoi( &tmp.soc_weight, arg + STRLENOF( "weight=" ) ) != 0
+				|| tmp.soc_weight < 1 )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid weight \"%s\"", c->argv[ 0 ], arg );
+				goto fail;
+			}
+
+		} else if ( strncasecmp( arg, "max=", STRLENOF( "max=" ) ) == 0 ) {
+			if ( lutil_atoi( &tmp.soc_max, arg + STRLENOF( "max=" ) ) != 0
+				|| tmp.soc_max < 0 )
+			{
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid max \"%s\"", c->argv[ 0 ], arg );
+				goto fail;
+			}
+
+		} else if ( strncasecmp( arg, "dn.exact=", STRLENOF( "dn.exact=" ) ) == 0 ) {
+			arg += STRLENOF( "dn.exact=" );
+			dns = &tmp.soc_ndn;
+
+		} else if ( strncasecmp( arg, "dn.subtree=", STRLENOF( "dn.subtree=" ) ) == 0 ) {
+			arg += STRLENOF( "dn.subtree=" );
+			dns = &tmp.soc_ndn_subtree;
+
+		} else {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> unknown parameter \"%s\"", c->argv[ 0 ], arg );
+			goto fail;
+		}
+
+		if ( dns ) {
+			ber_str2bv( arg, 0, 0, &dn );
+			if ( dnNormalize( 0, NULL, NULL, &dn, &ndn, NULL ) != LDAP_SUCCESS ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"<%s> invalid DN \"%s\"", c->argv[ 0 ], arg );
+				goto fail;
+			}
+			ber_bvarray_add( dns, &ndn );
+		}
+	}
+
+	connection_opclass_reset( oc );
+	oc->soc_weight = tmp.soc_weight;
+	oc->soc_max = tmp.soc_max;
+	oc->soc_ndn = tmp.soc_ndn;
+	oc->soc_ndn_subtree = tmp.soc_ndn_subtree;
+	connection_opclass_apply( oc );
+	return 0;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+	ber_bvarray_free( tmp.soc_ndn );
+	ber_bvarray_free( tmp.soc_ndn_subtree );
+	return 1;
+}
+#endif /* ! NO_THREADS */
+
 static int
 config_suffix(ConfigArgs *c)
 {
@@ -56,6 +56,15 @@ static unsigned long conn_nextid = SLAPD_SYNC_SYNCCONN_OFFSET;
 
 static const char conn_lost_str[] = "connection lost";
 
+/* Connections with gathered PDUs, oldest first, are flushed this long
+ * after the first PDU was gathered. See send_ldap_ber().
+ */
+#define SLAP_WBATCH_USEC	10000
+
+static ldap_pvt_thread_mutex_t conn_wbatch_mutex;
+static LDAP_TAILQ_HEAD(c_wb, Connection) conn_wbatch =
+	LDAP_TAILQ_HEAD_INITIALIZER(conn_wbatch);
+
 const char *
 connection_state2str( int state )
 {
@@ -71,6 +80,148 @@ connection_state2str( int state )
 	return "?";
 }
 
+slap_opclass slap_opclasses[SLAP_OPCLASS_LAST] = {
+	{ BER_BVC("default"), 1 },
+	{ BER_BVC("bind"), 1 },
+	{ BER_BVC("read"), 1 },
+	{ BER_BVC("search"), 1 },
+	{ BER_BVC("write"), 1 },
+	{ BER_BVC("repl"), 1 },
+};
+
+/* Ops of a class that is capped, or that weighs less than reading
+ * connections, always wait their turn in the pool instead of being
+ * run by the thread that read them.
+ */
+#define SLAP_OPCLASS_QUEUED(cls) \
+	( slap_opclasses[cls].soc_max || slap_opclasses[cls].soc_weight < \
+		slap_opclasses[SLAP_OPCLASS_DEFAULT].soc_weight )
+
+slap_opclass *
+connection_opclass_find( struct berval *name )
+{
+	int i;
+
+	for ( i = 0; i < SLAP_OPCLASS_LAST; i++ ) {
+		if ( ber_bvstrcasecmp( name, &slap_opclasses[i].soc_name ) == 0 )
+			return &slap_opclasses[i];
+	}
+	return NULL;
+}
+
+void
+connection_opclass_reset( slap_opclass *oc )
+{
+	oc->soc_weight = 1;
+	oc->soc_max = 0;
+	ber_bvarray_free( oc->soc_ndn );
+	oc->soc_ndn = NULL;
+	ber_bvarray_free( oc->soc_ndn_subtree );
+	oc->soc_ndn_subtree = NULL;
+}
+
+void
+connection_opclass_apply( slap_opclass *oc )
+{
+	ldap_pvt_thread_pool_class( &connection_pool, oc - slap_opclasses,
+		oc->soc_weight, oc->soc_max );
+}
+
+/* Peek at the scope of an undecoded search request */
+static ber_int_t
+connection_search_scope( BerElement *ber )
+{
+	BerElementBuffer berbuf;
+	BerElement *sber = (BerElement *)&berbuf;
+	struct berval bv;
+	ber_int_t scope;
+
+	if ( ber_peek_element( ber, &bv ) != LDAP_REQ_SEARCH )
+		return -1;
+	ber_init2( sber, &bv, LBER_USE_DER );
+	if ( ber_scanf( sber, "xe", &scope ) == LBER_ERROR )
+		return -1;
+	return scope;
+}
+
+/* Pick the class of an undecoded extended request by its name. Only
+ * those known to write or to just read get a class of their own.
+ */
+static int
+connection_exop_class( BerElement *ber )
+{
+	BerElementBuffer berbuf;
+	BerElement *sber = (BerElement *)&berbuf;
+	struct berval bv, oid;
+
+	if ( ber_peek_element( ber, &bv ) != LDAP_REQ_EXTENDED )
+		return SLAP_OPCLASS_DEFAULT;
+	ber_init2( sber, &bv, LBER_USE_DER );
+	/* leave the request intact, don't terminate the name in place */
+	if ( ber_get_stringbv( sber, &oid, LBER_BV_NOTERM ) == LBER_ERROR )
+		return SLAP_OPCLASS_DEFAULT;
+	if ( exop_writes( &oid ))
+		return SLAP_OPCLASS_WRITE;
+	if ( bvmatch( &oid, &slap_EXOP_WHOAMI ))
+		return SLAP_OPCLASS_READ;
+	return SLAP_OPCLASS_DEFAULT;
+}
+
+/*
+ * Pick the scheduling class of an op that has not been decoded yet.
+ * The identity of the connection comes first, then the kind of op.
+ * Bind, unbind and abandon keep their own class regardless, so that
+ * a busy identity can still authenticate and give up its requests.
+ */
+static int
+connection_op_class( Operation *op )
+{
+	Connection *c = op->o_conn;
+	struct berval *ndn;
+	int i, j;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_BIND:
+	case LDAP_REQ_UNBIND:
+	case LDAP_REQ_ABANDON:
+		return SLAP_OPCLASS_BIND;
+	}
+
+	ndn = BER_BVISNULL( &c->c_sasl_authz_dn ) ? &c->c_ndn : &c->c_sasl_authz_dn;
+	if ( !BER_BVISEMPTY( ndn ) ) {
+		for ( i = 0; i < SLAP_OPCLASS_LAST; i++ ) {
+			slap_opclass *oc = &slap_opclasses[i];
+
+			for ( j = 0; oc->soc_ndn && !BER_BVISNULL( &oc->soc_ndn[j] ); j++ ) {
+				if ( dn_match( ndn, &oc->soc_ndn[j] ) )
+					return i;
+			}
+			for ( j = 0; oc->soc_ndn_subtree &&
+				!BER_BVISNULL( &oc->soc_ndn_subtree[j] ); j++ ) {
+				if ( dnIsSuffix( ndn, &oc->soc_ndn_subtree[j] ) )
+					return i;
+			}
+		}
+	}
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_SEARCH:
+		if ( connection_search_scope( op->o_ber ) == LDAP_SCOPE_BASE )
+			return SLAP_OPCLASS_READ;
+		return SLAP_OPCLASS_SEARCH;
+	case LDAP_REQ_COMPARE:
+		return SLAP_OPCLASS_READ;
+	case LDAP_REQ_EXTENDED:
+		return connection_exop_class( op->o_ber );
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODIFY:
+	case LDAP_REQ_MODRDN:
+		return SLAP_OPCLASS_WRITE;
+	}
+	return SLAP_OPCLASS_DEFAULT;
+}
+
 static Connection* connection_get( ber_socket_t s );
 
 typedef struct conn_readinfo {
@@ -110,6 +261,7 @@ int connections_init(void)
 	/* should check return of every call */
 	ldap_pvt_thread_mutex_init( &connections_mutex );
 	ldap_pvt_thread_mutex_init( &conn_nextid_mutex );
+	ldap_pvt_thread_mutex_init( &conn_wbatch_mutex );
 
 	connections = (Connection *) ch_calloc( dtblsize, sizeof(Connection) );
 
@@ -169,6 +321,8 @@ int connections_destroy(void)
 
 	ldap_pvt_thread_mutex_destroy( &connections_mutex );
 	ldap_pvt_thread_mutex_destroy( &conn_nextid_mutex );
+	LDAP_TAILQ_INIT( &conn_wbatch );
+	ldap_pvt_thread_mutex_destroy( &conn_wbatch_mutex );
 	return 0;
 }
 
@@ -236,6 +390,69 @@ int connections_timeout_idle(time_t now)
 	return i;
 }
 
+/*
+ * Start the flush timer of PDUs gathered on c, with its c_write1_mutex
+ * locked. Daemon thread 0 runs the timers.
+ */
+void connection_wbatch_queue( Connection *c )
+{
+	int wake;
+
+	ldap_pvt_thread_mutex_lock( &conn_wbatch_mutex );
+	wake = LDAP_TAILQ_EMPTY( &conn_wbatch );
+	LDAP_TAILQ_INSERT_TAIL( &conn_wbatch, c, c_wbatch_next );
+	c->c_wbatch_queued = 1;
+	ldap_pvt_thread_mutex_unlock( &conn_wbatch_mutex );
+
+	if ( wake )
+		slap_wake_listener();
+}
+
+/*
+ * Stop the flush timer of c, its gathered PDUs are gone.
+ */
+void connection_wbatch_dequeue( Connection *c )
+{
+	ldap_pvt_thread_mutex_lock( &conn_wbatch_mutex );
+	if ( c->c_wbatch_queued ) {
+		LDAP_TAILQ_REMOVE( &conn_wbatch, c, c_wbatch_next );
+		c->c_wbatch_queued = 0;
+	}
+	ldap_pvt_thread_mutex_unlock( &conn_wbatch_mutex );
+}
+
+/*
+ * Flush the PDUs gathered for SLAP_WBATCH_USEC or longer. Returns 1
+ * and the time until the next flush is due in tv, 0 if there is none.
+ */
+int connections_wbatch_timeout( struct timeval *tv )
+{
+	struct timeval now;
+	Connection *c;
+	long usec;
+
+	gettimeofday( &now, NULL );
+
+	ldap_pvt_thread_mutex_lock( &conn_wbatch_mutex );
+	while (( c = LDAP_TAILQ_FIRST( &conn_wbatch )) != NULL ) {
+		usec = ( now.tv_sec - c->c_wbatch_tv.tv_sec ) * 1000000 +
+			now.tv_usec - c->c_wbatch_tv.tv_usec;
+		if ( usec < SLAP_WBATCH_USEC ) {
+			usec = SLAP_WBATCH_USEC - usec;
+			tv->tv_sec = usec / 1000000;
+			tv->tv_usec = usec % 1000000;
+			break;
+		}
+		LDAP_TAILQ_REMOVE( &conn_wbatch, c, c_wbatch_next );
+		c->c_wbatch_queued = 0;
+		ldap_pvt_thread_pool_submit( &connection_pool,
+			slap_wbatch_flush, c );
+	}
+	ldap_pvt_thread_mutex_unlock( &conn_wbatch_mutex );
+
+	return c != NULL;
+}
+
 /* Drop all client connections */
 void connections_drop()
 {
@@ -398,6 +615,7 @@ Connection * connection_init(
 		}
 
 		c->c_currentber = NULL;
+		c->c_wbatch = NULL;
 
 		/* should check status of thread calls */
 		ldap_pvt_thread_mutex_init( &c->c_mutex );
@@ -434,6 +652,7 @@ Connection * connection_init(
 	assert( c->c_sasl_bindop == NULL );
 	assert( c->c_sasl_cbind == NULL );
 	assert( c->c_currentber == NULL );
+	assert( c->c_wbatch == NULL );
 	assert( c->c_writewaiter == 0);
 	assert( c->c_writers == 0);
 
@@ -659,6 +878,12 @@ connection_destroy( Connection *c )
 		c->c_currentber = NULL;
 	}
 
+	if ( c->c_wbatch != NULL ) {
+		ber_free( c->c_wbatch, 1 );
+		c->c_wbatch = NULL;
+		connection_wbatch_dequeue( c );
+	}
+
 
 #ifdef LDAP_SLAPI
 	/* call destructors, then constructors; avoids unnecessary allocation */
@@ -1715,19 +1940,22 @@ connection_input( Connection *conn , conn_readinfo *cri )
 
 		/*
 		 * The first op will be processed in the same thread context,
-		 * as long as there is only one op total.
+		 * as long as there is only one op total and its class
+		 * need not wait its turn.
 		 * Subsequent ops will be submitted to the pool by
 		 * calling connection_op_activate()
 		 */
-		if ( cri->op == NULL ) {
+		if ( cri->op == NULL &&
+			!SLAP_OPCLASS_QUEUED( connection_op_class( op ) ) ) {
 			/* the first incoming request */
 			connection_op_queue( op );
 			cri->op = op;
 		} else {
-			if ( !cri->nullop ) {
+			if ( cri->op != NULL && !cri->nullop ) {
 				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
+				rc = ldap_pvt_thread_pool_submit_class( &connection_pool,
+					connection_operation, (void *) cri->op,
+					connection_op_class( cri->op ) );
 			}
 			connection_op_activate( op );
 		}
@@ -1917,8 +2145,8 @@ static int connection_op_activate( Operation *op )
 
 	connection_op_queue( op );
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_operation, (void *) op );
+	rc = ldap_pvt_thread_pool_submit_class( &connection_pool,
+		connection_operation, (void *) op, connection_op_class( op ) );
 
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -62,6 +62,9 @@ const struct berval slap_post_read_bv = BER_BVC(LDAP_CONTROL_POST_READ);
 
 struct slap_control_ids slap_cids;
 
+/* o_extra key of an OpExtraSort */
+const char slap_sort_oe_key[] = LDAP_CONTROL_SORTREQUEST;
+
 struct slap_control {
 	/* Control OID */
 	char *sc_oid;
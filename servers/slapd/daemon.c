@@ -45,14 +45,18 @@
 #include <poll.h>
 #endif
 
-#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
+#if defined(HAVE_IO_URING)
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
 # include <sys/epoll.h>
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_SYS_DEVPOLL_H) && defined(HAVE_DEVPOLL)
 # include <sys/types.h>
 # include <sys/stat.h>
 # include <fcntl.h>
 # include <sys/devpoll.h>
-#endif /* ! epoll && ! /dev/poll */
+#endif /* ! io_uring && ! epoll && ! /dev/poll */
 
 #ifdef HAVE_TCPD
 int allow_severity = LOG_INFO;
@@ -133,6 +137,40 @@ SOCKET *slapd_ws_sockets;
 static ldap_pvt_thread_mutex_t	sd_tcpd_mutex;
 #endif /* TCP Wrappers */
 
+#if defined(HAVE_IO_URING)
+/* Per-descriptor state for the io_uring event loop */
+typedef struct slap_uring_fd {
+	Listener		*uf_l;
+	unsigned		uf_gen;		/* tags this descriptor's polls */
+	unsigned short		uf_events;	/* POLLIN/POLLOUT wanted */
+	unsigned short		uf_state;
+#define	SLAP_URING_ACTIVE	0x01
+#define	SLAP_URING_ARMED	0x02	/* a poll is queued or in the kernel */
+#define	SLAP_URING_REARM	0x04	/* on sd_rearm, arm before waiting */
+#define	SLAP_URING_PARKED	0x08	/* not armed until interest changes */
+} slap_uring_fd;
+
+/* The rings shared with the kernel */
+typedef struct slap_uring {
+	int			ur_fd;
+	unsigned		ur_sqentries;
+	unsigned		ur_sqmask;
+	unsigned		ur_sqlocal;	/* next tail to publish */
+	unsigned		*ur_sqhead;
+	unsigned		*ur_sqtail;
+	struct io_uring_sqe	*ur_sqes;
+	unsigned		ur_cqmask;
+	unsigned		*ur_cqhead;
+	unsigned		*ur_cqtail;
+	struct io_uring_cqe	*ur_cqes;
+	void			*ur_sqmap;
+	size_t			ur_sqmaplen;
+	void			*ur_cqmap;
+	size_t			ur_cqmaplen;
+	size_t			ur_sqeslen;
+} slap_uring;
+#endif /* HAVE_IO_URING */
+
 typedef struct slap_daemon_st {
 	ldap_pvt_thread_mutex_t	sd_mutex;
 
@@ -140,7 +178,14 @@ typedef struct slap_daemon_st {
 	int			sd_nwriters;
 	int			sd_nfds;
 
-#if defined(HAVE_EPOLL)
+#if defined(HAVE_IO_URING)
+	slap_uring		sd_ring;
+	slap_uring_fd		*sd_fds;
+	struct pollfd		*sd_revents;
+	ber_socket_t		*sd_rearm;
+	int			sd_nrearm;
+	int			sd_defer;	/* daemon thread will submit soon */
+#elif defined(HAVE_EPOLL)
 	struct epoll_event	*sd_epolls;
 	int			*sd_index;
 	int			sd_epfd;
@@ -159,7 +204,7 @@ typedef struct slap_daemon_st {
 	fd_set			sd_readers;
 	fd_set			sd_writers;
 #endif /* ! HAVE_WINSOCK */
-#endif /* ! epoll && ! /dev/poll */
+#endif /* ! io_uring && ! epoll && ! /dev/poll */
 } slap_daemon_st;
 
 static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
@@ -171,11 +216,423 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
  *   with file descriptors and events respectively
  *
  * - SLAP_<type>_* for private interface; type by now is one of
- *   EPOLL, DEVPOLL, SELECT
+ *   URING, EPOLL, DEVPOLL, SELECT
  *
  * private interface should not be used in the code.
  */
-#if defined(HAVE_EPOLL)
+#if defined(HAVE_IO_URING)
+/*****************************************************
+ * Use Linux io_uring(7) - one-shot IORING_OP_POLL_ADD *
+ *****************************************************/
+# define SLAP_EVENT_FNAME		"io_uring"
+# define SLAP_EVENTS_ARE_INDEXED	0
+/*
+ * Every active descriptor has at most one poll request in the kernel.
+ * A poll completes once and the daemon thread arms it again, with
+ * whatever events are wanted by then, just before it waits; those
+ * re-arms and any interest changes made while it was busy go to the
+ * kernel in the same io_uring_enter() that waits for the next events.
+ * Changes made while the daemon thread is waiting are submitted by
+ * the caller, so they take effect without waking the daemon up.
+ *
+ * All of the state below is protected by sd_mutex.
+ */
+# define SLAP_URING_FD(t,s)		(slap_daemon[t].sd_fds[(s)])
+# define SLAP_URING_UDATA(t,s)	\
+	(((__u64)SLAP_URING_FD(t,s).uf_gen << 32) | (unsigned)(s))
+# define SLAP_URING_NOUDATA		(~(__u64)0)
+
+# define SLAP_SOCK_IS_ACTIVE(t,s)	(SLAP_URING_FD(t,s).uf_state & SLAP_URING_ACTIVE)
+# define SLAP_SOCK_NOT_ACTIVE(t,s)	(!SLAP_SOCK_IS_ACTIVE(t,s))
+# define SLAP_URING_SOCK_IS_SET(t,s, mode)	(SLAP_URING_FD(t,s).uf_events & (mode))
+
+# define SLAP_SOCK_IS_READ(t,s)		SLAP_URING_SOCK_IS_SET(t,(s), POLLIN)
+# define SLAP_SOCK_IS_WRITE(t,s)		SLAP_URING_SOCK_IS_SET(t,(s), POLLOUT)
+
+# define SLAP_SOCK_SET_READ(t,s)	\
+	slap_uring_mod(t,(s), SLAP_URING_FD(t,s).uf_events | POLLIN)
+# define SLAP_SOCK_SET_WRITE(t,s)	\
+	slap_uring_mod(t,(s), SLAP_URING_FD(t,s).uf_events | POLLOUT)
+
+# define SLAP_SOCK_CLR_READ(t,s)	\
+	slap_uring_mod(t,(s), SLAP_URING_FD(t,s).uf_events & ~POLLIN)
+# define SLAP_SOCK_CLR_WRITE(t,s)	\
+	slap_uring_mod(t,(s), SLAP_URING_FD(t,s).uf_events & ~POLLOUT)
+
+/* Interest changes reach the kernel without the daemon's help */
+# define SLAP_SOCK_WAKE(w)		0
+
+# define SLAP_EVENT_MAX(t)			slap_daemon[t].sd_nfds
+
+# define SLAP_SOCK_ADD(t, s, l)		do { \
+	SLAP_URING_FD(t,(s)).uf_l = (l); \
+	SLAP_URING_FD(t,(s)).uf_events = 0; \
+	SLAP_URING_FD(t,(s)).uf_state = SLAP_URING_ACTIVE | SLAP_URING_PARKED; \
+	slap_daemon[t].sd_nfds++; \
+	slap_uring_mod(t,(s), POLLIN); \
+} while (0)
+
+/* Bumping the generation makes any completion still on its way
+ * for this descriptor stale.
+ */
+# define SLAP_SOCK_DEL(t,s)		do { \
+	slap_uring_fd *uf = &SLAP_URING_FD(t,(s)); \
+	if ( !( uf->uf_state & SLAP_URING_ACTIVE ) ) break; \
+	if ( uf->uf_state & SLAP_URING_ARMED ) { \
+		struct io_uring_sqe *sqe = slap_uring_sqe( t ); \
+		sqe->opcode = IORING_OP_POLL_REMOVE; \
+		sqe->fd = -1; \
+		sqe->addr = SLAP_URING_UDATA(t,(s)); \
+		sqe->user_data = SLAP_URING_NOUDATA; \
+		slap_uring_push( t ); \
+	} \
+	uf->uf_l = NULL; \
+	uf->uf_gen++; \
+	uf->uf_events = 0; \
+	uf->uf_state = 0; \
+	slap_daemon[t].sd_nfds--; \
+} while (0)
+
+# define SLAP_EVENT_CLR_READ(i)		(revents[(i)].revents &= ~POLLIN)
+# define SLAP_EVENT_CLR_WRITE(i)	(revents[(i)].revents &= ~POLLOUT)
+
+# define SLAP_EVENT_FD(t,i)		(revents[(i)].fd)
+
+# define SLAP_EVENT_IS_READ(i)		(revents[(i)].revents & POLLIN)
+# define SLAP_EVENT_IS_WRITE(i)		(revents[(i)].revents & POLLOUT)
+# define SLAP_EVENT_IS_LISTENER(t,i)	(SLAP_EVENT_LISTENER(t,i) != NULL)
+# define SLAP_EVENT_LISTENER(t,i)		(SLAP_URING_FD(t,SLAP_EVENT_FD(t,(i))).uf_l)
+
+# define SLAP_SOCK_INIT(t)		do { \
+	if ( slap_uring_init( t ) ) { \
+		SLAP_SOCK_DESTROY(t); \
+		return -1; \
+	} \
+} while (0)
+
+# define SLAP_SOCK_DESTROY(t)		do { \
+	if ( slap_daemon[t].sd_fds != NULL ) { \
+		slap_uring_destroy( t ); \
+	} \
+} while ( 0 )
+
+# define SLAP_EVENT_DECL		struct pollfd *revents
+
+# define SLAP_EVENT_INIT(t)		do { \
+	revents = slap_daemon[t].sd_revents; \
+	slap_uring_rearm( t ); \
+} while (0)
+
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_uring_wait( (t), (tvp) ); \
+} while (0)
+
+static int
+slap_uring_enter( int fd, unsigned submit, unsigned wait, unsigned flags,
+	void *arg, size_t argsz )
+{
+	return syscall( __NR_io_uring_enter, fd, submit, wait, flags,
+		arg, argsz );
+}
+
+/* Hand the published but not yet consumed SQEs to the kernel */
+static void
+slap_uring_submit( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_ring;
+	unsigned n = ur->ur_sqlocal - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE );
+
+	while ( n && slap_uring_enter( ur->ur_fd, n, 0, 0, NULL, 0 ) < 0 ) {
+		if ( errno != EINTR && errno != EAGAIN ) {
+			Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+				"submit failed errno=%d\n", errno, 0, 0 );
+			break;
+		}
+	}
+}
+
+/* Get a cleared SQE; the caller fills it in and calls slap_uring_push() */
+static struct io_uring_sqe *
+slap_uring_sqe( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_ring;
+	struct io_uring_sqe *sqe;
+
+	if ( ur->ur_sqlocal - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE )
+		>= ur->ur_sqentries )
+	{
+		slap_uring_submit( t );
+	}
+	sqe = &ur->ur_sqes[ ur->ur_sqlocal & ur->ur_sqmask ];
+	memset( sqe, 0, sizeof( *sqe ));
+	return sqe;
+}
+
+static void
+slap_uring_push( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_ring;
+
+	ur->ur_sqlocal++;
+	__atomic_store_n( ur->ur_sqtail, ur->ur_sqlocal, __ATOMIC_RELEASE );
+	if ( !slap_daemon[t].sd_defer )
+		slap_uring_submit( t );
+}
+
+static void
+slap_uring_arm( int t, ber_socket_t s )
+{
+	slap_uring_fd *uf = &SLAP_URING_FD(t,s);
+	struct io_uring_sqe *sqe = slap_uring_sqe( t );
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = s;
+	sqe->poll32_events = uf->uf_events;
+	sqe->user_data = SLAP_URING_UDATA(t,s);
+	uf->uf_state |= SLAP_URING_ARMED;
+	uf->uf_state &= ~SLAP_URING_PARKED;
+	slap_uring_push( t );
+}
+
+static void
+slap_uring_mod( int t, ber_socket_t s, unsigned events )
+{
+	slap_uring_fd *uf = &SLAP_URING_FD(t,s);
+
+	if ( uf->uf_events == events ) return;
+	uf->uf_events = events;
+
+	if ( uf->uf_state & SLAP_URING_ARMED ) {
+		/* Replace the poll. Updating it in place needs Linux 5.13.
+		 * Bumping the generation drops the cancelled poll's
+		 * completion, or that of a poll that already fired: the
+		 * new one reports the same events if they are still there.
+		 */
+		struct io_uring_sqe *sqe = slap_uring_sqe( t );
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = SLAP_URING_UDATA(t,s);
+		sqe->user_data = SLAP_URING_NOUDATA;
+		slap_uring_push( t );
+		uf->uf_gen++;
+		if ( events ) {
+			slap_uring_arm( t, s );
+		} else {
+			uf->uf_state &= ~SLAP_URING_ARMED;
+			uf->uf_state |= SLAP_URING_PARKED;
+		}
+
+	} else if ( events && ( uf->uf_state & SLAP_URING_PARKED )) {
+		if ( slap_daemon[t].sd_defer &&
+			slap_daemon[t].sd_nrearm < dtblsize )
+		{
+			uf->uf_state &= ~SLAP_URING_PARKED;
+			uf->uf_state |= SLAP_URING_REARM;
+			slap_daemon[t].sd_rearm[ slap_daemon[t].sd_nrearm++ ] = s;
+		} else {
+			slap_uring_arm( t, s );
+		}
+	}
+}
+
+/* Called by the daemon thread with sd_mutex held, before waiting.
+ * The SQEs queued here go out with the wait itself.
+ */
+static void
+slap_uring_rearm( int t )
+{
+	int i;
+
+	for ( i = 0; i < slap_daemon[t].sd_nrearm; i++ ) {
+		ber_socket_t s = slap_daemon[t].sd_rearm[i];
+		slap_uring_fd *uf = &SLAP_URING_FD(t,s);
+
+		if ( !( uf->uf_state & SLAP_URING_REARM )) continue;
+		uf->uf_state &= ~SLAP_URING_REARM;
+		if ( !( uf->uf_state & SLAP_URING_ACTIVE )) continue;
+
+		/* Nothing wanted: like EPOLLET, don't keep reporting
+		 * a hangup until somebody asks for events again.
+		 */
+		if ( !uf->uf_events ) {
+			uf->uf_state |= SLAP_URING_PARKED;
+			continue;
+		}
+		slap_uring_arm( t, s );
+	}
+	slap_daemon[t].sd_nrearm = 0;
+	slap_daemon[t].sd_defer = 0;
+}
+
+static int
+slap_uring_wait( int t, struct timeval *tvp )
+{
+	slap_uring *ur = &slap_daemon[t].sd_ring;
+	struct io_uring_getevents_arg arg = { 0 };
+	struct __kernel_timespec ts;
+	unsigned head, tail, n;
+	int rc, ns = 0;
+
+	if ( tvp ) {
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64)(unsigned long)&ts;
+	}
+	n = ur->ur_sqlocal - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE );
+	rc = slap_uring_enter( ur->ur_fd, n, 1,
+		IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg ));
+	if ( rc < 0 ) {
+		if ( errno == ETIME ) return 0;
+		return -1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+	head = *ur->ur_cqhead;
+	tail = __atomic_load_n( ur->ur_cqtail, __ATOMIC_ACQUIRE );
+	for ( ; head != tail && ns < dtblsize; head++ ) {
+		struct io_uring_cqe *cqe = &ur->ur_cqes[ head & ur->ur_cqmask ];
+		ber_socket_t s;
+		slap_uring_fd *uf;
+		unsigned events;
+
+		if ( cqe->user_data == SLAP_URING_NOUDATA ) continue;
+		s = (unsigned)cqe->user_data;
+		uf = &SLAP_URING_FD(t,s);
+		if ( !( uf->uf_state & SLAP_URING_ACTIVE ) ||
+			uf->uf_gen != (unsigned)( cqe->user_data >> 32 ))
+		{
+			continue;
+		}
+		uf->uf_state &= ~SLAP_URING_ARMED;
+		events = cqe->res < 0 ? POLLERR : cqe->res;
+
+		if ( events & ( POLLIN|POLLOUT )) {
+			slap_daemon[t].sd_revents[ns].fd = s;
+			slap_daemon[t].sd_revents[ns].revents = events;
+			ns++;
+			uf->uf_state |= SLAP_URING_REARM;
+			slap_daemon[t].sd_rearm[ slap_daemon[t].sd_nrearm++ ] = s;
+		} else {
+			uf->uf_state |= SLAP_URING_PARKED;
+		}
+	}
+	__atomic_store_n( ur->ur_cqhead, head, __ATOMIC_RELEASE );
+	slap_daemon[t].sd_defer = 1;
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+
+	return ns;
+}
+
+static void
+slap_uring_destroy( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_ring;
+
+	if ( ur->ur_sqes != NULL )
+		munmap( ur->ur_sqes, ur->ur_sqeslen );
+	if ( ur->ur_cqmap != NULL && ur->ur_cqmap != ur->ur_sqmap )
+		munmap( ur->ur_cqmap, ur->ur_cqmaplen );
+	if ( ur->ur_sqmap != NULL )
+		munmap( ur->ur_sqmap, ur->ur_sqmaplen );
+	if ( ur->ur_fd >= 0 )
+		close( ur->ur_fd );
+	memset( ur, 0, sizeof( *ur ));
+	ch_free( slap_daemon[t].sd_fds );
+	slap_daemon[t].sd_fds = NULL;
+	slap_daemon[t].sd_revents = NULL;
+	slap_daemon[t].sd_rearm = NULL;
+}
+
+static int
+slap_uring_init( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_ring;
+	struct io_uring_params p;
+	unsigned entries;
+	char *sq, *cq;
+
+	slap_daemon[t].sd_fds = ch_calloc( 1,
+		( sizeof( slap_uring_fd ) + sizeof( struct pollfd )
+			+ sizeof( ber_socket_t )) * dtblsize );
+	slap_daemon[t].sd_revents = (struct pollfd *)&slap_daemon[t].sd_fds[ dtblsize ];
+	slap_daemon[t].sd_rearm = (ber_socket_t *)&slap_daemon[t].sd_revents[ dtblsize ];
+	slap_daemon[t].sd_nrearm = 0;
+	slap_daemon[t].sd_defer = 0;
+	ur->ur_fd = -1;
+
+	/* At most one poll per descriptor is outstanding, but interest
+	 * changes and removals also take SQEs and CQEs.
+	 */
+	entries = dtblsize / slapd_daemon_threads + 1;
+	if ( entries > 4096 ) entries = 4096;
+	memset( &p, 0, sizeof( p ));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	p.cq_entries = 2 * dtblsize;
+	ur->ur_fd = syscall( __NR_io_uring_setup, entries, &p );
+	if ( ur->ur_fd < 0 ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+			"io_uring_setup failed errno=%d\n", errno, 0, 0 );
+		return -1;
+	}
+	if ( !( p.features & IORING_FEAT_EXT_ARG )) {
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+			"kernel lacks IORING_FEAT_EXT_ARG (Linux 5.11), "
+			"slapd must be built without --enable-iouring\n", 0, 0, 0 );
+		return -1;
+	}
+
+	ur->ur_sqmaplen = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	ur->ur_cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( ur->ur_cqmaplen > ur->ur_sqmaplen )
+			ur->ur_sqmaplen = ur->ur_cqmaplen;
+	}
+	sq = mmap( NULL, ur->ur_sqmaplen, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, ur->ur_fd, IORING_OFF_SQ_RING );
+	if ( sq == MAP_FAILED ) goto fail;
+	ur->ur_sqmap = sq;
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		cq = sq;
+	} else {
+		cq = mmap( NULL, ur->ur_cqmaplen, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, ur->ur_fd, IORING_OFF_CQ_RING );
+		if ( cq == MAP_FAILED ) goto fail;
+	}
+	ur->ur_cqmap = cq;
+	ur->ur_sqeslen = p.sq_entries * sizeof( struct io_uring_sqe );
+	ur->ur_sqes = mmap( NULL, ur->ur_sqeslen, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, ur->ur_fd, IORING_OFF_SQES );
+	if ( ur->ur_sqes == MAP_FAILED ) {
+		ur->ur_sqes = NULL;
+		goto fail;
+	}
+
+	ur->ur_sqentries = p.sq_entries;
+	ur->ur_sqmask = *(unsigned *)( sq + p.sq_off.ring_mask );
+	ur->ur_sqhead = (unsigned *)( sq + p.sq_off.head );
+	ur->ur_sqtail = (unsigned *)( sq + p.sq_off.tail );
+	ur->ur_sqlocal = *ur->ur_sqtail;
+	ur->ur_cqmask = *(unsigned *)( cq + p.cq_off.ring_mask );
+	ur->ur_cqhead = (unsigned *)( cq + p.cq_off.head );
+	ur->ur_cqtail = (unsigned *)( cq + p.cq_off.tail );
+	ur->ur_cqes = (struct io_uring_cqe *)( cq + p.cq_off.cqes );
+
+	/* SQE slots are used in ring order, so the index array is fixed */
+	{
+		unsigned *array = (unsigned *)( sq + p.sq_off.array );
+		unsigned i;
+		for ( i = 0; i < p.sq_entries; i++ )
+			array[i] = i;
+	}
+	return 0;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+		"mmap of rings failed errno=%d\n", errno, 0, 0 );
+	return -1;
+}
+
+#elif defined(HAVE_EPOLL)
 /***************************************
  * Use epoll infrastructure - epoll(4) *
  ***************************************/
@@ -306,7 +763,8 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 
 # define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
 	*(nsp) = epoll_wait( slap_daemon[t].sd_epfd, revents, \
-		dtblsize, (tvp) ? (tvp)->tv_sec * 1000 : -1 ); \
+		dtblsize, (tvp) ? (tvp)->tv_sec * 1000 + \
+			((tvp)->tv_usec + 999) / 1000 : -1 ); \
 } while (0)
 
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_DEVPOLL)
@@ -482,7 +940,8 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 
 # define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
 	struct dvpoll		sd_dvpoll; \
-	sd_dvpoll.dp_timeout = (tvp) ? (tvp)->tv_sec * 1000 : -1; \
+	sd_dvpoll.dp_timeout = (tvp) ? (tvp)->tv_sec * 1000 + \
+		((tvp)->tv_usec + 999) / 1000 : -1; \
 	sd_dvpoll.dp_nfds = dtblsize; \
 	sd_dvpoll.dp_fds = revents; \
 	*(nsp) = ioctl( slap_daemon[t].sd_dpfd, DP_POLL, &sd_dvpoll ); \
@@ -676,7 +1135,12 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 		nwriters > 0 ? &writefds : NULL, NULL, (tvp) ); \
 } while (0)
 # endif /* !HAVE_WINSOCK */
-#endif /* ! epoll && ! /dev/poll */
+#endif /* ! io_uring && ! epoll && ! /dev/poll */
+
+#ifndef SLAP_SOCK_WAKE
+/* Whether changing a descriptor's events needs the daemon woken */
+# define SLAP_SOCK_WAKE(w)		(w)
+#endif
 
 #ifdef HAVE_SLP
 /*
@@ -923,8 +1387,8 @@ slapd_remove(
 			if ( lr->sl_mute ) {
 				lr->sl_mute = 0;
 				emfile--;
-				if ( DAEMON_ID(lr->sl_sd) != id )
-					WAKE_LISTENER(DAEMON_ID(lr->sl_sd), wake);
+				if ( lr->sl_tid != id )
+					WAKE_LISTENER(lr->sl_tid, wake);
 				break;
 			}
 		}
@@ -951,7 +1415,7 @@ slapd_clr_write( ber_socket_t s, int wake )
 	}
 
 	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
-	WAKE_LISTENER(id,wake);
+	WAKE_LISTENER(id,SLAP_SOCK_WAKE(wake));
 }
 
 void
@@ -968,7 +1432,7 @@ slapd_set_write( ber_socket_t s, int wake )
 	}
 
 	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
-	WAKE_LISTENER(id,wake);
+	WAKE_LISTENER(id,SLAP_SOCK_WAKE(wake));
 }
 
 int
@@ -984,7 +1448,7 @@ slapd_clr_read( ber_socket_t s, int wake )
 	}
 	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
 	if ( !rc )
-		WAKE_LISTENER(id,wake);
+		WAKE_LISTENER(id,SLAP_SOCK_WAKE(wake));
 	return rc;
 }
 
@@ -1002,7 +1466,7 @@ slapd_set_read( ber_socket_t s, int wake )
 	}
 	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
 	if ( do_wake )
-		WAKE_LISTENER(id,wake);
+		WAKE_LISTENER(id,SLAP_SOCK_WAKE(wake));
 }
 
 static void
@@ -1262,6 +1726,71 @@ errexit:
 	return -1;
 }
 
+#ifdef SO_REUSEPORT
+/* Open more sockets on the address of shard 0, each with its own
+ * accept queue, so that every daemon thread can accept connections
+ * without going through a single listener. listener-threads is only
+ * known once the configuration has been read, and by then we may no
+ * longer be allowed to bind the port, so open as many as could ever
+ * be used; slapd_shard_listeners() closes the ones left over.
+ */
+static void
+slap_open_listener_shards(
+	Listener *l0,
+	int addrlen,
+	int *listeners,
+	int *cur )
+{
+	Listener *li;
+	ber_socket_t s;
+	int i, rc, tmp = 1;
+
+	*listeners += SLAPD_MAX_DAEMON_THREADS - 1;
+	slap_listeners = ch_realloc( slap_listeners,
+		(*listeners + 1) * sizeof(Listener *) );
+
+	for ( i = 1; i < SLAPD_MAX_DAEMON_THREADS; i++ ) {
+		s = socket( l0->sl_sa.sa_addr.sa_family, SOCK_STREAM, 0 );
+		if ( s == AC_SOCKET_INVALID ) break;
+		if ( SLAP_SOCKNEW( s ) >= dtblsize ) {
+			tcp_close( s );
+			break;
+		}
+
+#ifdef SO_REUSEADDR
+		(void)setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
+			(char *) &tmp, sizeof(tmp) );
+#endif /* SO_REUSEADDR */
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+		if ( l0->sl_sa.sa_addr.sa_family == AF_INET6 ) {
+			(void)setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY,
+				(char *) &tmp, sizeof(tmp) );
+		}
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+		rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+			(char *) &tmp, sizeof(tmp) );
+		if ( rc != AC_SOCKET_ERROR )
+			rc = bind( s, &l0->sl_sa.sa_addr, addrlen );
+		if ( rc ) {
+			int err = sock_errno();
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: %s shard %d failed errno=%d\n",
+				l0->sl_name.bv_val, i, err );
+			tcp_close( s );
+			break;
+		}
+
+		li = ch_malloc( sizeof( Listener ) );
+		*li = *l0;
+		li->sl_sd = SLAP_SOCKNEW( s );
+		li->sl_tid = i;
+		ber_dupbv( &li->sl_url, &l0->sl_url );
+		ber_dupbv( &li->sl_name, &l0->sl_name );
+		slap_listeners[(*cur)++] = li;
+	}
+}
+#endif /* SO_REUSEPORT */
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1297,6 +1826,7 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_naccept = 0;
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1402,6 +1932,9 @@ slap_open_listener(
 		if( l.sl_is_udp ) socktype = SOCK_DGRAM;
 #endif /* LDAP_CONNECTIONLESS */
 
+		/* -1 until slapd_shard_listeners() picks a daemon thread */
+		l.sl_tid = -1;
+
 		s = socket( (*sal)->sa_family, socktype, 0);
 		if ( s == AC_SOCKET_INVALID ) {
 			int err = sock_errno();
@@ -1440,6 +1973,12 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+
+#ifdef SO_REUSEPORT
+			/* shard 0 of this address, once it is bound */
+			if ( socktype == SOCK_STREAM )
+				l.sl_tid = 0;
+#endif /* SO_REUSEPORT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1510,6 +2049,26 @@ slap_open_listener(
 			continue;
 		}
 
+#ifdef SO_REUSEPORT
+		/* Shard 0 of this address, see slap_open_listener_shards().
+		 * It was bound without SO_REUSEPORT, so the bind only
+		 * succeeded if no other server holds the port. Allowing
+		 * reuse now, before listen(), still lets the shards join it.
+		 */
+		if ( l.sl_tid == 0 ) {
+			tmp = 1;
+			rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+				(char *) &tmp, sizeof(tmp) );
+			if ( rc == AC_SOCKET_ERROR ) {
+				int err = sock_errno();
+				Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+					"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+					(long) l.sl_sd, err, sock_errstr(err) );
+				l.sl_tid = -1;
+			}
+		}
+#endif /* SO_REUSEPORT */
+
 		switch ( (*sal)->sa_family ) {
 #ifdef LDAP_PF_LOCAL
 		case AF_LOCAL: {
@@ -1567,6 +2126,10 @@ slap_open_listener(
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+#ifdef SO_REUSEPORT
+		if ( l.sl_tid == 0 )
+			slap_open_listener_shards( li, addrlen, listeners, cur );
+#endif /* SO_REUSEPORT */
 		sal++;
 	}
 
@@ -1685,6 +2248,48 @@ slapd_daemon_init( const char *urls )
 	return !i;
 }
 
+/*
+ * Called once listener-threads is known: give each daemon thread
+ * its own shard of every SO_REUSEPORT listener and close the shards
+ * nobody will poll. Other listeners stay with DAEMON_ID(sl_sd).
+ */
+void
+slapd_shard_listeners( void )
+{
+	int i, j, n = slapd_daemon_threads;
+
+	if ( slap_listeners == NULL )
+		return;
+	if ( n > SLAPD_MAX_DAEMON_THREADS )
+		n = SLAPD_MAX_DAEMON_THREADS;
+
+	for ( i = 0, j = 0; slap_listeners[i] != NULL; i++ ) {
+		Listener *lr = slap_listeners[i];
+
+		if ( lr->sl_tid >= n ) {
+			tcp_close( SLAP_FD2SOCK( lr->sl_sd ) );
+			ber_memfree( lr->sl_url.bv_val );
+			ber_memfree( lr->sl_name.bv_val );
+			free( lr );
+			continue;
+		}
+#ifdef SO_REUSEPORT
+		if ( lr->sl_tid == 0 && n == 1 ) {
+			/* Nothing to share the port with: don't let another
+			 * server bind it either.
+			 */
+			int tmp = 0;
+			(void)setsockopt( SLAP_FD2SOCK( lr->sl_sd ), SOL_SOCKET,
+				SO_REUSEPORT, (char *) &tmp, sizeof(tmp) );
+		}
+#endif /* SO_REUSEPORT */
+		if ( lr->sl_tid < 0 )
+			lr->sl_tid = DAEMON_ID( lr->sl_sd );
+		slap_listeners[j++] = lr;
+	}
+	slap_listeners[j] = NULL;
+}
+
 
 int
 slapd_daemon_destroy( void )
@@ -1740,7 +2345,12 @@ close_listeners(
 		if ( lr->sl_sd != AC_SOCKET_INVALID ) {
 			int s = lr->sl_sd;
 			lr->sl_sd = AC_SOCKET_INVALID;
-			if ( remove ) slapd_remove( s, NULL, 0, 0, 0 );
+			if ( remove ) {
+				/* not necessarily slap_daemon[DAEMON_ID(s)] */
+				ldap_pvt_thread_mutex_lock( &slap_daemon[lr->sl_tid].sd_mutex );
+				SLAP_SOCK_DEL( lr->sl_tid, s );
+				ldap_pvt_thread_mutex_unlock( &slap_daemon[lr->sl_tid].sd_mutex );
+			}
 
 #ifdef LDAP_PF_LOCAL
 			if ( lr->sl_sa.sa_addr.sa_family == AF_LOCAL ) {
@@ -1827,12 +2437,14 @@ slap_listener(
 #  endif /* LDAP_PF_LOCAL */
 
 	s = accept( SLAP_FD2SOCK( sl->sl_sd ), (struct sockaddr *) &from, &len );
+	if ( s != AC_SOCKET_INVALID )
+		sl->sl_naccept++;
 
 	/* Resume the listener FD to allow concurrent-processing of
 	 * additional incoming connections.
 	 */
 	sl->sl_busy = 0;
-	WAKE_LISTENER(DAEMON_ID(sl->sl_sd),1);
+	WAKE_LISTENER(sl->sl_tid,1);
 
 	if ( s == AC_SOCKET_INVALID ) {
 		int err = sock_errno();
@@ -2315,7 +2927,8 @@ slapd_daemon_task(
 			return (void*)-1;
 		}
 
-		slapd_add( slap_listeners[l]->sl_sd, 0, slap_listeners[l], -1 );
+		slapd_add( slap_listeners[l]->sl_sd, 0, slap_listeners[l],
+			slap_listeners[l]->sl_tid );
 	}
 
 #ifdef HAVE_NT_SERVICE_MANAGER
@@ -2420,7 +3033,7 @@ loop:
 			Listener *lr = slap_listeners[l];
 
 			if ( lr->sl_sd == AC_SOCKET_INVALID ) continue;
-			if ( DAEMON_ID( lr->sl_sd ) != tid ) continue;
+			if ( lr->sl_tid != tid ) continue;
 
 			if ( lr->sl_mute || lr->sl_busy )
 			{
@@ -2483,6 +3096,14 @@ loop:
 					tvp = &tv;
 				}
 			}
+
+			/* and the flush timers of gathered search results */
+			if ( connections_wbatch_timeout( &cat ) && ( tvp == NULL ||
+				cat.tv_sec < tv.tv_sec || ( cat.tv_sec == tv.tv_sec &&
+				cat.tv_usec < tv.tv_usec ))) {
+				tv = cat;
+				tvp = &tv;
+			}
 		}
 
 		for ( l = 0; slap_listeners[l] != NULL; l++ ) {
@@ -2771,7 +3392,7 @@ loop:
 					SLAP_EVENT_CLR_READ( i );
 					connection_read_activate( fd );
 				} else if ( !w ) {
-#ifdef HAVE_EPOLL
+#if defined(HAVE_EPOLL) && !defined(HAVE_IO_URING)
 					/* Don't keep reporting the hangup
 					 */
 					if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
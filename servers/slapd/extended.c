@@ -401,6 +401,15 @@ extops_kill (void)
 	return(0);
 }
 
+/* Whether the registered extended operation oid writes */
+int
+exop_writes( struct berval *oid )
+{
+	struct extop_list *ext = find_extop( supp_ext_list, oid );
+
+	return ext != NULL && ( ext->flags & SLAP_EXOP_WRITES );
+}
+
 static struct extop_list *
 find_extop( struct extop_list *list, struct berval *oid )
 {
@@ -71,7 +71,7 @@ int slapMode = SLAP_UNDEFINED_MODE;
 int
 slap_init( int mode, const char *name )
 {
-	int rc;
+	int rc, i;
 
 	assert( mode );
 
@@ -138,6 +138,8 @@ slap_init( int mode, const char *name )
 
 		ldap_pvt_thread_pool_init_q( &connection_pool,
 				connection_pool_max, 0, connection_pool_queues);
+		for ( i = 0; i < SLAP_OPCLASS_LAST; i++ )
+			connection_opclass_apply( &slap_opclasses[i] );
 
 		slap_counters_init( &slap_counters );
 
@@ -992,6 +992,7 @@ unhandled_option:;
 	 */
 	time( &starttime );
 
+	slapd_shard_listeners();
 	connections_init();
 
 	if ( slap_startup( NULL ) != 0 ) {
@@ -116,6 +116,7 @@ typedef struct sort_op
 	int so_vlv_target;
 	int so_session;
 	unsigned long so_vcontext;
+	OpExtraSort so_oe;	/* handed to the backend */
 } sort_op;
 
 /* There is only one conn table for all overlay instances */
@@ -699,12 +700,14 @@ static void send_result(
 
 	if ( ctrls[0] != NULL )
 		slap_add_ctrls( op, rs, ctrls );
-	send_ldap_result( op, rs );
 
 	if ( so->so_tree == NULL ) {
-		/* Search finished, so clean up */
+		/* Search finished, so clean up. This must happen before
+		 * the client sees the result and sends its next request.
+		 */
 		free_sort_op( op->o_conn, so );
 	}
+	send_ldap_result( op, rs );
 }
 
 static int sssvlv_op_response(
@@ -714,6 +717,12 @@ static int sssvlv_op_response(
 	sort_ctrl *sc = op->o_controls[sss_cid];
 	sort_op *so = op->o_callback->sc_private;
 
+	if ( rs->sr_type == REP_SEARCH && so->so_oe.oe_sorted ) {
+		/* The backend already returns them in order */
+		so->so_nentries++;
+		return SLAP_CB_CONTINUE;
+	}
+
 	if ( rs->sr_type == REP_SEARCH ) {
 		int i;
 		size_t len;
@@ -788,6 +797,18 @@ static int sssvlv_op_response(
 			op->o_callback = op->o_callback->sc_next;
 		}
 
+		if ( so->so_oe.oe.oe_key ) {
+			LDAP_SLIST_REMOVE( &op->o_extra, &so->so_oe.oe, OpExtra, oe_next );
+			so->so_oe.oe.oe_key = NULL;
+			if ( !BER_BVISNULL( &so->so_oe.oe_value ))
+				op->o_tmpfree( so->so_oe.oe_value.bv_val, op->o_tmpmemctx );
+			if ( so->so_oe.oe_sorted ) {
+				so->so_vlv_target = so->so_oe.oe_target;
+				so->so_nentries = so->so_oe.oe_content;
+				so->so_vlv_rc = LDAP_SUCCESS;
+			}
+		}
+
 		send_entry( op, rs, so );
 		send_result( op, rs, so );
 	}
@@ -795,6 +816,46 @@ static int sssvlv_op_response(
 	return rs->sr_err;
 }
 
+static void sort_backend_request(
+	Operation		*op,
+	sort_op			*so,
+	vlv_ctrl		*vc )
+{
+	OpExtraSort *oes = &so->so_oe;
+	sort_key *sk = &so->so_ctrl->sc_keys[0];
+	MatchingRule *mr = sk->sk_ordering;
+
+	oes->oe_ad = sk->sk_ad;
+	oes->oe_mr = mr;
+	oes->oe_reverse = sk->sk_direction < 0;
+	oes->oe_sorted = 0;
+	BER_BVZERO( &oes->oe_value );
+	if ( vc ) {
+		oes->oe_vlv = 1;
+		oes->oe_before = vc->vc_before;
+		oes->oe_after = vc->vc_after;
+		oes->oe_offset = vc->vc_offset;
+		oes->oe_count = vc->vc_count;
+		/* let send_list() report the errors */
+		if ( BER_BVISNULL( &vc->vc_value )) {
+			if ( vc->vc_count && vc->vc_offset > vc->vc_count )
+				return;
+		} else {
+			if ( mr->smr_normalize ) {
+				if ( mr->smr_normalize( SLAP_MR_VALUE_OF_SYNTAX,
+					mr->smr_syntax, mr, &vc->vc_value, &oes->oe_value,
+					op->o_tmpmemctx ))
+					return;
+			} else {
+				ber_dupbv_x( &oes->oe_value, &vc->vc_value,
+					op->o_tmpmemctx );
+			}
+		}
+	}
+	oes->oe.oe_key = (void *)slap_sort_oe_key;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &oes->oe, oe_next );
+}
+
 static int sssvlv_op_search(
 	Operation		*op,
 	SlapReply		*rs)
@@ -947,6 +1008,13 @@ static int sssvlv_op_search(
 			so->so_vcontext = (unsigned long)so;
 			so->so_nentries = 0;
 
+			/* A backend that has the entries in order can return
+			 * them that way. Paged results and searches that span
+			 * glued databases still have to be collected here.
+			 */
+			if ( !ps && sc->sc_nkeys == 1 && !SLAP_GLUE_INSTANCE( op->o_bd ))
+				sort_backend_request( op, so, vc );
+
 			op->o_callback		= cb;
 		}
 	} else {
@@ -645,6 +645,7 @@ LDAP_SLAPD_V (free_nibble_func*) nibble_mem_free;
  * controls.c
  */
 LDAP_SLAPD_V( struct slap_control_ids ) slap_cids;
+LDAP_SLAPD_V( const char ) slap_sort_oe_key[];
 LDAP_SLAPD_F (void) slap_free_ctrls LDAP_P((
 	Operation *op,
 	LDAPControl **ctrls ));
@@ -773,6 +774,9 @@ LDAP_SLAPD_F (int) connections_shutdown LDAP_P((void));
 LDAP_SLAPD_F (int) connections_destroy LDAP_P((void));
 LDAP_SLAPD_F (int) connections_timeout_idle LDAP_P((time_t));
 LDAP_SLAPD_F (void) connections_drop LDAP_P((void));
+LDAP_SLAPD_F (int) connections_wbatch_timeout LDAP_P(( struct timeval *tv ));
+LDAP_SLAPD_F (void) connection_wbatch_queue LDAP_P(( Connection *c ));
+LDAP_SLAPD_F (void) connection_wbatch_dequeue LDAP_P(( Connection *c ));
 
 LDAP_SLAPD_F (Connection *) connection_client_setup LDAP_P((
 	ber_socket_t s,
@@ -830,6 +834,12 @@ LDAP_SLAPD_F (void) operation_fake_init LDAP_P((
 	int newmem ));
 LDAP_SLAPD_F (void) connection_assign_nextid LDAP_P((Connection *));
 
+LDAP_SLAPD_V (slap_opclass)	slap_opclasses[SLAP_OPCLASS_LAST];
+LDAP_SLAPD_F (slap_opclass *) connection_opclass_find LDAP_P((
+	struct berval *name ));
+LDAP_SLAPD_F (void) connection_opclass_reset LDAP_P(( slap_opclass *oc ));
+LDAP_SLAPD_F (void) connection_opclass_apply LDAP_P(( slap_opclass *oc ));
+
 /*
  * cr.c
  */
@@ -870,6 +880,7 @@ LDAP_SLAPD_F (void) slap_queue_csn LDAP_P(( Operation *, struct berval * ));
  */
 LDAP_SLAPD_F (void) slapd_add_internal(ber_socket_t s, int isactive);
 LDAP_SLAPD_F (int) slapd_daemon_init( const char *urls );
+LDAP_SLAPD_F (void) slapd_shard_listeners(void);
 LDAP_SLAPD_F (int) slapd_daemon_destroy(void);
 LDAP_SLAPD_F (int) slapd_daemon(void);
 LDAP_SLAPD_F (Listener **)	slapd_get_listeners LDAP_P((void));
@@ -1054,6 +1065,7 @@ LDAP_SLAPD_F (int) entry_prealloc LDAP_P((int num));
  * extended.c
  */
 LDAP_SLAPD_F (int) exop_root_dse_info LDAP_P ((Entry *e));
+LDAP_SLAPD_F (int) exop_writes LDAP_P(( struct berval *oid ));
 
 #define exop_is_write( op )	((op->ore_flags & SLAP_EXOP_WRITES) != 0)
 
@@ -1619,6 +1631,9 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (void) slap_wbatch_begin LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_wbatch_end LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void *) slap_wbatch_flush LDAP_P(( void *ctx, void *arg ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
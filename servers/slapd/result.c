@@ -327,21 +327,36 @@ slap_writewait_play(
 	}
 }
 
+/* Search entries and references are gathered into one buffer per
+ * connection and written together: once SLAP_WBATCH_BYTES have been
+ * gathered, with the next PDU that is not gathered, or when the search
+ * is done. The daemon's timer flushes what was gathered SLAP_WBATCH_USEC
+ * after the first one, if nothing else did by then.
+ */
+#define SLAP_WBATCH_BYTES	65536
+
+/* Write a PDU, or with ber NULL, just the gathered ones. op is NULL
+ * when the flush timer writes them.
+ */
 static long send_ldap_ber(
+	Connection *conn,
 	Operation *op,
-	BerElement *ber )
+	BerElement *ber,
+	int gather )
 {
-	Connection *conn = op->o_conn;
-	ber_len_t bytes;
+	BerElement *wber;
+	struct berval bv;
+	ber_len_t bytes = 0;
 	long ret = 0;
 	char *close_reason;
 
-	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	if ( ber )
+		ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
-		conn->c_writers < 0 ) {
+	if (( ber && op->o_abandon && !op->o_cancel ) ||
+		!connection_valid( conn ) || conn->c_writers < 0 ) {
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		return 0;
 	}
@@ -367,11 +382,43 @@ static long send_ldap_ber(
 	/* Our turn */
 	conn->c_writing = 1;
 
+	/* add the pdu to those gathered before it */
+	if ( ber && ( gather || conn->c_wbatch )) {
+		ber_len_t len;
+
+		if ( !conn->c_wbatch ) {
+			conn->c_wbatch = ber_alloc_t( LBER_USE_DER );
+			if ( !conn->c_wbatch ) {
+				close_reason = "out of memory";
+				goto fail;
+			}
+			gettimeofday( &conn->c_wbatch_tv, NULL );
+			connection_wbatch_queue( conn );
+		}
+		if ( ber_flatten2( ber, &bv, 0 ) ||
+			ber_write( conn->c_wbatch, bv.bv_val, bv.bv_len, 0 ) < 0 ) {
+			close_reason = "out of memory";
+			goto fail;
+		}
+		ret = bytes;
+		ber_get_option( conn->c_wbatch, LBER_OPT_BER_BYTES_TO_WRITE, &len );
+		if ( gather && len < SLAP_WBATCH_BYTES )
+			goto done;
+	}
+	wber = conn->c_wbatch ? conn->c_wbatch : ber;
+	if ( !wber )
+		goto done;
+
 	/* write the pdu */
 	while( 1 ) {
 		int err;
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+		if ( ber_flush2( conn->c_sb, wber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+			if ( wber == conn->c_wbatch ) {
+				ber_free( wber, 1 );
+				conn->c_wbatch = NULL;
+				connection_wbatch_dequeue( conn );
+			}
 			ret = bytes;
 			break;
 		}
@@ -389,21 +436,15 @@ static long send_ldap_ber(
 
 		if ( err != EWOULDBLOCK && err != EAGAIN ) {
 			close_reason = "connection lost on write";
-fail:
-			conn->c_writers--;
-			conn->c_writing = 0;
-			ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
-			ldap_pvt_thread_mutex_lock( &conn->c_mutex );
-			connection_closing( conn, close_reason );
-			ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
-			return -1;
+			goto fail;
 		}
 
 		/* wait for socket to be write-ready */
 		conn->c_writewaiter = 1;
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		ldap_pvt_thread_pool_idle( &connection_pool );
-		slap_writewait_play( op );
+		if ( op )
+			slap_writewait_play( op );
 		err = slapd_wait_writer( conn->c_sd );
 		conn->c_writewaiter = 0;
 		ldap_pvt_thread_pool_unidle( &connection_pool );
@@ -425,6 +466,7 @@ fail:
 		}
 	}
 
+done:
 	conn->c_writing = 0;
 	if ( conn->c_writers < 0 ) {
 		conn->c_writers++;
@@ -437,6 +479,53 @@ fail:
 	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 
 	return ret;
+
+fail:
+	conn->c_writers--;
+	conn->c_writing = 0;
+	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
+	connection_closing( conn, close_reason );
+	ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
+	return -1;
+}
+
+/* Let the entries that op's search sends from this point on be
+ * gathered and written together. Copies of op that outlive the
+ * search, e.g. for persistent searches, write theirs right away.
+ */
+void
+slap_wbatch_begin( Operation *op )
+{
+#ifdef LDAP_CONNECTIONLESS
+	if ( op->o_conn->c_is_udp )
+		return;
+#endif
+	op->o_wbatch = op;
+}
+
+/* Write the entries gathered for op's search */
+void
+slap_wbatch_end( Operation *op )
+{
+	if ( op->o_wbatch != op )
+		return;
+	op->o_wbatch = NULL;
+	if ( op->o_conn->c_wbatch )
+		send_ldap_ber( op->o_conn, op, NULL, 0 );
+}
+
+/* Write the PDUs gathered on a connection when the flush timer
+ * expires, see connections_wbatch_timeout()
+ */
+void *
+slap_wbatch_flush( void *ctx, void *arg )
+{
+	Connection *conn = arg;
+
+	if ( conn->c_wbatch )
+		send_ldap_ber( conn, NULL, NULL, 0 );
+	return NULL;
 }
 
 static int
@@ -745,7 +834,7 @@ send_ldap_response(
 	}
 
 	/* send BER */
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op->o_conn, op, ber, 0 );
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0)
 #endif
@@ -1474,7 +1563,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_ldap_ber( op->o_conn, op, ber, op->o_wbatch == op );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1642,7 +1731,7 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op->o_conn, op, ber, op->o_wbatch == op );
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
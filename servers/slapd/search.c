@@ -399,7 +399,9 @@ fail1:
 	} else if ( op->o_bd->be_search ) {
 		if ( limits_check( op, rs ) == 0 ) {
 			/* actually do the search and send the result(s) */
+			slap_wbatch_begin( op );
 			(op->o_bd->be_search)( op, rs );
+			slap_wbatch_end( op );
 		}
 		/* else limits_check() sends error */
 
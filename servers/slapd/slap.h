@@ -249,6 +249,7 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_APPROX         0x0008UL
 #define SLAP_INDEX_SUBSTR         0x0010UL
 #define SLAP_INDEX_EXTENDED		  0x0020UL
+#define SLAP_INDEX_ORDERED        0x0040UL
 
 #define SLAP_INDEX_DEFAULT        SLAP_INDEX_EQUALITY
 
@@ -290,6 +291,7 @@ typedef struct slap_ssf_set {
 #define SLAP_INDEX_SUBSTR_INITIAL_PREFIX '^'
 #define SLAP_INDEX_SUBSTR_FINAL_PREFIX '$'
 #define SLAP_INDEX_CONT_PREFIX		'.'		/* prefix for continuation keys */
+#define SLAP_INDEX_ORDERED_PREFIX	'<'		/* prefix for ordered keys      */
 
 #define SLAP_SYNTAX_MATCHINGRULES_OID	 "1.3.6.1.4.1.1466.115.121.1.30"
 #define SLAP_SYNTAX_ATTRIBUTETYPES_OID	 "1.3.6.1.4.1.1466.115.121.1.3"
@@ -1167,6 +1169,7 @@ struct Attribute {
 #define SLAP_ATTR_DONT_FREE_DATA	0x4U
 #define SLAP_ATTR_DONT_FREE_VALS	0x8U
 #define	SLAP_ATTR_SORTED_VALS		0x10U	/* values are sorted */
+#define	SLAP_ATTR_BIG_MULTI		0x20U	/* values stored apart by backend */
 
 /* These flags persist across an attr_dup() */
 #define	SLAP_ATTR_PERSISTENT_FLAGS \
@@ -2600,6 +2603,29 @@ typedef struct OpExtraDB {
 	BackendDB *oe_db;
 } OpExtraDB;
 
+/* A server side sort request, passed on to the backend by the sssvlv
+ * overlay under the key slap_sort_oe_key. A backend that can return
+ * its entries in this order sets oe_sorted before sending the first
+ * one, and the overlay passes them on without sorting them itself.
+ * With oe_vlv set, the backend only returns the requested window and
+ * fills in the target position and its estimate of the content count.
+ */
+typedef struct OpExtraSort {
+	OpExtra oe;
+	AttributeDescription *oe_ad;
+	MatchingRule *oe_mr;
+	int oe_reverse;
+	int oe_vlv;
+	int oe_before;
+	int oe_after;
+	int oe_offset;
+	int oe_count;
+	struct berval oe_value;		/* normalized; NULL for offset lookups */
+	int oe_sorted;
+	int oe_target;
+	int oe_content;
+} OpExtraSort;
+
 struct Operation {
 	Opheader *o_hdr;
 
@@ -2701,6 +2727,7 @@ struct Operation {
 #define get_no_schema_check(op)			((op)->o_no_schema_check)
 	char o_no_subordinate_glue;
 #define get_no_subordinate_glue(op)		((op)->o_no_subordinate_glue)
+	Operation *o_wbatch;	/* this op, while its entries are gathered */
 
 #define SLAP_CONTROL_NONE	0
 #define SLAP_CONTROL_IGNORED	1
@@ -2868,6 +2895,26 @@ enum sc_conn_state {
 	SLAP_C_BINDING,			/* binding */
 	SLAP_C_CLIENT			/* outbound client conn */
 };
+
+/* scheduling classes of operations in the connection pool */
+enum slap_opclass_e {
+	SLAP_OPCLASS_DEFAULT = 0,	/* connection reads, other tasks */
+	SLAP_OPCLASS_BIND,		/* bind, unbind, abandon */
+	SLAP_OPCLASS_READ,		/* base search, compare, extended */
+	SLAP_OPCLASS_SEARCH,		/* onelevel and subtree search */
+	SLAP_OPCLASS_WRITE,		/* add, delete, modify, modrdn */
+	SLAP_OPCLASS_REPL,		/* only assigned by identity */
+	SLAP_OPCLASS_LAST
+};
+
+typedef struct slap_opclass {
+	struct berval	soc_name;
+	int		soc_weight;	/* share of the pool when busy */
+	int		soc_max;	/* max concurrent ops, 0 = unlimited */
+	BerVarray	soc_ndn;	/* identities whose ops go here */
+	BerVarray	soc_ndn_subtree;
+} slap_opclass;
+
 struct Connection {
 	enum sc_struct_state	c_struct_state; /* structure management state */
 	enum sc_conn_state	c_conn_state;	/* connection state */
@@ -2918,6 +2965,10 @@ struct Connection {
 	ldap_pvt_thread_cond_t	c_write2_cv;	/* used to wait for sd write-ready*/
 
 	BerElement	*c_currentber;	/* ber we're attempting to read */
+	BerElement	*c_wbatch;		/* pdus gathered to be written together */
+	struct timeval	c_wbatch_tv;	/* when the first of them was gathered */
+	LDAP_TAILQ_ENTRY(Connection) c_wbatch_next;	/* waiting for the flush timer */
+	char		c_wbatch_queued;	/* in that queue */
 	int			c_writers;		/* number of writers waiting */
 	char		c_writing;		/* someone is writing */
 
@@ -3039,6 +3090,8 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_tid;		/* daemon thread that accepts on sl_sd */
+	unsigned long	sl_naccept;	/* connections accepted */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr